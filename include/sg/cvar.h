@@ -263,6 +263,8 @@ sg_cvar_loadbuffer(
 /**
  * @brief Write all cvars to a file.
  *
+ * The file is written in the background with sg_file_save().
+ *
  * @param path Path to the output file.
  * @param pathlen Length of the path, in bytes.
  * @param save_all Whether to save non-persistent cvars.
@@ -27,6 +27,11 @@ enum {
     SG_MAX_PATH = 128
 };
 
+enum {
+    /** @brief A good buffer size for sg_writer_setbuffer().  */
+    SG_WRITER_BUFSIZE = 256 * 1024
+};
+
 /**
  * @brief Return codes for sg_file_load().
  */
@@ -99,7 +104,14 @@ enum {
     /** @brief Only search the application data path.  */
     SG_DATAONLY = 02,
     /** @brief Only load the file if it has changed.  */
-    SG_IFCHANGED = 04
+    SG_IFCHANGED = 04,
+    /**
+     * @brief Map the file into memory instead of reading it, if
+     * possible.
+     *
+     * Mapped data is read-only, and is not followed by a zero byte.
+     */
+    SG_FILE_MAP = 010
 };
 
 /**
@@ -113,11 +125,16 @@ struct sg_filedata {
      */
     sg_atomic_t refcount_;
 
+    /**
+     * @private @brief Nonzero if the data is mapped, do not modify.
+     */
+    int mapped_;
+
     /**
      * @brief Pointer to buffer data.
      *
      * This buffer also contains one zero byte after the end of the
-     * file.
+     * file, unless the file was loaded with ::SG_FILE_MAP.
      */
     void *data;
 
@@ -258,6 +275,63 @@ sg_file_load(
     struct sg_fileid *fileid,
     struct sg_error **err);
 
+/**
+ * @brief A callback for file change notifications.
+ *
+ * @param cxt The context pointer passed to sg_filewatch_add().
+ */
+typedef void (*sg_filewatch_func_t)(void *cxt);
+
+/**
+ * @brief Request notification when a file changes.
+ *
+ * The file is located the same way as with sg_file_load(), and the
+ * callback is invoked whenever a file that sg_file_load() could load
+ * for the same path and extensions is created, modified, renamed, or
+ * deleted, in any of the search paths.  Callbacks are invoked from
+ * the main thread between frames, and any number of changes to the
+ * same file within one frame result in a single callback.  The
+ * callback is responsible for reloading the file, typically with
+ * ::SG_IFCHANGED.
+ *
+ * On Linux, changes are detected using inotify.  On other platforms,
+ * or if inotify is unavailable, the files are polled periodically.
+ * Notifications can be disabled with the `file.watch` cvar.
+ *
+ * @param path The path to the file to watch.
+ * @param pathlen The length of the path, in bytes.
+ * @param flags The same flags that would be passed to sg_file_load().
+ * @param extensions The same extension list that would be passed to
+ * sg_file_load(), or NULL.
+ * @param callback The function to call when the file changes.
+ * @param cxt A parameter to pass to the callback function.
+ * @param err On failure, the error.
+ * @return Zero if successful, nonzero if an error occurred.
+ */
+int
+sg_filewatch_add(
+    const char *path,
+    size_t pathlen,
+    int flags,
+    const char *extensions,
+    sg_filewatch_func_t callback,
+    void *cxt,
+    struct sg_error **err);
+
+/**
+ * @brief Cancel file change notifications.
+ *
+ * This removes all notifications registered with the given callback
+ * and context pointer.
+ *
+ * @param callback The callback function.
+ * @param cxt The context pointer.
+ */
+void
+sg_filewatch_remove(
+    sg_filewatch_func_t callback,
+    void *cxt);
+
 /**
  * @brief An output stream for writing data to a file.
  */
@@ -314,6 +388,73 @@ sg_writer_write(
     size_t amt,
     struct sg_error **err);
 
+/**
+ * @brief A buffer for sg_writer_writev().
+ */
+struct sg_writer_vec {
+    /** @brief Pointer to the data.  */
+    const void *ptr;
+    /** @brief Length of the data, in bytes.  */
+    size_t len;
+};
+
+/**
+ * @brief Write data from multiple buffers to a file.
+ *
+ * Unlike sg_writer_write(), this writes all of the data before
+ * returning.  Unbuffered files will write the data with as few system
+ * calls as possible.
+ *
+ * @param fp The file.
+ * @param vec The source buffers.
+ * @param count The number of source buffers.
+ * @param err On failure, the error.
+ * @return Zero if successful, nonzero if an error occurred.
+ */
+int
+sg_writer_writev(
+    struct sg_writer *fp,
+    const struct sg_writer_vec *vec,
+    int count,
+    struct sg_error **err);
+
+/**
+ * @brief Set the size of the file's write buffer.
+ *
+ * Files are unbuffered by default, and each write is passed directly
+ * to the operating system.  If the file is buffered, small writes are
+ * collected until the buffer is full, and the buffer is then written
+ * as one block.  Writes to buffered files always write all of the
+ * data, unless an error occurs.  Any buffered data is written out
+ * before the buffer changes size.
+ *
+ * @param fp The file.
+ * @param size The buffer size in bytes, or zero to disable buffering.
+ * ::SG_WRITER_BUFSIZE is a good choice.
+ * @param err On failure, the error.
+ * @return Zero if successful, nonzero if an error occurred.
+ */
+int
+sg_writer_setbuffer(
+    struct sg_writer *fp,
+    size_t size,
+    struct sg_error **err);
+
+/**
+ * @brief Write out any buffered data.
+ *
+ * This is done automatically by sg_writer_seek() and
+ * sg_writer_commit().
+ *
+ * @param fp The file.
+ * @param err On failure, the error.
+ * @return Zero if successful, nonzero if an error occurred.
+ */
+int
+sg_writer_flush(
+    struct sg_writer *fp,
+    struct sg_error **err);
+
 /**
  * @brief Commit changes to the file.
  *
@@ -341,6 +482,66 @@ void
 sg_writer_close(
     struct sg_writer *fp);
 
+/**
+ * @brief Save data to a file in the background.
+ *
+ * The data is handed off to a background writer thread, which writes
+ * it to a temporary file, syncs it to disk, and atomically replaces
+ * the destination, the same way as sg_writer_commit().  Writes are
+ * performed in order.  If an earlier write to the same path is still
+ * waiting in the queue, it is discarded, since the new data
+ * supersedes it.  Errors which occur while writing are logged.
+ *
+ * @param path The file's relative path.
+ * @param pathlen The length of the path, in bytes.
+ * @param data The file contents, allocated with malloc().  The
+ * buffer is owned by the writer afterwards, and is freed even if this
+ * function fails.
+ * @param length The length of the data, in bytes.
+ * @param err On failure, the error.
+ * @return Zero if the data was queued, nonzero if an error occurred.
+ */
+int
+sg_file_save(
+    const char *path,
+    size_t pathlen,
+    void *data,
+    size_t length,
+    struct sg_error **err);
+
+/**
+ * @brief A function which runs on the background writer thread.
+ *
+ * @param cxt The context pointer passed to sg_file_savecall().
+ */
+typedef void (*sg_file_savefunc_t)(void *cxt);
+
+/**
+ * @brief Run a function on the background writer thread.
+ *
+ * This is for work which produces files but which should not run on
+ * the main thread, such as encoding and writing images.  The function
+ * runs in order with other queued writes, and is responsible for any
+ * resources owned by the context pointer.
+ *
+ * @param func The function to call.
+ * @param cxt A parameter to pass to the function.
+ * @param err On failure, the error.
+ * @return Zero if the function was queued, nonzero if an error
+ * occurred, in which case the function will not be called.
+ */
+int
+sg_file_savecall(
+    sg_file_savefunc_t func,
+    void *cxt,
+    struct sg_error **err);
+
+/**
+ * @brief Wait until all queued background writes are complete.
+ */
+void
+sg_file_savewait(void);
+
 /**
  * @brief An output stream for writing text to a file.
  */
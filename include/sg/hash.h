@@ -1,4 +1,4 @@
-/* Copyright 2012-2013 Dietrich Epp.
+/* Copyright 2012-2014 Dietrich Epp.
    This file is part of SGLib.  SGLib is licensed under the terms of the
    2-clause BSD license.  For more information, see LICENSE.txt. */
 #ifndef SG_HASH_H
@@ -7,6 +7,7 @@
 extern "C" {
 #endif
 #include <stddef.h>
+#include <stdint.h>
 #include "sg/defs.h"
 
 /**
@@ -26,6 +27,65 @@ SG_ATTR_PURE
 unsigned
 sg_hash(const void *data, size_t len);
 
+/**
+ * @brief State for computing a 64-bit hash incrementally.
+ *
+ * The 64-bit hash is XXH64, by Yann Collet.  Unlike sg_hash(), the
+ * result is the same on all platforms, so it is suitable for
+ * identifying data stored in files, such as cache keys.
+ */
+struct sg_hash64_state {
+    /** @brief The accumulators.  */
+    uint64_t v[4];
+    /** @brief The seed.  */
+    uint64_t seed;
+    /** @brief The total number of bytes hashed.  */
+    uint64_t total;
+    /** @brief Data which does not yet fill a 32-byte stripe.  */
+    unsigned char buf[32];
+    /** @brief The number of bytes in the buffer.  */
+    unsigned buflen;
+};
+
+/**
+ * @brief Start computing a 64-bit hash.
+ *
+ * @param state The hash state.
+ * @param seed The seed, which selects a different hash function.
+ */
+void
+sg_hash64_init(struct sg_hash64_state *state, uint64_t seed);
+
+/**
+ * @brief Add data to a 64-bit hash.
+ *
+ * The result does not depend on how the data is divided between
+ * calls.
+ */
+void
+sg_hash64_update(struct sg_hash64_state *state,
+                 const void *data, size_t len);
+
+/**
+ * @brief Get the 64-bit hash of the data added so far.
+ *
+ * This does not modify the state, so more data may be added
+ * afterwards.
+ */
+SG_ATTR_PURE
+uint64_t
+sg_hash64_final(const struct sg_hash64_state *state);
+
+/**
+ * @brief Compute the 64-bit hash of a byte string.
+ *
+ * This gives the same result as sg_hash64_init(),
+ * sg_hash64_update(), and sg_hash64_final().
+ */
+SG_ATTR_PURE
+uint64_t
+sg_hash64(const void *data, size_t len, uint64_t seed);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,202 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#ifndef SG_HASHMAP_H
+#define SG_HASHMAP_H
+#include <stddef.h>
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file hashmap.h
+ *
+ * @brief Open addressing hash map.
+ *
+ * The map stores fixed-size entries in a flat array, and keeps a
+ * separate array with one control byte per entry.  The control byte
+ * holds seven bits of the entry's hash, so a lookup can check sixteen
+ * entries at a time with a single SIMD comparison, and only compares
+ * keys for entries whose hash bits match.
+ *
+ * Entries are stored by value, and each entry must start with its
+ * key.  Entries move when the map grows, so pointers to entries are
+ * only valid until the next insertion.
+ */
+
+/**
+ * @brief Operations on the keys in a hash map.
+ */
+struct sg_hashmap_type {
+    /**
+     * @brief Compute the hash of a search key.
+     */
+    unsigned (*hash)(const void *key);
+
+    /**
+     * @brief Compute the hash of the key stored in an entry.
+     *
+     * This must give the same result as @c hash for equal keys.
+     */
+    unsigned (*entryhash)(const void *entry);
+
+    /**
+     * @brief Test whether a search key is equal to an entry's key.
+     */
+    int (*equal)(const void *key, const void *entry);
+};
+
+/**
+ * @brief Hash map type for entries which start with a @c uint32_t
+ * key.
+ */
+extern const struct sg_hashmap_type SG_HASHMAP_U32;
+
+/**
+ * @brief Hash map type for entries which start with a @c uint64_t
+ * key.
+ */
+extern const struct sg_hashmap_type SG_HASHMAP_U64;
+
+/**
+ * @brief A hash map.
+ */
+struct sg_hashmap {
+    /** @brief Control bytes.  */
+    unsigned char *ctrl;
+    /** @brief Entry array.  */
+    char *entry;
+    /** @brief The size of each entry, in bytes.  */
+    size_t entrysize;
+    /**
+     * @brief The number of entries in the map.
+     */
+    size_t size;
+    /** @brief The number of entries the arrays can hold.  */
+    size_t capacity;
+    /** @brief Number of entries which can be added before
+        the map must be rehashed.  */
+    size_t growth;
+    /** @brief Key operations.  */
+    const struct sg_hashmap_type *type;
+};
+
+/**
+ * @brief Initialize a hash map.
+ *
+ * @param m The map.
+ * @param type The key operations.
+ * @param entrysize The size of each entry, in bytes.  The entry must
+ * start with the key.
+ */
+void
+sg_hashmap_init(struct sg_hashmap *m, const struct sg_hashmap_type *type,
+                size_t entrysize);
+
+/**
+ * @brief Destroy a hash map.
+ */
+void
+sg_hashmap_destroy(struct sg_hashmap *m);
+
+/**
+ * @brief Get the entry for a key.
+ *
+ * @return The entry, or @c NULL if the key is not in the map.
+ */
+void *
+sg_hashmap_get(struct sg_hashmap *m, const void *key);
+
+/**
+ * @brief Insert a key into a hash map.
+ *
+ * If the key is already present, the existing entry is returned.
+ * Otherwise, a new entry is created and filled with zero bytes, and
+ * the caller must store the key in the new entry before performing
+ * any other operation on the map.
+ *
+ * @param m The map.
+ * @param key The search key.
+ * @param created Set to 1 if a new entry was created, or 0
+ * otherwise.  May be @c NULL.
+ * @return The entry, or @c NULL if out of memory.
+ */
+void *
+sg_hashmap_insert(struct sg_hashmap *m, const void *key, int *created);
+
+/**
+ * @brief Get the entry for a 32-bit integer key.
+ *
+ * The map must use ::SG_HASHMAP_U32.
+ */
+void *
+sg_hashmap_get32(struct sg_hashmap *m, uint32_t key);
+
+/**
+ * @brief Insert a 32-bit integer key into a hash map.
+ *
+ * The map must use ::SG_HASHMAP_U32.  New entries are filled with
+ * zero bytes, except for the key, which is stored automatically.
+ */
+void *
+sg_hashmap_insert32(struct sg_hashmap *m, uint32_t key, int *created);
+
+/**
+ * @brief Get the entry for a 64-bit integer key.
+ *
+ * The map must use ::SG_HASHMAP_U64.
+ */
+void *
+sg_hashmap_get64(struct sg_hashmap *m, uint64_t key);
+
+/**
+ * @brief Insert a 64-bit integer key into a hash map.
+ *
+ * The map must use ::SG_HASHMAP_U64.  New entries are filled with
+ * zero bytes, except for the key, which is stored automatically.
+ */
+void *
+sg_hashmap_insert64(struct sg_hashmap *m, uint64_t key, int *created);
+
+/**
+ * @brief Erase an entry from a hash map.
+ *
+ * @param m The map.
+ * @param entry An entry in the map.
+ */
+void
+sg_hashmap_erase(struct sg_hashmap *m, void *entry);
+
+/**
+ * @brief Iterate over the entries in a hash map.
+ *
+ * @param m The map.
+ * @param entry The previous entry, or @c NULL to get the first entry.
+ * @return The next entry, or @c NULL if there are no more entries.
+ */
+void *
+sg_hashmap_next(struct sg_hashmap *m, void *entry);
+
+/**
+ * @brief Reserve space in a hash map.
+ *
+ * Reserves enough space to contain the given total number of keys
+ * without rehashing.  Returns 0 on success or @c ENOMEM if out of
+ * memory.
+ */
+int
+sg_hashmap_reserve(struct sg_hashmap *m, size_t n);
+
+/**
+ * @brief Compact a hash map.
+ *
+ * Returns 0 on success or @c ENOMEM if out of memory.
+ */
+int
+sg_hashmap_compact(struct sg_hashmap *m);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
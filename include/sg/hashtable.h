@@ -4,6 +4,7 @@
 #ifndef SG_HASHTABLE_H
 #define SG_HASHTABLE_H
 #include <stddef.h>
+#include "sg/hashmap.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -13,8 +14,8 @@ extern "C" {
  *
  * @brief Hash table
  *
- * Simple hash table with linear probing.  You are responsible for
- * managing storage for the keys.
+ * Hash table with string keys, built on sg_hashmap.  You are
+ * responsible for managing storage for the keys.
  */
 
 /**
@@ -22,19 +23,10 @@ extern "C" {
  */
 struct sg_hashtable {
     /**
-     * @brief An array of hash table entries.
+     * @brief The underlying map, which contains sg_hashtable_entry
+     * entries.  The number of entries is <tt>map.size</tt>.
      */
-    struct sg_hashtable_entry *contents;
-
-    /**
-     * @brief The number of entries in the array which have data.
-     */
-    size_t size;
-
-    /**
-     * @brief The size of the array.
-     */
-    size_t capacity;
+    struct sg_hashmap map;
 };
 
 /**
@@ -44,8 +36,7 @@ struct sg_hashtable_entry {
     /**
      * @brief The key.
      *
-     * Storage for the key is not managed by the hash table.  The key
-     * will be @c NULL if this entry contains no data.
+     * Storage for the key is not managed by the hash table.
      */
     char *key;
 
@@ -96,7 +87,8 @@ sg_hashtable_get(struct sg_hashtable *d, char const *key);
  * set to NULL.
  *
  * If the key needs to be copied when it is inserted, you will need to
- * copy the key yourself.
+ * copy the key yourself.  Pointers to entries are invalidated by the
+ * next insertion.
  */
 struct sg_hashtable_entry *
 sg_hashtable_insert(struct sg_hashtable *d, char *key);
@@ -108,6 +100,16 @@ void
 sg_hashtable_erase(struct sg_hashtable *d,
                     struct sg_hashtable_entry *e);
 
+/**
+ * @brief Iterate over the entries in a hash table.
+ *
+ * Returns the entry after the given entry, or the first entry if @c e
+ * is @c NULL.  Returns @c NULL after the last entry.
+ */
+struct sg_hashtable_entry *
+sg_hashtable_next(struct sg_hashtable *d,
+                  struct sg_hashtable_entry *e);
+
 /**
  * @brief Compact the hash table.
  *
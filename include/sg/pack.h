@@ -38,9 +38,62 @@ struct sg_pack_size {
     unsigned short height;
 };
 
+/**
+ * @brief Rectangle packing methods.
+ *
+ * Except for the bottom left heuristics, positions which do not
+ * increase the height of the packing are preferred.
+ */
+enum sg_pack_method {
+    /**
+     * @brief Skyline packing, placing each rectangle with the lowest
+     * top edge.
+     *
+     * The skyline is the top edge of the packed rectangles.  This is
+     * the fastest method.
+     */
+    SG_PACK_SKYLINE_BOTTOMLEFT,
+    /**
+     * @brief Skyline packing, placing each rectangle to minimize the
+     * area wasted beneath it.
+     */
+    SG_PACK_SKYLINE_MINWASTE,
+    /**
+     * @brief MaxRects packing, placing each rectangle with the lowest
+     * top edge.
+     *
+     * MaxRects packing tracks all maximal free rectangles, which
+     * gives the best occupancy but is slower than skyline packing.
+     */
+    SG_PACK_MAXRECTS_BOTTOMLEFT,
+    /**
+     * @brief MaxRects packing, placing each rectangle in the free
+     * rectangle where the shorter leftover side is smallest.
+     */
+    SG_PACK_MAXRECTS_SHORTSIDE,
+    /**
+     * @brief MaxRects packing, placing each rectangle in the smallest
+     * free rectangle that fits.
+     */
+    SG_PACK_MAXRECTS_AREA
+};
+
+/**
+ * @brief Rectangle packing flags.
+ */
+enum {
+    /**
+     * @brief Round the packing size up to powers of two.
+     */
+    SG_PACK_POW2 = 1u << 0
+};
+
 /**
  * @brief Pack a set of rectangles in a larger rectangle.
  *
+ * This is the same as sg_pack2() with ::SG_PACK_SKYLINE_BOTTOMLEFT and
+ * ::SG_PACK_POW2.
+ *
  * @param rect The array of rectangles, with width and height
  * specified.  If this function is successful, it will set the
  * rectangle locations.
@@ -63,6 +116,140 @@ sg_pack(struct sg_pack_rect *rect, unsigned rectcount,
         struct sg_pack_size *size, const struct sg_pack_size *maxsize,
         struct sg_error **err);
 
+/**
+ * @brief Pack a set of rectangles in a larger rectangle.
+ *
+ * Several sizes are tried, and the one with the smallest area is
+ * chosen.  Unless ::SG_PACK_POW2 is set, the size will be the
+ * bounding box of the packed rectangles.
+ *
+ * @param rect The array of rectangles, with width and height
+ * specified.  If this function is successful, it will set the
+ * rectangle locations.
+ *
+ * @param rectcount The number of rectangles in the array.
+ *
+ * @param size On success, the size of the packing.
+ *
+ * @param maxsize The maximum size of the packing.
+ *
+ * @param method The packing method.
+ *
+ * @param flags Packing flags, such as ::SG_PACK_POW2.
+ *
+ * @param err On failure, the error.
+ *
+ * @return If successful, a positive number is returned.  If a packing
+ * could not be found that fits the given constraints, zero is
+ * returned.  If an error occurs, a negative number is returned.
+ */
+int
+sg_pack2(struct sg_pack_rect *rect, unsigned rectcount,
+         struct sg_pack_size *size, const struct sg_pack_size *maxsize,
+         enum sg_pack_method method, unsigned flags,
+         struct sg_error **err);
+
+/**
+ * @brief An incremental rectangle packer.
+ *
+ * Rectangles can be added to and removed from the packing one at a
+ * time, for dynamic atlases such as glyph caches.
+ */
+struct sg_packer;
+
+/**
+ * @brief Create a new incremental rectangle packer.
+ *
+ * @param method The packing method.
+ * @param width The width of the area for packing.
+ * @param height The height of the area for packing.
+ * @param err On failure, the error.
+ * @return The new packer, or NULL if an error occurred.
+ */
+struct sg_packer *
+sg_packer_new(enum sg_pack_method method, unsigned width, unsigned height,
+              struct sg_error **err);
+
+/**
+ * @brief Free an incremental rectangle packer.
+ */
+void
+sg_packer_free(struct sg_packer *pk);
+
+/**
+ * @brief Remove all rectangles from a packer.
+ */
+void
+sg_packer_clear(struct sg_packer *pk);
+
+/**
+ * @brief Set the size of the smallest rectangle which will be added.
+ *
+ * Free space narrower or shorter than this is discarded.  This makes
+ * MaxRects packing much faster, since most of the free rectangles it
+ * tracks are slivers too small to be used.
+ *
+ * @param pk The packer.
+ * @param width The minimum rectangle width.
+ * @param height The minimum rectangle height.
+ */
+void
+sg_packer_setminsize(struct sg_packer *pk, unsigned width, unsigned height);
+
+/**
+ * @brief Enlarge the area for packing.
+ *
+ * Rectangles already in the packing keep their locations.
+ *
+ * @param pk The packer.
+ * @param width The new width, at least the current width.
+ * @param height The new height, at least the current height.
+ * @param err On failure, the error.
+ * @return Zero on success, or nonzero if an error occurred.
+ */
+int
+sg_packer_grow(struct sg_packer *pk, unsigned width, unsigned height,
+               struct sg_error **err);
+
+/**
+ * @brief Add a rectangle to the packing.
+ *
+ * @param pk The packer.
+ * @param rect The rectangle, with width and height specified.  If
+ * the rectangle is added, this will set its location.
+ * @param err On failure, the error.
+ * @return A positive number if the rectangle was added, zero if there
+ * is no room for the rectangle, or a negative number if an error
+ * occurred.
+ */
+int
+sg_packer_insert(struct sg_packer *pk, struct sg_pack_rect *rect,
+                 struct sg_error **err);
+
+/**
+ * @brief Remove a rectangle from the packing.
+ *
+ * The space becomes available for later insertions.  Free space is
+ * not always merged, so removing and inserting rectangles will
+ * gradually reduce occupancy until the packer is cleared.
+ *
+ * @param pk The packer.
+ * @param rect A rectangle previously added to the packing.
+ * @param err On failure, the error.
+ * @return Zero on success, or nonzero if an error occurred.
+ */
+int
+sg_packer_remove(struct sg_packer *pk, const struct sg_pack_rect *rect,
+                 struct sg_error **err);
+
+/**
+ * @brief Get the bounding box of the rectangles in the packing.
+ *
+ * The bounding box includes rectangles which have been removed.
+ */
+void
+sg_packer_extent(const struct sg_packer *pk, struct sg_pack_size *size);
+
 #ifdef __cplusplus
 }
 #endif
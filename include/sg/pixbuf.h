@@ -65,17 +65,58 @@ struct sg_pixbuf {
     int rowbytes;
 };
 
+/**
+ * @brief Alignment of rows in allocated pixel buffers, in bytes.
+ */
+#define SG_PIXBUF_ALIGN 64
+
+/**
+ * @brief Pixel buffer allocation flags.
+ */
+enum {
+    /**
+     * @brief Round the width and height up to powers of two.
+     *
+     * The pixel buffer will have the rounded dimensions.  This is
+     * for uploading textures on systems which do not support
+     * textures with other dimensions.
+     */
+    SG_PIXBUF_POW2 = 1u << 0,
+
+    /** @brief Fill the buffer with zeroes.  */
+    SG_PIXBUF_ZERO = 1u << 1
+};
+
 /**
  * @brief Allocate memory for a pixel buffer.
  *
  * This will assume the buffer is uninitialized.  This will fail if
- * the dimensions or format are not supported.  The buffer data should
- * be later freed with `free()`.
+ * the dimensions or format are not supported.  The row stride is
+ * rounded up to a multiple of ::SG_PIXBUF_ALIGN bytes.  The buffer
+ * data should be later freed with `free()`.
  *
  * @param pbuf The pixel buffer.
- * @brief format The pixel format.
- * @brief width The image width.
- * @brief height The image height.
+ * @param format The pixel format.
+ * @param width The image width.
+ * @param height The image height.
+ * @param flags Allocation flags, e.g., ::SG_PIXBUF_POW2.
+ * @param err On failure, the error.
+ * @return Zero for success, nonzero for failure.
+ */
+int
+sg_pixbuf_allocflags(struct sg_pixbuf *pbuf, sg_pixbuf_format_t format,
+                     int width, int height, unsigned flags,
+                     struct sg_error **err);
+
+/**
+ * @brief Allocate memory for a pixel buffer.
+ *
+ * This is the same as sg_pixbuf_allocflags() with no flags.
+ *
+ * @param pbuf The pixel buffer.
+ * @param format The pixel format.
+ * @param width The image width.
+ * @param height The image height.
  * @param err On failure, the error.
  * @return Zero for success, nonzero for failure.
  */
@@ -86,14 +127,12 @@ sg_pixbuf_alloc(struct sg_pixbuf *pbuf, sg_pixbuf_format_t format,
 /**
  * @brief Allocate zeroed memory for a pixel buffer.
  *
- * This will assume the buffer is uninitialized.  This will fail if
- * the dimensions or format are not supported.  The buffer data should
- * be later freed with `free()`.
+ * This is the same as sg_pixbuf_allocflags() with ::SG_PIXBUF_ZERO.
  *
  * @param pbuf The pixel buffer.
- * @brief format The pixel format.
- * @brief width The image width.
- * @brief height The image height.
+ * @param format The pixel format.
+ * @param width The image width.
+ * @param height The image height.
  * @param err On failure, the error.
  * @return Zero for success, nonzero for failure.
  */
@@ -114,14 +153,290 @@ int
 sg_pixbuf_writepng(struct sg_pixbuf *pbuf, const char *path, size_t pathlen,
                    struct sg_error **err);
 
+/**
+ * @brief PNG row filters.
+ */
+typedef enum {
+    /** @brief No filter, fastest to encode.  */
+    SG_PNG_FILTER_NONE,
+    /** @brief Difference from the pixel to the left.  */
+    SG_PNG_FILTER_SUB,
+    /** @brief Difference from the pixel above.  */
+    SG_PNG_FILTER_UP,
+    /** @brief Difference from the average of left and above.  */
+    SG_PNG_FILTER_AVERAGE,
+    /** @brief Paeth predictor.  */
+    SG_PNG_FILTER_PAETH,
+    /** @brief Choose the best filter for each row, slowest.  */
+    SG_PNG_FILTER_ADAPTIVE
+} sg_png_filter_t;
+
+/**
+ * @brief Options for writing PNG images.
+ */
+struct sg_pngopts {
+    /** @brief The compression level, from 0 (none) to 9 (best).  */
+    int level;
+    /** @brief The row filter.  */
+    sg_png_filter_t filter;
+    /**
+     * @brief The number of threads to use, or zero to use one per
+     * processor.
+     */
+    int nthread;
+};
+
+/**
+ * @brief Write an image to a file using the PNG format, with the
+ * given options.
+ *
+ * The image is divided into horizontal strips which are compressed
+ * in parallel.  Each strip is primed with the data preceding it, so
+ * the file is only slightly larger than one compressed as a single
+ * stream.  Depending on the platform, the options may be ignored.
+ *
+ * @param pbuf The pixel buffer to write, RGBX or RGBA.
+ * @param path The path to the file to write the image to.
+ * @param pathlen The length of the path.
+ * @param opts The options, or NULL for default options.
+ * @param err On failure, the error.
+ * @return Zero for success, nonzero for failure.
+ */
+int
+sg_pixbuf_writepngopts(struct sg_pixbuf *pbuf,
+                       const char *path, size_t pathlen,
+                       const struct sg_pngopts *opts,
+                       struct sg_error **err);
+
 /**
  * @brief Upload a pixel buffer as an OpenGL texture.
  *
+ * The row stride must be a positive multiple of the pixel size.
+ *
  * @param pbuf The pixel buffer containing data to upload.
  */
 void
 sg_pixbuf_texture(struct sg_pixbuf *pbuf);
 
+/**
+ * @brief Convert a pixel buffer to premultiplied alpha.
+ *
+ * This only affects RGBA pixel buffers.
+ *
+ * @param pbuf The pixel buffer to modify.
+ */
+void
+sg_pixbuf_premultiply(struct sg_pixbuf *pbuf);
+
+/**
+ * @brief Convert a pixel buffer from premultiplied alpha.
+ *
+ * This only affects RGBA pixel buffers.  Pixels with zero alpha
+ * become transparent black.
+ *
+ * @param pbuf The pixel buffer to modify.
+ */
+void
+sg_pixbuf_unpremultiply(struct sg_pixbuf *pbuf);
+
+/**
+ * @brief Rearrange the channels in a pixel buffer.
+ *
+ * This only affects RGBX and RGBA pixel buffers.  For example, the
+ * order `{2, 1, 0, 3}` converts between RGBA and BGRA.
+ *
+ * @param pbuf The pixel buffer to modify.
+ * @param order For each output channel, the index of the input
+ * channel, from 0 to 3.
+ */
+void
+sg_pixbuf_swizzle(struct sg_pixbuf *pbuf, const unsigned char *order);
+
+/**
+ * @brief Flip a pixel buffer vertically.
+ *
+ * @param pbuf The pixel buffer to modify.
+ */
+void
+sg_pixbuf_flip(struct sg_pixbuf *pbuf);
+
+/**
+ * @brief Copy a pixel buffer, converting it to another format.
+ *
+ * Gray is expanded to RGB, RGB is converted to gray using the Rec. 601
+ * luma weights, and missing alpha channels are set to 255.  The
+ * source and destination must have the same width and height.  Either
+ * buffer's row stride may be negative, which can be used to copy and
+ * flip an image at the same time.  The buffers may only overlap if
+ * they are the same buffer and the pixel formats are the same size.
+ *
+ * @param dest The destination pixel buffer.
+ * @param src The source pixel buffer.
+ */
+void
+sg_pixbuf_convert(struct sg_pixbuf *dest, const struct sg_pixbuf *src);
+
+/**
+ * @brief Mipmap filters.
+ */
+typedef enum {
+    /** @brief Average the source pixels covered by each pixel.  */
+    SG_MIPMAP_BOX,
+    /** @brief Kaiser windowed sinc, which is sharper than a box.  */
+    SG_MIPMAP_KAISER
+} sg_mipmap_filter_t;
+
+/**
+ * @brief Mipmap flags.
+ */
+enum {
+    /**
+     * @brief The color channels are encoded with the sRGB curve.
+     *
+     * Colors are converted to linear values before filtering, and
+     * back to sRGB afterwards.  Alpha is always linear.
+     */
+    SG_MIPMAP_SRGB = 1u << 0
+};
+
+/**
+ * @brief Get the number of levels in a full mipmap chain.
+ *
+ * @param width The width of the base level.
+ * @param height The height of the base level.
+ * @return The number of levels, including the base level.
+ */
+int
+sg_pixbuf_miplevels(int width, int height);
+
+/**
+ * @brief Create the next mipmap level of a pixel buffer.
+ *
+ * The destination must have the same format as the source, and each
+ * dimension must be half of the source dimension, rounded down, but
+ * at least 1.  Images with odd dimensions are filtered without
+ * dropping the last row or column.  Edges are clamped.
+ *
+ * @param dest The destination pixel buffer.
+ * @param src The source pixel buffer.
+ * @param filter The filter to use.
+ * @param flags Mipmap flags, e.g., ::SG_MIPMAP_SRGB.
+ * @param err On failure, the error.
+ * @return Zero for success, nonzero for failure.
+ */
+int
+sg_pixbuf_mipmap(struct sg_pixbuf *dest, const struct sg_pixbuf *src,
+                 sg_mipmap_filter_t filter, unsigned flags,
+                 struct sg_error **err);
+
+/**
+ * @brief Block compressed pixel formats.
+ *
+ * Each format stores the image as 4x4 blocks of pixels.
+ */
+typedef enum {
+    /** @brief BC1 (DXT1), opaque RGB, 8 bytes per block.  */
+    SG_BC1,
+    /** @brief BC3 (DXT5), RGBA, 16 bytes per block.  */
+    SG_BC3,
+    /** @brief BC4 (RGTC1), one channel, 8 bytes per block.  */
+    SG_BC4
+} sg_cpixbuf_format_t;
+
+/**
+ * @brief The number of compressed pixel formats.
+ */
+#define SG_CPIXBUF_NFORMAT ((int) SG_BC4 + 1)
+
+/**
+ * @brief Map from compressed pixel formats to block size, in bytes.
+ */
+extern const size_t SG_CPIXBUF_BLOCKSIZE[SG_CPIXBUF_NFORMAT];
+
+/**
+ * @brief Map from compressed pixel formats to their names.
+ */
+extern const char SG_CPIXBUF_FORMATNAME[SG_CPIXBUF_NFORMAT][4];
+
+/**
+ * @brief Compressed pixel buffer.
+ *
+ * Like the pixel buffer structure, this does not manage its memory.
+ * Rows of blocks are not padded.
+ */
+struct sg_cpixbuf {
+    /** @brief Pointer to block data.  */
+    void *data;
+    /** @brief The compressed pixel format.  */
+    sg_cpixbuf_format_t format;
+    /** @brief Image width, in pixels.  */
+    int width;
+    /** @brief Image height, in pixels.  */
+    int height;
+    /** @brief Number of bytes per row of blocks.  */
+    int rowbytes;
+};
+
+/**
+ * @brief Allocate memory for a compressed pixel buffer.
+ *
+ * The buffer data should be later freed with `free()`.
+ *
+ * @param cbuf The compressed pixel buffer.
+ * @param format The compressed pixel format.
+ * @param width The image width.
+ * @param height The image height.
+ * @param err On failure, the error.
+ * @return Zero for success, nonzero for failure.
+ */
+int
+sg_cpixbuf_alloc(struct sg_cpixbuf *cbuf, sg_cpixbuf_format_t format,
+                 int width, int height, struct sg_error **err);
+
+/**
+ * @brief Compress a pixel buffer.
+ *
+ * BC1 and BC3 require an RGBX or RGBA source, and BC1 ignores alpha.
+ * BC4 compresses the first channel of any source.  The source and
+ * destination must have the same size.  Rows of blocks are divided
+ * among threads.
+ *
+ * @param dest The destination, which must already be allocated.
+ * @param src The source pixel buffer.
+ * @param nthread The number of threads to use, or zero to use one
+ * thread per processor.
+ * @param err On failure, the error.
+ * @return Zero for success, nonzero for failure.
+ */
+int
+sg_cpixbuf_encode(struct sg_cpixbuf *dest, const struct sg_pixbuf *src,
+                  int nthread, struct sg_error **err);
+
+/**
+ * @brief Decompress a compressed pixel buffer.
+ *
+ * BC1 and BC3 decode to RGBX or RGBA, and BC4 decodes to R.  This is
+ * for systems without support for compressed textures, and testing.
+ *
+ * @param dest The destination pixel buffer, with the same size.
+ * @param src The compressed pixel buffer.
+ * @param err On failure, the error.
+ * @return Zero for success, nonzero for failure.
+ */
+int
+sg_cpixbuf_decode(struct sg_pixbuf *dest, const struct sg_cpixbuf *src,
+                  struct sg_error **err);
+
+/**
+ * @brief Upload a compressed pixel buffer as one level of an OpenGL
+ * texture.
+ *
+ * @param cbuf The compressed pixel buffer containing data to upload.
+ * @param level The mipmap level.
+ */
+void
+sg_cpixbuf_texture(struct sg_cpixbuf *cbuf, int level);
+
 /**
  * @brief Image flags.
  */
@@ -180,8 +495,77 @@ struct sg_image {
      */
     int (*draw)(struct sg_image *img, struct sg_pixbuf *pbuf,
                 int x, int y, struct sg_error **err);
+
+    /**
+     * @brief Draw this image to a pixel buffer, reduced in size.
+     *
+     * The image is reduced by a factor of `2^shift` in each
+     * dimension, rounding up, without decoding it at full size.
+     * This may be NULL if the image format does not support reduced
+     * decoding.  Use sg_image_drawscaled() instead of calling this
+     * directly.
+     *
+     * @param img This image.
+     * @param pbuf The target pixel buffer.
+     * @param x The target X offset for the image upper left.
+     * @param y The target Y offset for the image upper left.
+     * @param shift The base 2 logarithm of the reduction factor.
+     * @param err On failure, the error.
+     */
+    int (*drawscaled)(struct sg_image *img, struct sg_pixbuf *pbuf,
+                      int x, int y, int shift, struct sg_error **err);
 };
 
+/**
+ * @brief The largest reduction for sg_image_drawscaled(), as a base 2
+ * logarithm.
+ */
+#define SG_IMAGE_MAXSHIFT 12
+
+/**
+ * @brief Get the size of an image reduced to a target size.
+ *
+ * The image is reduced by the largest power of two, up to
+ * `2^SG_IMAGE_MAXSHIFT`, which still gives an image at least as large
+ * as the target size.  Each dimension is rounded up.  If the image is
+ * smaller than the target size, it is not reduced.
+ *
+ * @param img The image.
+ * @param width The target width.
+ * @param height The target height.
+ * @param swidth On return, the reduced width.
+ * @param sheight On return, the reduced height.
+ * @return The base 2 logarithm of the reduction factor.
+ */
+int
+sg_image_scaledsize(const struct sg_image *img, int width, int height,
+                    int *swidth, int *sheight);
+
+/**
+ * @brief Draw an image to a pixel buffer at a reduced size.
+ *
+ * The size must be the image size reduced by a power of two, as
+ * returned by sg_image_scaledsize().  Each output pixel is the
+ * average of the pixels it covers.  JPEG images are reduced while
+ * decoding, and PNG images are reduced one row at a time, so the
+ * full size image is never stored in memory.  Other formats are
+ * decoded at full size and then reduced.  Otherwise, this works like
+ * the `draw` method, and may only be called once per image.
+ *
+ * @param img The image.
+ * @param pbuf The target pixel buffer.
+ * @param x The target X offset for the image upper left.
+ * @param y The target Y offset for the image upper left.
+ * @param width The reduced image width.
+ * @param height The reduced image height.
+ * @param err On failure, the error.
+ * @return Zero for success, nonzero for failure.
+ */
+int
+sg_image_drawscaled(struct sg_image *img, struct sg_pixbuf *pbuf,
+                    int x, int y, int width, int height,
+                    struct sg_error **err);
+
 /**
  * @brief Load an image from a file.
  *
@@ -203,6 +587,66 @@ sg_image_file(const char *path, size_t pathlen, struct sg_error **err);
 struct sg_image *
 sg_image_buffer(struct sg_filedata *data, struct sg_error **err);
 
+/**
+ * @brief A request to load an image, for sg_image_loadbatch().
+ */
+struct sg_image_request {
+    /** @brief The path to the image, without extension.  */
+    const char *path;
+
+    /** @brief The length of the path, in bytes.  */
+    size_t pathlen;
+
+    /**
+     * @brief On success, the image.
+     *
+     * Images with alpha are premultiplied RGBA, other images are
+     * RGBX.  The data should be freed with `free()`.  On failure,
+     * the data is NULL.
+     */
+    struct sg_pixbuf pixbuf;
+
+    /** @brief On success, the image flags.  */
+    unsigned flags;
+
+    /** @brief On failure, the error, otherwise NULL.  */
+    struct sg_error *err;
+};
+
+/**
+ * @brief A callback for images loaded by sg_image_loadbatch().
+ *
+ * @param cxt The context pointer passed to sg_image_loadbatch().
+ * @param req The request, which has finished loading or failed.
+ * The callback may take ownership of the pixel data by setting the
+ * pixel buffer's data to NULL.
+ * @param index The index of the request.
+ */
+typedef void (*sg_image_batch_func_t)(
+    void *cxt, struct sg_image_request *req, unsigned index);
+
+/**
+ * @brief Load and decode a batch of images in parallel.
+ *
+ * Images are decoded on worker threads.  If a callback is given, it
+ * is called on the calling thread for each request in order, as soon
+ * as that request and all requests before it are finished, so
+ * textures can be uploaded while later images are still decoding.
+ *
+ * @param req The array of requests.  The path and pathlen fields
+ * must be set, the other fields are set by this function.
+ * @param count The number of requests.
+ * @param nthread The number of threads to use, or zero to use one
+ * thread per processor.
+ * @param func The callback, or NULL.
+ * @param cxt The context pointer for the callback.
+ * @return Zero if every image was loaded, nonzero if any image
+ * failed to load.
+ */
+int
+sg_image_loadbatch(struct sg_image_request *req, unsigned count,
+                   int nthread, sg_image_batch_func_t func, void *cxt);
+
 #ifdef __cplusplus
 }
 #endif
@@ -3,9 +3,13 @@
    2-clause BSD license.  For more information, see LICENSE.txt. */
 #ifndef SG_SPRITE_H
 #define SG_SPRITE_H
+#include <stddef.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
+struct sg_error;
+struct sg_filedata;
+struct sg_pixbuf;
 
 /**
  * @file sg/sprite.h
@@ -111,6 +115,193 @@ void
 sg_sprite_write2(void *buffer, unsigned stride, struct sg_sprite sp,
                  int x, int y, sg_sprite_xform_t xform);
 
+/**
+ * @brief Write a transformed sprite as an indexed quad.
+ *
+ * Writes four vertexes with four shorts each, in the same format as
+ * sg_sprite_write2().  Vertex `i` has the texture coordinates `(x + (i
+ * & 1) * w, y + (i >> 1) * h)`.  The quad is drawn as two triangles
+ * using indexes from sg_quad_writeindex(), which saves two vertexes
+ * per sprite.
+ *
+ * @brief buffer The location where the sprite will be written.
+ * @brief stride The byte offset between consecutive vertexes.
+ * @brief sp The sprite texture coordinates.
+ * @brief x The output X coordinate of the sprite origin.
+ * @brief y The output Y coordinate of the sprite origin.
+ * @brief xform The transformation to apply to the vertex coordinates
+ * before translation.
+ */
+void
+sg_sprite_write4(void *buffer, unsigned stride, struct sg_sprite sp,
+                 int x, int y, sg_sprite_xform_t xform);
+
+/**
+ * @brief Write an array of transformed sprites to a vertex buffer.
+ *
+ * Produces the same output as calling sg_sprite_write2() for each
+ * sprite, with the vertexes packed together: each sprite is six
+ * vertexes of four shorts, or 48 bytes.  Uses SIMD instructions when
+ * available.
+ *
+ * @brief buffer The location where the sprites will be written, with
+ * room for `count * 24` shorts.
+ * @brief sp The sprite texture coordinates, one for each sprite.
+ * @brief pos The output coordinates of the sprite origins, an X and Y
+ * coordinate for each sprite.
+ * @brief xform The transformation for each sprite, values of
+ * ::sg_sprite_xform_t, or NULL for no transformation.
+ * @brief count The number of sprites.
+ */
+void
+sg_sprite_writearray2(short *buffer, const struct sg_sprite *sp,
+                      const short *pos, const unsigned char *xform,
+                      unsigned count);
+
+/**
+ * @brief Write an array of transformed sprites as indexed quads.
+ *
+ * Produces the same output as calling sg_sprite_write4() for each
+ * sprite, with the vertexes packed together: each sprite is four
+ * vertexes of four shorts, or 32 bytes.  The arguments are the same
+ * as for sg_sprite_writearray2().
+ */
+void
+sg_sprite_writearray4(short *buffer, const struct sg_sprite *sp,
+                      const short *pos, const unsigned char *xform,
+                      unsigned count);
+
+/**
+ * @brief A sprite record for instanced drawing.
+ *
+ * The vertex shader generates the four corners of the quad.  The
+ * corner with texture coordinates `(tx + i * w, ty + j * h)` is at
+ * `(vx, vy)` plus the vector `(i * w, j * h)` transformed by `xform`:
+ * first rotated counterclockwise by 90 degrees `xform & 3` times, and
+ * then negating the Y coordinate if `xform & 4` is set.
+ */
+struct sg_sprite_instance {
+    /** @brief Vertex coordinates of the lower left texture corner.  */
+    short vx, vy;
+    /** @brief Lower left texture coordinates.  */
+    short tx, ty;
+    /** @brief Width and height in the texture.  */
+    short w, h;
+    /** @brief The transformation, a sg_sprite_xform_t.  */
+    short xform;
+    /** @brief Zero.  */
+    short reserved;
+};
+
+/**
+ * @brief Write a transformed sprite as a record for instanced drawing.
+ *
+ * @brief inst The record to write.
+ * @brief sp The sprite texture coordinates.
+ * @brief x The output X coordinate of the sprite origin.
+ * @brief y The output Y coordinate of the sprite origin.
+ * @brief xform The transformation to apply.
+ */
+void
+sg_sprite_writeinstance(struct sg_sprite_instance *inst,
+                        struct sg_sprite sp, int x, int y,
+                        sg_sprite_xform_t xform);
+
+/**
+ * @brief The maximum number of quads which 16-bit indexes can address.
+ */
+#define SG_QUAD_MAXCOUNT 16384
+
+/**
+ * @brief Write the indexes for drawing quads as triangles.
+ *
+ * Writes six indexes for each quad, for vertexes written by
+ * sg_sprite_write4() or text layouts in the ::SG_TEXTFORMAT_QUADS
+ * format.  The indexes are the same for every batch, so they only
+ * need to be written once, into a shared index buffer.  Batches with
+ * more than ::SG_QUAD_MAXCOUNT quads are drawn in several parts, with
+ * the vertex array offset for each part.
+ *
+ * @param buffer The buffer, with room for `count * 6` indexes.
+ * @param count The number of quads, at most ::SG_QUAD_MAXCOUNT.
+ */
+void
+sg_quad_writeindex(unsigned short *buffer, unsigned count);
+
+/**
+ * @brief A sprite sheet: a texture with a table of named sprites.
+ *
+ * Sprite sheets are created by the spritesheet tool from a directory
+ * of images.  The file is mapped into memory, so loading a sprite
+ * sheet does not decode any images.
+ */
+struct sg_spritesheet;
+
+/**
+ * @brief Load a sprite sheet from a file.
+ *
+ * @param path The path to the sprite sheet, without the ".sheet"
+ * extension.
+ * @param pathlen The length of the path, in bytes.
+ * @param err On failure, the error.
+ * @return A sprite sheet, or NULL for failure.
+ */
+struct sg_spritesheet *
+sg_spritesheet_file(const char *path, size_t pathlen, struct sg_error **err);
+
+/**
+ * @brief Load a sprite sheet from a file buffer.
+ *
+ * @param data The file buffer containing the sprite sheet.  The
+ * sprite sheet keeps a reference to the buffer.
+ * @param err On failure, the error.
+ * @return A sprite sheet, or NULL for failure.
+ */
+struct sg_spritesheet *
+sg_spritesheet_buffer(struct sg_filedata *data, struct sg_error **err);
+
+/**
+ * @brief Free a sprite sheet.
+ */
+void
+sg_spritesheet_free(struct sg_spritesheet *sheet);
+
+/**
+ * @brief Get a sprite from a sprite sheet by name.
+ *
+ * Sprites are named after their source image's path, relative to the
+ * directory given to the spritesheet tool, without extension.  The
+ * sprite may be stored transformed in the sheet.  To draw the sprite
+ * with a transformation, compose the transformations with
+ * `sg_sprite_xform_compose(xform, *sxform)`.
+ *
+ * @param sheet The sprite sheet.
+ * @param name The sprite name.
+ * @param namelen The length of the name, in bytes.
+ * @param sp On success, the sprite.
+ * @param sxform On success, the transformation which draws the sprite
+ * in its original orientation.
+ * @return Zero if the sprite was found, nonzero otherwise.
+ */
+int
+sg_spritesheet_get(const struct sg_spritesheet *sheet,
+                   const char *name, size_t namelen,
+                   struct sg_sprite *sp, sg_sprite_xform_t *sxform);
+
+/**
+ * @brief Get the pixel data for a sprite sheet.
+ *
+ * The pixel buffer is premultiplied RGBA, stored from the bottom row
+ * to the top row, and can be uploaded with sg_pixbuf_texture().  The
+ * data belongs to the sprite sheet and must not be modified.
+ *
+ * @param sheet The sprite sheet.
+ * @param pbuf On return, the pixel buffer.
+ */
+void
+sg_spritesheet_pixbuf(const struct sg_spritesheet *sheet,
+                      struct sg_pixbuf *pbuf);
+
 #ifdef __cplusplus
 }
 #endif
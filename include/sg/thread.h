@@ -175,6 +175,38 @@ sg_evt_signal(struct sg_evt *p);
 void
 sg_evt_wait(struct sg_evt *p);
 
+/* ========== Threads ========== */
+
+/** @brief A function which runs in a new thread.  */
+typedef void (*sg_thread_func_t)(void *arg);
+
+/** @brief Start a detached thread running the given function, and
+    return zero if successful or nonzero if the thread could not be
+    created.  */
+int
+sg_thread_start(sg_thread_func_t func, void *arg);
+
+/** @brief Get the number of processors available for running
+    threads.  Always returns at least 1.  */
+int
+sg_thread_cpucount(void);
+
+/** @brief A function run in parallel by sg_thread_run().  The index
+    identifies which of the threads is calling the function.  */
+typedef void (*sg_thread_task_t)(void *arg, int index);
+
+/**
+ * @brief Run a function on several threads, and wait for all of them
+ * to finish.
+ *
+ * The function is called once for each index from 0 to count-1.
+ * Index 0 runs on the calling thread.  If a thread cannot be created,
+ * its index is run on the calling thread instead, so the function is
+ * always called exactly count times.
+ */
+void
+sg_thread_run(sg_thread_task_t func, void *arg, int count);
+
 #ifdef __cplusplus
 }
 #endif
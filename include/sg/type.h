@@ -139,15 +139,81 @@ sg_font_decref(struct sg_font *fp);
 struct sg_font *
 sg_font_new(struct sg_typeface *tp, float size, struct sg_error **err);
 
+/**
+ * @brief Create a signed distance field font from a typeface.
+ *
+ * Distance field fonts store, for each texel, the distance to the
+ * nearest edge of the glyph outline instead of the glyph coverage.
+ * All distance field fonts from the same typeface share one atlas,
+ * rendered once at a fixed size, and can be drawn at any scale.  The
+ * text is drawn by thresholding the texture at 0.5, and the fragment
+ * shader can use sg_font_getsdfrange() to antialias the edge.
+ * Layouts created with distance field fonts have the same vertex
+ * format as bitmap fonts, with positions in pixels at the given size.
+ *
+ * Distance field fonts use unhinted metrics, so the spacing may
+ * differ slightly from a bitmap font at the same size.
+ *
+ * @param tp The typeface, which must be scalable.
+ * @param size The font size.
+ * @param err On failure, the error.
+ * @return A reference to the font, or `NULL` on failure.
+ */
+struct sg_font *
+sg_font_newsdf(struct sg_typeface *tp, float size, struct sg_error **err);
+
+/**
+ * @brief Get the range of a distance field font.
+ *
+ * Texel values from 1 to 0 map linearly to distances from minus this
+ * range to plus this range, in pixels at the font's size, with
+ * negative distances inside the glyph.
+ *
+ * @return The range in pixels, or zero if the font is a bitmap font.
+ */
+float
+sg_font_getsdfrange(struct sg_font *fp);
+
+/**
+ * @brief Render every glyph in a font.
+ *
+ * Glyphs are normally rendered the first time they are used.  This
+ * renders all remaining glyphs at once, using several threads, each
+ * with its own FreeType face.  The resulting atlas is the same as if
+ * the glyphs were rendered one at a time in glyph index order.
+ *
+ * The rendered font is saved to a cache in the user path, and later
+ * calls to sg_font_new() for the same typeface file and size load it
+ * from the cache, with every glyph already rendered.  The cache is
+ * controlled by the `font.cache` cvar.
+ *
+ * @param fp The font.
+ * @param nthread The number of threads to use, or zero to use one
+ * thread per processor.
+ * @param err On failure, the error.
+ * @return Zero for success, or nonzero for failure.
+ */
+int
+sg_font_renderall(struct sg_font *fp, int nthread, struct sg_error **err);
+
 /**
  * @brief Get the font texture data.
  *
+ * Glyphs are rendered into the font's atlas the first time they are
+ * added to a text flow, and the atlas may have several pages.  This
+ * uploads any glyphs rendered since the last call, so the OpenGL
+ * context must be active.  Distance field fonts at different sizes
+ * from the same typeface return the same textures.
+ *
  * @param fp The font.
+ * @param page The atlas page, from a ::sg_textbatch.
  * @param texture On return, the texture index.
  * @param scale On return, an array containing the X and Y scale.
+ * @return Zero for success, or nonzero if the page does not exist.
  */
-void
-sg_font_gettexture(struct sg_font *fp, unsigned *texture, float *scale);
+int
+sg_font_gettexture(struct sg_font *fp, int page,
+                   unsigned *texture, float *scale);
 
 /**********************************************************************/
 
@@ -174,6 +240,8 @@ sg_textflow_free(struct sg_textflow *flow);
 /**
  * @brief Add text to a text flow.
  *
+ * Invalid UTF-8 sequences in the text are replaced with U+FFFD.
+ *
  * @param flow The text flow to modify.
  * @param text The text to add, encoded in UTF-8.
  * @param length The text length, in bytes.
@@ -206,6 +274,37 @@ sg_textflow_setfont(struct sg_textflow *flow, struct sg_font *font);
 void
 sg_textflow_setwidth(struct sg_textflow *flow, float width);
 
+/**
+ * @brief Vertex formats for text layouts.
+ */
+enum sg_textformat {
+    /**
+     * @brief Six ::sg_textvert vertexes per glyph, forming two
+     * triangles.  This is the default.
+     */
+    SG_TEXTFORMAT_TRIANGLES,
+
+    /**
+     * @brief Four ::sg_textvert vertexes per glyph, drawn with the
+     * indexes from sg_quad_writeindex().
+     */
+    SG_TEXTFORMAT_QUADS,
+
+    /**
+     * @brief One ::sg_textquad per glyph, for instanced drawing.
+     */
+    SG_TEXTFORMAT_INSTANCES
+};
+
+/**
+ * @brief Set the vertex format for layouts of a text flow.
+ *
+ * @param flow The text flow to modify.
+ * @param format The vertex format.
+ */
+void
+sg_textflow_setformat(struct sg_textflow *flow, enum sg_textformat format);
+
 /**********************************************************************/
 
 /**
@@ -215,11 +314,28 @@ struct sg_textvert {
     short vx, vy, tx, ty;
 };
 
+/**
+ * @brief Text quad, for instanced drawing.
+ *
+ * The corner with texture coordinates `(tx + i * tw, ty + j * th)` is
+ * at `(vx + i * vw, vy + j * vh)`, for `i` and `j` either 0 or 1.
+ * The texture height is negative, because atlas rows are stored from
+ * top to bottom.
+ */
+struct sg_textquad {
+    short vx, vy, vw, vh, tx, ty, tw, th;
+};
+
 /**
  * @brief Batch of text layout data.
+ *
+ * All glyphs in a batch use the same font and the same atlas page.
+ * The offset and count are in vertexes, or in quads for the
+ * ::SG_TEXTFORMAT_INSTANCES format.
  */
 struct sg_textbatch {
     struct sg_font *font;
+    int page;
     int offset;
     int count;
 };
@@ -232,10 +348,22 @@ struct sg_textbatch {
  */
 struct sg_textlayout {
     struct sg_textmetrics metrics;
+    /** @brief The format of the vertex data.  */
+    enum sg_textformat format;
+    /** @brief Vertexes, unless the format is instances.  */
     struct sg_textvert *vert;
     int vertcount;
+    /** @brief Quads, if the format is instances.  */
+    struct sg_textquad *quad;
+    int quadcount;
     struct sg_textbatch *batch;
     int batchcount;
+
+    /**
+     * @private @brief Line breaks and a copy of the text flow, for
+     * updating the layout.
+     */
+    struct sg_textlayout_state *state_;
 };
 
 /**
@@ -250,6 +378,28 @@ int
 sg_textlayout_create(struct sg_textlayout *layout, struct sg_textflow *flow,
                      struct sg_error **err);
 
+/**
+ * @brief Update a text layout after the text flow changes.
+ *
+ * Lines before the first glyph which differs from the text the
+ * layout was created from are kept, and only the rest of the text is
+ * laid out again.  The flow does not have to be the same object the
+ * layout was created from, so text which is rebuilt for every change
+ * will still share the unchanged lines.  Changing the flow's width
+ * lays out the entire text again.
+ *
+ * The vertex and batch arrays may move.  On failure, the layout is
+ * empty, but must still be destroyed.
+ *
+ * @param layout The layout to update.
+ * @param flow The text flow to use for layout.
+ * @param err On failure, the error.
+ * @return Zero for success, or nonzero for failure.
+ */
+int
+sg_textlayout_update(struct sg_textlayout *layout, struct sg_textflow *flow,
+                     struct sg_error **err);
+
 /**
  * @brief Free a text layout object.
  *
@@ -260,6 +410,50 @@ sg_textlayout_create(struct sg_textlayout *layout, struct sg_textflow *flow,
 void
 sg_textlayout_destroy(struct sg_textlayout *layout);
 
+/**********************************************************************/
+
+/**
+ * @brief A cache of text layouts.
+ *
+ * Layouts are found by a hash of the text flow's glyphs, fonts, and
+ * width.  When the cache is full, the least recently used layout is
+ * updated for the new text, which reuses its lines if the text only
+ * differs at the end.
+ */
+struct sg_textcache;
+
+/**
+ * @brief Create a text layout cache.
+ *
+ * @param capacity The maximum number of layouts in the cache.
+ * @param err On failure, the error.
+ * @return A new cache, or `NULL` for failure.
+ */
+struct sg_textcache *
+sg_textcache_new(unsigned capacity, struct sg_error **err);
+
+/**
+ * @brief Free a text layout cache and all of its layouts.
+ */
+void
+sg_textcache_free(struct sg_textcache *cache);
+
+/**
+ * @brief Get the layout for a text flow.
+ *
+ * The layout belongs to the cache.  It remains valid until it is
+ * replaced by a later call to this function, which only happens once
+ * `capacity` other texts have been requested since it was last used.
+ *
+ * @param cache The cache.
+ * @param flow The text flow.
+ * @param err On failure, the error.
+ * @return The layout, or `NULL` for failure.
+ */
+const struct sg_textlayout *
+sg_textcache_get(struct sg_textcache *cache, struct sg_textflow *flow,
+                 struct sg_error **err);
+
 #ifdef __cplusplus
 }
 #endif
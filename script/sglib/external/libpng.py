@@ -4,7 +4,8 @@
 from d3build.package import ExternalPackage
 
 def pkg_config(build):
-    flags = build.pkg_config('libpng12')
+    # The PNG writer uses zlib directly.
+    flags = build.pkg_config('libpng12 zlib')
     return None, build.target.module().add_flags(flags)
 
 module = ExternalPackage(
@@ -19,6 +19,7 @@ error.h
 event.h
 file.h
 hash.h
+hashmap.h
 hashtable.h
 key.h
 keycode.h
@@ -31,6 +32,7 @@ pixbuf.h
 rand.h
 record.h
 shader.h
+sprite.h
 strbuf.h
 thread.h
 type.h
@@ -65,8 +67,12 @@ error.c
 file_impl.h
 file_load.c
 file_posix.c posix
+file_save.c
 file_textwriter.c
 file_win.c windows
+file_writer.c
+filewatch.c
+filewatch_inotify.c linux
 keyid.c
 keytable_evdev.c linux
 keytable_mac.c osx
@@ -86,6 +92,10 @@ path_win.c windows
 private.h
 rand.c
 shader.c
+sprite_impl.h
+sprite_sheet.c
+sprite_write.c
+sprite_xform.c
 sys.c
 timer.c
 version.c
@@ -112,12 +122,17 @@ system_sdl.c audio_sdl
 
 src.add(path='src/pixbuf', sources='''
 coregraphics.c image_coregraphics
+image_batch.c
+image_scale.c
 image.c
 libjpeg.c image_libjpeg
 libpng.c image_libpng
+mipmap.c
 pixbuf.c
-premultiply_alpha.c
+pixops.c
+pngwrite.c image_libpng
 private.h
+texcomp.c
 texture.c
 wincodec.c image_wincodec
 ''')
@@ -129,27 +144,39 @@ record.c !video_recording
 record.h !video_recording
 screenshot.c !video_recording
 screenshot.h !video_recording
+videoconv.c
+videoconv.h
 videoio.c
 videoio.h
 videoproc.c
 videoproc.h
+videoraw.c
+videoraw.h
 ''')
 
 src.add(path='src/type', tags=['freetype'], sources='''
+atlas.c
 font.c
+font_cache.c
+font_texture.c
 freetype_error.c
 private.h
+sdf.c
+textcache.c
 textflow.c
 textlayout.c
 typeface.c
+utf8.c
 ''')
 
 src.add(path='src/util', sources='''
 cpu.c
 hash.c
+hashmap.c
 hashtable.c
 strbuf.c
 thread_pthread.c posix
+thread_run.c
 thread_windows.c windows
 ''')
 
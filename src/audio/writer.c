@@ -70,7 +70,8 @@ sg_audio_writer_open(const char *path,
     struct sg_audio_writer *writer = NULL;
     struct sg_writer *fp = NULL;
     char header[WAV_HEADER_SIZE];
-    int r, pos;
+    struct sg_writer_vec vec;
+    int r;
 
     if (sg_audio_writer_fmtsize(format) == 0) {
         sg_error_invalid(err, __FUNCTION__, "format");
@@ -87,14 +88,17 @@ sg_audio_writer_open(const char *path,
     if (!fp)
         goto cleanup;
 
+    /* Audio is written in small pieces, one mixer buffer at a time.  */
+    r = sg_writer_setbuffer(fp, SG_WRITER_BUFSIZE, err);
+    if (r)
+        goto cleanup;
+
     memset(header, 0, WAV_HEADER_SIZE);
-    pos = 0;
-    while (pos < WAV_HEADER_SIZE) {
-        r = sg_writer_write(fp, header, WAV_HEADER_SIZE, err);
-        if (r < 0)
-            goto cleanup;
-        pos += r;
-    }
+    vec.ptr = header;
+    vec.len = WAV_HEADER_SIZE;
+    r = sg_writer_writev(fp, &vec, 1, err);
+    if (r)
+        goto cleanup;
 
     writer->fp = fp;
     writer->format = format;
@@ -109,7 +113,8 @@ sg_audio_writer_open(const char *path,
 cleanup:
     if (writer)
         free(writer);
-    sg_writer_close(fp);
+    if (fp)
+        sg_writer_close(fp);
     return NULL;
 }
 
@@ -118,9 +123,10 @@ sg_audio_writer_close(struct sg_audio_writer *writer,
                       struct sg_error **err)
 {
     struct sg_writer *fp = writer->fp;
-    int r, sz, pos, ret, ssize, sfloat, fsize;
+    int r, sz, ret, ssize, sfloat, fsize;
     int64_t rr;
     char header[WAV_HEADER_SIZE];
+    struct sg_writer_vec vec;
 
     ssize = sg_audio_writer_fmtsize(writer->format);
     sfloat = sg_audio_writer_fmtfloat(writer->format);
@@ -129,9 +135,9 @@ sg_audio_writer_close(struct sg_audio_writer *writer,
     rr = sg_writer_seek(fp, 0, SEEK_SET, err);
     if (rr < 0) goto error;
 
-    sz = writer->len;
+    sz = writer->len * fsize;
     memcpy(header, "RIFF", 4);
-    sg_write_lu32(header + 4, sz * 4 + 36);
+    sg_write_lu32(header + 4, sz + 36);
     memcpy(header + 8, "WAVE", 4);
 
     memcpy(header + 12, "fmt ", 4);
@@ -144,14 +150,13 @@ sg_audio_writer_close(struct sg_audio_writer *writer,
     sg_write_lu16(header + 34, ssize * 8);
 
     memcpy(header + 36, "data", 4);
-    sg_write_lu32(header + 40, sz * 4);
+    sg_write_lu32(header + 40, sz);
 
-    pos = 0;
-    while (pos < WAV_HEADER_SIZE) {
-        r = sg_writer_write(fp, header, WAV_HEADER_SIZE, err);
-        if (r < 0) goto error;
-        pos += r;
-    }
+    vec.ptr = header;
+    vec.len = WAV_HEADER_SIZE;
+    r = sg_writer_writev(fp, &vec, 1, err);
+    if (r)
+        goto error;
 
     r = sg_writer_commit(fp, err);
     if (r)
@@ -207,11 +212,11 @@ sg_audio_writer_write(struct sg_audio_writer *writer,
                       const void *data, int count,
                       struct sg_error **err)
 {
-    struct sg_writer *fp = writer->fp;
+    struct sg_writer_vec vec;
     int ssize, sswapped, r;
-    size_t nsamp, bsize, pos, nalloc;
+    size_t nsamp, bsize, nalloc;
     void *tmp;
-    const unsigned *buf;
+    const void *buf;
 
     ssize = sg_audio_writer_fmtsize(writer->format);
     sswapped = sg_audio_writer_fmtswapped(writer->format);
@@ -233,7 +238,7 @@ sg_audio_writer_write(struct sg_audio_writer *writer,
         } else {
             tmp = writer->tmp;
         }
-        switch (bsize) {
+        switch (ssize) {
         case 2:
             sg_audio_pcm_swap2(tmp, data, nsamp);
             break;
@@ -246,13 +251,12 @@ sg_audio_writer_write(struct sg_audio_writer *writer,
         buf = data;
     }
 
-    pos = 0;
-    while (pos < bsize) {
-        r = sg_writer_write(fp, buf + pos, bsize - pos, err);
-        if (r < 0)
-            return -1;
-        pos += r;
-    }
+    vec.ptr = buf;
+    vec.len = bsize;
+    r = sg_writer_writev(writer->fp, &vec, 1, err);
+    if (r)
+        return -1;
+    writer->len += count;
 
     return 0;
 
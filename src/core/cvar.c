@@ -7,7 +7,10 @@
 #include "sg/cvar.h"
 #include "sg/entry.h"
 #include "sg/error.h"
+#include "sg/file.h"
+#include "sg/hash.h"
 #include "sg/log.h"
+#include "sg/strbuf.h"
 #include <errno.h>
 #include <limits.h>
 #include <math.h>
@@ -34,23 +37,42 @@ enum {
                        SG_CVAR_IFUNSET)
 };
 
+/* Hash and length of the configuration file contents we last wrote,
+   so we don't reload our own changes.  */
+static unsigned sg_cvar_cfghash;
+static size_t sg_cvar_cfglen;
+
 /* Timer callback for saving the configuration.  */
 static void
 sg_cvar_timercallback(double time, void *cxt)
 {
     struct sg_error *err = NULL;
+    struct sg_strbuf buf;
+    size_t len;
     int r;
 
     (void) time;
     (void) cxt;
 
-    r = sg_cvar_save("config.ini", strlen("config.ini"), 0, &err);
+    sg_strbuf_init(&buf, 0);
+    r = sg_cvar_format(&buf, 0, &err);
     if (r) {
-        sg_logerrf(SG_LOG_ERROR, err, "Could not save configuration.");
-        sg_error_clear(&err);
-    } else {
-        sg_logf(SG_LOG_INFO, "Configuration saved.");
+        sg_strbuf_destroy(&buf);
+        goto error;
     }
+    len = sg_strbuf_len(&buf);
+    sg_cvar_cfghash = sg_hash(buf.s, len);
+    sg_cvar_cfglen = len;
+    r = sg_file_save("config.ini", strlen("config.ini"),
+                     sg_strbuf_detach(&buf), len, &err);
+    if (r)
+        goto error;
+    sg_logf(SG_LOG_INFO, "Saving configuration.");
+    return;
+
+error:
+    sg_logerrf(SG_LOG_ERROR, err, "Could not save configuration.");
+    sg_error_clear(&err);
 }
 
 /* Mark the configuration as changed, so it will be saved to disk
@@ -589,3 +611,54 @@ sg_cvar_loadcfg(void)
 
     sg_cvar_markdirty();
 }
+
+/* File watch callback for the configuration file.  */
+static void
+sg_cvar_cfgchanged(void *cxt)
+{
+    struct sg_filedata *data;
+    struct sg_error *err = NULL;
+    int r;
+
+    (void) cxt;
+
+    r = sg_file_load(&data, "config", strlen("config"), 0,
+                     "ini", SG_CVAR_MAXCFGSIZE, NULL, &err);
+    if (r) {
+        if (err->domain != &SG_ERROR_NOTFOUND) {
+            sg_logerrf(SG_LOG_ERROR, err,
+                       "Could not reload configuration file.");
+        }
+        sg_error_clear(&err);
+        return;
+    }
+    if (data->length == sg_cvar_cfglen &&
+        sg_hash(data->data, data->length) == sg_cvar_cfghash) {
+        sg_filedata_decref(data);
+        return;
+    }
+    r = sg_cvar_loadbuffer(data, SG_CVAR_CREATE | SG_CVAR_PERSISTENT, &err);
+    sg_filedata_decref(data);
+    if (r) {
+        sg_logerrf(SG_LOG_ERROR, err,
+                   "Could not reload configuration file.");
+        sg_error_clear(&err);
+        return;
+    }
+    sg_logs(SG_LOG_INFO, "Configuration reloaded.");
+}
+
+void
+sg_cvar_watchcfg(void)
+{
+    struct sg_error *err = NULL;
+    int r;
+
+    r = sg_filewatch_add("config", strlen("config"), 0, "ini",
+                         sg_cvar_cfgchanged, NULL, &err);
+    if (r) {
+        sg_logerrs(SG_LOG_WARN, err,
+                   "Could not watch configuration file.");
+        sg_error_clear(&err);
+    }
+}
@@ -8,8 +8,6 @@
 #include "sg/log.h"
 #include <string.h>
 
-#define SG_CVAR_MAXCFGSIZE (1024 * 1024)
-
 int
 sg_cvar_loadfile(
     const char *path,
@@ -2,6 +2,8 @@
    This file is part of SGLib.  SGLib is licensed under the terms of the
    2-clause BSD license.  For more information, see LICENSE.txt. */
 #include <stddef.h>
+struct sg_error;
+struct sg_strbuf;
 
 /* Maximum length of CVar name or section name.  */
 #define SG_CVAR_NAMELEN 16
@@ -9,6 +11,9 @@
 /* Maximum length for cvar strings.  */
 #define SG_CVAR_VALUELEN 1023
 
+/* Maximum size of a configuration file.  */
+#define SG_CVAR_MAXCFGSIZE (1024 * 1024)
+
 /* The default cvar section.  */
 extern const char SG_CVAR_DEFAULTSECTION[SG_CVAR_NAMELEN];
 
@@ -76,3 +81,12 @@ sg_cvar_set2(
     const char *name,
     const char *value,
     unsigned flags);
+
+/* Format the cvars as a configuration file.  If save_all is zero,
+   only persistent cvars are written.  Returns 0 for success, nonzero
+   for failure.  */
+int
+sg_cvar_format(
+    struct sg_strbuf *buf,
+    int save_all,
+    struct sg_error **err);
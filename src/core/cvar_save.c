@@ -7,6 +7,7 @@
 #include "sg/error.h"
 #include "sg/file.h"
 #include "sg/log.h"
+#include "sg/strbuf.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,16 +18,18 @@ sg_cvar_cmpname(const void *x, const void *y)
     return memcmp(x, y, SG_CVAR_NAMELEN);
 }
 
-static int
-sg_cvar_save_str(struct sg_textwriter *wp, const char *secname,
+static void
+sg_cvar_save_str(struct sg_strbuf *wp, const char *secname,
                  const char *name, const char *value)
 {
     size_t len = strlen(value), i;
     char buf[SG_CVAR_VALUELEN * 2 + 3], *pos, *qval;
     int needs_quote, c;
 
-    if (!len)
-        return sg_textwriter_putf(wp, "%s =", name);
+    if (!len) {
+        sg_strbuf_printf(wp, "%s =", name);
+        return;
+    }
     if (len > SG_CVAR_VALUELEN) {
         sg_logf(SG_LOG_WARN, "Cvar value too long: %s.%s", secname, name);
         goto failed;
@@ -69,7 +72,8 @@ sg_cvar_save_str(struct sg_textwriter *wp, const char *secname,
         qval = buf + 1;
     }
     *pos++ = '\0';
-    return sg_textwriter_putf(wp, "%s = %s", name, qval);
+    sg_strbuf_printf(wp, "%s = %s", name, qval);
+    return;
 
 failed_badchar:
     sg_logf(SG_LOG_WARN, "Cvar contains invalid characters: %s.%s",
@@ -77,13 +81,12 @@ failed_badchar:
     goto failed;
 
 failed:
-    return sg_textwriter_putf(wp, "# %s", name);
+    sg_strbuf_printf(wp, "# %s", name);
 }
 
 int
-sg_cvar_save(
-    const char *path,
-    size_t pathlen,
+sg_cvar_format(
+    struct sg_strbuf *wp,
     int save_all,
     struct sg_error **err)
 {
@@ -92,15 +95,10 @@ sg_cvar_save(
     struct sg_cvartable *section;
     unsigned count = sg_cvar_section.count, size = sg_cvar_section.size,
         scount, ssize, i, j, k, max_scount;
-    struct sg_textwriter wp;
     void **sp, **se;
-    int r, state;
+    int state;
     struct sg_cvar_head *cvar;
 
-    r = sg_textwriter_open(&wp, path, pathlen, err);
-    if (r)
-        return -1;
-
     if (!count)
         goto done;
     max_scount = 0;
@@ -155,39 +153,39 @@ sg_cvar_save(
                 continue;
             if (state < 2) {
                 if (state == 1)
-                    sg_textwriter_putc(&wp, '\n');
-                sg_textwriter_putf(&wp, "[%s]\n", secname);
+                    sg_strbuf_putc(wp, '\n');
+                sg_strbuf_printf(wp, "[%s]\n", secname);
                 state = 2;
             } else {
-                sg_textwriter_putc(&wp, '\n');
+                sg_strbuf_putc(wp, '\n');
             }
             if (cvar->doc)
-                sg_textwriter_putf(&wp, "# %s\n", cvar->doc);
+                sg_strbuf_printf(wp, "# %s\n", cvar->doc);
             if ((cvar->flags & SG_CVAR_HASPERSISTENT) == 0)
-                sg_textwriter_puts(&wp, "# ");
+                sg_strbuf_puts(wp, "# ");
             switch (cvar->flags >> 16) {
             case SG_CVAR_STRING:
             case SG_CVAR_USER:
                 sg_cvar_save_str(
-                    &wp, secname, cvarname,
+                    wp, secname, cvarname,
                     ((struct sg_cvar_string *) cvar)->persistent_value);
                 break;
 
             case SG_CVAR_INT:
-                sg_textwriter_putf(
-                    &wp, "%s = %d", cvarname,
+                sg_strbuf_printf(
+                    wp, "%s = %d", cvarname,
                     ((struct sg_cvar_int *) cvar)->persistent_value);
                 break;
 
             case SG_CVAR_FLOAT:
-                sg_textwriter_putf(
-                    &wp, "%s = %f", cvarname,
+                sg_strbuf_printf(
+                    wp, "%s = %f", cvarname,
                     ((struct sg_cvar_float *) cvar)->persistent_value);
                 break;
 
             case SG_CVAR_BOOL:
-                sg_textwriter_putf(
-                    &wp, "%s = %s", cvarname,
+                sg_strbuf_printf(
+                    wp, "%s = %s", cvarname,
                     ((struct sg_cvar_bool *) cvar)->persistent_value ?
                     "yes" : "no");
                 break;
@@ -196,19 +194,36 @@ sg_cvar_save(
                 sg_sys_abort("corrupted cvar");
                 goto done;
             }
-            sg_textwriter_putc(&wp, '\n');
+            sg_strbuf_putc(wp, '\n');
         }
     }
 
 done:
     free(names);
-    r = sg_textwriter_commit(&wp, err);
-    sg_textwriter_close(&wp);
-    return r;
+    return 0;
 
 nomem:
-    free(names);
-    sg_textwriter_close(&wp);
     sg_error_nomem(err);
     return -1;
 }
+
+int
+sg_cvar_save(
+    const char *path,
+    size_t pathlen,
+    int save_all,
+    struct sg_error **err)
+{
+    struct sg_strbuf buf;
+    size_t len;
+    int r;
+
+    sg_strbuf_init(&buf, 0);
+    r = sg_cvar_format(&buf, save_all, err);
+    if (r) {
+        sg_strbuf_destroy(&buf);
+        return -1;
+    }
+    len = sg_strbuf_len(&buf);
+    return sg_file_save(path, pathlen, sg_strbuf_detach(&buf), len, err);
+}
@@ -9,6 +9,7 @@ struct sg_error;
 struct sg_filedata;
 struct sg_fileid;
 struct sg_writer;
+struct sg_writer_vec;
 
 /* Return codes for sg_reader_open() */
 enum {
@@ -104,6 +105,48 @@ void
 sg_reader_close(
     struct sg_reader *fp);
 
+/* Map the first 'size' bytes of a file into memory, read-only.
+   Returns NULL for error.  The mapping remains valid after the file
+   is closed.  */
+void *
+sg_reader_map(
+    struct sg_reader *fp,
+    size_t size,
+    struct sg_error **err);
+
+/* Unmap memory mapped by sg_reader_map().  */
+void
+sg_reader_unmap(
+    void *ptr,
+    size_t size);
+
+/* User-space write buffer, which must be the first member of the
+   platform's sg_writer structure.  The buffer is NULL if the file is
+   unbuffered.  */
+struct sg_writerbuf {
+    char *buf;
+    size_t pos;
+    size_t size;
+};
+
+/* Write data directly to a file, bypassing the buffer.  Returns the
+   number of bytes written, or -1 for error.  */
+int
+sg_writer_rawwrite(
+    struct sg_writer *fp,
+    const void *buf,
+    size_t amt,
+    struct sg_error **err);
+
+/* Write all data from multiple buffers directly to a file, bypassing
+   the buffer.  Returns 0 for success, -1 for error.  */
+int
+sg_writer_rawwritev(
+    struct sg_writer *fp,
+    const struct sg_writer_vec *vec,
+    int count,
+    struct sg_error **err);
+
 /* Returns NULL on error.  */
 struct sg_filedata *
 sg_reader_load(
@@ -148,3 +191,58 @@ sg_path_getdatapath(pchar *buf, size_t buflen);
 pchar *
 sg_file_createpath(const char *path, size_t pathlen,
                    struct sg_error **err);
+
+/* Search for a file and open it, searching in the same way as
+   sg_file_load().  The normalized path of the file that was found,
+   including its extension, is stored in nbuf, which must have size
+   SG_MAX_PATH.  Returns the length of the normalized path, or
+   SG_FILE_ERROR if the file could not be found or opened.  */
+int
+sg_file_open(
+    struct sg_reader *fp,
+    char *nbuf,
+    const char *path,
+    size_t pathlen,
+    int flags,
+    const char *extensions,
+    struct sg_error **err);
+
+/* Get the identity of the file that sg_file_load() would load, without
+   loading it.  Returns SG_FILE_OK or SG_FILE_ERROR.  */
+int
+sg_file_getid(
+    struct sg_fileid *fileid,
+    const char *path,
+    size_t pathlen,
+    int flags,
+    const char *extensions,
+    struct sg_error **err);
+
+/* Report that a file has changed, from any thread.  The path is the
+   normalized relative path of the file, including its extension.  If
+   the path is NULL, all watched files are treated as changed.  */
+void
+sg_filewatch_notify(const char *path, size_t pathlen);
+
+#if defined __linux__
+
+/* File change notifications are available from the platform.  */
+#define SG_FILEWATCH_SYS 1
+
+/* Initialize the platform file change notification backend.  Returns
+   0 for success, or nonzero if notifications are unavailable.  */
+int
+sg_filewatch_sys_init(struct sg_error **err);
+
+/* Watch a directory for changes in each search path.  The directory
+   is a normalized relative path, either empty or ending with '/'.
+   Directories which do not exist are ignored.  Returns 0 for success,
+   nonzero for failure.  */
+int
+sg_filewatch_sys_adddir(
+    const char *path,
+    size_t pathlen,
+    int flags,
+    struct sg_error **err);
+
+#endif
@@ -11,11 +11,40 @@
 static void
 sg_filedata_free_(struct sg_filedata *data)
 {
-    if (data->data)
+    if (data->mapped_)
+        sg_reader_unmap(data->data, data->length);
+    else if (data->data)
         free(data->data);
     free(data);
 }
 
+/* Create a file data object which owns the given buffer.  Returns
+   NULL if out of memory, without freeing the buffer.  */
+static struct sg_filedata *
+sg_filedata_new(
+    void *buf,
+    size_t length,
+    int mapped,
+    const char *path,
+    size_t pathlen)
+{
+    struct sg_filedata *dp;
+    char *pp;
+    dp = malloc(sizeof(*dp) + pathlen + 1);
+    if (!dp)
+        return NULL;
+    pp = (char *) (dp + 1);
+    sg_atomic_set(&dp->refcount_, 1);
+    dp->mapped_ = mapped;
+    dp->data = buf;
+    dp->length = length;
+    dp->path = pp;
+    dp->pathlen = pathlen;
+    memcpy(pp, path, pathlen);
+    pp[pathlen] = '\0';
+    return dp;
+}
+
 void
 sg_filedata_incref(struct sg_filedata *data)
 {
@@ -40,7 +69,6 @@ sg_reader_load(
 {
     struct sg_filedata *dp;
     unsigned char *buf = NULL;
-    char *pp;
     size_t pos;
     int r;
 
@@ -59,17 +87,9 @@ sg_reader_load(
     buf[pos] = '\0';
     if (pos < size)
         buf = realloc(buf, pos + 1);
-    dp = malloc(sizeof(*dp) + pathlen + 1);
+    dp = sg_filedata_new(buf, pos, 0, path, pathlen);
     if (!dp)
         goto nomem;
-    pp = (char *) (dp + 1);
-    sg_atomic_set(&dp->refcount_, 1);
-    dp->data = buf;
-    dp->length = pos;
-    dp->path = pp;
-    dp->pathlen = pathlen;
-    memcpy(pp, path, pathlen);
-    pp[pathlen] = '\0';
     return dp;
 
 nomem:
@@ -78,24 +98,45 @@ nomem:
     return NULL;
 }
 
+/* Like sg_reader_load(), but maps the file instead of reading it.  */
+static struct sg_filedata *
+sg_reader_loadmap(
+    struct sg_reader *fp,
+    size_t size,
+    const char *path,
+    size_t pathlen,
+    struct sg_error **err)
+{
+    struct sg_filedata *dp;
+    void *ptr;
+
+    ptr = sg_reader_map(fp, size, err);
+    if (!ptr)
+        return NULL;
+    dp = sg_filedata_new(ptr, size, 1, path, pathlen);
+    if (!dp) {
+        sg_reader_unmap(ptr, size);
+        sg_error_nomem(err);
+        return NULL;
+    }
+    return dp;
+}
+
 struct sg_file_ext {
     const char *p;
     unsigned len;
 };
 
 int
-sg_file_load(
-    struct sg_filedata **data,
+sg_file_open(
+    struct sg_reader *fp,
+    char *nbuf,
     const char *path,
     size_t pathlen,
     int flags,
     const char *extensions,
-    size_t maxsize,
-    struct sg_fileid *fileid,
     struct sg_error **err)
 {
-    struct sg_reader fp;
-    char nbuf[SG_MAX_PATH];
     pchar *pbuf = NULL;
     struct sg_path *search;
     unsigned sflags, searchcount, maxslen;
@@ -193,7 +234,7 @@ sg_file_load(
                 for (k = 0; k < extlen; k++)
                     pbuf[maxslen + nlen + 1 + k] = ext[k];
                 pbuf[maxslen + nlen + 1 + extlen] = '\0';
-                r = sg_reader_open(&fp, pptr, err);
+                r = sg_reader_open(fp, pptr, err);
                 if (r == SG_FILE_OK) {
                     nbuf[nlen++] = '.';
                     memcpy(nbuf + nlen, ext, extlen);
@@ -221,7 +262,7 @@ sg_file_load(
         for (i = 0; i < searchcount; i++) {
             pptr = pbuf + maxslen - search[i].len;
             pmemcpy(pptr, search[i].path, search[i].len);
-            r = sg_reader_open(&fp, pptr, err);
+            r = sg_reader_open(fp, pptr, err);
             if (r == SG_FILE_OK) {
                 goto success;
             } else if (r == SG_FILE_ERROR) {
@@ -234,41 +275,7 @@ sg_file_load(
 
 success:
     free(pbuf);
-    pbuf = NULL;
-    {
-        int64_t flen;
-        struct sg_fileid fi;
-        struct sg_filedata *dp;
-        int r, i;
-
-        r = sg_reader_getinfo(&fp, &flen, &fi, err);
-        if (r) {
-            sg_reader_close(&fp);
-            return SG_FILE_ERROR;
-        }
-        if ((uint64_t) flen > maxsize) {
-            sg_error_sets(err, &SG_ERROR_DATA, 0, "file is too large");
-            sg_reader_close(&fp);
-            return SG_FILE_ERROR;
-        }
-        if (flags & SG_IFCHANGED) {
-            for (i = 0; i < 3; i++)
-                if (fi.f_[i] != fileid->f_[i])
-                    break;
-            if (i == 3) {
-                sg_reader_close(&fp);
-                return SG_FILE_NOTCHANGED;
-            }
-        }
-        dp = sg_reader_load(&fp, (size_t) flen, nbuf, nlen, err);
-        sg_reader_close(&fp);
-        if (!dp)
-            return SG_FILE_ERROR;
-        *data = dp;
-        if (fileid)
-            *fileid = fi;
-    }
-    return SG_FILE_OK;
+    return nlen;
 
 notfound:
     sg_error_notfound(err, nbuf);
@@ -282,3 +289,79 @@ error:
     free(pbuf);
     return SG_FILE_ERROR;
 }
+
+int
+sg_file_load(
+    struct sg_filedata **data,
+    const char *path,
+    size_t pathlen,
+    int flags,
+    const char *extensions,
+    size_t maxsize,
+    struct sg_fileid *fileid,
+    struct sg_error **err)
+{
+    struct sg_reader fp;
+    char nbuf[SG_MAX_PATH];
+    int64_t flen;
+    struct sg_fileid fi;
+    struct sg_filedata *dp;
+    int r, i, nlen;
+
+    nlen = sg_file_open(&fp, nbuf, path, pathlen, flags, extensions, err);
+    if (nlen < 0)
+        return SG_FILE_ERROR;
+
+    r = sg_reader_getinfo(&fp, &flen, &fi, err);
+    if (r) {
+        sg_reader_close(&fp);
+        return SG_FILE_ERROR;
+    }
+    if ((uint64_t) flen > maxsize) {
+        sg_error_sets(err, &SG_ERROR_DATA, 0, "file is too large");
+        sg_reader_close(&fp);
+        return SG_FILE_ERROR;
+    }
+    if (flags & SG_IFCHANGED) {
+        for (i = 0; i < 3; i++)
+            if (fi.f_[i] != fileid->f_[i])
+                break;
+        if (i == 3) {
+            sg_reader_close(&fp);
+            return SG_FILE_NOTCHANGED;
+        }
+    }
+    if ((flags & SG_FILE_MAP) && flen > 0)
+        dp = sg_reader_loadmap(&fp, (size_t) flen, nbuf, nlen, err);
+    else
+        dp = sg_reader_load(&fp, (size_t) flen, nbuf, nlen, err);
+    sg_reader_close(&fp);
+    if (!dp)
+        return SG_FILE_ERROR;
+    *data = dp;
+    if (fileid)
+        *fileid = fi;
+    return SG_FILE_OK;
+}
+
+int
+sg_file_getid(
+    struct sg_fileid *fileid,
+    const char *path,
+    size_t pathlen,
+    int flags,
+    const char *extensions,
+    struct sg_error **err)
+{
+    struct sg_reader fp;
+    char nbuf[SG_MAX_PATH];
+    int64_t flen;
+    int r;
+
+    r = sg_file_open(&fp, nbuf, path, pathlen, flags, extensions, err);
+    if (r < 0)
+        return SG_FILE_ERROR;
+    r = sg_reader_getinfo(&fp, &flen, fileid, err);
+    sg_reader_close(&fp);
+    return r ? SG_FILE_ERROR : SG_FILE_OK;
+}
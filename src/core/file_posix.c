@@ -16,8 +16,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 int
@@ -93,12 +95,36 @@ sg_reader_close(
     close(fp->fdes);
 }
 
+void *
+sg_reader_map(
+    struct sg_reader *fp,
+    size_t size,
+    struct sg_error **err)
+{
+    void *ptr;
+    ptr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fp->fdes, 0);
+    if (ptr == MAP_FAILED) {
+        sg_error_errno(err, errno);
+        return NULL;
+    }
+    return ptr;
+}
+
+void
+sg_reader_unmap(
+    void *ptr,
+    size_t size)
+{
+    munmap(ptr, size);
+}
+
 /*
   See Theo Ts'o's blog post for the reasoning behind how we write files.
 
   http://thunk.org/tytso/blog/2009/03/15/dont-fear-the-fsync/
 */
 struct sg_writer {
+    struct sg_writerbuf b;
     int fdes;
     char *destpath;
     char *temppath;
@@ -152,6 +178,9 @@ sg_writer_open(
             goto error_errno;
         }
     }
+    fp->b.buf = NULL;
+    fp->b.pos = 0;
+    fp->b.size = 0;
     fp->fdes = fdes;
     return fp;
 
@@ -180,6 +209,8 @@ sg_writer_seek(
         sg_error_invalid(err, __FUNCTION__, "fp");
         return -1;
     }
+    if (sg_writer_flush(fp, err))
+        return -1;
     r = lseek(fp->fdes, offset, whence);
     if (r < 0)
         sg_error_errno(err, errno);
@@ -187,7 +218,7 @@ sg_writer_seek(
 }
 
 int
-sg_writer_write(
+sg_writer_rawwrite(
     struct sg_writer *fp,
     const void *buf,
     size_t amt,
@@ -206,6 +237,67 @@ sg_writer_write(
     return r;
 }
 
+/* Maximum number of buffers passed to each writev() call.  */
+#define SG_WRITER_IOVCOUNT 16
+
+int
+sg_writer_rawwritev(
+    struct sg_writer *fp,
+    const struct sg_writer_vec *vec,
+    int count,
+    struct sg_error **err)
+{
+    struct iovec iov[SG_WRITER_IOVCOUNT];
+    size_t off = 0, amt, avail;
+    ssize_t r;
+    int i = 0, j, n;
+    if (fp->fdes < 0) {
+        sg_error_invalid(err, __FUNCTION__, "fp");
+        return -1;
+    }
+    while (1) {
+        while (i < count && off == vec[i].len) {
+            i++;
+            off = 0;
+        }
+        if (i == count)
+            return 0;
+        n = 0;
+        amt = 0;
+        for (j = i; j < count && n < SG_WRITER_IOVCOUNT; j++) {
+            avail = vec[j].len - (j == i ? off : 0);
+            if (!avail)
+                continue;
+            if (avail > INT_MAX - amt)
+                avail = INT_MAX - amt;
+            iov[n].iov_base = (char *) vec[j].ptr + (j == i ? off : 0);
+            iov[n].iov_len = avail;
+            n++;
+            amt += avail;
+            if (amt == INT_MAX)
+                break;
+        }
+        r = writev(fp->fdes, iov, n);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            sg_error_errno(err, errno);
+            return -1;
+        }
+        amt = r;
+        while (amt) {
+            avail = vec[i].len - off;
+            if (amt < avail) {
+                off += amt;
+                break;
+            }
+            amt -= avail;
+            i++;
+            off = 0;
+        }
+    }
+}
+
 int
 sg_writer_commit(
     struct sg_writer *fp,
@@ -217,6 +309,8 @@ sg_writer_commit(
         sg_error_invalid(err, __FUNCTION__, "fp");
         return -1;
     }
+    if (sg_writer_flush(fp, err))
+        return -1;
     fp->fdes = -1;
     r = fsync(fdes);
     if (r) {
@@ -262,5 +356,6 @@ sg_writer_close(
         close(fp->fdes);
         unlink(fp->temppath);
     }
+    free(fp->b.buf);
     free(fp);
 }
@@ -0,0 +1,257 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "file_impl.h"
+#include "private.h"
+#include "sg/error.h"
+#include "sg/file.h"
+#include "sg/log.h"
+#include "sg/thread.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Background durable-write queue.
+
+   Writing a file durably means writing a temporary file, calling
+   fsync(), and renaming the file over the destination, which can take
+   tens of milliseconds on a slow disk.  Callers hand finished data to
+   this queue instead, and a single writer thread performs the writes
+   in order.  A write which is still waiting in the queue is discarded
+   if a newer write to the same path arrives.  */
+
+/* An entry in the write queue.  */
+struct sg_filesave {
+    struct sg_filesave *next;
+
+    /* Function to call, or NULL to write data.  */
+    sg_file_savefunc_t func;
+    void *cxt;
+
+    /* The data to write.  */
+    void *data;
+    size_t length;
+
+    /* The normalized destination path.  */
+    int pathlen;
+    char path[SG_MAX_PATH];
+};
+
+struct sg_filesaveglobal {
+    /* Lock for the queue and thread state.  */
+    struct sg_lock lock;
+    /* Signaled when entries are added to the queue.  */
+    struct sg_evt work;
+    /* Signaled when the queue becomes empty.  */
+    struct sg_evt idle;
+
+    struct sg_filesave *head;
+    struct sg_filesave *tail;
+
+    /* Whether the writer thread has been started.  */
+    int running;
+    /* Whether the writer thread is processing an entry.  */
+    int busy;
+};
+
+static struct sg_filesaveglobal sg_filesaveglobal;
+
+void
+sg_filesave_init(void)
+{
+    struct sg_filesaveglobal *g = &sg_filesaveglobal;
+    sg_lock_init(&g->lock);
+    sg_evt_init(&g->work);
+    sg_evt_init(&g->idle);
+}
+
+static int
+sg_filesave_write(
+    struct sg_filesave *sp,
+    struct sg_error **err)
+{
+    struct sg_writer *fp;
+    const char *ptr = sp->data, *end = ptr + sp->length;
+    int r;
+
+    fp = sg_writer_open(sp->path, sp->pathlen, err);
+    if (!fp)
+        return -1;
+    while (ptr != end) {
+        r = sg_writer_write(fp, ptr, end - ptr, err);
+        if (r < 0) {
+            sg_writer_close(fp);
+            return -1;
+        }
+        ptr += r;
+    }
+    r = sg_writer_commit(fp, err);
+    sg_writer_close(fp);
+    return r;
+}
+
+static void
+sg_filesave_thread(void *arg)
+{
+    struct sg_filesaveglobal *g = arg;
+    struct sg_filesave *sp;
+    struct sg_error *err = NULL;
+    int r;
+
+    sg_lock_acquire(&g->lock);
+    while (1) {
+        sp = g->head;
+        if (!sp) {
+            g->busy = 0;
+            sg_evt_signal(&g->idle);
+            sg_lock_release(&g->lock);
+            sg_evt_wait(&g->work);
+            sg_lock_acquire(&g->lock);
+            continue;
+        }
+        g->head = sp->next;
+        if (!g->head)
+            g->tail = NULL;
+        g->busy = 1;
+        sg_lock_release(&g->lock);
+
+        if (sp->func) {
+            sp->func(sp->cxt);
+        } else {
+            r = sg_filesave_write(sp, &err);
+            if (r) {
+                sg_logerrf(SG_LOG_ERROR, err, "Could not save file: %s",
+                           sp->path);
+                sg_error_clear(&err);
+            } else {
+                sg_logf(SG_LOG_DEBUG, "Saved file: %s", sp->path);
+            }
+            free(sp->data);
+        }
+        free(sp);
+
+        sg_lock_acquire(&g->lock);
+    }
+}
+
+/* Add an entry to the end of the queue.  On failure, the entry is
+   freed, but not its data.  */
+static int
+sg_filesave_push(
+    struct sg_filesave *sp,
+    struct sg_error **err)
+{
+    struct sg_filesaveglobal *g = &sg_filesaveglobal;
+    int r;
+
+    sp->next = NULL;
+    sg_lock_acquire(&g->lock);
+    if (!g->running) {
+        r = sg_thread_start(sg_filesave_thread, g);
+        if (r) {
+            sg_lock_release(&g->lock);
+            free(sp);
+            sg_error_sets(err, &SG_ERROR_GENERIC, 0,
+                          "could not start writer thread");
+            return -1;
+        }
+        g->running = 1;
+    }
+    if (g->tail)
+        g->tail->next = sp;
+    else
+        g->head = sp;
+    g->tail = sp;
+    sg_lock_release(&g->lock);
+    sg_evt_signal(&g->work);
+    return 0;
+}
+
+int
+sg_file_save(
+    const char *path,
+    size_t pathlen,
+    void *data,
+    size_t length,
+    struct sg_error **err)
+{
+    struct sg_filesaveglobal *g = &sg_filesaveglobal;
+    struct sg_filesave *sp;
+    char nbuf[SG_MAX_PATH];
+    void *olddata;
+    int nlen, r;
+
+    nlen = sg_path_norm(nbuf, path, pathlen, err);
+    if (nlen < 0)
+        goto error;
+
+    /* If a write to the same path has not started yet, replace its
+       data instead of writing the file twice.  */
+    sg_lock_acquire(&g->lock);
+    for (sp = g->head; sp; sp = sp->next) {
+        if (!sp->func && sp->pathlen == nlen &&
+            !memcmp(sp->path, nbuf, nlen)) {
+            olddata = sp->data;
+            sp->data = data;
+            sp->length = length;
+            sg_lock_release(&g->lock);
+            free(olddata);
+            return 0;
+        }
+    }
+    sg_lock_release(&g->lock);
+
+    sp = malloc(sizeof(*sp));
+    if (!sp) {
+        sg_error_nomem(err);
+        goto error;
+    }
+    sp->func = NULL;
+    sp->cxt = NULL;
+    sp->data = data;
+    sp->length = length;
+    sp->pathlen = nlen;
+    memcpy(sp->path, nbuf, nlen + 1);
+    r = sg_filesave_push(sp, err);
+    if (r)
+        goto error;
+    return 0;
+
+error:
+    free(data);
+    return -1;
+}
+
+int
+sg_file_savecall(
+    sg_file_savefunc_t func,
+    void *cxt,
+    struct sg_error **err)
+{
+    struct sg_filesave *sp;
+
+    sp = malloc(sizeof(*sp));
+    if (!sp) {
+        sg_error_nomem(err);
+        return -1;
+    }
+    sp->func = func;
+    sp->cxt = cxt;
+    sp->data = NULL;
+    sp->length = 0;
+    sp->pathlen = 0;
+    sp->path[0] = '\0';
+    return sg_filesave_push(sp, err);
+}
+
+void
+sg_file_savewait(void)
+{
+    struct sg_filesaveglobal *g = &sg_filesaveglobal;
+    sg_lock_acquire(&g->lock);
+    while (g->head || g->busy) {
+        sg_lock_release(&g->lock);
+        sg_evt_wait(&g->idle);
+        sg_lock_acquire(&g->lock);
+    }
+    sg_lock_release(&g->lock);
+}
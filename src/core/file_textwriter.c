@@ -8,7 +8,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define SG_TEXTWRITER_BUFSZ 8192
+#define SG_TEXTWRITER_BUFSZ (64 * 1024)
 
 static int
 sg_textwriter_writeall(
@@ -16,16 +16,10 @@ sg_textwriter_writeall(
     const char *buf,
     const char *end)
 {
-    struct sg_writer *fp = wp->fp;
-    const char *ptr = buf;
-    int r;
-    while (ptr != end) {
-        r = sg_writer_write(fp, ptr, end - ptr, &wp->err);
-        if (r < 0)
-            return -1;
-        ptr += r;
-    }
-    return 0;
+    struct sg_writer_vec vec;
+    vec.ptr = buf;
+    vec.len = end - buf;
+    return sg_writer_writev(wp->fp, &vec, 1, &wp->err);
 }
 
 int
@@ -43,8 +37,8 @@ sg_textwriter_open(
         return -1;
     }
     fp = sg_writer_open(path, pathlen, err);
-    if (!wp->fp) {
-        free(wp->buf);
+    if (!fp) {
+        free(buf);
         return -1;
     }
     wp->fp = fp;
@@ -96,6 +90,7 @@ sg_textwriter_write(
     const char *buf,
     size_t len)
 {
+    struct sg_writer_vec vec[2];
     size_t rem;
     int r;
     if (!wp->fp) {
@@ -120,10 +115,11 @@ sg_textwriter_write(
         wp->ptr = wp->buf + (len - rem);
         return 0;
     } else {
-        r = sg_textwriter_writeall(wp, wp->buf, wp->ptr);
-        if (r)
-            return r;
-        r = sg_textwriter_writeall(wp, buf, buf + len);
+        vec[0].ptr = wp->buf;
+        vec[0].len = wp->ptr - wp->buf;
+        vec[1].ptr = buf;
+        vec[1].len = len;
+        r = sg_writer_writev(wp->fp, vec, 2, &wp->err);
         if (r)
             return r;
         wp->ptr = wp->buf;
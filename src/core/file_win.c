@@ -83,6 +83,30 @@ sg_reader_read(
     return ramt;
 }
 
+int
+sg_writer_rawwritev(
+    struct sg_writer *fp,
+    const struct sg_writer_vec *vec,
+    int count,
+    struct sg_error **err)
+{
+    const char *ptr;
+    size_t rem;
+    int i, r;
+    for (i = 0; i < count; i++) {
+        ptr = vec[i].ptr;
+        rem = vec[i].len;
+        while (rem) {
+            r = sg_writer_rawwrite(fp, ptr, rem, err);
+            if (r < 0)
+                return -1;
+            ptr += r;
+            rem -= r;
+        }
+    }
+    return 0;
+}
+
 void
 sg_reader_close(
     struct sg_reader *fp)
@@ -90,7 +114,38 @@ sg_reader_close(
     CloseHandle(fp->handle);
 }
 
+void *
+sg_reader_map(
+    struct sg_reader *fp,
+    size_t size,
+    struct sg_error **err)
+{
+    HANDLE mapping;
+    void *ptr;
+    mapping = CreateFileMappingW(fp->handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        sg_error_win32(err, GetLastError());
+        return NULL;
+    }
+    ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+    if (!ptr)
+        sg_error_win32(err, GetLastError());
+    /* The view keeps the mapping open.  */
+    CloseHandle(mapping);
+    return ptr;
+}
+
+void
+sg_reader_unmap(
+    void *ptr,
+    size_t size)
+{
+    (void) size;
+    UnmapViewOfFile(ptr);
+}
+
 struct sg_writer {
+    struct sg_writerbuf b;
     HANDLE handle;
     wchar_t *destpath;
     wchar_t *temppath;
@@ -159,6 +214,9 @@ sg_writer_open(
             goto error_win32;
         }
     }
+    fp->b.buf = NULL;
+    fp->b.pos = 0;
+    fp->b.size = 0;
     fp->handle = h;
     return fp;
 
@@ -188,6 +246,8 @@ sg_writer_seek(
         sg_error_invalid(err, __FUNCTION__, "fp");
         return -1;
     }
+    if (sg_writer_flush(fp, err))
+        return -1;
     switch (whence) {
     case SEEK_SET: method = FILE_BEGIN; break;
     case SEEK_CUR: method = FILE_CURRENT; break;
@@ -208,7 +268,7 @@ sg_writer_seek(
 }
 
 int
-sg_writer_write(
+sg_writer_rawwrite(
     struct sg_writer *fp,
     const void *buf,
     size_t amt,
@@ -242,6 +302,8 @@ sg_writer_commit(
         sg_error_invalid(err, __FUNCTION__, "fp");
         return -1;
     }
+    if (sg_writer_flush(fp, err))
+        return -1;
     fp->handle = INVALID_HANDLE_VALUE;
     if (!FlushFileBuffers(h)) {
         CloseHandle(h);
@@ -275,5 +337,6 @@ sg_writer_close(
         CloseHandle(h);
         DeleteFile(fp->temppath);
     }
+    free(fp->b.buf);
     free(fp);
 }
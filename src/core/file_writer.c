@@ -0,0 +1,151 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "file_impl.h"
+#include "sg/error.h"
+#include "sg/file.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Buffered output for sg_writer.  The platform code only performs
+   unbuffered writes.  Small writes are copied into the buffer, and
+   the buffer is written out in full blocks, so a file written in many
+   small pieces is written with a handful of large system calls.  */
+
+/* Write all data through the buffer.  Returns 0 for success, -1 for
+   error.  */
+static int
+sg_writer_bufwrite(
+    struct sg_writer *fp,
+    const char *ptr,
+    size_t amt,
+    struct sg_error **err)
+{
+    struct sg_writerbuf *b = (struct sg_writerbuf *) fp;
+    struct sg_writer_vec vec[2];
+    size_t rem;
+    int r;
+
+    rem = b->size - b->pos;
+    if (amt <= rem) {
+        memcpy(b->buf + b->pos, ptr, amt);
+        b->pos += amt;
+        return 0;
+    }
+
+    if (amt < b->size) {
+        /* Fill the buffer, write it, and keep the remainder.  */
+        memcpy(b->buf + b->pos, ptr, rem);
+        b->pos = b->size;
+        r = sg_writer_flush(fp, err);
+        if (r)
+            return r;
+        memcpy(b->buf, ptr + rem, amt - rem);
+        b->pos = amt - rem;
+        return 0;
+    }
+
+    /* Large writes bypass the buffer, but are combined with the
+       buffered data into a single call.  */
+    vec[0].ptr = b->buf;
+    vec[0].len = b->pos;
+    vec[1].ptr = ptr;
+    vec[1].len = amt;
+    r = sg_writer_rawwritev(fp, vec, 2, err);
+    if (r)
+        return r;
+    b->pos = 0;
+    return 0;
+}
+
+int
+sg_writer_write(
+    struct sg_writer *fp,
+    const void *buf,
+    size_t amt,
+    struct sg_error **err)
+{
+    struct sg_writerbuf *b = (struct sg_writerbuf *) fp;
+    size_t namt;
+    int r;
+    if (!b->buf)
+        return sg_writer_rawwrite(fp, buf, amt, err);
+    namt = amt > INT_MAX ? INT_MAX : amt;
+    r = sg_writer_bufwrite(fp, buf, namt, err);
+    if (r)
+        return -1;
+    return (int) namt;
+}
+
+int
+sg_writer_writev(
+    struct sg_writer *fp,
+    const struct sg_writer_vec *vec,
+    int count,
+    struct sg_error **err)
+{
+    struct sg_writerbuf *b = (struct sg_writerbuf *) fp;
+    int i, r;
+    if (count < 0) {
+        sg_error_invalid(err, __FUNCTION__, "count");
+        return -1;
+    }
+    if (!b->buf)
+        return sg_writer_rawwritev(fp, vec, count, err);
+    for (i = 0; i < count; i++) {
+        r = sg_writer_bufwrite(fp, vec[i].ptr, vec[i].len, err);
+        if (r)
+            return r;
+    }
+    return 0;
+}
+
+int
+sg_writer_setbuffer(
+    struct sg_writer *fp,
+    size_t size,
+    struct sg_error **err)
+{
+    struct sg_writerbuf *b = (struct sg_writerbuf *) fp;
+    char *buf;
+    int r;
+    if (size == b->size)
+        return 0;
+    r = sg_writer_flush(fp, err);
+    if (r)
+        return r;
+    if (!size) {
+        free(b->buf);
+        b->buf = NULL;
+        b->size = 0;
+        return 0;
+    }
+    buf = realloc(b->buf, size);
+    if (!buf) {
+        sg_error_nomem(err);
+        return -1;
+    }
+    b->buf = buf;
+    b->size = size;
+    return 0;
+}
+
+int
+sg_writer_flush(
+    struct sg_writer *fp,
+    struct sg_error **err)
+{
+    struct sg_writerbuf *b = (struct sg_writerbuf *) fp;
+    struct sg_writer_vec vec;
+    int r;
+    if (!b->pos)
+        return 0;
+    vec.ptr = b->buf;
+    vec.len = b->pos;
+    r = sg_writer_rawwritev(fp, &vec, 1, err);
+    if (r)
+        return r;
+    b->pos = 0;
+    return 0;
+}
@@ -0,0 +1,554 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "file_impl.h"
+#include "private.h"
+#include "sg/atomic.h"
+#include "sg/clock.h"
+#include "sg/cvar.h"
+#include "sg/error.h"
+#include "sg/file.h"
+#include "sg/log.h"
+#include "sg/thread.h"
+#include "sg/util.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* File change notification.
+
+   Changes are detected either by the platform's notification backend
+   (sg_filewatch_sys_*), which reports changed relative paths from its
+   own thread through sg_filewatch_notify(), or by polling the identity
+   of each watched file at a fixed interval.  Either way, callbacks are
+   only invoked from sg_filewatch_dispatch(), which runs once per frame
+   on the main thread.  When using notifications, the per-frame cost
+   when nothing has changed is a single atomic load.  */
+
+typedef enum {
+    /* File change notifications are disabled.  */
+    SG_FILEWATCH_OFF,
+    /* Changes are reported by the backend.  */
+    SG_FILEWATCH_NOTIFY,
+    /* Changes are detected by polling.  */
+    SG_FILEWATCH_POLL
+} sg_filewatch_mode_t;
+
+struct sg_filewatch {
+    /* Callback, or NULL if the watch has been removed.  */
+    sg_filewatch_func_t callback;
+    void *cxt;
+    /* Set if the file changed since the last dispatch.  */
+    int changed;
+    /* Search flags and extension list, as for sg_file_load().  */
+    int flags;
+    char *extensions;
+    /* Identity of the file, when polling.  */
+    struct sg_fileid fileid;
+    /* Normalized path, without extension.  */
+    int pathlen;
+    char path[SG_MAX_PATH];
+};
+
+/* A copy of a watch, made while polling.  */
+struct sg_filewatch_pollent {
+    /* Search flags and extension list of the watch.  The extension list
+       is not freed while polling.  */
+    int flags;
+    const char *extensions;
+    /* Offset and length of the path in the copied paths.  */
+    size_t pathoff;
+    int pathlen;
+    /* Identity of the file, and whether it changed.  */
+    struct sg_fileid fileid;
+    int changed;
+};
+
+struct sg_filewatchglobal {
+    sg_filewatch_mode_t mode;
+
+    /* Lock for the watch list and the list of changed paths.  */
+    struct sg_lock lock;
+
+    /* List of all watches.  */
+    struct sg_filewatch *watch;
+    unsigned watchcount;
+    unsigned watchalloc;
+
+    /* Nonzero if watches are being polled or callbacks are being
+       invoked, which means that removed watches must not be compacted
+       yet.  */
+    int dispatching;
+    /* Nonzero if there are removed watches to compact.  */
+    int removed;
+
+    /* Nonzero if there are changes which have not been dispatched.  */
+    sg_atomic_t pending;
+    /* Changed paths, each terminated with NUL.  */
+    char *changed;
+    size_t changedlen;
+    size_t changedalloc;
+    /* Set if every watch should be considered changed, for example,
+       if the backend dropped events.  */
+    int changedall;
+
+    /* Time of the next poll.  */
+    double polltime;
+    /* Copy of the watch list, used while polling without the lock
+       held, and the paths of the copied watches.  */
+    struct sg_filewatch_pollent *poll;
+    unsigned pollalloc;
+    char *pollpath;
+    size_t pollpathalloc;
+
+    struct sg_cvar_bool enable;
+    struct sg_cvar_float interval;
+};
+
+static struct sg_filewatchglobal sg_filewatchglobal;
+
+void
+sg_filewatch_init(void)
+{
+    struct sg_filewatchglobal *g = &sg_filewatchglobal;
+#if defined SG_FILEWATCH_SYS
+    struct sg_error *err = NULL;
+    int r;
+#endif
+
+    sg_lock_init(&g->lock);
+    sg_cvar_defbool(
+        "file", "watch", "Reload files when they change",
+        &g->enable, 1, SG_CVAR_INITONLY | SG_CVAR_PERSISTENT);
+    sg_cvar_deffloat(
+        "file", "pollinterval",
+        "Seconds between checks for changed files, if polling",
+        &g->interval, 1.0, 0.1, 60.0, SG_CVAR_PERSISTENT);
+
+    if (!g->enable.value) {
+        g->mode = SG_FILEWATCH_OFF;
+        return;
+    }
+
+#if defined SG_FILEWATCH_SYS
+    r = sg_filewatch_sys_init(&err);
+    if (!r) {
+        g->mode = SG_FILEWATCH_NOTIFY;
+        return;
+    }
+    sg_logerrs(SG_LOG_WARN, err,
+               "File change notifications are unavailable; "
+               "polling for changes instead.");
+    sg_error_clear(&err);
+#endif
+
+    g->mode = SG_FILEWATCH_POLL;
+}
+
+/* Get the directory part of a normalized path, including the
+   trailing slash.  */
+static int
+sg_filewatch_dirlen(const char *path, int pathlen)
+{
+    int i;
+    for (i = pathlen; i > 0; i--)
+        if (path[i - 1] == '/')
+            break;
+    return i;
+}
+
+static void
+sg_filewatch_getid(struct sg_fileid *fileid, const char *path, int pathlen,
+                   int flags, const char *extensions)
+{
+    int r;
+    r = sg_file_getid(fileid, path, pathlen, flags, extensions, NULL);
+    if (r)
+        memset(fileid, 0, sizeof(*fileid));
+}
+
+int
+sg_filewatch_add(
+    const char *path,
+    size_t pathlen,
+    int flags,
+    const char *extensions,
+    sg_filewatch_func_t callback,
+    void *cxt,
+    struct sg_error **err)
+{
+    struct sg_filewatchglobal *g = &sg_filewatchglobal;
+    struct sg_filewatch *wp, *nwatch;
+    char *ext = NULL;
+    unsigned nalloc;
+    int r;
+
+    if (!callback) {
+        sg_error_invalid(err, __FUNCTION__, "callback");
+        return -1;
+    }
+    if ((flags & ~(SG_USERONLY | SG_DATAONLY)) ||
+        (flags & SG_USERONLY && flags & SG_DATAONLY)) {
+        sg_error_invalid(err, __FUNCTION__, "flags");
+        return -1;
+    }
+    if (g->mode == SG_FILEWATCH_OFF)
+        return 0;
+
+    if (extensions) {
+        size_t len = strlen(extensions);
+        ext = malloc(len + 1);
+        if (!ext)
+            goto nomem;
+        memcpy(ext, extensions, len + 1);
+    }
+
+    sg_lock_acquire(&g->lock);
+    if (g->watchcount >= g->watchalloc) {
+        nalloc = sg_round_up_pow2_32(g->watchcount + 1);
+        if (!nalloc)
+            goto nomem_locked;
+        nwatch = realloc(g->watch, nalloc * sizeof(*nwatch));
+        if (!nwatch)
+            goto nomem_locked;
+        g->watch = nwatch;
+        g->watchalloc = nalloc;
+    }
+    wp = &g->watch[g->watchcount];
+    r = sg_path_norm(wp->path, path, pathlen, err);
+    if (r < 0) {
+        sg_lock_release(&g->lock);
+        free(ext);
+        return -1;
+    }
+    wp->pathlen = r;
+    wp->callback = callback;
+    wp->cxt = cxt;
+    wp->changed = 0;
+    wp->flags = flags;
+    wp->extensions = ext;
+    memset(&wp->fileid, 0, sizeof(wp->fileid));
+
+    switch (g->mode) {
+    case SG_FILEWATCH_OFF:
+        break;
+
+    case SG_FILEWATCH_NOTIFY:
+#if defined SG_FILEWATCH_SYS
+        r = sg_filewatch_sys_adddir(
+            wp->path, sg_filewatch_dirlen(wp->path, wp->pathlen),
+            flags, err);
+        if (r) {
+            sg_lock_release(&g->lock);
+            free(ext);
+            return -1;
+        }
+#endif
+        break;
+
+    case SG_FILEWATCH_POLL:
+        sg_filewatch_getid(&wp->fileid, wp->path, wp->pathlen,
+                           wp->flags, wp->extensions);
+        break;
+    }
+
+    g->watchcount++;
+    sg_lock_release(&g->lock);
+    return 0;
+
+nomem_locked:
+    sg_lock_release(&g->lock);
+nomem:
+    free(ext);
+    sg_error_nomem(err);
+    return -1;
+}
+
+/* Remove deleted watches from the list.  Lock must be held.  */
+static void
+sg_filewatch_compact(struct sg_filewatchglobal *g)
+{
+    struct sg_filewatch *wp = g->watch, *we = wp + g->watchcount, *wo;
+    for (wo = wp; wp != we; wp++) {
+        if (wp->callback) {
+            if (wo != wp)
+                *wo = *wp;
+            wo++;
+        } else {
+            free(wp->extensions);
+        }
+    }
+    g->watchcount = (unsigned) (wo - g->watch);
+    g->removed = 0;
+}
+
+void
+sg_filewatch_remove(
+    sg_filewatch_func_t callback,
+    void *cxt)
+{
+    struct sg_filewatchglobal *g = &sg_filewatchglobal;
+    struct sg_filewatch *wp, *we;
+
+    if (g->mode == SG_FILEWATCH_OFF)
+        return;
+
+    sg_lock_acquire(&g->lock);
+    wp = g->watch;
+    we = wp + g->watchcount;
+    for (; wp != we; wp++) {
+        if (wp->callback == callback && wp->cxt == cxt) {
+            wp->callback = NULL;
+            g->removed = 1;
+        }
+    }
+    if (g->removed && !g->dispatching)
+        sg_filewatch_compact(g);
+    sg_lock_release(&g->lock);
+}
+
+void
+sg_filewatch_notify(const char *path, size_t pathlen)
+{
+    struct sg_filewatchglobal *g = &sg_filewatchglobal;
+    const char *p, *e;
+    size_t nalloc;
+    char *nbuf;
+
+    sg_lock_acquire(&g->lock);
+    if (!path) {
+        g->changedall = 1;
+    } else if (!g->changedall) {
+        p = g->changed;
+        e = p + g->changedlen;
+        while (p != e) {
+            if (strlen(p) == pathlen && !memcmp(p, path, pathlen))
+                goto done;
+            p += strlen(p) + 1;
+        }
+        if (pathlen + 1 > g->changedalloc - g->changedlen) {
+            nalloc = g->changedalloc ? g->changedalloc : 256;
+            while (pathlen + 1 > nalloc - g->changedlen)
+                nalloc *= 2;
+            nbuf = realloc(g->changed, nalloc);
+            if (!nbuf) {
+                g->changedall = 1;
+                goto done;
+            }
+            g->changed = nbuf;
+            g->changedalloc = nalloc;
+        }
+        memcpy(g->changed + g->changedlen, path, pathlen);
+        g->changed[g->changedlen + pathlen] = '\0';
+        g->changedlen += pathlen + 1;
+    }
+done:
+    sg_atomic_set_release(&g->pending, 1);
+    sg_lock_release(&g->lock);
+}
+
+/* Test whether a changed file matches a watch.  */
+static int
+sg_filewatch_match(
+    const struct sg_filewatch *wp,
+    const char *path,
+    size_t pathlen)
+{
+    const char *ext, *extp, *extsep;
+    size_t n = wp->pathlen, extlen;
+
+    if (!wp->extensions)
+        return pathlen == n && !memcmp(path, wp->path, n);
+    if (pathlen < n + 2 || path[n] != '.' || memcmp(path, wp->path, n))
+        return 0;
+    path += n + 1;
+    pathlen -= n + 1;
+    extp = wp->extensions;
+    while (extp) {
+        ext = extp;
+        extsep = strchr(extp, ':');
+        if (!extsep) {
+            extp = NULL;
+            extlen = strlen(ext);
+        } else {
+            extp = extsep + 1;
+            extlen = extsep - ext;
+        }
+        if (extlen == pathlen && !memcmp(ext, path, extlen))
+            return 1;
+    }
+    return 0;
+}
+
+/* Mark watches which match the list of changed paths.  Lock must be
+   held.  */
+static void
+sg_filewatch_markchanged(struct sg_filewatchglobal *g)
+{
+    struct sg_filewatch *wp, *we;
+    const char *p, *e;
+    size_t len;
+
+    wp = g->watch;
+    we = wp + g->watchcount;
+    if (g->changedall) {
+        for (; wp != we; wp++)
+            wp->changed = 1;
+    } else {
+        p = g->changed;
+        e = p + g->changedlen;
+        for (; p != e; p += len + 1) {
+            len = strlen(p);
+            for (wp = g->watch; wp != we; wp++)
+                if (wp->callback && sg_filewatch_match(wp, p, len))
+                    wp->changed = 1;
+        }
+    }
+    g->changedlen = 0;
+    g->changedall = 0;
+}
+
+/* Copy the watch list for polling.  Returns the number of watches
+   copied.  Lock must be held.  */
+static unsigned
+sg_filewatch_pollcopy(struct sg_filewatchglobal *g)
+{
+    struct sg_filewatch *wp;
+    struct sg_filewatch_pollent *pp;
+    unsigned i, n = g->watchcount, nalloc;
+    size_t pathsize, palloc;
+    char *npath;
+
+    if (n > g->pollalloc) {
+        nalloc = sg_round_up_pow2_32(n);
+        if (!nalloc)
+            return 0;
+        pp = realloc(g->poll, nalloc * sizeof(*pp));
+        if (!pp)
+            return 0;
+        g->poll = pp;
+        g->pollalloc = nalloc;
+    }
+    pathsize = 0;
+    for (i = 0; i < n; i++)
+        pathsize += g->watch[i].pathlen;
+    if (pathsize > g->pollpathalloc) {
+        palloc = g->pollpathalloc ? g->pollpathalloc : 1024;
+        while (palloc < pathsize)
+            palloc *= 2;
+        npath = realloc(g->pollpath, palloc);
+        if (!npath)
+            return 0;
+        g->pollpath = npath;
+        g->pollpathalloc = palloc;
+    }
+
+    pathsize = 0;
+    for (i = 0; i < n; i++) {
+        wp = &g->watch[i];
+        pp = &g->poll[i];
+        pp->flags = wp->flags;
+        pp->extensions = wp->extensions;
+        pp->pathoff = pathsize;
+        pp->pathlen = wp->callback ? wp->pathlen : -1;
+        pp->fileid = wp->fileid;
+        pp->changed = 0;
+        memcpy(g->pollpath + pathsize, wp->path, wp->pathlen);
+        pathsize += wp->pathlen;
+    }
+    return n;
+}
+
+/* Poll all watches for changes.  Opening each file can be slow, so the
+   watches are copied and the lock is released while polling.  Lock
+   must be held, and is held again on return.  */
+static void
+sg_filewatch_poll(struct sg_filewatchglobal *g)
+{
+    struct sg_filewatch *wp;
+    struct sg_filewatch_pollent *pp;
+    struct sg_fileid fileid;
+    unsigned i, n;
+
+    n = sg_filewatch_pollcopy(g);
+    if (!n)
+        return;
+
+    /* Watches are not compacted while dispatching, and new watches
+       are added at the end, so the first n watches stay in place.  */
+    g->dispatching = 1;
+    sg_lock_release(&g->lock);
+    for (i = 0; i < n; i++) {
+        pp = &g->poll[i];
+        if (pp->pathlen < 0)
+            continue;
+        sg_filewatch_getid(&fileid, g->pollpath + pp->pathoff,
+                           pp->pathlen, pp->flags, pp->extensions);
+        if (memcmp(&fileid, &pp->fileid, sizeof(fileid))) {
+            pp->fileid = fileid;
+            pp->changed = 1;
+        }
+    }
+    sg_lock_acquire(&g->lock);
+    g->dispatching = 0;
+
+    for (i = 0; i < n; i++) {
+        wp = &g->watch[i];
+        pp = &g->poll[i];
+        if (pp->changed && wp->callback) {
+            wp->fileid = pp->fileid;
+            wp->changed = 1;
+        }
+    }
+}
+
+void
+sg_filewatch_dispatch(void)
+{
+    struct sg_filewatchglobal *g = &sg_filewatchglobal;
+    struct sg_filewatch *wp;
+    sg_filewatch_func_t callback;
+    void *cxt;
+    double now;
+    unsigned i;
+
+    switch (g->mode) {
+    case SG_FILEWATCH_OFF:
+        return;
+
+    case SG_FILEWATCH_NOTIFY:
+        if (!sg_atomic_get_acquire(&g->pending))
+            return;
+        sg_lock_acquire(&g->lock);
+        sg_atomic_set(&g->pending, 0);
+        sg_filewatch_markchanged(g);
+        break;
+
+    case SG_FILEWATCH_POLL:
+        now = sg_clock_get();
+        if (now < g->polltime)
+            return;
+        g->polltime = now + g->interval.value;
+        sg_lock_acquire(&g->lock);
+        sg_filewatch_poll(g);
+        break;
+    }
+
+    /* Callbacks may add or remove watches, so the lock is released
+       while each callback runs.  */
+    g->dispatching = 1;
+    for (i = 0; i < g->watchcount; i++) {
+        wp = &g->watch[i];
+        if (!wp->changed || !wp->callback)
+            continue;
+        wp->changed = 0;
+        callback = wp->callback;
+        cxt = wp->cxt;
+        sg_lock_release(&g->lock);
+        callback(cxt);
+        sg_lock_acquire(&g->lock);
+    }
+    g->dispatching = 0;
+    if (g->removed)
+        sg_filewatch_compact(g);
+    sg_lock_release(&g->lock);
+}
@@ -0,0 +1,222 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "file_impl.h"
+#include "sg/error.h"
+#include "sg/file.h"
+#include "sg/log.h"
+#include "sg/thread.h"
+#include "sg/util.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/* Events which indicate that a file should be reloaded.  Files are
+   normally replaced by renaming a temporary file over them, which
+   shows up as IN_MOVED_TO.  */
+#define SG_FILEWATCH_MASK \
+    (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE)
+
+/* A watched directory in one of the search paths.  */
+struct sg_filewatch_dir {
+    /* The inotify watch descriptor.  */
+    int wd;
+    /* Index of the search path.  */
+    unsigned root;
+    /* Normalized relative path, either empty or ending with '/'.  */
+    int pathlen;
+    char path[SG_MAX_PATH];
+};
+
+struct sg_filewatch_inotify {
+    int fdes;
+
+    /* Lock for the directory list.  */
+    struct sg_lock lock;
+    struct sg_filewatch_dir *dir;
+    unsigned dircount;
+    unsigned diralloc;
+};
+
+static struct sg_filewatch_inotify sg_filewatch_inotify;
+
+static void
+sg_filewatch_thread(void *arg)
+{
+    struct sg_filewatch_inotify *g = arg;
+    union {
+        struct inotify_event ev;
+        char buf[4096];
+    } u;
+    const struct inotify_event *ev;
+    struct sg_filewatch_dir *dp, *de;
+    char path[SG_MAX_PATH];
+    size_t pathlen = 0, namelen;
+    ssize_t amt;
+    char *p, *e;
+    struct sg_error *err = NULL;
+    int found;
+
+    while (1) {
+        amt = read(g->fdes, u.buf, sizeof(u.buf));
+        if (amt < 0) {
+            if (errno == EINTR)
+                continue;
+            sg_error_errno(&err, errno);
+            sg_logerrs(SG_LOG_ERROR, err,
+                       "Could not read file change notifications.");
+            sg_error_clear(&err);
+            break;
+        }
+
+        p = u.buf;
+        e = p + amt;
+        while (p < e) {
+            ev = (const struct inotify_event *) p;
+            p += sizeof(*ev) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                sg_filewatch_notify(NULL, 0);
+                continue;
+            }
+
+            found = 0;
+            sg_lock_acquire(&g->lock);
+            dp = g->dir;
+            de = dp + g->dircount;
+            for (; dp != de; dp++) {
+                if (dp->wd == ev->wd)
+                    break;
+            }
+            if (dp != de) {
+                if (ev->mask & IN_IGNORED) {
+                    /* The directory was deleted or unmounted.  */
+                    g->dircount--;
+                    if (dp != de - 1)
+                        *dp = *(de - 1);
+                } else if (ev->len) {
+                    namelen = strlen(ev->name);
+                    if (dp->pathlen + namelen < SG_MAX_PATH) {
+                        memcpy(path, dp->path, dp->pathlen);
+                        memcpy(path + dp->pathlen, ev->name, namelen);
+                        pathlen = dp->pathlen + namelen;
+                        found = 1;
+                    }
+                }
+            }
+            sg_lock_release(&g->lock);
+
+            if (found)
+                sg_filewatch_notify(path, pathlen);
+        }
+    }
+}
+
+int
+sg_filewatch_sys_init(struct sg_error **err)
+{
+    struct sg_filewatch_inotify *g = &sg_filewatch_inotify;
+
+    g->fdes = inotify_init1(IN_CLOEXEC);
+    if (g->fdes < 0) {
+        sg_error_errno(err, errno);
+        return -1;
+    }
+    sg_lock_init(&g->lock);
+
+    if (sg_thread_start(sg_filewatch_thread, g)) {
+        sg_error_sets(err, &SG_ERROR_GENERIC, 0,
+                      "could not start file watch thread");
+        sg_lock_destroy(&g->lock);
+        close(g->fdes);
+        g->fdes = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+sg_filewatch_sys_adddir(
+    const char *path,
+    size_t pathlen,
+    int flags,
+    struct sg_error **err)
+{
+    struct sg_filewatch_inotify *g = &sg_filewatch_inotify;
+    struct sg_filewatch_dir *dp, *de, *ndir;
+    struct sg_path *search;
+    unsigned searchcount, nalloc, i, root;
+    char *pbuf;
+    int wd, e;
+
+    search = sg_paths.path;
+    searchcount = sg_paths.pathcount;
+    root = 0;
+    if (flags & SG_USERONLY) {
+        searchcount = searchcount > 0;
+    } else if (flags & SG_DATAONLY && searchcount > 0) {
+        search++;
+        searchcount--;
+        root++;
+    }
+
+    pbuf = malloc(sg_paths.maxlen + pathlen + 1);
+    if (!pbuf) {
+        sg_error_nomem(err);
+        return -1;
+    }
+
+    sg_lock_acquire(&g->lock);
+    for (i = 0; i < searchcount; i++, root++) {
+        dp = g->dir;
+        de = dp + g->dircount;
+        for (; dp != de; dp++) {
+            if (dp->root == root && (size_t) dp->pathlen == pathlen &&
+                !memcmp(dp->path, path, pathlen))
+                break;
+        }
+        if (dp != de)
+            continue;
+
+        memcpy(pbuf, search[i].path, search[i].len);
+        memcpy(pbuf + search[i].len, path, pathlen);
+        pbuf[search[i].len + pathlen] = '\0';
+        wd = inotify_add_watch(g->fdes, pbuf, SG_FILEWATCH_MASK);
+        if (wd < 0) {
+            e = errno;
+            if (e == ENOENT || e == ENOTDIR || e == EACCES)
+                continue;
+            sg_error_errno(err, e);
+            goto error;
+        }
+
+        if (g->dircount >= g->diralloc) {
+            nalloc = sg_round_up_pow2_32(g->dircount + 1);
+            if (!nalloc)
+                goto nomem;
+            ndir = realloc(g->dir, nalloc * sizeof(*ndir));
+            if (!ndir)
+                goto nomem;
+            g->dir = ndir;
+            g->diralloc = nalloc;
+        }
+        dp = &g->dir[g->dircount++];
+        dp->wd = wd;
+        dp->root = root;
+        dp->pathlen = (int) pathlen;
+        memcpy(dp->path, path, pathlen);
+    }
+    sg_lock_release(&g->lock);
+    free(pbuf);
+    return 0;
+
+nomem:
+    sg_error_nomem(err);
+error:
+    sg_lock_release(&g->lock);
+    free(pbuf);
+    return -1;
+}
@@ -418,6 +418,7 @@ main(int argc, char *argv[])
 {
     sg_gtk_init(argc, argv);
     gtk_main();
+    sg_sys_destroy();
     return 0;
 }
 
@@ -83,6 +83,11 @@ sg_version_platform(struct sg_logger *sp)
     [d showWindow:self];
 }
 
+- (void)applicationWillTerminate:(NSNotification *)notification {
+    (void)notification;
+    sg_sys_destroy();
+}
+
 - (BOOL)applicationShouldTerminateAfterLastWindowClosed:(NSApplication *)theApplication {
     (void)theApplication;
     return !displays_ || ![displays_ count];
@@ -3,51 +3,793 @@
    2-clause BSD license.  For more information, see LICENSE.txt. */
 #include "sg/error.h"
 #include "sg/pack.h"
-#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
 /*
   Rectangle packing
 
-  We use a simple algorithm which is not terribly inefficient and not
-  terribly slow.
+  Skyline packing tracks the top edge of the packed rectangles as a
+  list of horizontal segments, sorted by X coordinate.  Each rectangle
+  is placed on top of the skyline at the left edge of a segment.  The
+  space above the skyline is free.  Space beneath the skyline is only
+  reused when rectangles are removed: if nothing was placed above the
+  removed rectangle, the skyline is lowered, otherwise the rectangle
+  goes on a list of free rectangles which are tried before the
+  skyline.
 
-  For any enclosing size, try to pack the rectangles inside the
-  enclosing rectangle, with the widest packing rectangle first.  Try
-  to place each rectangle below the previous, or at the top if there
-  is no space remaining below the previous rectangle.  Rectangles get
-  placed at the leftmost available position once the vertical position
-  is selected, although the available horizontal positions (tracked in
-  the "frontier" array) are not tracked precisely.
+  MaxRects packing tracks a list of free rectangles, which may
+  overlap.  Each free rectangle is maximal, that is, not contained in
+  any larger free rectangle.  Placing a rectangle splits each free
+  rectangle it overlaps into up to four maximal pieces.  Removed
+  rectangles are added to the free list, but are not merged with
+  adjacent free space.
+
+  Batch packing sorts the rectangles by height and packs them with
+  several different widths, keeping the packing with the smallest
+  area.
 */
 
+/* A segment of the skyline.  */
+struct sg_pack_node {
+    unsigned x, y, w;
+};
+
+/* A free rectangle.  */
+struct sg_pack_free {
+    unsigned x, y, w, h;
+};
+
+struct sg_packer {
+    enum sg_pack_method method;
+    unsigned width, height;
+    unsigned extentw, extenth;
+    /* Free rectangles smaller than this are discarded.  */
+    unsigned minw, minh;
+    /* Skyline segments.  */
+    struct sg_pack_node *node;
+    unsigned nodecount, nodealloc;
+    /* Free rectangles.  */
+    struct sg_pack_free *free;
+    unsigned freecount, freealloc;
+    /* New free rectangles, while splitting.  */
+    struct sg_pack_free *split;
+    unsigned splitcount, splitalloc;
+    /* Free rectangles touching the split rectangle.  */
+    unsigned *near;
+    unsigned nearalloc;
+};
+
+/* Make room for at least count elements in an array.  */
+static int
+sg_pack_reserve(void **ptr, unsigned *alloc, unsigned count, size_t size)
+{
+    unsigned nalloc;
+    void *narr;
+    if (count <= *alloc)
+        return 0;
+    nalloc = *alloc ? *alloc : 16;
+    while (nalloc < count) {
+        if (nalloc > (unsigned) -1 / 2)
+            return -1;
+        nalloc *= 2;
+    }
+    if ((size_t) nalloc > (size_t) -1 / size)
+        return -1;
+    narr = realloc(*ptr, nalloc * size);
+    if (!narr)
+        return -1;
+    *ptr = narr;
+    *alloc = nalloc;
+    return 0;
+}
+
+static int
+sg_pack_isskyline(enum sg_pack_method method)
+{
+    return method == SG_PACK_SKYLINE_BOTTOMLEFT ||
+        method == SG_PACK_SKYLINE_MINWASTE;
+}
+
+/* Test whether the first rectangle is contained in the second.  */
+static int
+sg_pack_contains(const struct sg_pack_free *a, const struct sg_pack_free *b)
+{
+    return a->x >= b->x && a->y >= b->y &&
+        a->x + a->w <= b->x + b->w && a->y + a->h <= b->y + b->h;
+}
+
+/* Add a rectangle to the free list.  */
+static int
+sg_pack_addfree(struct sg_packer *pk, unsigned x, unsigned y,
+                unsigned w, unsigned h)
+{
+    struct sg_pack_free *f;
+    if (sg_pack_reserve((void **) &pk->free, &pk->freealloc,
+                        pk->freecount + 1, sizeof(*pk->free)))
+        return -1;
+    f = &pk->free[pk->freecount++];
+    f->x = x;
+    f->y = y;
+    f->w = w;
+    f->h = h;
+    return 0;
+}
+
+/* Remove free rectangles contained in other free rectangles.  */
+static void
+sg_pack_prune(struct sg_packer *pk)
+{
+    struct sg_pack_free *f = pk->free;
+    unsigned i, j, n = pk->freecount;
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < n; j++) {
+            if (i != j && sg_pack_contains(&f[i], &f[j])) {
+                f[i] = f[--n];
+                i--;
+                break;
+            }
+        }
+    }
+    pk->freecount = n;
+}
+
+/* Reset the packer to an empty area.  Does not allocate memory.  */
+static void
+sg_packer_reset(struct sg_packer *pk, unsigned width, unsigned height)
+{
+    pk->width = width;
+    pk->height = height;
+    pk->extentw = 0;
+    pk->extenth = 0;
+    pk->freecount = 0;
+    pk->nodecount = 0;
+    if (!width || !height)
+        return;
+    if (sg_pack_isskyline(pk->method)) {
+        pk->node[0].x = 0;
+        pk->node[0].y = 0;
+        pk->node[0].w = width;
+        pk->nodecount = 1;
+    } else {
+        pk->free[0].x = 0;
+        pk->free[0].y = 0;
+        pk->free[0].w = width;
+        pk->free[0].h = height;
+        pk->freecount = 1;
+    }
+}
+
+struct sg_packer *
+sg_packer_new(enum sg_pack_method method, unsigned width, unsigned height,
+              struct sg_error **err)
+{
+    struct sg_packer *pk;
+    if (method > SG_PACK_MAXRECTS_AREA) {
+        sg_error_invalid(err, __FUNCTION__, "method");
+        return NULL;
+    }
+    if (width > 0xffff || height > 0xffff) {
+        sg_error_invalid(err, __FUNCTION__, "size");
+        return NULL;
+    }
+    pk = malloc(sizeof(*pk));
+    if (!pk)
+        goto nomem;
+    pk->method = method;
+    pk->minw = 1;
+    pk->minh = 1;
+    pk->node = NULL;
+    pk->nodecount = 0;
+    pk->nodealloc = 0;
+    pk->free = NULL;
+    pk->freecount = 0;
+    pk->freealloc = 0;
+    pk->split = NULL;
+    pk->splitcount = 0;
+    pk->splitalloc = 0;
+    pk->near = NULL;
+    pk->nearalloc = 0;
+    if (sg_pack_reserve((void **) &pk->node, &pk->nodealloc,
+                        1, sizeof(*pk->node)) ||
+        sg_pack_reserve((void **) &pk->free, &pk->freealloc,
+                        1, sizeof(*pk->free))) {
+        sg_packer_free(pk);
+        goto nomem;
+    }
+    sg_packer_reset(pk, width, height);
+    return pk;
+
+nomem:
+    sg_error_nomem(err);
+    return NULL;
+}
+
+void
+sg_packer_free(struct sg_packer *pk)
+{
+    free(pk->node);
+    free(pk->free);
+    free(pk->split);
+    free(pk->near);
+    free(pk);
+}
+
+void
+sg_packer_clear(struct sg_packer *pk)
+{
+    sg_packer_reset(pk, pk->width, pk->height);
+}
+
+void
+sg_packer_setminsize(struct sg_packer *pk, unsigned width, unsigned height)
+{
+    pk->minw = width ? width : 1;
+    pk->minh = height ? height : 1;
+}
+
+int
+sg_packer_grow(struct sg_packer *pk, unsigned width, unsigned height,
+               struct sg_error **err)
+{
+    struct sg_pack_node *n;
+    struct sg_pack_free *f;
+    unsigned i, oldw = pk->width, oldh = pk->height;
+
+    if (width < oldw || height < oldh || width > 0xffff || height > 0xffff) {
+        sg_error_invalid(err, __FUNCTION__, "size");
+        return -1;
+    }
+    if (!oldw || !oldh) {
+        sg_packer_reset(pk, width, height);
+        return 0;
+    }
+    pk->width = width;
+    pk->height = height;
+
+    if (sg_pack_isskyline(pk->method)) {
+        if (width == oldw)
+            return 0;
+        n = &pk->node[pk->nodecount - 1];
+        if (!n->y) {
+            n->w += width - oldw;
+            return 0;
+        }
+        if (sg_pack_reserve((void **) &pk->node, &pk->nodealloc,
+                            pk->nodecount + 1, sizeof(*pk->node)))
+            goto nomem;
+        n = &pk->node[pk->nodecount++];
+        n->x = oldw;
+        n->y = 0;
+        n->w = width - oldw;
+        return 0;
+    }
+
+    /* Free rectangles on the old edges extend into the new area.  */
+    for (i = 0; i < pk->freecount; i++) {
+        f = &pk->free[i];
+        if (f->x + f->w == oldw)
+            f->w = width - f->x;
+        if (f->y + f->h == oldh)
+            f->h = height - f->y;
+    }
+    if (width > oldw && sg_pack_addfree(pk, oldw, 0, width - oldw, height))
+        goto nomem;
+    if (height > oldh && sg_pack_addfree(pk, 0, oldh, width, height - oldh))
+        goto nomem;
+    sg_pack_prune(pk);
+    return 0;
+
+nomem:
+    sg_error_nomem(err);
+    return -1;
+}
+
+/* Find the smallest free rectangle which fits, and take the rectangle
+   from its lower left corner.  Used by the skyline packer, which only
+   has free rectangles after removing rectangles.  There must be room
+   for one more free rectangle.  */
+static int
+sg_packer_insertfree(struct sg_packer *pk, struct sg_pack_rect *rect)
+{
+    struct sg_pack_free *f, *e;
+    unsigned i, w = rect->w, h = rect->h, area, best = 0, besti = 0;
+    unsigned x, y, rw, rh;
+    int found = 0;
+    for (i = 0; i < pk->freecount; i++) {
+        f = &pk->free[i];
+        if (f->w < w || f->h < h)
+            continue;
+        area = f->w * f->h;
+        if (!found || area < best) {
+            best = area;
+            besti = i;
+            found = 1;
+        }
+    }
+    if (!found)
+        return 0;
+    f = &pk->free[besti];
+    x = f->x;
+    y = f->y;
+    rw = f->w - w;
+    rh = f->h - h;
+    rect->x = (unsigned short) x;
+    rect->y = (unsigned short) y;
+    /* Split along the shorter leftover side, so the larger piece gets
+       the full width or height.  */
+    e = &pk->free[pk->freecount];
+    if (rw < rh) {
+        f->y = y + h;
+        f->h = rh;
+        e->x = x + w;
+        e->y = y;
+        e->w = rw;
+        e->h = h;
+    } else {
+        f->x = x + w;
+        f->w = rw;
+        e->x = x;
+        e->y = y + h;
+        e->w = w;
+        e->h = rh;
+    }
+    if (e->w >= pk->minw && e->h >= pk->minh)
+        pk->freecount++;
+    if (f->w < pk->minw || f->h < pk->minh)
+        *f = pk->free[--pk->freecount];
+    return 1;
+}
+
+static int
+sg_packer_insertskyline(struct sg_packer *pk, struct sg_pack_rect *rect)
+{
+    struct sg_pack_node *node = pk->node;
+    unsigned i, j, n = pk->nodecount, w = rect->w, h = rect->h;
+    unsigned x, y, left, seg, top, waste, end, ext;
+    unsigned best0 = 0, best1 = 0, best2 = 0, besti = 0, besty = 0;
+    int minwaste = pk->method == SG_PACK_SKYLINE_MINWASTE, found = 0;
+
+    if (sg_pack_reserve((void **) &pk->node, &pk->nodealloc,
+                        n + 1, sizeof(*pk->node)))
+        return -1;
+    node = pk->node;
+    for (i = 0; i < n; i++) {
+        x = node[i].x;
+        if (w > pk->width - x)
+            break;
+        /* Find the lowest position for the rectangle here.  */
+        y = 0;
+        for (j = i, left = w; ; j++) {
+            if (y < node[j].y)
+                y = node[j].y;
+            if (node[j].w >= left)
+                break;
+            left -= node[j].w;
+        }
+        if (h > pk->height - y)
+            continue;
+        top = y + h;
+        if (minwaste) {
+            /* Prefer not to increase the height of the packing, so
+               rectangles do not stack up in towers.  */
+            ext = top > pk->extenth ? top : pk->extenth;
+            waste = 0;
+            for (j = i, left = w; ; j++) {
+                seg = node[j].w < left ? node[j].w : left;
+                waste += (y - node[j].y) * seg;
+                if (seg == left)
+                    break;
+                left -= seg;
+            }
+            if (!found || ext < best0 || (ext == best0 &&
+                (waste < best1 || (waste == best1 && top < best2)))) {
+                best0 = ext;
+                best1 = waste;
+                best2 = top;
+                besti = i;
+                besty = y;
+                found = 1;
+            }
+        } else {
+            if (!found || top < best1 ||
+                (top == best1 && node[i].w < best2)) {
+                best1 = top;
+                best2 = node[i].w;
+                besti = i;
+                besty = y;
+                found = 1;
+            }
+        }
+    }
+    if (!found)
+        return 0;
+
+    x = node[besti].x;
+    end = x + w;
+    rect->x = (unsigned short) x;
+    rect->y = (unsigned short) besty;
+
+    /* Trim or remove the segments under the rectangle, then insert a
+       segment for the top of the rectangle.  */
+    for (j = besti; j < n && node[j].x + node[j].w <= end; j++) { }
+    if (j < n && node[j].x < end) {
+        node[j].w -= end - node[j].x;
+        node[j].x = end;
+    }
+    /* Segments besti..j-1 are covered, replace them with one.  */
+    if (j == besti) {
+        memmove(node + besti + 1, node + besti, sizeof(*node) * (n - besti));
+        n++;
+    } else if (j > besti + 1) {
+        memmove(node + besti + 1, node + j, sizeof(*node) * (n - j));
+        n -= j - besti - 1;
+    }
+    node[besti].x = x;
+    node[besti].y = besty + h;
+    node[besti].w = w;
+    /* Merge with neighbors at the same height.  */
+    i = besti;
+    if (i + 1 < n && node[i + 1].y == node[i].y) {
+        node[i].w += node[i + 1].w;
+        memmove(node + i + 1, node + i + 2, sizeof(*node) * (n - i - 2));
+        n--;
+    }
+    if (i > 0 && node[i - 1].y == node[i].y) {
+        node[i - 1].w += node[i].w;
+        memmove(node + i, node + i + 1, sizeof(*node) * (n - i - 1));
+        n--;
+    }
+    pk->nodecount = n;
+    return 1;
+}
+
+/* Split the free rectangles overlapping the placed rectangle.  */
+static int
+sg_packer_split(struct sg_packer *pk, const struct sg_pack_free *r)
+{
+    struct sg_pack_free *f = pk->free, *s, p;
+    unsigned i, j, n = pk->freecount, ns, m, nn;
+    unsigned *near;
+
+    pk->splitcount = 0;
+    nn = 0;
+    for (i = 0, m = 0; i < n; i++) {
+        p = f[i];
+        if (r->x > p.x + p.w || p.x > r->x + r->w ||
+            r->y > p.y + p.h || p.y > r->y + r->h) {
+            f[m++] = p;
+            continue;
+        }
+        if (r->x == p.x + p.w || p.x == r->x + r->w ||
+            r->y == p.y + p.h || p.y == r->y + r->h) {
+            /* Touching, but not overlapping.  */
+            if (sg_pack_reserve((void **) &pk->near, &pk->nearalloc,
+                                nn + 1, sizeof(*pk->near)))
+                return -1;
+            pk->near[nn++] = m;
+            f[m++] = p;
+            continue;
+        }
+        if (sg_pack_reserve((void **) &pk->split, &pk->splitalloc,
+                            pk->splitcount + 4, sizeof(*pk->split)))
+            return -1;
+        s = pk->split + pk->splitcount;
+        if (r->x > p.x) {
+            s->x = p.x; s->y = p.y; s->w = r->x - p.x; s->h = p.h;
+            s++;
+        }
+        if (r->x + r->w < p.x + p.w) {
+            s->x = r->x + r->w; s->y = p.y;
+            s->w = p.x + p.w - s->x; s->h = p.h;
+            s++;
+        }
+        if (r->y > p.y) {
+            s->x = p.x; s->y = p.y; s->w = p.w; s->h = r->y - p.y;
+            s++;
+        }
+        if (r->y + r->h < p.y + p.h) {
+            s->x = p.x; s->y = r->y + r->h;
+            s->w = p.w; s->h = p.y + p.h - s->y;
+            s++;
+        }
+        pk->splitcount = (unsigned) (s - pk->split);
+    }
+    n = m;
+
+    /* The new pieces cannot contain the remaining free rectangles,
+       since those would have been contained in the rectangles which
+       were split.  Only the new pieces need to be pruned.  Each new
+       piece touches the placed rectangle, so any free rectangle
+       containing it must touch the placed rectangle too.  */
+    s = pk->split;
+    ns = pk->splitcount;
+    near = pk->near;
+    for (i = 0; i < ns; i++) {
+        if (s[i].w < pk->minw || s[i].h < pk->minh)
+            goto drop;
+        for (j = 0; j < nn; j++)
+            if (sg_pack_contains(&s[i], &f[near[j]]))
+                goto drop;
+        for (j = 0; j < ns; j++)
+            if (j != i && sg_pack_contains(&s[i], &s[j]))
+                goto drop;
+        continue;
+    drop:
+        s[i--] = s[--ns];
+    }
+    if (sg_pack_reserve((void **) &pk->free, &pk->freealloc,
+                        n + ns, sizeof(*pk->free)))
+        return -1;
+    memcpy(pk->free + n, s, sizeof(*s) * ns);
+    pk->freecount = n + ns;
+    return 0;
+}
+
+static int
+sg_packer_insertmaxrects(struct sg_packer *pk, struct sg_pack_rect *rect)
+{
+    struct sg_pack_free *f, r;
+    unsigned i, n = pk->freecount, w = rect->w, h = rect->h;
+    unsigned s0, s1, s2, lw, lh, best0 = 0, best1 = 0, best2 = 0, besti = 0;
+    int found = 0;
+
+    for (i = 0; i < n; i++) {
+        f = &pk->free[i];
+        if (f->w < w || f->h < h)
+            continue;
+        lw = f->w - w;
+        lh = f->h - h;
+        /* As with skyline packing, prefer not to increase the height
+           of the packing.  */
+        s0 = f->y + h > pk->extenth ? f->y + h : pk->extenth;
+        switch (pk->method) {
+        case SG_PACK_MAXRECTS_BOTTOMLEFT:
+        default:
+            s1 = f->y + h;
+            s2 = f->x;
+            break;
+        case SG_PACK_MAXRECTS_SHORTSIDE:
+            s1 = lw < lh ? lw : lh;
+            s2 = lw < lh ? lh : lw;
+            break;
+        case SG_PACK_MAXRECTS_AREA:
+            s1 = f->w * f->h - w * h;
+            s2 = lw < lh ? lw : lh;
+            break;
+        }
+        if (!found || s0 < best0 || (s0 == best0 &&
+            (s1 < best1 || (s1 == best1 && s2 < best2)))) {
+            best0 = s0;
+            best1 = s1;
+            best2 = s2;
+            besti = i;
+            found = 1;
+        }
+    }
+    if (!found)
+        return 0;
+
+    r.x = pk->free[besti].x;
+    r.y = pk->free[besti].y;
+    r.w = w;
+    r.h = h;
+    if (sg_packer_split(pk, &r))
+        return -1;
+    rect->x = (unsigned short) r.x;
+    rect->y = (unsigned short) r.y;
+    return 1;
+}
+
+int
+sg_packer_insert(struct sg_packer *pk, struct sg_pack_rect *rect,
+                 struct sg_error **err)
+{
+    int r;
+    if (!rect->w || !rect->h) {
+        rect->x = 0;
+        rect->y = 0;
+        return 1;
+    }
+    if (sg_pack_isskyline(pk->method)) {
+        r = 0;
+        if (pk->freecount) {
+            /* Splitting a free rectangle adds at most one more.  */
+            if (sg_pack_reserve((void **) &pk->free, &pk->freealloc,
+                                pk->freecount + 1, sizeof(*pk->free))) {
+                sg_error_nomem(err);
+                return -1;
+            }
+            r = sg_packer_insertfree(pk, rect);
+        }
+        if (!r)
+            r = sg_packer_insertskyline(pk, rect);
+    } else {
+        r = sg_packer_insertmaxrects(pk, rect);
+    }
+    if (r < 0) {
+        sg_error_nomem(err);
+        return -1;
+    }
+    if (r > 0) {
+        if (pk->extentw < (unsigned) rect->x + rect->w)
+            pk->extentw = rect->x + rect->w;
+        if (pk->extenth < (unsigned) rect->y + rect->h)
+            pk->extenth = rect->y + rect->h;
+    }
+    return r;
+}
+
+/* Lower the skyline beneath a removed rectangle, if nothing was
+   placed above it.  Returns nonzero on success.  */
+static int
+sg_packer_lower(struct sg_packer *pk, const struct sg_pack_rect *rect)
+{
+    struct sg_pack_node *node = pk->node;
+    unsigned i, j, k, n = pk->nodecount, x = rect->x, end, top;
+    end = x + rect->w;
+    top = (unsigned) rect->y + rect->h;
+
+    for (i = 0; i < n && node[i].x + node[i].w <= x; i++) { }
+    for (j = i; j < n && node[j].x < end; j++)
+        if (node[j].y != top)
+            return 0;
+    /* Segments i..j-1 cover the rectangle.  Make room for splitting
+       the first and last segments.  */
+    if (sg_pack_reserve((void **) &pk->node, &pk->nodealloc,
+                        n + 2, sizeof(*pk->node)))
+        return -1;
+    node = pk->node;
+    if (node[j - 1].x + node[j - 1].w > end) {
+        memmove(node + j, node + j - 1, sizeof(*node) * (n - j + 1));
+        n++;
+        node[j].x = end;
+        node[j].w = node[j - 1].x + node[j - 1].w - end;
+        node[j - 1].w -= node[j].w;
+    }
+    if (node[i].x < x) {
+        memmove(node + i + 1, node + i, sizeof(*node) * (n - i));
+        n++;
+        j++;
+        node[i].w = x - node[i].x;
+        i++;
+        node[i].x = x;
+        node[i].w -= node[i - 1].w;
+    }
+    node[i].y = rect->y;
+    node[i].w = rect->w;
+    k = i + 1;
+    if (j > k) {
+        memmove(node + k, node + j, sizeof(*node) * (n - j));
+        n -= j - k;
+    }
+    if (i + 1 < n && node[i + 1].y == node[i].y) {
+        node[i].w += node[i + 1].w;
+        memmove(node + i + 1, node + i + 2, sizeof(*node) * (n - i - 2));
+        n--;
+    }
+    if (i > 0 && node[i - 1].y == node[i].y) {
+        node[i - 1].w += node[i].w;
+        memmove(node + i, node + i + 1, sizeof(*node) * (n - i - 1));
+        n--;
+    }
+    pk->nodecount = n;
+    return 1;
+}
+
+int
+sg_packer_remove(struct sg_packer *pk, const struct sg_pack_rect *rect,
+                 struct sg_error **err)
+{
+    int lowered;
+    if (!rect->w || !rect->h)
+        return 0;
+    if (sg_pack_isskyline(pk->method)) {
+        lowered = sg_packer_lower(pk, rect);
+        if (lowered < 0)
+            goto nomem;
+        if (lowered)
+            return 0;
+        if (sg_pack_addfree(pk, rect->x, rect->y, rect->w, rect->h))
+            goto nomem;
+        return 0;
+    }
+    if (sg_pack_addfree(pk, rect->x, rect->y, rect->w, rect->h))
+        goto nomem;
+    return 0;
+
+nomem:
+    sg_error_nomem(err);
+    return -1;
+}
+
+void
+sg_packer_extent(const struct sg_packer *pk, struct sg_pack_size *size)
+{
+    size->width = (unsigned short) pk->extentw;
+    size->height = (unsigned short) pk->extenth;
+}
+
 struct sg_pack_ref {
     unsigned index;
-    unsigned short w, h;
-    unsigned short x, y;
+    struct sg_pack_rect rect;
 };
 
-static int sg_pack_ref_compare(const void *p1, const void *p2)
+/* Sort by decreasing height.  This is better for both methods than
+   sorting by area, and MaxRects packing is much faster, since fewer
+   small holes are left behind.  */
+static int
+sg_pack_ref_compare(const void *p1, const void *p2)
 {
     const struct sg_pack_ref *r1 = p1, *r2 = p2;
-    if (r1->w != r2->w)
-        return r1->w > r2->w ? -1 : 1;
-    if (r1->h != r2->h)
-        return r1->h > r2->h ? -1 : 1;
-    return 0;
+    if (r1->rect.h != r2->rect.h)
+        return r1->rect.h > r2->rect.h ? -1 : 1;
+    if (r1->rect.w != r2->rect.w)
+        return r1->rect.w > r2->rect.w ? -1 : 1;
+    return r1->index < r2->index ? -1 : 1;
+}
+
+static unsigned
+sg_pack_pow2(unsigned x)
+{
+    unsigned y = 1;
+    while (y < x)
+        y <<= 1;
+    return y;
+}
+
+/* Smallest width whose square is at least the area.  */
+static unsigned
+sg_pack_sqrt(double area)
+{
+    unsigned lo = 0, hi = 0xffff, mid;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if ((double) mid * mid < area)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int
+sg_pack_log2(unsigned x)
+{
+    int n = 0;
+    while (x > 1) {
+        x >>= 1;
+        n++;
+    }
+    return n;
 }
 
 int
 sg_pack(struct sg_pack_rect *rect, unsigned rectcount,
         struct sg_pack_size *size, const struct sg_pack_size *maxsize,
         struct sg_error **err)
+{
+    return sg_pack2(rect, rectcount, size, maxsize,
+                    SG_PACK_SKYLINE_BOTTOMLEFT, SG_PACK_POW2, err);
+}
+
+/* The number of widths to try for packings without SG_PACK_POW2,
+   from the square root of the area to twice that.  */
+#define SG_PACK_NWIDTH 9
+
+int
+sg_pack2(struct sg_pack_rect *rect, unsigned rectcount,
+         struct sg_pack_size *size, const struct sg_pack_size *maxsize,
+         enum sg_pack_method method, unsigned flags,
+         struct sg_error **err)
 {
     struct sg_pack_ref *ref;
-    unsigned i, j, wi, hi, pw, ph, rw, rh, maxw, maxh, ypos, xpos;
-    unsigned total_area, rect_area, pack_area, best_area, frontier_size;
-    int success, pack_nonsquare, best_nonsquare;
-    unsigned short *frontier;
+    struct sg_packer *pk;
+    struct sg_pack_size ext;
+    unsigned i, k, maxw, maxh, maxrw, maxrh, minrw, minrh, pw, ph, lastw;
+    double total_area, pack_area, best_area = 0.0;
+    int r, pow2 = (flags & SG_PACK_POW2) != 0, success = 0;
+    int nonsquare, best_nonsquare = 0;
 
     if (rectcount == 0) {
         size->width = 1;
@@ -57,105 +799,120 @@ sg_pack(struct sg_pack_rect *rect, unsigned rectcount,
 
     maxw = maxsize->width;
     maxh = maxsize->height;
-
     ref = malloc(sizeof(*ref) * rectcount);
     if (!ref) {
         sg_error_nomem(err);
         return -1;
     }
-    total_area = 0;
+    total_area = 0.0;
+    maxrw = 1;
+    maxrh = 1;
+    minrw = (unsigned) -1;
+    minrh = (unsigned) -1;
     for (i = 0; i < rectcount; i++) {
-        rw = rect[i].w;
-        rh = rect[i].h;
-        rect_area = rw * rh;
         ref[i].index = i;
-        ref[i].w = rect[i].w;
-        ref[i].h = rect[i].h;
-        if (rect_area > (unsigned) -1 - total_area ||
-            rw > maxw || rh > maxh) {
+        ref[i].rect.w = rect[i].w;
+        ref[i].rect.h = rect[i].h;
+        if (rect[i].w > maxw || rect[i].h > maxh) {
             free(ref);
             return 0;
         }
-        total_area += rect_area;
+        if (maxrw < rect[i].w)
+            maxrw = rect[i].w;
+        if (maxrh < rect[i].h)
+            maxrh = rect[i].h;
+        if (minrw > rect[i].w)
+            minrw = rect[i].w;
+        if (minrh > rect[i].h)
+            minrh = rect[i].h;
+        total_area += (double) rect[i].w * rect[i].h;
+    }
+    if (total_area > (double) maxw * maxh) {
+        free(ref);
+        return 0;
     }
     qsort(ref, rectcount, sizeof(*ref), sg_pack_ref_compare);
-    /*
-    for (i = 0; i < rectcount; i++)
-        printf("%3d %3d %3d\n", ref[i].index, ref[i].w, ref[i].h);
-    */
-
-    success = 0;
-    frontier_size = 0;
-    frontier = NULL;
-    for (hi = 0; hi < 16; hi++) {
-        ph = 1u << hi;
-        if (ph > maxh)
-            break;
-        for (wi = 0; wi < 16; wi++) {
-            pw = 1u << wi;
-            if (pw > maxw)
+
+    pk = sg_packer_new(method, maxw, maxh, err);
+    if (!pk) {
+        free(ref);
+        return -1;
+    }
+    sg_packer_setminsize(pk, minrw, minrh);
+
+    /* Choose the first width to try.  */
+    if (pow2) {
+        maxrw = sg_pack_pow2(maxrw);
+        maxrh = sg_pack_pow2(maxrh);
+    } else {
+        pw = sg_pack_sqrt(total_area);
+        if (maxrw < pw)
+            maxrw = pw;
+        if (maxrw > maxw)
+            maxrw = maxw;
+    }
+    lastw = 0;
+    for (k = 0; ; k++) {
+        if (pow2) {
+            pw = maxrw << k;
+        } else {
+            if (k >= SG_PACK_NWIDTH)
                 break;
-            pack_area = pw * ph;
-            if (total_area > pack_area)
-                continue;
-            pack_nonsquare = abs(wi - hi);
-            if (success &&
-                (pack_area > best_area ||
-                 (pack_area == best_area && pack_nonsquare > best_nonsquare)))
+            pw = maxrw + maxrw * k / (SG_PACK_NWIDTH - 1);
+            if (pw > maxw)
+                pw = maxw;
+            if (pw == lastw)
                 break;
+        }
+        if (pw > maxw)
+            break;
+        lastw = pw;
+        if ((double) pw * maxh < total_area)
+            continue;
+        /* Every later width gives a larger area.  */
+        if (pow2 && success && (double) pw * maxrh > best_area)
+            break;
 
-            if (frontier_size < ph) {
-                free(frontier);
-                frontier_size = ph;
-                frontier = calloc(frontier_size, sizeof(*frontier));
-                if (!frontier) {
-                    free(ref);
-                    sg_error_nomem(err);
-                    return -1;
-                }
-            } else {
-                memset(frontier, 0, sizeof(*frontier) * ph);
-            }
-
-            ypos = 0;
-            for (i = 0; i < rectcount; i++) {
-                rw = ref[i].w;
-                rh = ref[i].h;
-                if (ypos + rh > ph)
-                    ypos = 0;
-                while (ypos + rh <= ph && frontier[ypos] + rw > pw)
-                    ypos++;
-                if (ypos + rh > ph)
-                    break;
-                xpos = frontier[ypos];
-                for (j = 0; j < ypos + rh; j++) {
-                    if (frontier[j] < xpos + rw)
-                        frontier[j] = xpos + rw;
-                }
-                assert(ypos <= ph - rh);
-                assert(xpos <= pw - rw);
-                ref[i].x = xpos;
-                ref[i].y = ypos;
-                ypos += rh;
+        sg_packer_reset(pk, pw, maxh);
+        for (i = 0; i < rectcount; i++) {
+            r = sg_packer_insert(pk, &ref[i].rect, err);
+            if (r < 0) {
+                success = -1;
+                goto done;
             }
-
-            if (i == rectcount) {
-                best_area = pack_area;
-                best_nonsquare = pack_nonsquare;
-                size->width = pw;
-                size->height = ph;
-                for (i = 0; i < rectcount; i++) {
-                    j = ref[i].index;
-                    rect[j].x = ref[i].x;
-                    rect[j].y = ref[i].y;
-                }
-                success = 1;
+            if (!r)
                 break;
-            }
         }
+        if (i < rectcount)
+            continue;
+        sg_packer_extent(pk, &ext);
+        if (pow2) {
+            ph = sg_pack_pow2(ext.height);
+            if (ph > maxh)
+                continue;
+        } else {
+            pw = ext.width ? ext.width : 1;
+            ph = ext.height ? ext.height : 1;
+        }
+        pack_area = (double) pw * ph;
+        nonsquare = abs(sg_pack_log2(pw) - sg_pack_log2(ph));
+        if (success &&
+            (pack_area > best_area ||
+             (pack_area == best_area && nonsquare >= best_nonsquare)))
+            continue;
+        best_area = pack_area;
+        best_nonsquare = nonsquare;
+        size->width = (unsigned short) pw;
+        size->height = (unsigned short) ph;
+        for (i = 0; i < rectcount; i++) {
+            rect[ref[i].index].x = ref[i].rect.x;
+            rect[ref[i].index].y = ref[i].rect.y;
+        }
+        success = 1;
     }
 
-    free(frontier);
+done:
+    sg_packer_free(pk);
     free(ref);
     return success;
 }
@@ -36,6 +36,18 @@ sg_log_init(void);
 void
 sg_path_init(void);
 
+/* Initialize the background file writer.  */
+void
+sg_filesave_init(void);
+
+/* Initialize file change notifications.  */
+void
+sg_filewatch_init(void);
+
+/* Invoke callbacks for files which have changed.  */
+void
+sg_filewatch_dispatch(void);
+
 /* Initialize the main audio system.  */
 void
 sg_mixer_init(void);
@@ -91,6 +103,11 @@ sg_sys_getvidsize(
 void
 sg_cvar_loadcfg(void);
 
+/* Reload the main configuration file when it is changed by another
+   program.  */
+void
+sg_cvar_watchcfg(void);
+
 #if defined(_WIN32)
 
 /* Convert a UTF-8 string to UTF-16, alloctaing the destination buffer.
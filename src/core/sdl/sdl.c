@@ -39,6 +39,7 @@ sdl_quit(int status)
 void
 sg_sys_quit(void)
 {
+    sg_sys_destroy();
     sdl_quit(0);
 }
 
@@ -0,0 +1,61 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Sprite sheet file format.  */
+#include "sg/defs.h"
+#include "sg/sprite.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  Sprite sheet files are written by the spritesheet tool and mapped
+  into memory when loaded, so they are stored in native byte order and
+  used without parsing.
+
+  Layout: header, sprite array, name table, padding to
+  SG_SPRITESHEET_ALIGN, pixel data.
+
+  The sprite array is sorted by name hash, then by name.  Names are
+  not NUL-terminated.  The pixel data is premultiplied RGBA, with no
+  padding between rows.  Rows are stored from bottom to top, like
+  OpenGL textures, so the sheet can be uploaded directly and sprite
+  coordinates are measured from the lower left.
+*/
+
+#define SG_SPRITESHEET_VERSION 1
+#define SG_SPRITESHEET_ALIGN 64
+#define SG_SPRITESHEET_MAXSIZE (256 * 1024 * 1024)
+#define SG_SPRITESHEET_MAGIC "SGSheet"
+
+struct sg_spritesheet_header {
+    char magic[8];
+    /* Written in native byte order, so this also checks endian.  */
+    uint32_t version;
+    uint32_t spritecount;
+    uint32_t namesize;
+    uint16_t width;
+    uint16_t height;
+};
+
+struct sg_spritesheet_entry {
+    /* Hash of the name, from sg_hash64() with seed 0.  */
+    uint64_t hash;
+    /* Offset of the name in the name table.  */
+    uint32_t name;
+    uint16_t namelen;
+    /* Transformation to apply to the sprite to get the source
+       image.  */
+    uint16_t xform;
+    struct sg_sprite sprite;
+    uint32_t reserved;
+};
+
+/* Get the offset of the pixel data in a sprite sheet file.  */
+SG_INLINE size_t
+sg_spritesheet_pixeloffset(uint32_t spritecount, uint32_t namesize)
+{
+    size_t off = sizeof(struct sg_spritesheet_header) +
+        sizeof(struct sg_spritesheet_entry) * spritecount + namesize;
+    return (off + SG_SPRITESHEET_ALIGN - 1) &
+        ~(size_t) (SG_SPRITESHEET_ALIGN - 1);
+}
@@ -0,0 +1,159 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "sg/error.h"
+#include "sg/file.h"
+#include "sg/hash.h"
+#include "sg/pixbuf.h"
+#include "sg/sprite.h"
+#include "sprite_impl.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct sg_spritesheet {
+    struct sg_filedata *data;
+    const struct sg_spritesheet_entry *entry;
+    unsigned entrycount;
+    const char *names;
+    struct sg_pixbuf pixbuf;
+};
+
+struct sg_spritesheet *
+sg_spritesheet_file(const char *path, size_t pathlen, struct sg_error **err)
+{
+    struct sg_filedata *data;
+    struct sg_spritesheet *sheet;
+    int r;
+    r = sg_file_load(&data, path, pathlen, SG_FILE_MAP, "sheet",
+                     SG_SPRITESHEET_MAXSIZE, NULL, err);
+    if (r)
+        return NULL;
+    sheet = sg_spritesheet_buffer(data, err);
+    sg_filedata_decref(data);
+    return sheet;
+}
+
+/* Compare two sprite sheet entries, by hash then by name.  */
+static int
+sg_spritesheet_compare(const struct sg_spritesheet_entry *x,
+                       const struct sg_spritesheet_entry *y,
+                       const char *names)
+{
+    size_t len;
+    int r;
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+    len = x->namelen < y->namelen ? x->namelen : y->namelen;
+    r = memcmp(names + x->name, names + y->name, len);
+    if (r)
+        return r;
+    return (int) x->namelen - (int) y->namelen;
+}
+
+struct sg_spritesheet *
+sg_spritesheet_buffer(struct sg_filedata *data, struct sg_error **err)
+{
+    struct sg_spritesheet_header h;
+    struct sg_spritesheet *sheet;
+    const struct sg_spritesheet_entry *entry, *e;
+    const char *ptr = data->data, *names;
+    size_t pixoff;
+    unsigned i;
+
+    if (data->length < sizeof(h))
+        goto invalid;
+    memcpy(&h, ptr, sizeof(h));
+    if (memcmp(h.magic, SG_SPRITESHEET_MAGIC, sizeof(h.magic)) ||
+        h.version != SG_SPRITESHEET_VERSION ||
+        h.spritecount > SG_SPRITESHEET_MAXSIZE /
+            sizeof(struct sg_spritesheet_entry) ||
+        h.namesize > SG_SPRITESHEET_MAXSIZE ||
+        h.width < 1 || h.width > 0x7fff ||
+        h.height < 1 || h.height > 0x7fff)
+        goto invalid;
+    pixoff = sg_spritesheet_pixeloffset(h.spritecount, h.namesize);
+    if (data->length != pixoff + (size_t) h.width * h.height * 4)
+        goto invalid;
+
+    entry = (const void *) (ptr + sizeof(h));
+    names = (const char *) (entry + h.spritecount);
+    for (i = 0; i < h.spritecount; i++) {
+        e = &entry[i];
+        if (e->name > h.namesize || e->namelen > h.namesize - e->name ||
+            e->xform > 7 ||
+            e->sprite.x < 0 || e->sprite.y < 0 ||
+            e->sprite.w < 0 || e->sprite.h < 0 ||
+            e->sprite.w > h.width - e->sprite.x ||
+            e->sprite.h > h.height - e->sprite.y ||
+            e->hash != sg_hash64(names + e->name, e->namelen, 0))
+            goto invalid;
+        /* Lookup uses binary search, so the entries must be sorted
+           and unique.  */
+        if (i > 0 && sg_spritesheet_compare(e - 1, e, names) >= 0)
+            goto invalid;
+    }
+
+    sheet = malloc(sizeof(*sheet));
+    if (!sheet) {
+        sg_error_nomem(err);
+        return NULL;
+    }
+    sg_filedata_incref(data);
+    sheet->data = data;
+    sheet->entry = entry;
+    sheet->entrycount = h.spritecount;
+    sheet->names = names;
+    sheet->pixbuf.data = (void *) (ptr + pixoff);
+    sheet->pixbuf.format = SG_RGBA;
+    sheet->pixbuf.width = h.width;
+    sheet->pixbuf.height = h.height;
+    sheet->pixbuf.rowbytes = h.width * 4;
+    return sheet;
+
+invalid:
+    sg_error_data(err, "sprite sheet");
+    return NULL;
+}
+
+void
+sg_spritesheet_free(struct sg_spritesheet *sheet)
+{
+    sg_filedata_decref(sheet->data);
+    free(sheet);
+}
+
+int
+sg_spritesheet_get(const struct sg_spritesheet *sheet,
+                   const char *name, size_t namelen,
+                   struct sg_sprite *sp, sg_sprite_xform_t *sxform)
+{
+    const struct sg_spritesheet_entry *entry = sheet->entry, *e;
+    uint64_t hash = sg_hash64(name, namelen, 0);
+    unsigned lo = 0, hi = sheet->entrycount, mid;
+
+    /* Find the first entry with a matching hash.  */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (entry[mid].hash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (; lo < sheet->entrycount && entry[lo].hash == hash; lo++) {
+        e = &entry[lo];
+        if (e->namelen == namelen &&
+            !memcmp(sheet->names + e->name, name, namelen)) {
+            *sp = e->sprite;
+            *sxform = (sg_sprite_xform_t) e->xform;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void
+sg_spritesheet_pixbuf(const struct sg_spritesheet *sheet,
+                      struct sg_pixbuf *pbuf)
+{
+    *pbuf = sheet->pixbuf;
+}
@@ -3,6 +3,12 @@
    2-clause BSD license.  For more information, see LICENSE.txt. */
 #include "sg/sprite.h"
 
+#if defined __SSE2__ || defined _M_X64 || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2)
+# define SG_SPRITE_SSE2 1
+# include <emmintrin.h>
+#endif
+
 void
 sg_sprite_write(void *buffer, unsigned stride, struct sg_sprite sp,
                 int x, int y)
@@ -29,16 +35,16 @@ sg_sprite_write(void *buffer, unsigned stride, struct sg_sprite sp,
     data[0] = rx1; data[1] = ry1; data[2] = tx1; data[3] = ty1;
 }
 
-void
-sg_sprite_write2(void *buffer, unsigned stride, struct sg_sprite sp,
-                 int x, int y, sg_sprite_xform_t xform)
+/* Calculate the vertex coordinates of a transformed sprite.  Vertex i
+   has texture coordinates (x + (i & 1) * w, y + (i >> 1) * h).
+   Returns nonzero if the transformation is invalid.  */
+static int
+sg_sprite_corners(short *vx, short *vy, struct sg_sprite sp,
+                  int x, int y, sg_sprite_xform_t xform)
 {
-    short *data;
     short vx0, vx1, vx2, vx3, vy0, vy1, vy2, vy3;
-    short tx0, tx1, ty0, ty1, rx0, rx1, ry0, ry1;
+    short rx0, rx1, ry0, ry1;
 
-    tx0 = sp.x; tx1 = tx0 + sp.w;
-    ty0 = sp.y; ty1 = ty0 + sp.h;
     rx0 = -sp.cx, rx1 = rx0 + sp.w;
     ry0 = -sp.cy, ry1 = ry0 + sp.h;
 
@@ -103,19 +109,228 @@ sg_sprite_write2(void *buffer, unsigned stride, struct sg_sprite sp,
 #ifdef __GCC__
         __builtin_unreachable();
 #endif
-        return;
+        return -1;
     }
 
+    vx[0] = vx0; vx[1] = vx1; vx[2] = vx2; vx[3] = vx3;
+    vy[0] = vy0; vy[1] = vy1; vy[2] = vy2; vy[3] = vy3;
+    return 0;
+}
+
+void
+sg_sprite_write2(void *buffer, unsigned stride, struct sg_sprite sp,
+                 int x, int y, sg_sprite_xform_t xform)
+{
+    short *data;
+    short vx[4], vy[4], tx0, tx1, ty0, ty1;
+
+    tx0 = sp.x; tx1 = tx0 + sp.w;
+    ty0 = sp.y; ty1 = ty0 + sp.h;
+    if (sg_sprite_corners(vx, vy, sp, x, y, xform))
+        return;
+
     data = buffer;
-    data[0] = vx0; data[1] = vy0; data[2] = tx0; data[3] = ty0;
+    data[0] = vx[0]; data[1] = vy[0]; data[2] = tx0; data[3] = ty0;
     data = (void *) ((unsigned char *) buffer + stride * 1);
-    data[0] = vx1; data[1] = vy1; data[2] = tx1; data[3] = ty0;
+    data[0] = vx[1]; data[1] = vy[1]; data[2] = tx1; data[3] = ty0;
     data = (void *) ((unsigned char *) buffer + stride * 2);
-    data[0] = vx2; data[1] = vy2; data[2] = tx0; data[3] = ty1;
+    data[0] = vx[2]; data[1] = vy[2]; data[2] = tx0; data[3] = ty1;
     data = (void *) ((unsigned char *) buffer + stride * 3);
-    data[0] = vx2; data[1] = vy2; data[2] = tx0; data[3] = ty1;
+    data[0] = vx[2]; data[1] = vy[2]; data[2] = tx0; data[3] = ty1;
     data = (void *) ((unsigned char *) buffer + stride * 4);
-    data[0] = vx1; data[1] = vy1; data[2] = tx1; data[3] = ty0;
+    data[0] = vx[1]; data[1] = vy[1]; data[2] = tx1; data[3] = ty0;
     data = (void *) ((unsigned char *) buffer + stride * 5);
-    data[0] = vx3; data[1] = vy3; data[2] = tx1; data[3] = ty1;
+    data[0] = vx[3]; data[1] = vy[3]; data[2] = tx1; data[3] = ty1;
+}
+
+void
+sg_sprite_write4(void *buffer, unsigned stride, struct sg_sprite sp,
+                 int x, int y, sg_sprite_xform_t xform)
+{
+    short *data;
+    short vx[4], vy[4], tx0, tx1, ty0, ty1;
+
+    tx0 = sp.x; tx1 = tx0 + sp.w;
+    ty0 = sp.y; ty1 = ty0 + sp.h;
+    if (sg_sprite_corners(vx, vy, sp, x, y, xform))
+        return;
+
+    data = buffer;
+    data[0] = vx[0]; data[1] = vy[0]; data[2] = tx0; data[3] = ty0;
+    data = (void *) ((unsigned char *) buffer + stride * 1);
+    data[0] = vx[1]; data[1] = vy[1]; data[2] = tx1; data[3] = ty0;
+    data = (void *) ((unsigned char *) buffer + stride * 2);
+    data[0] = vx[2]; data[1] = vy[2]; data[2] = tx0; data[3] = ty1;
+    data = (void *) ((unsigned char *) buffer + stride * 3);
+    data[0] = vx[3]; data[1] = vy[3]; data[2] = tx1; data[3] = ty1;
+}
+
+void
+sg_sprite_writeinstance(struct sg_sprite_instance *inst,
+                        struct sg_sprite sp, int x, int y,
+                        sg_sprite_xform_t xform)
+{
+    short vx[4], vy[4];
+    if (sg_sprite_corners(vx, vy, sp, x, y, xform))
+        return;
+    inst->vx = vx[0];
+    inst->vy = vy[0];
+    inst->tx = sp.x;
+    inst->ty = sp.y;
+    inst->w = sp.w;
+    inst->h = sp.h;
+    inst->xform = (short) xform;
+    inst->reserved = 0;
+}
+
+/*
+  Sprite arrays are written without branching on the transformation.
+  Each vertex is computed as four lanes (vx, vy, tx, ty), and the
+  vertex with texture corner (i, j) is P + i * Q + j * R, where P is
+  the vertex for the lower left texture corner, Q is the step for
+  moving one sprite width along the texture, and R is the step for
+  moving one sprite height.  For a transformation with matrix M,
+
+    P = (x, y, sp.x, sp.y) - cx * (M00, M10, 0, 0) - cy * (M01, M11, 0, 0)
+    Q = w * (M00, M10, 1, 0)
+    R = h * (M01, M11, 0, 1)
+
+  Each row of the table contains Q / w, R / h, and the coefficients
+  of cx and cy in P.  This matches sg_sprite_corners().
+*/
+static const short SG_SPRITE_STEP[8][16] = {
+    /* SG_X_NORMAL */
+    {  1,  0, 1, 0,  0,  1, 0, 1, -1,  0, 0, 0,  0, -1, 0, 0 },
+    /* SG_X_ROTATE_90 */
+    {  0,  1, 1, 0, -1,  0, 0, 1,  0, -1, 0, 0,  1,  0, 0, 0 },
+    /* SG_X_ROTATE_180 */
+    { -1,  0, 1, 0,  0, -1, 0, 1,  1,  0, 0, 0,  0,  1, 0, 0 },
+    /* SG_X_ROTATE_270 */
+    {  0, -1, 1, 0,  1,  0, 0, 1,  0,  1, 0, 0, -1,  0, 0, 0 },
+    /* SG_X_FLIP_VERTICAL */
+    {  1,  0, 1, 0,  0, -1, 0, 1, -1,  0, 0, 0,  0,  1, 0, 0 },
+    /* SG_X_TRANSPOSE_2 */
+    {  0, -1, 1, 0, -1,  0, 0, 1,  0,  1, 0, 0,  1,  0, 0, 0 },
+    /* SG_X_FLIP_HORIZONTAL */
+    { -1,  0, 1, 0,  0,  1, 0, 1,  1,  0, 0, 0,  0, -1, 0, 0 },
+    /* SG_X_TRANSPOSE */
+    {  0,  1, 1, 0,  1,  0, 0, 1,  0, -1, 0, 0, -1,  0, 0, 0 }
+};
+
+#if defined SG_SPRITE_SSE2
+
+static void
+sg_sprite_writearray(short *buffer, const struct sg_sprite *sp,
+                     const short *pos, const unsigned char *xform,
+                     unsigned count, int nvert)
+{
+    __m128i *out = (__m128i *) buffer;
+    __m128i a, b, step, size, ctr, p, pq, pr, pqr;
+    unsigned i, xf;
+
+    for (i = 0; i < count; i++) {
+        xf = xform ? xform[i] & 7 : 0;
+        /* a = (sp.x, sp.y, sp.w, sp.h), b = (sp.w, sp.h, sp.cx, sp.cy) */
+        a = _mm_loadl_epi64((const __m128i *) &sp[i].x);
+        b = _mm_loadl_epi64((const __m128i *) &sp[i].w);
+        b = _mm_unpacklo_epi16(b, b);
+        size = _mm_shuffle_epi32(b, _MM_SHUFFLE(1, 1, 0, 0));
+        ctr = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 3, 2, 2));
+        step = _mm_mullo_epi16(
+            _mm_loadu_si128((const __m128i *) SG_SPRITE_STEP[xf] + 1), ctr);
+        p = _mm_unpacklo_epi32(
+            _mm_cvtsi32_si128((unsigned short) pos[i*2+0] |
+                              ((unsigned) (unsigned short) pos[i*2+1] << 16)),
+            a);
+        p = _mm_add_epi16(_mm_add_epi16(p, step), _mm_srli_si128(step, 8));
+        step = _mm_mullo_epi16(
+            _mm_loadu_si128((const __m128i *) SG_SPRITE_STEP[xf]), size);
+        pq = _mm_add_epi16(p, step);
+        step = _mm_srli_si128(step, 8);
+        pr = _mm_add_epi16(p, step);
+        pqr = _mm_add_epi16(pq, step);
+        if (nvert == 6) {
+            _mm_storeu_si128(out + 0, _mm_unpacklo_epi64(p, pq));
+            _mm_storeu_si128(out + 1, _mm_unpacklo_epi64(pr, pr));
+            _mm_storeu_si128(out + 2, _mm_unpacklo_epi64(pq, pqr));
+            out += 3;
+        } else {
+            _mm_storeu_si128(out + 0, _mm_unpacklo_epi64(p, pq));
+            _mm_storeu_si128(out + 1, _mm_unpacklo_epi64(pr, pqr));
+            out += 2;
+        }
+    }
+}
+
+#else
+
+static void
+sg_sprite_writearray(short *buffer, const struct sg_sprite *sp,
+                     const short *pos, const unsigned char *xform,
+                     unsigned count, int nvert)
+{
+    const short *step;
+    short *data = buffer;
+    short vx0, vx1, vx2, vx3, vy0, vy1, vy2, vy3, tx0, tx1, ty0, ty1;
+    unsigned i;
+
+    for (i = 0; i < count; i++) {
+        step = SG_SPRITE_STEP[xform ? xform[i] & 7 : 0];
+        tx0 = sp[i].x; tx1 = tx0 + sp[i].w;
+        ty0 = sp[i].y; ty1 = ty0 + sp[i].h;
+        vx0 = pos[i*2+0] + step[8] * sp[i].cx + step[12] * sp[i].cy;
+        vy0 = pos[i*2+1] + step[9] * sp[i].cx + step[13] * sp[i].cy;
+        vx1 = vx0 + step[0] * sp[i].w;
+        vy1 = vy0 + step[1] * sp[i].w;
+        vx2 = vx0 + step[4] * sp[i].h;
+        vy2 = vy0 + step[5] * sp[i].h;
+        vx3 = vx1 + step[4] * sp[i].h;
+        vy3 = vy1 + step[5] * sp[i].h;
+        data[0] = vx0; data[1] = vy0; data[2] = tx0; data[3] = ty0;
+        data[4] = vx1; data[5] = vy1; data[6] = tx1; data[7] = ty0;
+        data[8] = vx2; data[9] = vy2; data[10] = tx0; data[11] = ty1;
+        if (nvert == 6) {
+            data[12] = vx2; data[13] = vy2; data[14] = tx0; data[15] = ty1;
+            data[16] = vx1; data[17] = vy1; data[18] = tx1; data[19] = ty0;
+            data += 8;
+        }
+        data[12] = vx3; data[13] = vy3; data[14] = tx1; data[15] = ty1;
+        data += 16;
+    }
+}
+
+#endif
+
+void
+sg_sprite_writearray2(short *buffer, const struct sg_sprite *sp,
+                      const short *pos, const unsigned char *xform,
+                      unsigned count)
+{
+    sg_sprite_writearray(buffer, sp, pos, xform, count, 6);
+}
+
+void
+sg_sprite_writearray4(short *buffer, const struct sg_sprite *sp,
+                      const short *pos, const unsigned char *xform,
+                      unsigned count)
+{
+    sg_sprite_writearray(buffer, sp, pos, xform, count, 4);
+}
+
+void
+sg_quad_writeindex(unsigned short *buffer, unsigned count)
+{
+    unsigned i, v;
+    if (count > SG_QUAD_MAXCOUNT)
+        count = SG_QUAD_MAXCOUNT;
+    for (i = 0; i < count; i++) {
+        v = i * 4;
+        buffer[0] = (unsigned short) v;
+        buffer[1] = (unsigned short) (v + 1);
+        buffer[2] = (unsigned short) (v + 2);
+        buffer[3] = (unsigned short) (v + 2);
+        buffer[4] = (unsigned short) (v + 1);
+        buffer[5] = (unsigned short) (v + 3);
+        buffer += 6;
+    }
 }
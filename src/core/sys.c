@@ -4,6 +4,7 @@
 #include "private.h"
 #include "sg/entry.h"
 #include "sg/cvar.h"
+#include "sg/file.h"
 #include "sg/log.h"
 #include "sg/rand.h"
 #include "sg/record.h"
@@ -173,7 +174,10 @@ sg_sys_init(
     sg_log_init();
     sg_sys_parseargs(argc, argv);
     sg_path_init();
+    sg_filesave_init();
     sg_cvar_loadcfg();
+    sg_filewatch_init();
+    sg_cvar_watchcfg();
 
     sg_version_print();
     sg_rand_seed(&sg_rand_global, 1);
@@ -237,6 +241,13 @@ void
 sg_sys_postdraw(void)
 {
     sg_timer_invoke();
+    sg_filewatch_dispatch();
+}
+
+void
+sg_sys_destroy(void)
+{
+    sg_file_savewait();
 }
 
 void
@@ -430,5 +430,6 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
 done:
 
     killGLWindow();
+    sg_sys_destroy();
     return 0;
 }
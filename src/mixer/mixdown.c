@@ -2,7 +2,6 @@
    This file is part of SGLib.  SGLib is licensed under the terms of the
    2-clause BSD license.  For more information, see LICENSE.txt. */
 #include "mixer.h"
-#include "sound.h"
 #include "sg/error.h"
 #include <assert.h>
 #include <math.h>
@@ -117,7 +116,11 @@ sg_mixer_mixdown_syncflags(struct sg_mixer_mixdowniface *mp)
             mchan[i].flags |= SG_MIXER_LFLAG_STOP;
         if (gchan[i].gflags & SG_MIXER_GFLAG_LOOP)
             mchan[i].flags |= SG_MIXER_LFLAG_LOOP;
+        mchan[i].sample = gchan[i].sound->sample;
+        if (mchan[i].samplepos > mchan[i].sample.length)
+            mchan[i].samplepos = mchan[i].sample.length;
     }
+    sg_mixer.syncount[mp->mixdown.which]++;
 }
 
 /* Collect incoming messages.  Requires global mixer lock.  */
@@ -192,8 +195,7 @@ static void
 sg_mixer_mixdown_renderinput(struct sg_mixer_mixdown *SG_RESTRICT mp,
                              int ch, int start, int end)
 {
-    struct sg_mixer_sample *sample =
-        &sg_mixer.channel[ch].sound->sample;
+    const struct sg_mixer_sample *sample = &mp->channel[ch].sample;
     const short *adata = sample->data;
     int apos, i, n, rem, asz = mp->bufsz;
     int loop = (mp->channel[ch].flags & SG_MIXER_LFLAG_LOOP) != 0;
@@ -2,7 +2,6 @@
    This file is part of SGLib.  SGLib is licensed under the terms of the
    2-clause BSD license.  For more information, see LICENSE.txt. */
 #include "mixer.h"
-#include "sound.h"
 #include "../core/private.h"
 #include <stdlib.h>
 #include <string.h>
@@ -128,6 +127,8 @@ sg_mixer_commit(void)
     sg_mixer_commitmsg();
     sg_mixer.is_ready = 1;
     sg_mixer.committime = sg_mixer.time;
+    if (sg_mixer.oldcount)
+        sg_mixer_sound_freeold();
     sg_lock_release(&sg_mixer.lock);
 
     sg_mixer_cleanup();
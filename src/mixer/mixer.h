@@ -7,6 +7,7 @@
 #include "sg/atomic.h"
 #include "sg/thread.h"
 #include "config.h"
+#include "sound.h"
 #include "time.h"
 
 enum {
@@ -111,6 +112,9 @@ struct sg_mixer_mixchan {
     float param[SG_MIXER_PARAM_COUNT];
     /* The current sample position.  */
     unsigned samplepos;
+    /* Copy of the channel's sample data, taken while the global lock
+       is held, so sounds can be reloaded while the mixdown renders.  */
+    struct sg_mixer_sample sample;
 };
 
 /* A mixdown.  There may be a separate mixdown for live audio and
@@ -195,6 +199,14 @@ void
 sg_mixer_mixdown_get_f32(struct sg_mixer_mixdowniface *mp,
                          float *buffer);
 
+/* Sample data which was replaced when a sound was reloaded, but which
+   a mixdown may still be rendering.  */
+struct sg_mixer_oldsample {
+    short *data;
+    /* The sync count of each mixdown when the data was replaced.  */
+    unsigned syncount[2];
+};
+
 /* Global mixer system state.  */
 struct sg_mixer {
 #if defined ENABLE_AUDIO_ALSA
@@ -231,6 +243,15 @@ struct sg_mixer {
     /* The mixdowns: the live mixdown renders to the audio output, the
        recording mixdown renders to a file.  */
     struct sg_mixer_mixdowniface *mix_live, *mix_record;
+
+    /* The number of times each mixdown has copied the channel state,
+       indexed by sg_mixer_which_t.  */
+    unsigned syncount[2];
+
+    /* Sample data waiting to be freed.  */
+    struct sg_mixer_oldsample *oldsample;
+    unsigned oldcount;
+    unsigned oldalloc;
 };
 
 /* Initialize the mixer system output.  */
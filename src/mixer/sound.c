@@ -1,7 +1,7 @@
 /* Copyright 2014 Dietrich Epp.
    This file is part of SGLib.  SGLib is licensed under the terms of the
    2-clause BSD license.  For more information, see LICENSE.txt. */
-#include "sound.h"
+#include "mixer.h"
 #include "sg/audio_file.h"
 #include "sg/error.h"
 #include "sg/file.h"
@@ -142,6 +142,93 @@ sg_mixer_sound_setrate(int rate)
     sg_lock_release(&sg->lock);
 }
 
+/* Keep sample data from a reloaded sound until every mixdown has
+   copied the new data.  Each mixdown copies the sample with the global
+   lock held and then renders without it, so the old data may still be
+   in use.  Requires global mixer lock.  */
+static void
+sg_mixer_sound_retire(short *data)
+{
+    struct sg_mixer_oldsample *op;
+    unsigned nalloc;
+
+    if (sg_mixer.oldcount >= sg_mixer.oldalloc) {
+        nalloc = sg_mixer.oldalloc ? sg_mixer.oldalloc * 2 : 4;
+        op = realloc(sg_mixer.oldsample, nalloc * sizeof(*op));
+        if (!op) {
+            /* Leaking the data is safe, freeing it is not.  */
+            sg_logs(SG_LOG_ERROR, "out of memory, sound data leaked");
+            return;
+        }
+        sg_mixer.oldsample = op;
+        sg_mixer.oldalloc = nalloc;
+    }
+    op = &sg_mixer.oldsample[sg_mixer.oldcount++];
+    op->data = data;
+    op->syncount[SG_MIXER_LIVE] = sg_mixer.syncount[SG_MIXER_LIVE];
+    op->syncount[SG_MIXER_RECORD] = sg_mixer.syncount[SG_MIXER_RECORD];
+}
+
+void
+sg_mixer_sound_freeold(void)
+{
+    struct sg_mixer_oldsample *op = sg_mixer.oldsample;
+    unsigned i, j, n = sg_mixer.oldcount;
+
+    for (i = 0, j = 0; i < n; i++) {
+        if ((sg_mixer.mix_live &&
+             op[i].syncount[SG_MIXER_LIVE] ==
+             sg_mixer.syncount[SG_MIXER_LIVE]) ||
+            (sg_mixer.mix_record &&
+             op[i].syncount[SG_MIXER_RECORD] ==
+             sg_mixer.syncount[SG_MIXER_RECORD]))
+            op[j++] = op[i];
+        else
+            free(op[i].data);
+    }
+    sg_mixer.oldcount = j;
+}
+
+/* File watch callback, which reloads a sound when its file changes.  */
+static void
+sg_mixer_sound_changed(void *cxt)
+{
+    struct sg_mixer_soundglobal *sg = &sg_mixer_soundglobal;
+    struct sg_mixer_sound *sp = cxt, tmp;
+    struct sg_mixer_sample old;
+    int rate;
+
+    sg_lock_acquire(&sg->lock);
+    rate = sg->rate;
+    sg_lock_release(&sg->lock);
+    if (!rate)
+        return;
+
+    tmp.path = sp->path;
+    tmp.pathlen = sp->pathlen;
+    tmp.sample.data = NULL;
+    tmp.sample.stereo = 0;
+    tmp.sample.length = 0;
+    sg_mixer_sound_load(&tmp, rate);
+    if (!tmp.sample.data)
+        return;
+
+    sg_lock_acquire(&sg_mixer.lock);
+    sg_lock_acquire(&sg->lock);
+    if (sg->rate == rate) {
+        old = sp->sample;
+        sp->sample = tmp.sample;
+    } else {
+        old = tmp.sample;
+    }
+    sg_lock_release(&sg->lock);
+    if (old.data)
+        sg_mixer_sound_retire(old.data);
+    sg_lock_release(&sg_mixer.lock);
+
+    sg_logf(SG_LOG_INFO, "Reloaded sound: %s", sp->path);
+}
+
 struct sg_mixer_sound *
 sg_mixer_sound_file(const char *path, size_t pathlen,
                     struct sg_error **err)
@@ -151,6 +238,7 @@ sg_mixer_sound_file(const char *path, size_t pathlen,
     int npathlen, rate;
     unsigned nalloc;
     char npath[SG_MAX_PATH], *pp;
+    struct sg_error *werr = NULL;
 
     npathlen = sg_path_norm(npath, path, pathlen, err);
     if (npathlen < 0)
@@ -200,6 +288,13 @@ sg_mixer_sound_file(const char *path, size_t pathlen,
     sg_mixer_sound_load(sp, rate);
     sg_lock_release(&sg->lock);
 
+    if (sg_filewatch_add(sp->path, sp->pathlen, 0, SG_AUDIO_FILE_EXTENSIONS,
+                         sg_mixer_sound_changed, sp, &werr)) {
+        sg_logerrf(SG_LOG_WARN, werr, "%s: could not watch file",
+                   sp->path);
+        sg_error_clear(&werr);
+    }
+
     return sp;
 
 nomem:
@@ -211,6 +306,7 @@ nomem:
 static void
 sg_mixer_sound_free(struct sg_mixer_sound *sound)
 {
+    sg_filewatch_remove(sg_mixer_sound_changed, sound);
     free(sound->sample.data);
     free(sound);
 }
@@ -27,3 +27,8 @@ sg_mixer_sound_init(void);
    rate is set.  */
 void
 sg_mixer_sound_setrate(int rate);
+
+/* Free sample data from reloaded sounds once every mixdown has copied
+   the new data.  Requires global mixer lock.  */
+void
+sg_mixer_sound_freeold(void);
@@ -116,6 +116,7 @@ sg_image_cg_new(CGImageRef img, struct sg_error **err)
     im->img.flags = flags;
     im->img.free = sg_image_cg_free;
     im->img.draw = sg_image_cg_draw;
+    im->img.drawscaled = NULL;
     im->cgimg = img;
     return &im->img;
 
@@ -84,3 +84,17 @@ sg_pixbuf_writepng(struct sg_pixbuf *pbuf, const char *path, size_t pathlen,
 }
 
 #endif
+
+#if !defined ENABLE_PNG_LIBPNG
+
+int
+sg_pixbuf_writepngopts(struct sg_pixbuf *pbuf,
+                       const char *path, size_t pathlen,
+                       const struct sg_pngopts *opts,
+                       struct sg_error **err)
+{
+    (void) opts;
+    return sg_pixbuf_writepng(pbuf, path, pathlen, err);
+}
+
+#endif
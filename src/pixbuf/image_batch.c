@@ -0,0 +1,141 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "sg/atomic.h"
+#include "sg/error.h"
+#include "sg/pixbuf.h"
+#include "sg/thread.h"
+#include <stdlib.h>
+
+struct sg_image_batch {
+    struct sg_image_request *req;
+    unsigned count;
+    sg_image_batch_func_t func;
+    void *cxt;
+
+    /* Index of the next request to decode.  */
+    sg_atomic_t next;
+    /* Nonzero for each request that is finished.  */
+    sg_atomic_t *done;
+    /* Signaled when a request is finished.  */
+    struct sg_evt evt;
+    /* Index of the next request to pass to the callback, only
+       accessed by the calling thread.  */
+    unsigned delivered;
+};
+
+/* Load one image.  */
+static void
+sg_image_batch_load(struct sg_image_request *req)
+{
+    struct sg_image *img;
+    struct sg_pixbuf *pbuf = &req->pixbuf;
+
+    pbuf->data = NULL;
+    req->flags = 0;
+    req->err = NULL;
+    img = sg_image_file(req->path, req->pathlen, &req->err);
+    if (!img)
+        return;
+    if (!sg_pixbuf_alloc(pbuf, (img->flags & SG_IMAGE_ALPHA) != 0 ?
+                         SG_RGBA : SG_RGBX,
+                         img->width, img->height, &req->err)) {
+        if (img->draw(img, pbuf, 0, 0, &req->err)) {
+            free(pbuf->data);
+            pbuf->data = NULL;
+        } else {
+            req->flags = img->flags;
+        }
+    }
+    img->free(img);
+}
+
+/* Pass finished requests to the callback, in order.  */
+static void
+sg_image_batch_deliver(struct sg_image_batch *b)
+{
+    unsigned i;
+    for (i = b->delivered; i < b->count; i++) {
+        if (!sg_atomic_get_acquire(&b->done[i]))
+            break;
+        b->func(b->cxt, &b->req[i], i);
+    }
+    b->delivered = i;
+}
+
+static void
+sg_image_batch_task(void *arg, int index)
+{
+    struct sg_image_batch *b = arg;
+    unsigned i;
+
+    while (1) {
+        i = (unsigned) sg_atomic_fetch_add(&b->next, 1);
+        if (i >= b->count)
+            break;
+        sg_image_batch_load(&b->req[i]);
+        sg_atomic_set_release(&b->done[i], 1);
+        if (index == 0) {
+            if (b->func)
+                sg_image_batch_deliver(b);
+        } else {
+            sg_evt_signal(&b->evt);
+        }
+    }
+
+    /* The calling thread waits for the remaining requests so it can
+       deliver them in order.  An event which is signaled before the
+       wait is not lost, so it is enough to check after each wake.  */
+    if (index == 0 && b->func) {
+        sg_image_batch_deliver(b);
+        while (b->delivered < b->count) {
+            sg_evt_wait(&b->evt);
+            sg_image_batch_deliver(b);
+        }
+    }
+}
+
+int
+sg_image_loadbatch(struct sg_image_request *req, unsigned count,
+                   int nthread, sg_image_batch_func_t func, void *cxt)
+{
+    struct sg_image_batch b;
+    unsigned i;
+    int r;
+
+    if (nthread <= 0)
+        nthread = sg_thread_cpucount();
+    if ((unsigned) nthread > count)
+        nthread = (int) count;
+
+    b.done = NULL;
+    if (nthread > 1)
+        b.done = malloc(sizeof(*b.done) * count);
+    if (!b.done) {
+        /* Load on the calling thread.  */
+        for (i = 0; i < count; i++) {
+            sg_image_batch_load(&req[i]);
+            if (func)
+                func(cxt, &req[i], i);
+        }
+    } else {
+        b.req = req;
+        b.count = count;
+        b.func = func;
+        b.cxt = cxt;
+        sg_atomic_set(&b.next, 0);
+        for (i = 0; i < count; i++)
+            sg_atomic_set(&b.done[i], 0);
+        sg_evt_init(&b.evt);
+        b.delivered = 0;
+        sg_thread_run(sg_image_batch_task, &b, nthread);
+        sg_evt_destroy(&b.evt);
+        free(b.done);
+    }
+
+    r = 0;
+    for (i = 0; i < count; i++)
+        if (req[i].err)
+            r = -1;
+    return r;
+}
@@ -0,0 +1,168 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "sg/error.h"
+#include "sg/pixbuf.h"
+#include "private.h"
+#include <stdlib.h>
+
+int
+sg_image_checkdest(const struct sg_pixbuf *pbuf, int x, int y,
+                   int width, int height)
+{
+    if ((pbuf->format != SG_RGBX && pbuf->format != SG_RGBA) ||
+        x < 0 || width > pbuf->width || x > pbuf->width - width ||
+        y < 0 || height > pbuf->height || y > pbuf->height - height ||
+        !pbuf->data)
+        return -1;
+    return 0;
+}
+
+int
+sg_reduce_init(struct sg_reduce *r, int width, int shift,
+               struct sg_error **err)
+{
+    r->sum = calloc(SG_IMAGE_REDUCE(width, shift), sizeof(*r->sum) * 4);
+    if (!r->sum) {
+        sg_error_nomem(err);
+        return -1;
+    }
+    r->width = width;
+    r->shift = shift;
+    r->nrow = 0;
+    return 0;
+}
+
+void
+sg_reduce_destroy(struct sg_reduce *r)
+{
+    free(r->sum);
+}
+
+int
+sg_reduce_addrow(struct sg_reduce *r, const unsigned char *row)
+{
+    unsigned *sum = r->sum, s0, s1, s2, s3;
+    int x, i, n = 1 << r->shift, bw, w = r->width;
+    for (x = 0; x < w; x += n) {
+        bw = w - x < n ? w - x : n;
+        s0 = sum[0];
+        s1 = sum[1];
+        s2 = sum[2];
+        s3 = sum[3];
+        for (i = 0; i < bw; i++) {
+            s0 += row[0];
+            s1 += row[1];
+            s2 += row[2];
+            s3 += row[3];
+            row += 4;
+        }
+        sum[0] = s0;
+        sum[1] = s1;
+        sum[2] = s2;
+        sum[3] = s3;
+        sum += 4;
+    }
+    r->nrow++;
+    return r->nrow == n;
+}
+
+void
+sg_reduce_getrow(struct sg_reduce *r, unsigned char *row)
+{
+    unsigned *sum = r->sum, count, half;
+    int x, i, n = 1 << r->shift, bw, w = r->width, s2 = r->shift * 2;
+    for (x = 0; x < w; x += n) {
+        bw = w - x < n ? w - x : n;
+        count = (unsigned) (bw * r->nrow);
+        half = count >> 1;
+        if (count == 1u << s2) {
+            for (i = 0; i < 4; i++)
+                row[i] = (unsigned char) ((sum[i] + half) >> s2);
+        } else {
+            for (i = 0; i < 4; i++)
+                row[i] = (unsigned char) ((sum[i] + half) / count);
+        }
+        for (i = 0; i < 4; i++)
+            sum[i] = 0;
+        sum += 4;
+        row += 4;
+    }
+    r->nrow = 0;
+}
+
+int
+sg_image_drawreduced(struct sg_image *img, struct sg_pixbuf *pbuf,
+                     int x, int y, int shift, struct sg_error **err)
+{
+    struct sg_pixbuf tmp;
+    struct sg_reduce r;
+    unsigned char *dest;
+    int j, ret;
+
+    if (sg_image_checkdest(pbuf, x, y,
+                           SG_IMAGE_REDUCE(img->width, shift),
+                           SG_IMAGE_REDUCE(img->height, shift))) {
+        sg_error_invalid(err, __FUNCTION__, "pbuf");
+        return -1;
+    }
+    if (sg_pixbuf_alloc(&tmp, pbuf->format, img->width, img->height, err))
+        return -1;
+    if (sg_reduce_init(&r, img->width, shift, err)) {
+        free(tmp.data);
+        return -1;
+    }
+    ret = img->draw(img, &tmp, 0, 0, err);
+    if (!ret) {
+        dest = (unsigned char *) pbuf->data + pbuf->rowbytes * y + x * 4;
+        for (j = 0; j < img->height; j++) {
+            if (sg_reduce_addrow(
+                    &r, (unsigned char *) tmp.data + tmp.rowbytes * j) ||
+                j == img->height - 1) {
+                sg_reduce_getrow(&r, dest);
+                dest += pbuf->rowbytes;
+            }
+        }
+    }
+    sg_reduce_destroy(&r);
+    free(tmp.data);
+    return ret;
+}
+
+int
+sg_image_scaledsize(const struct sg_image *img, int width, int height,
+                    int *swidth, int *sheight)
+{
+    int shift = 0, iw = img->width, ih = img->height;
+    while (shift < SG_IMAGE_MAXSHIFT &&
+           (SG_IMAGE_REDUCE(iw, shift) > 1 ||
+            SG_IMAGE_REDUCE(ih, shift) > 1) &&
+           SG_IMAGE_REDUCE(iw, shift + 1) >= width &&
+           SG_IMAGE_REDUCE(ih, shift + 1) >= height)
+        shift++;
+    *swidth = SG_IMAGE_REDUCE(iw, shift);
+    *sheight = SG_IMAGE_REDUCE(ih, shift);
+    return shift;
+}
+
+int
+sg_image_drawscaled(struct sg_image *img, struct sg_pixbuf *pbuf,
+                    int x, int y, int width, int height,
+                    struct sg_error **err)
+{
+    int shift;
+    for (shift = 0; shift <= SG_IMAGE_MAXSHIFT; shift++) {
+        if (SG_IMAGE_REDUCE(img->width, shift) == width &&
+            SG_IMAGE_REDUCE(img->height, shift) == height)
+            break;
+    }
+    if (shift > SG_IMAGE_MAXSHIFT) {
+        sg_error_invalid(err, __FUNCTION__, "width");
+        return -1;
+    }
+    if (!shift)
+        return img->draw(img, pbuf, x, y, err);
+    if (img->drawscaled)
+        return img->drawscaled(img, pbuf, x, y, shift, err);
+    return sg_image_drawreduced(img, pbuf, x, y, shift, err);
+}
@@ -75,32 +75,100 @@ sg_image_jpeg_free(struct sg_image *img)
     free(im);
 }
 
+/* Number of scanlines to read from LibJPEG at a time.  */
+#define SG_JPEG_NROW 16
+
+/* Draw the image reduced by 2^shift.  LibJPEG reduces the image by up
+   to a factor of 8 while decoding, and any further reduction is done
+   by averaging.  */
 static int
-sg_image_jpeg_draw(struct sg_image *img, struct sg_pixbuf *pbuf,
-                   int x, int y, struct sg_error **err)
+sg_image_jpeg_decode(struct sg_image_jpeg *im, struct sg_pixbuf *pbuf,
+                     int x, int y, int shift, struct sg_error **err)
 {
-    struct sg_image_jpeg *im = (struct sg_image_jpeg *) img;
-    int iw = im->img.width, ih = im->img.height,
-        pw = pbuf->width, ph = pbuf->height, rb = pbuf->rowbytes;
-    unsigned char *data = pbuf->data, *rowp[1];
-    if ((pbuf->format != SG_RGBX && pbuf->format != SG_RGBA) ||
-        x < 0 || iw > pw || x > pw - iw ||
-        y < 0 || ih > ph || y > ph - ih ||
-        !data)
-        goto invalid;
-
-    jpeg_start_decompress(&im->cinfo);
-    while (im->cinfo.output_scanline < (unsigned) ih) {
-        rowp[0] = data + (im->cinfo.output_scanline + y) * rb + x * 4;
-        jpeg_read_scanlines(&im->cinfo, rowp, 1);
+    j_decompress_ptr cinfo = &im->cinfo;
+    int jshift = shift < 3 ? shift : 3, rshift = shift - jshift,
+        rb = pbuf->rowbytes, ow, oh, i, n;
+    unsigned char *data, *buf = NULL, *rowp[SG_JPEG_NROW];
+    struct sg_reduce r;
+
+    if (sg_image_checkdest(pbuf, x, y,
+                           SG_IMAGE_REDUCE(im->img.width, shift),
+                           SG_IMAGE_REDUCE(im->img.height, shift))) {
+        sg_error_invalid(err, __FUNCTION__, "pbuf");
+        return -1;
+    }
+
+    cinfo->scale_num = 1;
+    cinfo->scale_denom = 1u << jshift;
+    jpeg_calc_output_dimensions(cinfo);
+    ow = (int) cinfo->output_width;
+    oh = (int) cinfo->output_height;
+    if (ow != SG_IMAGE_REDUCE(im->img.width, jshift) ||
+        oh != SG_IMAGE_REDUCE(im->img.height, jshift)) {
+        sg_logs(SG_LOG_ERROR, "LibJPEG: unexpected scaled image size");
+        sg_error_data(err, "JPEG");
+        return -1;
+    }
+
+    if (rshift) {
+        buf = malloc((size_t) ow * 4 * SG_JPEG_NROW);
+        if (!buf) {
+            sg_error_nomem(err);
+            return -1;
+        }
+        if (sg_reduce_init(&r, ow, rshift, err)) {
+            free(buf);
+            return -1;
+        }
+        for (i = 0; i < SG_JPEG_NROW; i++)
+            rowp[i] = buf + (size_t) ow * 4 * i;
+    }
+
+    data = (unsigned char *) pbuf->data + rb * y + x * 4;
+    jpeg_start_decompress(cinfo);
+    while (cinfo->output_scanline < (unsigned) oh) {
+        n = oh - (int) cinfo->output_scanline;
+        if (n > SG_JPEG_NROW)
+            n = SG_JPEG_NROW;
+        if (!rshift) {
+            for (i = 0; i < n; i++)
+                rowp[i] = data + rb * ((int) cinfo->output_scanline + i);
+        }
+        n = (int) jpeg_read_scanlines(cinfo, rowp, n);
+        if (rshift) {
+            for (i = 0; i < n; i++) {
+                if (sg_reduce_addrow(&r, rowp[i])) {
+                    sg_reduce_getrow(&r, data);
+                    data += rb;
+                }
+            }
+        }
     }
-    jpeg_finish_decompress(&im->cinfo);
+    jpeg_finish_decompress(cinfo);
 
+    if (rshift) {
+        if (r.nrow)
+            sg_reduce_getrow(&r, data);
+        sg_reduce_destroy(&r);
+        free(buf);
+    }
     return 0;
+}
+
+static int
+sg_image_jpeg_draw(struct sg_image *img, struct sg_pixbuf *pbuf,
+                   int x, int y, struct sg_error **err)
+{
+    return sg_image_jpeg_decode(
+        (struct sg_image_jpeg *) img, pbuf, x, y, 0, err);
+}
 
-invalid:
-    sg_error_invalid(err, __FUNCTION__, "pbuf");
-    return -1;
+static int
+sg_image_jpeg_drawscaled(struct sg_image *img, struct sg_pixbuf *pbuf,
+                         int x, int y, int shift, struct sg_error **err)
+{
+    return sg_image_jpeg_decode(
+        (struct sg_image_jpeg *) img, pbuf, x, y, shift, err);
 }
 
 struct sg_image *
@@ -142,6 +210,7 @@ sg_image_jpeg(struct sg_filedata *data, struct sg_error **err)
          SG_IMAGE_COLOR : 0);
     im->img.free = sg_image_jpeg_free;
     im->img.draw = sg_image_jpeg_draw;
+    im->img.drawscaled = sg_image_jpeg_drawscaled;
 
     im->data = data;
     sg_filedata_incref(data);
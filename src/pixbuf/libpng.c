@@ -12,6 +12,7 @@
 #include <assert.h>
 #include <png.h>
 #include <stdlib.h>
+#include <string.h>
 
 struct sg_image_png {
     struct sg_image img;
@@ -108,12 +109,12 @@ sg_image_png_draw(struct sg_image *img, struct sg_pixbuf *pbuf,
 
     if ((im->img.flags & SG_IMAGE_ALPHA) != 0 &&
         pbuf->format == SG_RGBA) {
-        rect.data = data + rb * y + x;
+        rect.data = data + rb * y + x * 4;
         rect.format = SG_RGBA;
         rect.width = iw;
         rect.height = ih;
         rect.rowbytes = rb;
-        sg_pixbuf_premultiply_alpha(&rect);
+        sg_pixbuf_premultiply(&rect);
     }
 
     im->err = NULL;
@@ -121,6 +122,74 @@ sg_image_png_draw(struct sg_image *img, struct sg_pixbuf *pbuf,
     return 0;
 }
 
+/* Draw the image reduced by 2^shift, reducing each row as it is
+   decoded.  Interlaced images are decoded at full size first.  */
+static int
+sg_image_png_drawscaled(struct sg_image *img, struct sg_pixbuf *pbuf,
+                        int x, int y, int shift, struct sg_error **err)
+{
+    struct sg_image_png *im = (struct sg_image_png *) img;
+    int iw = im->img.width, ih = im->img.height, rb = pbuf->rowbytes, j,
+        premultiply;
+    png_struct *pngp = im->pngp;
+    unsigned char *row, *data;
+    struct sg_reduce r;
+    struct sg_pixbuf rect;
+
+    if (png_get_interlace_type(pngp, im->infop) != PNG_INTERLACE_NONE)
+        return sg_image_drawreduced(img, pbuf, x, y, shift, err);
+
+    if (sg_image_checkdest(pbuf, x, y,
+                           SG_IMAGE_REDUCE(iw, shift),
+                           SG_IMAGE_REDUCE(ih, shift))) {
+        sg_error_invalid(err, __FUNCTION__, "pbuf");
+        return -1;
+    }
+
+    row = malloc((size_t) iw * 4);
+    if (!row) {
+        sg_error_nomem(err);
+        return -1;
+    }
+    if (sg_reduce_init(&r, iw, shift, err)) {
+        free(row);
+        return -1;
+    }
+
+    im->err = err;
+    if (setjmp(png_jmpbuf(pngp))) {
+        sg_reduce_destroy(&r);
+        free(row);
+        return -1;
+    }
+
+    premultiply = (im->img.flags & SG_IMAGE_ALPHA) != 0 &&
+        pbuf->format == SG_RGBA;
+    rect.data = row;
+    rect.format = SG_RGBA;
+    rect.width = iw;
+    rect.height = 1;
+    rect.rowbytes = iw * 4;
+    data = (unsigned char *) pbuf->data + rb * y + x * 4;
+    for (j = 0; j < ih; j++) {
+        png_read_row(pngp, row, NULL);
+        if (premultiply)
+            sg_pixbuf_premultiply(&rect);
+        if (sg_reduce_addrow(&r, row)) {
+            sg_reduce_getrow(&r, data);
+            data += rb;
+        }
+    }
+    if (r.nrow)
+        sg_reduce_getrow(&r, data);
+    png_read_end(pngp, NULL);
+
+    im->err = NULL;
+    sg_reduce_destroy(&r);
+    free(row);
+    return 0;
+}
+
 struct sg_image *
 sg_image_png(struct sg_filedata *data, struct sg_error **err)
 {
@@ -185,6 +254,7 @@ sg_image_png(struct sg_filedata *data, struct sg_error **err)
          SG_IMAGE_COLOR : 0);
     im->img.free = sg_image_png_free;
     im->img.draw = sg_image_png_draw;
+    im->img.drawscaled = sg_image_png_drawscaled;
     sg_filedata_incref(data);
     im->err = NULL;
 
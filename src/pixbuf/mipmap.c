@@ -0,0 +1,500 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "sg/error.h"
+#include "sg/pixbuf.h"
+#include <math.h>
+#include <stdlib.h>
+
+#if defined __SSE2__ || defined _M_X64 || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2)
+# define SG_X_SSE2 1
+# include <emmintrin.h>
+#endif
+
+#define SG_PI 3.14159265358979323846
+
+/* Radius of the Kaiser filter, in destination pixels.  */
+#define SG_KAISER_RADIUS 2.0
+/* Shape parameter of the Kaiser window.  */
+#define SG_KAISER_ALPHA 4.0
+
+/* Linear values for each sRGB value.  */
+static const float SG_SRGB_LINEAR[256] = {
+    0.0f, 0.000303526984f, 0.000607053967f, 0.000910580951f, 0.00121410793f,
+    0.00151763492f, 0.0018211619f, 0.00212468888f, 0.00242821587f,
+    0.00273174285f, 0.00303526984f, 0.00334653576f, 0.00367650732f,
+    0.00402471702f, 0.00439144204f, 0.00477695348f, 0.0051815167f,
+    0.00560539162f, 0.00604883302f, 0.00651209079f, 0.00699541019f,
+    0.00749903204f, 0.00802319299f, 0.00856812562f, 0.0091340587f,
+    0.00972121732f, 0.010329823f, 0.010960094f, 0.0116122452f,
+    0.0122864884f, 0.0129830323f, 0.013702083f, 0.0144438436f,
+    0.0152085144f, 0.0159962934f, 0.0168073758f, 0.0176419545f,
+    0.0185002201f, 0.019382361f, 0.0202885631f, 0.0212190104f,
+    0.0221738848f, 0.0231533662f, 0.0241576324f, 0.0251868596f,
+    0.0262412219f, 0.0273208916f, 0.0284260395f, 0.0295568344f,
+    0.0307134437f, 0.0318960331f, 0.0331047666f, 0.0343398068f,
+    0.0356013149f, 0.0368894504f, 0.0382043716f, 0.0395462353f,
+    0.0409151969f, 0.0423114106f, 0.0437350293f, 0.0451862044f,
+    0.0466650863f, 0.0481718242f, 0.049706566f, 0.0512694584f, 0.052860647f,
+    0.0544802764f, 0.05612849f, 0.0578054302f, 0.0595112382f, 0.0612460542f,
+    0.0630100177f, 0.0648032667f, 0.0666259386f, 0.0684781698f,
+    0.0703600957f, 0.0722718507f, 0.0742135684f, 0.0761853815f,
+    0.0781874218f, 0.0802198203f, 0.0822827071f, 0.0843762115f,
+    0.086500462f, 0.0886555863f, 0.0908417112f, 0.0930589628f,
+    0.0953074666f, 0.0975873471f, 0.0998987282f, 0.102241733f, 0.104616484f,
+    0.107023103f, 0.109461711f, 0.111932428f, 0.114435374f, 0.116970668f,
+    0.119538428f, 0.122138772f, 0.124771818f, 0.12743768f, 0.130136477f,
+    0.132868322f, 0.13563333f, 0.138431615f, 0.141263291f, 0.144128471f,
+    0.147027266f, 0.14995979f, 0.152926152f, 0.155926464f, 0.158960835f,
+    0.162029376f, 0.165132195f, 0.1682694f, 0.171441101f, 0.174647404f,
+    0.177888416f, 0.181164244f, 0.184474995f, 0.187820772f, 0.191201683f,
+    0.19461783f, 0.19806932f, 0.201556254f, 0.205078736f, 0.20863687f,
+    0.212230757f, 0.2158605f, 0.2195262f, 0.223227957f, 0.226965874f,
+    0.230740049f, 0.234550582f, 0.238397574f, 0.242281122f, 0.246201327f,
+    0.250158285f, 0.254152094f, 0.258182853f, 0.262250658f, 0.266355605f,
+    0.270497791f, 0.274677312f, 0.278894263f, 0.28314874f, 0.287440838f,
+    0.29177065f, 0.296138271f, 0.300543794f, 0.304987314f, 0.309468923f,
+    0.313988713f, 0.318546778f, 0.323143209f, 0.327778098f, 0.332451536f,
+    0.337163615f, 0.341914425f, 0.346704056f, 0.3515326f, 0.356400144f,
+    0.36130678f, 0.366252596f, 0.37123768f, 0.376262123f, 0.381326011f,
+    0.386429434f, 0.391572478f, 0.396755231f, 0.40197778f, 0.407240212f,
+    0.412542613f, 0.417885071f, 0.42326767f, 0.428690497f, 0.434153636f,
+    0.439657174f, 0.445201195f, 0.450785783f, 0.456411023f, 0.462077f,
+    0.467783796f, 0.473531496f, 0.479320183f, 0.48514994f, 0.49102085f,
+    0.496932995f, 0.502886458f, 0.508881321f, 0.514917665f, 0.520995573f,
+    0.527115126f, 0.533276404f, 0.539479489f, 0.545724461f, 0.552011402f,
+    0.55834039f, 0.564711506f, 0.571124829f, 0.57758044f, 0.584078418f,
+    0.590618841f, 0.597201788f, 0.603827339f, 0.610495571f, 0.617206562f,
+    0.623960392f, 0.630757136f, 0.637596874f, 0.644479682f, 0.651405637f,
+    0.658374817f, 0.665387298f, 0.672443157f, 0.67954247f, 0.686685312f,
+    0.693871761f, 0.701101892f, 0.70837578f, 0.715693501f, 0.723055129f,
+    0.73046074f, 0.737910409f, 0.74540421f, 0.752942217f, 0.760524505f,
+    0.768151147f, 0.775822218f, 0.783537792f, 0.79129794f, 0.799102738f,
+    0.806952258f, 0.814846572f, 0.822785754f, 0.830769877f, 0.838799012f,
+    0.846873232f, 0.854992608f, 0.863157213f, 0.871367119f, 0.879622397f,
+    0.887923118f, 0.896269353f, 0.904661174f, 0.913098652f, 0.921581856f,
+    0.930110858f, 0.938685728f, 0.947306537f, 0.955973353f, 0.964686248f,
+    0.97344529f, 0.98225055f, 0.991102097f, 1.0f
+};
+
+/* Linear values halfway between consecutive sRGB values, for
+   rounding.  */
+static const float SG_SRGB_THRESHOLD[255] = {
+    0.000151763492f, 0.000455290475f, 0.000758817459f, 0.00106234444f,
+    0.00136587143f, 0.00166939841f, 0.00197292539f, 0.00227645238f,
+    0.00257997936f, 0.00288350634f, 0.0031883009f, 0.00350925935f,
+    0.00384831493f, 0.00420574803f, 0.00458183274f, 0.00497683725f,
+    0.00539102416f, 0.00582465078f, 0.00627796943f, 0.00675122763f,
+    0.00724466842f, 0.0077585305f, 0.00829304845f, 0.00884845295f,
+    0.00942497089f, 0.0100228256f, 0.0106422369f, 0.0112834213f,
+    0.0119465921f, 0.0126319598f, 0.0133397316f, 0.014070112f,
+    0.0148233028f, 0.0155995031f, 0.0163989095f, 0.0172217161f,
+    0.0180681146f, 0.0189382945f, 0.0198324428f, 0.0207507446f,
+    0.0216933829f, 0.0226605384f, 0.0236523902f, 0.024669115f,
+    0.0257108881f, 0.0267778826f, 0.0278702702f, 0.0289882206f,
+    0.0301319019f, 0.0313014806f, 0.0324971216f, 0.0337189882f,
+    0.0349672424f, 0.0362420443f, 0.037543553f, 0.0388719259f,
+    0.0402273192f, 0.0416098877f, 0.0430197848f, 0.0444571628f,
+    0.0459221727f, 0.047414964f, 0.0489356854f, 0.0504844842f,
+    0.0520615066f, 0.0536668976f, 0.0553008013f, 0.0569633604f,
+    0.0586547169f, 0.0603750115f, 0.0621243839f, 0.0639029729f,
+    0.0657109163f, 0.0675483509f, 0.0694154125f, 0.0713122362f,
+    0.0732389559f, 0.0751957047f, 0.077182615f, 0.0791998181f,
+    0.0812474446f, 0.0833256241f, 0.0854344855f, 0.087574157f,
+    0.0897447658f, 0.0919464383f, 0.0941793004f, 0.096443477f,
+    0.0987390924f, 0.10106627f, 0.103425133f, 0.105815802f, 0.108238401f,
+    0.110693048f, 0.113179865f, 0.11569897f, 0.118250482f, 0.12083452f,
+    0.1234512f, 0.12610064f, 0.128782955f, 0.131498261f, 0.134246673f,
+    0.137028306f, 0.139843272f, 0.142691686f, 0.14557366f, 0.148489305f,
+    0.151438734f, 0.154422057f, 0.157439385f, 0.160490827f, 0.163576493f,
+    0.166696492f, 0.169850932f, 0.17303992f, 0.176263564f, 0.179521971f,
+    0.182815248f, 0.186143498f, 0.189506829f, 0.192905345f, 0.196339151f,
+    0.19980835f, 0.203313045f, 0.20685334f, 0.210429338f, 0.21404114f,
+    0.217688849f, 0.221372565f, 0.225092389f, 0.228848422f, 0.232640764f,
+    0.236469515f, 0.240334772f, 0.244236636f, 0.248175205f, 0.252150577f,
+    0.256162849f, 0.260212118f, 0.264298482f, 0.268422037f, 0.272582879f,
+    0.276781103f, 0.281016805f, 0.285290081f, 0.289601024f, 0.293949728f,
+    0.298336289f, 0.302760799f, 0.307223352f, 0.31172404f, 0.316262956f,
+    0.320840192f, 0.325455841f, 0.330109993f, 0.33480274f, 0.339534173f,
+    0.344304382f, 0.349113458f, 0.353961491f, 0.35884857f, 0.363774785f,
+    0.368740224f, 0.373744977f, 0.378789131f, 0.383872775f, 0.388995998f,
+    0.394158885f, 0.399361525f, 0.404604005f, 0.409886411f, 0.41520883f,
+    0.420571347f, 0.42597405f, 0.431417022f, 0.43690035f, 0.442424119f,
+    0.447988412f, 0.453593316f, 0.459238914f, 0.46492529f, 0.470652528f,
+    0.476420711f, 0.482229923f, 0.488080246f, 0.493971763f, 0.499904557f,
+    0.505878709f, 0.511894303f, 0.517951419f, 0.524050139f, 0.530190544f,
+    0.536372716f, 0.542596734f, 0.54886268f, 0.555170635f, 0.561520677f,
+    0.567912887f, 0.574347344f, 0.580824128f, 0.587343319f, 0.593904994f,
+    0.600509233f, 0.607156115f, 0.613845717f, 0.620578117f, 0.627353395f,
+    0.634171626f, 0.641032889f, 0.647937261f, 0.654884819f, 0.66187564f,
+    0.668909801f, 0.675987377f, 0.683108445f, 0.690273081f, 0.697481362f,
+    0.704733362f, 0.712029156f, 0.719368822f, 0.726752432f, 0.734180063f,
+    0.741651788f, 0.749167683f, 0.756727821f, 0.764332277f, 0.771981125f,
+    0.779674438f, 0.787412289f, 0.795194753f, 0.803021903f, 0.810893811f,
+    0.81881055f, 0.826772194f, 0.834778813f, 0.842830482f, 0.850927271f,
+    0.859069253f, 0.867256499f, 0.875489082f, 0.883767073f, 0.892090542f,
+    0.900459561f, 0.908874202f, 0.917334534f, 0.925840628f, 0.934392556f,
+    0.942990386f, 0.95163419f, 0.960324036f, 0.969059996f, 0.977842139f,
+    0.986670534f, 0.99554525f
+};
+
+/* Filter weights for one dimension.  Each destination pixel is the
+   weighted sum of ntap source pixels, with indexes clamped to the
+   edge of the image.  */
+struct sg_mipfilter {
+    int ntap;
+    int *index;
+    float *weight;
+};
+
+/* Modified Bessel function of the first kind, order zero.  */
+static double
+sg_bessel0(double x)
+{
+    double sum = 1.0, term = 1.0, y = x * x * 0.25;
+    int k;
+    for (k = 1; k < 50 && term > sum * 1e-12; k++) {
+        term *= y / ((double) k * k);
+        sum += term;
+    }
+    return sum;
+}
+
+/* Kaiser windowed sinc, with t in destination pixels.  */
+static double
+sg_kaiser(double t)
+{
+    double s, u;
+    if (t <= -SG_KAISER_RADIUS || t >= SG_KAISER_RADIUS)
+        return 0.0;
+    s = t == 0.0 ? 1.0 : sin(SG_PI * t) / (SG_PI * t);
+    u = t / SG_KAISER_RADIUS;
+    return s * sg_bessel0(SG_KAISER_ALPHA * sqrt(1.0 - u * u)) /
+        sg_bessel0(SG_KAISER_ALPHA);
+}
+
+static void
+sg_mipfilter_destroy(struct sg_mipfilter *f)
+{
+    free(f->index);
+    free(f->weight);
+}
+
+static int
+sg_mipfilter_init(struct sg_mipfilter *f, int ssize, int dsize,
+                  sg_mipmap_filter_t filter, struct sg_error **err)
+{
+    double ratio = (double) ssize / dsize, x0, x1, w, sum;
+    int ntap, i, j, k, start, *index;
+    float *weight;
+
+    if (filter == SG_MIPMAP_BOX)
+        ntap = (int) ceil(ratio) + 1;
+    else
+        ntap = (int) ceil(2.0 * SG_KAISER_RADIUS * ratio) + 1;
+    f->ntap = ntap;
+    f->index = malloc(sizeof(*f->index) * ntap * dsize);
+    f->weight = malloc(sizeof(*f->weight) * ntap * dsize);
+    if (!f->index || !f->weight) {
+        sg_mipfilter_destroy(f);
+        sg_error_nomem(err);
+        return -1;
+    }
+
+    for (i = 0; i < dsize; i++) {
+        index = f->index + ntap * i;
+        weight = f->weight + ntap * i;
+        x0 = i * ratio;
+        x1 = (i + 1) * ratio;
+        if (filter == SG_MIPMAP_BOX)
+            start = (int) floor(x0);
+        else
+            start = (int) ceil(
+                (x0 + x1) * 0.5 - SG_KAISER_RADIUS * ratio - 0.5);
+        sum = 0.0;
+        for (k = 0; k < ntap; k++) {
+            j = start + k;
+            if (filter == SG_MIPMAP_BOX) {
+                w = (x1 < j + 1 ? x1 : j + 1) - (x0 > j ? x0 : j);
+                if (w < 0.0)
+                    w = 0.0;
+            } else {
+                w = sg_kaiser((j + 0.5 - (x0 + x1) * 0.5) / ratio);
+            }
+            index[k] = j < 0 ? 0 : j >= ssize ? ssize - 1 : j;
+            weight[k] = (float) w;
+            sum += w;
+        }
+        for (k = 0; k < ntap; k++)
+            weight[k] = (float) (weight[k] / sum);
+    }
+    return 0;
+}
+
+/* Convert a row of pixels to linear RGBA floats.  */
+static void
+sg_mipmap_loadrow(float *out, const unsigned char *p, int width,
+                  sg_pixbuf_format_t format, const float *ctab,
+                  const float *atab)
+{
+    int x;
+    switch (format) {
+    case SG_R:
+        for (x = 0; x < width; x++, p++, out += 4) {
+            out[0] = ctab[p[0]];
+            out[1] = out[2] = out[3] = 0.0f;
+        }
+        break;
+    case SG_RG:
+        for (x = 0; x < width; x++, p += 2, out += 4) {
+            out[0] = ctab[p[0]];
+            out[1] = atab[p[1]];
+            out[2] = out[3] = 0.0f;
+        }
+        break;
+    case SG_RGBX:
+        for (x = 0; x < width; x++, p += 4, out += 4) {
+            out[0] = ctab[p[0]];
+            out[1] = ctab[p[1]];
+            out[2] = ctab[p[2]];
+            out[3] = 0.0f;
+        }
+        break;
+    case SG_RGBA:
+        for (x = 0; x < width; x++, p += 4, out += 4) {
+            out[0] = ctab[p[0]];
+            out[1] = ctab[p[1]];
+            out[2] = ctab[p[2]];
+            out[3] = atab[p[3]];
+        }
+        break;
+    }
+}
+
+static unsigned char
+sg_mipmap_linear(float v)
+{
+    if (!(v > 0.0f))
+        return 0;
+    if (v >= 1.0f)
+        return 255;
+    return (unsigned char) (int) (v * 255.0f + 0.5f);
+}
+
+static unsigned char
+sg_mipmap_srgb(float v)
+{
+    int lo = 0, hi = 255, mid;
+    if (!(v > 0.0f))
+        return 0;
+    while (lo < hi) {
+        mid = (lo + hi) >> 1;
+        if (v >= SG_SRGB_THRESHOLD[mid])
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (unsigned char) lo;
+}
+
+/* Convert a row of linear RGBA floats to pixels.  */
+static void
+sg_mipmap_storerow(unsigned char *p, const float *in, int width,
+                   sg_pixbuf_format_t format, int srgb)
+{
+    int x, i, nc;
+    switch (format) {
+    case SG_R:
+    case SG_RG:
+        nc = 1;
+        break;
+    default:
+        nc = 3;
+        break;
+    }
+    for (x = 0; x < width; x++, in += 4) {
+        for (i = 0; i < nc; i++)
+            *p++ = srgb ? sg_mipmap_srgb(in[i]) : sg_mipmap_linear(in[i]);
+        switch (format) {
+        case SG_R:
+            break;
+        case SG_RG:
+            *p++ = sg_mipmap_linear(in[1]);
+            break;
+        case SG_RGBX:
+            *p++ = 255;
+            break;
+        case SG_RGBA:
+            *p++ = sg_mipmap_linear(in[3]);
+            break;
+        }
+    }
+}
+
+/* Filter a row horizontally.  */
+static void
+sg_mipmap_hfilter(float *out, const float *in, int width,
+                  const struct sg_mipfilter *f)
+{
+    const int *index = f->index;
+    const float *weight = f->weight;
+    int x, k, ntap = f->ntap;
+#if defined SG_X_SSE2
+    __m128 acc;
+    for (x = 0; x < width; x++) {
+        acc = _mm_setzero_ps();
+        for (k = 0; k < ntap; k++)
+            acc = _mm_add_ps(
+                acc, _mm_mul_ps(_mm_set1_ps(weight[k]),
+                                _mm_loadu_ps(in + index[k] * 4)));
+        _mm_storeu_ps(out + x * 4, acc);
+        index += ntap;
+        weight += ntap;
+    }
+#else
+    float a0, a1, a2, a3, w;
+    const float *p;
+    for (x = 0; x < width; x++) {
+        a0 = a1 = a2 = a3 = 0.0f;
+        for (k = 0; k < ntap; k++) {
+            w = weight[k];
+            p = in + index[k] * 4;
+            a0 += w * p[0];
+            a1 += w * p[1];
+            a2 += w * p[2];
+            a3 += w * p[3];
+        }
+        out[x*4+0] = a0;
+        out[x*4+1] = a1;
+        out[x*4+2] = a2;
+        out[x*4+3] = a3;
+        index += ntap;
+        weight += ntap;
+    }
+#endif
+}
+
+/* Sum rows with weights.  */
+static void
+sg_mipmap_vfilter(float *out, const float *const *rows,
+                  const float *weight, int ntap, int width)
+{
+    int x, k, n = width * 4;
+#if defined SG_X_SSE2
+    __m128 acc;
+    for (x = 0; x < n; x += 4) {
+        acc = _mm_setzero_ps();
+        for (k = 0; k < ntap; k++)
+            acc = _mm_add_ps(
+                acc, _mm_mul_ps(_mm_set1_ps(weight[k]),
+                                _mm_loadu_ps(rows[k] + x)));
+        _mm_storeu_ps(out + x, acc);
+    }
+#else
+    float a;
+    for (x = 0; x < n; x++) {
+        a = 0.0f;
+        for (k = 0; k < ntap; k++)
+            a += weight[k] * rows[k][x];
+        out[x] = a;
+    }
+#endif
+}
+
+int
+sg_pixbuf_miplevels(int width, int height)
+{
+    int n = 1;
+    while (width > 1 || height > 1) {
+        width = width > 1 ? width >> 1 : 1;
+        height = height > 1 ? height >> 1 : 1;
+        n++;
+    }
+    return n;
+}
+
+int
+sg_pixbuf_mipmap(struct sg_pixbuf *dest, const struct sg_pixbuf *src,
+                 sg_mipmap_filter_t filter, unsigned flags,
+                 struct sg_error **err)
+{
+    struct sg_mipfilter fh, fv;
+    float ctab[256], atab[256], *buf = NULL, *hbuf, *inrow;
+    const float **rows = NULL;
+    int *tag = NULL;
+    int sw = src->width, sh = src->height, dw = dest->width,
+        dh = dest->height, srgb = (flags & SG_MIPMAP_SRGB) != 0,
+        nslot, i, j, k, slot, y, ret = -1;
+    const int *index;
+
+    if (dest->format != src->format ||
+        (filter != SG_MIPMAP_BOX && filter != SG_MIPMAP_KAISER) ||
+        sw <= 0 || sh <= 0 ||
+        dw != (sw > 1 ? sw >> 1 : 1) || dh != (sh > 1 ? sh >> 1 : 1) ||
+        !src->data || !dest->data) {
+        sg_error_invalid(err, __FUNCTION__, "dest");
+        return -1;
+    }
+
+    for (i = 0; i < 256; i++) {
+        atab[i] = (float) i * (1.0f / 255.0f);
+        ctab[i] = srgb ? SG_SRGB_LINEAR[i] : atab[i];
+    }
+
+    if (sg_mipfilter_init(&fh, sw, dw, filter, err))
+        return -1;
+    if (sg_mipfilter_init(&fv, sh, dh, filter, err)) {
+        sg_mipfilter_destroy(&fh);
+        return -1;
+    }
+
+    /* Rows filtered horizontally are kept in a ring of slots, indexed
+       by source row modulo the number of slots.  The rows used by
+       each destination row are consecutive, so they never share a
+       slot.  */
+    nslot = fv.ntap;
+    buf = malloc(sizeof(*buf) * 4 * ((size_t) sw + (size_t) dw * nslot));
+    rows = malloc(sizeof(*rows) * nslot);
+    tag = malloc(sizeof(*tag) * nslot);
+    if (!buf || !rows || !tag) {
+        sg_error_nomem(err);
+        goto done;
+    }
+    inrow = buf;
+    hbuf = buf + (size_t) sw * 4;
+    for (i = 0; i < nslot; i++)
+        tag[i] = -1;
+
+    for (y = 0; y < dh; y++) {
+        index = fv.index + fv.ntap * y;
+        for (k = 0; k < fv.ntap; k++) {
+            j = index[k];
+            slot = j % nslot;
+            if (tag[slot] != j) {
+                sg_mipmap_loadrow(
+                    inrow,
+                    (const unsigned char *) src->data + src->rowbytes * j,
+                    sw, src->format, ctab, atab);
+                sg_mipmap_hfilter(hbuf + (size_t) dw * 4 * slot,
+                                  inrow, dw, &fh);
+                tag[slot] = j;
+            }
+            rows[k] = hbuf + (size_t) dw * 4 * slot;
+        }
+        sg_mipmap_vfilter(inrow, rows, fv.weight + fv.ntap * y,
+                          fv.ntap, dw);
+        sg_mipmap_storerow(
+            (unsigned char *) dest->data + dest->rowbytes * y,
+            inrow, dw, dest->format, srgb);
+    }
+    ret = 0;
+
+done:
+    free(buf);
+    free((void *) rows);
+    free(tag);
+    sg_mipfilter_destroy(&fh);
+    sg_mipfilter_destroy(&fv);
+    return ret;
+}
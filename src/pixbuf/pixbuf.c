@@ -27,29 +27,29 @@ sg_pixbuf_error(struct sg_error **err, const char *msg)
 
 static size_t
 sg_pixbuf_set(struct sg_pixbuf *pbuf, sg_pixbuf_format_t format,
-              int width, int height, struct sg_error **err)
+              int width, int height, unsigned flags, struct sg_error **err)
 {
-    int psz, w, h, npx;
+    int psz, rb;
 
     if (width <= 0 || height <= 0)
         goto invalid;
     if (width > MAX_DIM || height > MAX_DIM)
         goto toolarge;
-    w = sg_round_up_pow2_32(width);
-    h = sg_round_up_pow2_32(height);
-    if (w > INT_MAX / h)
-        goto toolarge;
+    if ((flags & SG_PIXBUF_POW2) != 0) {
+        width = sg_round_up_pow2_32(width);
+        height = sg_round_up_pow2_32(height);
+    }
 
     psz = SG_PIXBUF_FORMATSIZE[format];
-    npx = w * h;
-    if (npx > INT_MAX / psz)
+    rb = (psz * width + SG_PIXBUF_ALIGN - 1) & ~(SG_PIXBUF_ALIGN - 1);
+    if (rb > INT_MAX / height)
         goto toolarge;
 
     pbuf->format = format;
     pbuf->width = width;
     pbuf->height = height;
-    pbuf->rowbytes = psz * w;
-    return psz * w * h;
+    pbuf->rowbytes = rb;
+    return (size_t) rb * height;
 
 toolarge:
     sg_pixbuf_error(err, "dimensions too large");
@@ -61,15 +61,16 @@ invalid:
 }
 
 int
-sg_pixbuf_alloc(struct sg_pixbuf *pbuf, sg_pixbuf_format_t format,
-                int width, int height, struct sg_error **err)
+sg_pixbuf_allocflags(struct sg_pixbuf *pbuf, sg_pixbuf_format_t format,
+                     int width, int height, unsigned flags,
+                     struct sg_error **err)
 {
     size_t sz;
     void *ptr;
-    sz = sg_pixbuf_set(pbuf, format, width, height, err);
+    sz = sg_pixbuf_set(pbuf, format, width, height, flags, err);
     if (!sz)
         return -1;
-    ptr = malloc(sz);
+    ptr = (flags & SG_PIXBUF_ZERO) != 0 ? calloc(sz, 1) : malloc(sz);
     if (!ptr) {
         sg_error_nomem(err);
         return -1;
@@ -78,20 +79,17 @@ sg_pixbuf_alloc(struct sg_pixbuf *pbuf, sg_pixbuf_format_t format,
     return 0;
 }
 
+int
+sg_pixbuf_alloc(struct sg_pixbuf *pbuf, sg_pixbuf_format_t format,
+                int width, int height, struct sg_error **err)
+{
+    return sg_pixbuf_allocflags(pbuf, format, width, height, 0, err);
+}
+
 int
 sg_pixbuf_calloc(struct sg_pixbuf *pbuf, sg_pixbuf_format_t format,
                  int width, int height, struct sg_error **err)
 {
-    size_t sz;
-    void *ptr;
-    sz = sg_pixbuf_set(pbuf, format, width, height, err);
-    if (!sz)
-        return -1;
-    ptr = calloc(sz, 1);
-    if (!ptr) {
-        sg_error_nomem(err);
-        return -1;
-    }
-    pbuf->data = ptr;
-    return 0;
+    return sg_pixbuf_allocflags(
+        pbuf, format, width, height, SG_PIXBUF_ZERO, err);
 }
@@ -0,0 +1,559 @@
+/* Copyright 2012-2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "sg/defs.h"
+#include "sg/pixbuf.h"
+#include <string.h>
+
+#if defined __SSE2__ || defined _M_X64 || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2)
+# define SG_PIXBUF_SSE2 1
+# include <emmintrin.h>
+#endif
+
+/* All operations work a row at a time, so pixel buffers may have any
+   row stride, including a negative stride.  Each row function
+   processes as many pixels as possible with SIMD and finishes the row
+   with scalar code, which also serves as the reference
+   implementation.  */
+
+/* Get a pointer to a row in a pixel buffer.  */
+SG_INLINE unsigned char *
+sg_pixbuf_row(const struct sg_pixbuf *pbuf, int y)
+{
+    return (unsigned char *) pbuf->data + (ptrdiff_t) pbuf->rowbytes * y;
+}
+
+/* Compute luminance from RGB, using the Rec. 601 weights.  */
+SG_INLINE unsigned
+sg_pixbuf_luma(unsigned r, unsigned g, unsigned b)
+{
+    return (r * 77 + g * 150 + b * 29 + 128) >> 8;
+}
+
+/* ===== Premultiplied alpha ===== */
+
+static void
+sg_pixbuf_premultiply_row(unsigned char *p, int n)
+{
+    int i = 0;
+    unsigned a, r, g, b;
+
+#if defined SG_PIXBUF_SSE2
+    {
+        /* Multiply each channel by alpha, and the alpha channel by 255,
+           which is the identity after rounding.  */
+        const __m128i zero = _mm_setzero_si128(),
+            one = _mm_set1_epi16(1),
+            cmask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1),
+            a255 = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+        __m128i v, lo, hi, alo, ahi;
+        for (; i + 4 <= n; i += 4) {
+            v = _mm_loadu_si128((const __m128i *) (p + i * 4));
+            lo = _mm_unpacklo_epi8(v, zero);
+            hi = _mm_unpackhi_epi8(v, zero);
+            alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xff), 0xff);
+            ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xff), 0xff);
+            alo = _mm_or_si128(_mm_and_si128(alo, cmask), a255);
+            ahi = _mm_or_si128(_mm_and_si128(ahi, cmask), a255);
+            lo = _mm_mullo_epi16(lo, alo);
+            hi = _mm_mullo_epi16(hi, ahi);
+            lo = _mm_add_epi16(_mm_add_epi16(lo, one), _mm_srli_epi16(lo, 8));
+            hi = _mm_add_epi16(_mm_add_epi16(hi, one), _mm_srli_epi16(hi, 8));
+            lo = _mm_srli_epi16(lo, 8);
+            hi = _mm_srli_epi16(hi, 8);
+            _mm_storeu_si128((__m128i *) (p + i * 4),
+                             _mm_packus_epi16(lo, hi));
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        a = p[i*4+3];
+        r = p[i*4+0] * a;
+        g = p[i*4+1] * a;
+        b = p[i*4+2] * a;
+        p[i*4+0] = (unsigned char) ((r + 1 + (r >> 8)) >> 8);
+        p[i*4+1] = (unsigned char) ((g + 1 + (g >> 8)) >> 8);
+        p[i*4+2] = (unsigned char) ((b + 1 + (b >> 8)) >> 8);
+    }
+}
+
+static void
+sg_pixbuf_unpremultiply_row(unsigned char *p, int n)
+{
+    int i = 0;
+    unsigned a, c, j;
+
+#if defined SG_PIXBUF_SSE2
+    {
+        /* Compute floor(c * 255 / a + 0.5) in single precision, which
+           is exact for these inputs.  Zero alpha produces zero.  */
+        const __m128i zero = _mm_setzero_si128(),
+            amask = _mm_set1_epi32((int) 0xff000000);
+        const __m128 s255 = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+        __m128i v, lo, hi, px[4], out, va, za;
+        __m128 f, fa;
+        int k;
+        for (; i + 4 <= n; i += 4) {
+            v = _mm_loadu_si128((const __m128i *) (p + i * 4));
+            lo = _mm_unpacklo_epi8(v, zero);
+            hi = _mm_unpackhi_epi8(v, zero);
+            px[0] = _mm_unpacklo_epi16(lo, zero);
+            px[1] = _mm_unpackhi_epi16(lo, zero);
+            px[2] = _mm_unpacklo_epi16(hi, zero);
+            px[3] = _mm_unpackhi_epi16(hi, zero);
+            for (k = 0; k < 4; k++) {
+                f = _mm_cvtepi32_ps(px[k]);
+                fa = _mm_shuffle_ps(f, f, 0xff);
+                f = _mm_add_ps(_mm_div_ps(_mm_mul_ps(f, s255), fa), half);
+                px[k] = _mm_cvttps_epi32(f);
+            }
+            out = _mm_packus_epi16(_mm_packs_epi32(px[0], px[1]),
+                                   _mm_packs_epi32(px[2], px[3]));
+            va = _mm_and_si128(v, amask);
+            za = _mm_cmpeq_epi32(va, zero);
+            out = _mm_or_si128(_mm_andnot_si128(_mm_or_si128(za, amask), out),
+                               va);
+            _mm_storeu_si128((__m128i *) (p + i * 4), out);
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        a = p[i*4+3];
+        for (j = 0; j < 3; j++) {
+            if (a) {
+                c = (p[i*4+j] * 510 + a) / (a * 2);
+                p[i*4+j] = (unsigned char) (c > 255 ? 255 : c);
+            } else {
+                p[i*4+j] = 0;
+            }
+        }
+    }
+}
+
+void
+sg_pixbuf_premultiply(struct sg_pixbuf *pbuf)
+{
+    int y;
+    if (pbuf->format != SG_RGBA)
+        return;
+    for (y = 0; y < pbuf->height; y++)
+        sg_pixbuf_premultiply_row(sg_pixbuf_row(pbuf, y), pbuf->width);
+}
+
+void
+sg_pixbuf_unpremultiply(struct sg_pixbuf *pbuf)
+{
+    int y;
+    if (pbuf->format != SG_RGBA)
+        return;
+    for (y = 0; y < pbuf->height; y++)
+        sg_pixbuf_unpremultiply_row(sg_pixbuf_row(pbuf, y), pbuf->width);
+}
+
+/* ===== Swizzle ===== */
+
+static void
+sg_pixbuf_swizzle_row(unsigned char *p, int n, const unsigned char *order)
+{
+    int i = 0;
+    unsigned o0 = order[0], o1 = order[1], o2 = order[2], o3 = order[3];
+    unsigned char t[4];
+#if defined SG_PIXBUF_SSE2
+    unsigned j;
+#endif
+
+#if defined SG_PIXBUF_SSE2
+    {
+        const __m128i mask = _mm_set1_epi32(0xff);
+        __m128i src[4], dest[4], v, out;
+        for (j = 0; j < 4; j++) {
+            src[j] = _mm_cvtsi32_si128(order[j] * 8);
+            dest[j] = _mm_cvtsi32_si128(j * 8);
+        }
+        for (; i + 4 <= n; i += 4) {
+            v = _mm_loadu_si128((const __m128i *) (p + i * 4));
+            out = _mm_setzero_si128();
+            for (j = 0; j < 4; j++)
+                out = _mm_or_si128(out, _mm_sll_epi32(_mm_and_si128(
+                    _mm_srl_epi32(v, src[j]), mask), dest[j]));
+            _mm_storeu_si128((__m128i *) (p + i * 4), out);
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        t[0] = p[i*4+o0];
+        t[1] = p[i*4+o1];
+        t[2] = p[i*4+o2];
+        t[3] = p[i*4+o3];
+        memcpy(p + i * 4, t, 4);
+    }
+}
+
+void
+sg_pixbuf_swizzle(struct sg_pixbuf *pbuf, const unsigned char *order)
+{
+    unsigned char o[4];
+    int y;
+    if (pbuf->format != SG_RGBX && pbuf->format != SG_RGBA)
+        return;
+    for (y = 0; y < 4; y++)
+        o[y] = order[y] & 3;
+    for (y = 0; y < pbuf->height; y++)
+        sg_pixbuf_swizzle_row(sg_pixbuf_row(pbuf, y), pbuf->width, o);
+}
+
+/* ===== Vertical flip ===== */
+
+static void
+sg_pixbuf_swaprows(unsigned char *SG_RESTRICT p, unsigned char *SG_RESTRICT q,
+                   size_t n)
+{
+    size_t i = 0;
+    unsigned char t;
+
+#if defined SG_PIXBUF_SSE2
+    {
+        __m128i a0, a1, b0, b1;
+        for (; i + 32 <= n; i += 32) {
+            a0 = _mm_loadu_si128((const __m128i *) (p + i));
+            a1 = _mm_loadu_si128((const __m128i *) (p + i + 16));
+            b0 = _mm_loadu_si128((const __m128i *) (q + i));
+            b1 = _mm_loadu_si128((const __m128i *) (q + i + 16));
+            _mm_storeu_si128((__m128i *) (p + i), b0);
+            _mm_storeu_si128((__m128i *) (p + i + 16), b1);
+            _mm_storeu_si128((__m128i *) (q + i), a0);
+            _mm_storeu_si128((__m128i *) (q + i + 16), a1);
+        }
+    }
+#else
+    {
+        unsigned char buf[256];
+        for (; i + sizeof(buf) <= n; i += sizeof(buf)) {
+            memcpy(buf, p + i, sizeof(buf));
+            memcpy(p + i, q + i, sizeof(buf));
+            memcpy(q + i, buf, sizeof(buf));
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        t = p[i];
+        p[i] = q[i];
+        q[i] = t;
+    }
+}
+
+void
+sg_pixbuf_flip(struct sg_pixbuf *pbuf)
+{
+    size_t n = SG_PIXBUF_FORMATSIZE[pbuf->format] * (size_t) pbuf->width;
+    int y, h = pbuf->height;
+    for (y = 0; y < h / 2; y++)
+        sg_pixbuf_swaprows(sg_pixbuf_row(pbuf, y),
+                           sg_pixbuf_row(pbuf, h - 1 - y), n);
+}
+
+/* ===== Format conversion ===== */
+
+/* Convert a row of pixels.  The destination may be the same as the
+   source if the pixels are the same size.  */
+typedef void (*sg_pixbuf_convert_func)(unsigned char *d,
+                                       const unsigned char *s, int n);
+
+/* R to RG: gray, 255.  */
+static void
+sg_pixbuf_convert_r_rg(unsigned char *d, const unsigned char *s, int n)
+{
+    int i = 0;
+#if defined SG_PIXBUF_SSE2
+    {
+        const __m128i ff = _mm_set1_epi8(-1);
+        __m128i v;
+        for (; i + 16 <= n; i += 16) {
+            v = _mm_loadu_si128((const __m128i *) (s + i));
+            _mm_storeu_si128((__m128i *) (d + i * 2),
+                             _mm_unpacklo_epi8(v, ff));
+            _mm_storeu_si128((__m128i *) (d + i * 2 + 16),
+                             _mm_unpackhi_epi8(v, ff));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        d[i*2+0] = s[i];
+        d[i*2+1] = 255;
+    }
+}
+
+/* R to RGBA or RGBX: gray, gray, gray, 255.  */
+static void
+sg_pixbuf_convert_r_rgba(unsigned char *d, const unsigned char *s, int n)
+{
+    int i = 0;
+#if defined SG_PIXBUF_SSE2
+    {
+        const __m128i ff = _mm_set1_epi8(-1);
+        __m128i v, gg, ga;
+        for (; i + 16 <= n; i += 16) {
+            v = _mm_loadu_si128((const __m128i *) (s + i));
+            gg = _mm_unpacklo_epi8(v, v);
+            ga = _mm_unpacklo_epi8(v, ff);
+            _mm_storeu_si128((__m128i *) (d + i * 4),
+                             _mm_unpacklo_epi16(gg, ga));
+            _mm_storeu_si128((__m128i *) (d + i * 4 + 16),
+                             _mm_unpackhi_epi16(gg, ga));
+            gg = _mm_unpackhi_epi8(v, v);
+            ga = _mm_unpackhi_epi8(v, ff);
+            _mm_storeu_si128((__m128i *) (d + i * 4 + 32),
+                             _mm_unpacklo_epi16(gg, ga));
+            _mm_storeu_si128((__m128i *) (d + i * 4 + 48),
+                             _mm_unpackhi_epi16(gg, ga));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        d[i*4+0] = s[i];
+        d[i*4+1] = s[i];
+        d[i*4+2] = s[i];
+        d[i*4+3] = 255;
+    }
+}
+
+/* RG to R: gray.  */
+static void
+sg_pixbuf_convert_rg_r(unsigned char *d, const unsigned char *s, int n)
+{
+    int i = 0;
+#if defined SG_PIXBUF_SSE2
+    {
+        const __m128i mask = _mm_set1_epi16(0xff);
+        __m128i v0, v1;
+        for (; i + 16 <= n; i += 16) {
+            v0 = _mm_loadu_si128((const __m128i *) (s + i * 2));
+            v1 = _mm_loadu_si128((const __m128i *) (s + i * 2 + 16));
+            _mm_storeu_si128((__m128i *) (d + i), _mm_packus_epi16(
+                _mm_and_si128(v0, mask), _mm_and_si128(v1, mask)));
+        }
+    }
+#endif
+    for (; i < n; i++)
+        d[i] = s[i*2];
+}
+
+/* RG to RGBA or RGBX: gray, gray, gray, alpha or 255.  */
+static void
+sg_pixbuf_convert_rg_rgba2(unsigned char *d, const unsigned char *s, int n,
+                           int opaque)
+{
+    int i = 0;
+#if defined SG_PIXBUF_SSE2
+    {
+        const __m128i lmask = _mm_set1_epi16(0xff),
+            amask = _mm_set1_epi16(opaque ? (short) 0xff00 : 0);
+        __m128i v, l, la;
+        for (; i + 8 <= n; i += 8) {
+            v = _mm_loadu_si128((const __m128i *) (s + i * 2));
+            l = _mm_and_si128(v, lmask);
+            l = _mm_or_si128(l, _mm_slli_epi16(l, 8));
+            la = _mm_or_si128(v, amask);
+            _mm_storeu_si128((__m128i *) (d + i * 4),
+                             _mm_unpacklo_epi16(l, la));
+            _mm_storeu_si128((__m128i *) (d + i * 4 + 16),
+                             _mm_unpackhi_epi16(l, la));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        unsigned char l = s[i*2], a = opaque ? 255 : s[i*2+1];
+        d[i*4+0] = l;
+        d[i*4+1] = l;
+        d[i*4+2] = l;
+        d[i*4+3] = a;
+    }
+}
+
+static void
+sg_pixbuf_convert_rg_rgba(unsigned char *d, const unsigned char *s, int n)
+{
+    sg_pixbuf_convert_rg_rgba2(d, s, n, 0);
+}
+
+static void
+sg_pixbuf_convert_rg_rgbx(unsigned char *d, const unsigned char *s, int n)
+{
+    sg_pixbuf_convert_rg_rgba2(d, s, n, 1);
+}
+
+#if defined SG_PIXBUF_SSE2
+
+/* Compute the luminance of four pixels, as 32-bit integers.  */
+SG_INLINE __m128i
+sg_pixbuf_luma4(__m128i v)
+{
+    const __m128i mask = _mm_set1_epi32(0x00ff00ff),
+        gmask = _mm_set1_epi32(0xff),
+        rb = _mm_set1_epi32((29 << 16) | 77),
+        g = _mm_set1_epi32(150),
+        round = _mm_set1_epi32(128);
+    __m128i x;
+    x = _mm_add_epi32(
+        _mm_madd_epi16(_mm_and_si128(v, mask), rb),
+        _mm_madd_epi16(_mm_and_si128(_mm_srli_epi32(v, 8), gmask), g));
+    return _mm_srli_epi32(_mm_add_epi32(x, round), 8);
+}
+
+/* Compute the luminance of 16 pixels, as bytes.  */
+SG_INLINE __m128i
+sg_pixbuf_luma16(const unsigned char *s)
+{
+    __m128i y0, y1, y2, y3;
+    y0 = sg_pixbuf_luma4(_mm_loadu_si128((const __m128i *) s));
+    y1 = sg_pixbuf_luma4(_mm_loadu_si128((const __m128i *) (s + 16)));
+    y2 = sg_pixbuf_luma4(_mm_loadu_si128((const __m128i *) (s + 32)));
+    y3 = sg_pixbuf_luma4(_mm_loadu_si128((const __m128i *) (s + 48)));
+    return _mm_packus_epi16(_mm_packs_epi32(y0, y1),
+                            _mm_packs_epi32(y2, y3));
+}
+
+#endif
+
+/* RGBA or RGBX to R: luminance.  */
+static void
+sg_pixbuf_convert_rgba_r(unsigned char *d, const unsigned char *s, int n)
+{
+    int i = 0;
+#if defined SG_PIXBUF_SSE2
+    for (; i + 16 <= n; i += 16)
+        _mm_storeu_si128((__m128i *) (d + i), sg_pixbuf_luma16(s + i * 4));
+#endif
+    for (; i < n; i++)
+        d[i] = (unsigned char) sg_pixbuf_luma(s[i*4], s[i*4+1], s[i*4+2]);
+}
+
+/* RGBA or RGBX to RG: luminance, alpha or 255.  */
+static void
+sg_pixbuf_convert_rgba_rg2(unsigned char *d, const unsigned char *s, int n,
+                           int opaque)
+{
+    int i = 0;
+#if defined SG_PIXBUF_SSE2
+    {
+        const __m128i ff = _mm_set1_epi8(-1);
+        __m128i y, a, a0, a1, a2, a3;
+        for (; i + 16 <= n; i += 16) {
+            y = sg_pixbuf_luma16(s + i * 4);
+            if (opaque) {
+                a = ff;
+            } else {
+                a0 = _mm_srli_epi32(
+                    _mm_loadu_si128((const __m128i *) (s + i * 4)), 24);
+                a1 = _mm_srli_epi32(
+                    _mm_loadu_si128((const __m128i *) (s + i * 4 + 16)), 24);
+                a2 = _mm_srli_epi32(
+                    _mm_loadu_si128((const __m128i *) (s + i * 4 + 32)), 24);
+                a3 = _mm_srli_epi32(
+                    _mm_loadu_si128((const __m128i *) (s + i * 4 + 48)), 24);
+                a = _mm_packus_epi16(_mm_packs_epi32(a0, a1),
+                                     _mm_packs_epi32(a2, a3));
+            }
+            _mm_storeu_si128((__m128i *) (d + i * 2),
+                             _mm_unpacklo_epi8(y, a));
+            _mm_storeu_si128((__m128i *) (d + i * 2 + 16),
+                             _mm_unpackhi_epi8(y, a));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        d[i*2+0] = (unsigned char)
+            sg_pixbuf_luma(s[i*4], s[i*4+1], s[i*4+2]);
+        d[i*2+1] = opaque ? 255 : s[i*4+3];
+    }
+}
+
+static void
+sg_pixbuf_convert_rgba_rg(unsigned char *d, const unsigned char *s, int n)
+{
+    sg_pixbuf_convert_rgba_rg2(d, s, n, 0);
+}
+
+static void
+sg_pixbuf_convert_rgbx_rg(unsigned char *d, const unsigned char *s, int n)
+{
+    sg_pixbuf_convert_rgba_rg2(d, s, n, 1);
+}
+
+/* RGBA to RGBX or RGBX to RGBA: set alpha to 255.  */
+static void
+sg_pixbuf_convert_opaque(unsigned char *d, const unsigned char *s, int n)
+{
+    int i = 0;
+#if defined SG_PIXBUF_SSE2
+    {
+        const __m128i amask = _mm_set1_epi32((int) 0xff000000);
+        __m128i v;
+        for (; i + 4 <= n; i += 4) {
+            v = _mm_loadu_si128((const __m128i *) (s + i * 4));
+            _mm_storeu_si128((__m128i *) (d + i * 4),
+                             _mm_or_si128(v, amask));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        d[i*4+0] = s[i*4+0];
+        d[i*4+1] = s[i*4+1];
+        d[i*4+2] = s[i*4+2];
+        d[i*4+3] = 255;
+    }
+}
+
+/* Conversion functions, indexed by source format, then destination
+   format.  NULL is a copy.  */
+static const sg_pixbuf_convert_func
+SG_PIXBUF_CONVERT[SG_PIXBUF_NFORMAT][SG_PIXBUF_NFORMAT] = {
+    {
+        NULL,
+        sg_pixbuf_convert_r_rg,
+        sg_pixbuf_convert_r_rgba,
+        sg_pixbuf_convert_r_rgba
+    },
+    {
+        sg_pixbuf_convert_rg_r,
+        NULL,
+        sg_pixbuf_convert_rg_rgbx,
+        sg_pixbuf_convert_rg_rgba
+    },
+    {
+        sg_pixbuf_convert_rgba_r,
+        sg_pixbuf_convert_rgbx_rg,
+        NULL,
+        sg_pixbuf_convert_opaque
+    },
+    {
+        sg_pixbuf_convert_rgba_r,
+        sg_pixbuf_convert_rgba_rg,
+        sg_pixbuf_convert_opaque,
+        NULL
+    }
+};
+
+void
+sg_pixbuf_convert(struct sg_pixbuf *dest, const struct sg_pixbuf *src)
+{
+    sg_pixbuf_convert_func func =
+        SG_PIXBUF_CONVERT[src->format][dest->format];
+    size_t rowsize = SG_PIXBUF_FORMATSIZE[src->format] * (size_t) src->width;
+    unsigned char *d;
+    const unsigned char *s;
+    int y;
+    for (y = 0; y < src->height; y++) {
+        d = sg_pixbuf_row(dest, y);
+        s = sg_pixbuf_row(src, y);
+        if (func)
+            func(d, s, src->width);
+        else if (d != s)
+            memcpy(d, s, rowsize);
+    }
+}
@@ -0,0 +1,544 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+
+/* Parallel PNG writer.  The image is divided into strips, and each
+   strip is filtered and compressed on its own thread as a raw deflate
+   stream ending on a byte boundary.  The streams are joined into one
+   zlib stream, the same way pigz does it: each stream but the last
+   ends with a sync flush, and the checksums are combined.  Each strip
+   is primed with the 32 KiB of filtered data preceding it, so little
+   compression is lost at the strip boundaries.  */
+
+#include "sg/atomic.h"
+#include "sg/error.h"
+#include "sg/file.h"
+#include "sg/pixbuf.h"
+#include "sg/thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#if defined __SSE2__ || defined _M_X64 || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2)
+# define SG_X_SSE2 1
+# include <emmintrin.h>
+#endif
+
+/* Approximate amount of filtered data in each strip.  */
+#define SG_PNG_STRIPSIZE (256 * 1024)
+
+/* Size of the deflate window, the most data a strip can use from
+   preceding strips.  */
+#define SG_PNG_WINDOW 32768
+
+static const unsigned char SG_PNG_SIGNATURE[8] = {
+    137, 80, 78, 71, 13, 10, 26, 10
+};
+
+static const struct sg_pngopts SG_PNG_DEFAULTOPTS = {
+    6, SG_PNG_FILTER_ADAPTIVE, 0
+};
+
+/* Result of compressing one strip.  */
+enum {
+    SG_PNG_OK,
+    SG_PNG_NOMEM,
+    SG_PNG_ZERROR
+};
+
+struct sg_png_strip {
+    /* Compressed data, starting at offset 2 to leave room for the
+       zlib header, with 4 spare bytes at the end for the trailer.  */
+    unsigned char *data;
+    size_t len;
+    /* Length and Adler-32 checksum of the uncompressed data.  */
+    size_t inlen;
+    uLong adler;
+    int result;
+};
+
+struct sg_png_job {
+    const struct sg_pixbuf *pbuf;
+    int level;
+    sg_png_filter_t filter;
+    /* Bytes per pixel in the output, and bytes per filtered row,
+       including the filter type byte.  */
+    int bpp;
+    size_t rowsize;
+    int striprows, nstrip;
+    struct sg_png_strip *strip;
+    /* Index of the next strip to compress.  */
+    sg_atomic_t next;
+    /* Set if any strip failed.  */
+    sg_atomic_t failed;
+};
+
+/* Copy a row of source pixels, dropping the X channel of RGBX.  */
+static void
+sg_png_pack(unsigned char *dest, const struct sg_pixbuf *pbuf, int y)
+{
+    const unsigned char *src =
+        (const unsigned char *) pbuf->data + (size_t) pbuf->rowbytes * y;
+    int i, n = pbuf->width;
+    if (pbuf->format == SG_RGBA) {
+        memcpy(dest, src, (size_t) n * 4);
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        dest[i*3+0] = src[i*4+0];
+        dest[i*3+1] = src[i*4+1];
+        dest[i*3+2] = src[i*4+2];
+    }
+}
+
+/* Apply the Paeth filter to as much of a row as possible with SIMD,
+   starting after the first pixel, and return the index of the first
+   byte not filtered.  */
+static size_t
+sg_png_paeth(unsigned char *dest, const unsigned char *cur,
+             const unsigned char *prev, size_t n, size_t b)
+{
+#if defined SG_X_SSE2
+    __m128i z = _mm_setzero_si128(), a, p, c, pa, pb, pc, m1, m2, pred;
+    size_t i;
+    for (i = b; i + 8 <= n; i += 8) {
+        a = _mm_unpacklo_epi8(
+            _mm_loadl_epi64((const __m128i *) (cur + i - b)), z);
+        p = _mm_unpacklo_epi8(
+            _mm_loadl_epi64((const __m128i *) (prev + i)), z);
+        c = _mm_unpacklo_epi8(
+            _mm_loadl_epi64((const __m128i *) (prev + i - b)), z);
+        pa = _mm_sub_epi16(p, c);
+        pb = _mm_sub_epi16(a, c);
+        pc = _mm_add_epi16(pa, pb);
+        pa = _mm_max_epi16(pa, _mm_sub_epi16(z, pa));
+        pb = _mm_max_epi16(pb, _mm_sub_epi16(z, pb));
+        pc = _mm_max_epi16(pc, _mm_sub_epi16(z, pc));
+        /* Use a unless m1 is set, then use c if m2 is set, else p.  */
+        m1 = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+        m2 = _mm_cmpgt_epi16(pb, pc);
+        pred = _mm_or_si128(_mm_and_si128(m2, c), _mm_andnot_si128(m2, p));
+        pred = _mm_or_si128(_mm_and_si128(m1, pred),
+                            _mm_andnot_si128(m1, a));
+        pred = _mm_packus_epi16(pred, pred);
+        _mm_storel_epi64(
+            (__m128i *) (dest + i),
+            _mm_sub_epi8(_mm_loadl_epi64((const __m128i *) (cur + i)),
+                         pred));
+    }
+    return i;
+#else
+    (void) dest;
+    (void) cur;
+    (void) prev;
+    (void) n;
+    return b;
+#endif
+}
+
+/* Filter a row with a single filter type.  The previous row is all
+   zero for the first row of the image.  */
+static void
+sg_png_filterrow(unsigned char *dest, const unsigned char *cur,
+                 const unsigned char *prev,
+                 size_t n, int bpp, int type)
+{
+    size_t i, b = (size_t) bpp;
+    int a, c, p, pa, pb, pc;
+    dest[0] = (unsigned char) type;
+    dest++;
+    switch (type) {
+    case SG_PNG_FILTER_NONE:
+        memcpy(dest, cur, n);
+        break;
+
+    case SG_PNG_FILTER_SUB:
+        for (i = 0; i < b; i++)
+            dest[i] = cur[i];
+        for (; i < n; i++)
+            dest[i] = (unsigned char) (cur[i] - cur[i-b]);
+        break;
+
+    case SG_PNG_FILTER_UP:
+        for (i = 0; i < n; i++)
+            dest[i] = (unsigned char) (cur[i] - prev[i]);
+        break;
+
+    case SG_PNG_FILTER_AVERAGE:
+        for (i = 0; i < b; i++)
+            dest[i] = (unsigned char) (cur[i] - (prev[i] >> 1));
+        for (; i < n; i++)
+            dest[i] = (unsigned char)
+                (cur[i] - ((cur[i-b] + prev[i]) >> 1));
+        break;
+
+    case SG_PNG_FILTER_PAETH:
+        for (i = 0; i < b; i++)
+            dest[i] = (unsigned char) (cur[i] - prev[i]);
+        i = sg_png_paeth(dest, cur, prev, n, b);
+        for (; i < n; i++) {
+            a = cur[i-b];
+            p = prev[i];
+            c = prev[i-b];
+            pa = abs(p - c);
+            pb = abs(a - c);
+            pc = abs(a + p - 2 * c);
+            if (pa <= pb && pa <= pc)
+                p = a;
+            else if (pb > pc)
+                p = c;
+            dest[i] = (unsigned char) (cur[i] - p);
+        }
+        break;
+    }
+}
+
+/* Sum of the filtered bytes as signed values, the usual heuristic
+   for choosing a filter.  */
+static unsigned long
+sg_png_rowcost(const unsigned char *row, size_t n)
+{
+    unsigned long sum = 0;
+    size_t i = 0;
+#if defined SG_X_SSE2
+    __m128i z = _mm_setzero_si128(), acc = z, v;
+    for (; i + 16 <= n; i += 16) {
+        v = _mm_loadu_si128((const __m128i *) (row + i));
+        v = _mm_min_epu8(v, _mm_sub_epi8(z, v));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(v, z));
+    }
+    sum = (unsigned long) _mm_cvtsi128_si32(acc) +
+        (unsigned long) _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+    for (; i < n; i++)
+        sum += row[i] < 128 ? row[i] : 256 - row[i];
+    return sum;
+}
+
+/* Filter a row with the filter chosen in the options.  The scratch
+   buffer holds two filtered rows, for adaptive filtering.  */
+static void
+sg_png_filter(struct sg_png_job *job, unsigned char *dest,
+              unsigned char *scratch, const unsigned char *cur,
+              const unsigned char *prev)
+{
+    size_t n = job->rowsize - 1;
+    unsigned long cost, bestcost = 0;
+    unsigned char *row = scratch, *best = scratch + job->rowsize, *tmp;
+    int type;
+    if (job->filter != SG_PNG_FILTER_ADAPTIVE) {
+        sg_png_filterrow(dest, cur, prev, n, job->bpp, job->filter);
+        return;
+    }
+    for (type = SG_PNG_FILTER_NONE; type <= SG_PNG_FILTER_PAETH; type++) {
+        sg_png_filterrow(row, cur, prev, n, job->bpp, type);
+        cost = sg_png_rowcost(row + 1, n);
+        if (type == SG_PNG_FILTER_NONE || cost < bestcost) {
+            bestcost = cost;
+            tmp = best;
+            best = row;
+            row = tmp;
+        }
+    }
+    memcpy(dest, best, job->rowsize);
+}
+
+/* Filter and compress one strip.  */
+static int
+sg_png_compress(struct sg_png_job *job, int index)
+{
+    struct sg_png_strip *sp = &job->strip[index];
+    const struct sg_pixbuf *pbuf = job->pbuf;
+    size_t rowsize = job->rowsize, pixsize = rowsize - 1, dictlen,
+        outcap, pos;
+    int first, last, y0, y, ndict, last_strip, r, result;
+    unsigned char *filt = NULL, *rows = NULL, *out, *cur, *prev, *tmp;
+    z_stream z;
+
+    first = index * job->striprows;
+    last = first + job->striprows;
+    last_strip = last >= pbuf->height;
+    if (last_strip)
+        last = pbuf->height;
+
+    /* Filter the rows preceding the strip too, to use as the
+       dictionary.  */
+    ndict = 0;
+    if (job->level > 0 && first > 0) {
+        ndict = (int) ((SG_PNG_WINDOW + rowsize - 1) / rowsize);
+        if (ndict > first)
+            ndict = first;
+    }
+    y0 = first - ndict;
+
+    filt = malloc(rowsize * (last - y0));
+    rows = malloc(pixsize * 2 + rowsize * 2);
+    if (!filt || !rows) {
+        result = SG_PNG_NOMEM;
+        goto done;
+    }
+    prev = rows;
+    cur = rows + pixsize;
+    if (y0 > 0)
+        sg_png_pack(prev, pbuf, y0 - 1);
+    else
+        memset(prev, 0, pixsize);
+    for (y = y0; y < last; y++) {
+        sg_png_pack(cur, pbuf, y);
+        sg_png_filter(job, filt + rowsize * (y - y0),
+                      rows + pixsize * 2, cur, prev);
+        tmp = cur;
+        cur = prev;
+        prev = tmp;
+    }
+
+    sp->inlen = rowsize * (last - first);
+    sp->adler = adler32(adler32(0, NULL, 0),
+                        filt + rowsize * ndict, (uInt) sp->inlen);
+
+    memset(&z, 0, sizeof(z));
+    r = deflateInit2(&z, job->level, Z_DEFLATED, -15, 8,
+                     job->filter == SG_PNG_FILTER_NONE ?
+                     Z_DEFAULT_STRATEGY : Z_FILTERED);
+    if (r != Z_OK) {
+        result = r == Z_MEM_ERROR ? SG_PNG_NOMEM : SG_PNG_ZERROR;
+        goto done;
+    }
+    if (ndict > 0) {
+        dictlen = rowsize * ndict;
+        if (dictlen > SG_PNG_WINDOW)
+            dictlen = SG_PNG_WINDOW;
+        deflateSetDictionary(&z, filt + rowsize * ndict - dictlen,
+                             (uInt) dictlen);
+    }
+
+    /* The bound does not include the empty block from the sync
+       flush, so allow some extra space and grow if necessary.  */
+    outcap = deflateBound(&z, (uLong) sp->inlen) + 16;
+    out = malloc(outcap + 6);
+    if (!out) {
+        deflateEnd(&z);
+        result = SG_PNG_NOMEM;
+        goto done;
+    }
+    sp->data = out;
+    z.next_in = filt + rowsize * ndict;
+    z.avail_in = (uInt) sp->inlen;
+    pos = 0;
+    while (1) {
+        z.next_out = out + 2 + pos;
+        z.avail_out = (uInt) (outcap - pos);
+        r = deflate(&z, last_strip ? Z_FINISH : Z_SYNC_FLUSH);
+        pos = outcap - z.avail_out;
+        if (last_strip ? r == Z_STREAM_END : r == Z_OK && z.avail_out > 0)
+            break;
+        if (r != Z_OK && r != Z_BUF_ERROR) {
+            deflateEnd(&z);
+            result = SG_PNG_ZERROR;
+            goto done;
+        }
+        outcap *= 2;
+        out = realloc(sp->data, outcap + 6);
+        if (!out) {
+            deflateEnd(&z);
+            result = SG_PNG_NOMEM;
+            goto done;
+        }
+        sp->data = out;
+    }
+    deflateEnd(&z);
+    sp->len = pos;
+    result = SG_PNG_OK;
+
+done:
+    free(filt);
+    free(rows);
+    return result;
+}
+
+static void
+sg_png_task(void *arg, int index)
+{
+    struct sg_png_job *job = arg;
+    int i, r;
+    (void) index;
+    while (!sg_atomic_get(&job->failed)) {
+        i = sg_atomic_fetch_add(&job->next, 1);
+        if (i >= job->nstrip)
+            break;
+        r = sg_png_compress(job, i);
+        job->strip[i].result = r;
+        if (r != SG_PNG_OK)
+            sg_atomic_set(&job->failed, 1);
+    }
+}
+
+static void
+sg_png_put32(unsigned char *p, unsigned long x)
+{
+    p[0] = (unsigned char) (x >> 24);
+    p[1] = (unsigned char) (x >> 16);
+    p[2] = (unsigned char) (x >> 8);
+    p[3] = (unsigned char) x;
+}
+
+static int
+sg_png_chunk(struct sg_writer *fp, const char *type,
+             const void *data, size_t len, struct sg_error **err)
+{
+    struct sg_writer_vec vec[3];
+    unsigned char head[8], tail[4];
+    uLong crc;
+    sg_png_put32(head, (unsigned long) len);
+    memcpy(head + 4, type, 4);
+    crc = crc32(crc32(0, NULL, 0), head + 4, 4);
+    if (len > 0)
+        crc = crc32(crc, data, (uInt) len);
+    sg_png_put32(tail, crc);
+    vec[0].ptr = head;
+    vec[0].len = 8;
+    vec[1].ptr = data;
+    vec[1].len = len;
+    vec[2].ptr = tail;
+    vec[2].len = 4;
+    return sg_writer_writev(fp, vec, 3, err);
+}
+
+/* Write the PNG file from the compressed strips.  */
+static int
+sg_png_writefile(struct sg_png_job *job, const char *path, size_t pathlen,
+                 struct sg_error **err)
+{
+    const struct sg_pixbuf *pbuf = job->pbuf;
+    struct sg_writer *fp;
+    struct sg_png_strip *sp;
+    struct sg_writer_vec vec;
+    unsigned char ihdr[13];
+    uLong adler;
+    unsigned flevel;
+    int i, r;
+
+    fp = sg_writer_open(path, pathlen, err);
+    if (!fp)
+        return -1;
+    vec.ptr = SG_PNG_SIGNATURE;
+    vec.len = sizeof(SG_PNG_SIGNATURE);
+    r = sg_writer_writev(fp, &vec, 1, err);
+    if (r)
+        goto done;
+
+    sg_png_put32(ihdr, (unsigned long) pbuf->width);
+    sg_png_put32(ihdr + 4, (unsigned long) pbuf->height);
+    ihdr[8] = 8;
+    ihdr[9] = pbuf->format == SG_RGBA ? 6 : 2;
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = 0;
+    r = sg_png_chunk(fp, "IHDR", ihdr, sizeof(ihdr), err);
+    if (r)
+        goto done;
+
+    /* The zlib header goes before the first strip, and the combined
+       checksum goes after the last.  */
+    flevel = job->level < 2 ? 0 : job->level < 6 ? 1 : job->level == 6 ?
+        2 : 3;
+    sp = &job->strip[0];
+    sp->data[0] = 0x78;
+    sp->data[1] = (unsigned char) (flevel << 6);
+    sp->data[1] += (31 - (0x7800 + sp->data[1]) % 31) % 31;
+    adler = adler32(0, NULL, 0);
+    for (i = 0; i < job->nstrip; i++)
+        adler = adler32_combine(adler, job->strip[i].adler,
+                                (z_off_t) job->strip[i].inlen);
+    sp = &job->strip[job->nstrip - 1];
+    sg_png_put32(sp->data + 2 + sp->len, adler);
+    sp->len += 4;
+
+    for (i = 0; i < job->nstrip; i++) {
+        sp = &job->strip[i];
+        if (i == 0)
+            r = sg_png_chunk(fp, "IDAT", sp->data, sp->len + 2, err);
+        else
+            r = sg_png_chunk(fp, "IDAT", sp->data + 2, sp->len, err);
+        if (r)
+            goto done;
+    }
+    r = sg_png_chunk(fp, "IEND", NULL, 0, err);
+    if (r)
+        goto done;
+    r = sg_writer_commit(fp, err);
+
+done:
+    sg_writer_close(fp);
+    return r ? -1 : 0;
+}
+
+int
+sg_pixbuf_writepngopts(struct sg_pixbuf *pbuf,
+                       const char *path, size_t pathlen,
+                       const struct sg_pngopts *opts,
+                       struct sg_error **err)
+{
+    struct sg_png_job job;
+    int i, r, nthread;
+
+    if (!opts)
+        opts = &SG_PNG_DEFAULTOPTS;
+    if ((pbuf->format != SG_RGBX && pbuf->format != SG_RGBA) ||
+        pbuf->width < 1 || pbuf->height < 1) {
+        sg_error_invalid(err, __FUNCTION__, "pbuf");
+        return -1;
+    }
+    if (opts->level < 0 || opts->level > 9 ||
+        (int) opts->filter < 0 || opts->filter > SG_PNG_FILTER_ADAPTIVE) {
+        sg_error_invalid(err, __FUNCTION__, "opts");
+        return -1;
+    }
+
+    job.pbuf = pbuf;
+    job.level = opts->level;
+    job.filter = opts->filter;
+    job.bpp = pbuf->format == SG_RGBA ? 4 : 3;
+    job.rowsize = (size_t) pbuf->width * job.bpp + 1;
+    job.striprows = (int) (SG_PNG_STRIPSIZE / job.rowsize);
+    if (job.striprows < 1)
+        job.striprows = 1;
+    job.nstrip = (pbuf->height + job.striprows - 1) / job.striprows;
+    job.strip = calloc(job.nstrip, sizeof(*job.strip));
+    if (!job.strip) {
+        sg_error_nomem(err);
+        return -1;
+    }
+    sg_atomic_set(&job.next, 0);
+    sg_atomic_set(&job.failed, 0);
+
+    nthread = opts->nthread;
+    if (nthread <= 0)
+        nthread = sg_thread_cpucount();
+    if (nthread > job.nstrip)
+        nthread = job.nstrip;
+    sg_thread_run(sg_png_task, &job, nthread);
+
+    r = 0;
+    for (i = 0; i < job.nstrip; i++) {
+        if (job.strip[i].result == SG_PNG_NOMEM) {
+            sg_error_nomem(err);
+            r = -1;
+            break;
+        } else if (job.strip[i].result != SG_PNG_OK) {
+            sg_error_sets(err, &SG_ERROR_GENERIC, 0,
+                          "zlib: could not compress image");
+            r = -1;
+            break;
+        }
+    }
+    if (!r)
+        r = sg_png_writefile(&job, path, pathlen, err);
+
+    for (i = 0; i < job.nstrip; i++)
+        free(job.strip[i].data);
+    free(job.strip);
+    return r;
+}
@@ -6,6 +6,53 @@
 struct sg_filedata;
 struct sg_error;
 struct sg_image;
+struct sg_pixbuf;
+
+/* Get an image dimension reduced by 2^shift, rounding up.  */
+#define SG_IMAGE_REDUCE(size, shift) ((((size) - 1) >> (shift)) + 1)
+
+/* Check that a rectangle in a pixel buffer is a valid target for
+   drawing an image.  Return zero if it is valid.  */
+int
+sg_image_checkdest(const struct sg_pixbuf *pbuf, int x, int y,
+                   int width, int height);
+
+/* Reduces a four channel image by a power of two, one row at a time,
+   by averaging each block of pixels.  Blocks on the right and bottom
+   edges may be partial.  */
+struct sg_reduce {
+    /* The sum of each channel in the current output row.  */
+    unsigned *sum;
+    /* The input width.  */
+    int width;
+    /* The base 2 logarithm of the reduction factor.  */
+    int shift;
+    /* The number of input rows added to the current output row.  */
+    int nrow;
+};
+
+/* Initialize a reducer for input rows of the given width.  */
+int
+sg_reduce_init(struct sg_reduce *r, int width, int shift,
+               struct sg_error **err);
+
+/* Destroy a reducer.  */
+void
+sg_reduce_destroy(struct sg_reduce *r);
+
+/* Add an input row.  Return nonzero if the output row is complete.  */
+int
+sg_reduce_addrow(struct sg_reduce *r, const unsigned char *row);
+
+/* Write the output row, which may be partial, and start the next.  */
+void
+sg_reduce_getrow(struct sg_reduce *r, unsigned char *row);
+
+/* Draw an image reduced by 2^shift, by drawing it to a temporary
+   buffer at full size and reducing it.  */
+int
+sg_image_drawreduced(struct sg_image *img, struct sg_pixbuf *pbuf,
+                     int x, int y, int shift, struct sg_error **err);
 
 #if defined ENABLE_PNG
 
@@ -22,8 +69,3 @@ struct sg_image *
 sg_image_jpeg(struct sg_filedata *data, struct sg_error **err);
 
 #endif
-
-/* Convert image data from non-premultiplied alpha to premultiplied
-   alpha.  This only works on RGBA images.  */
-void
-sg_pixbuf_premultiply_alpha(struct sg_pixbuf *pbuf);
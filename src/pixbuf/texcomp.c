@@ -0,0 +1,520 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "sg/atomic.h"
+#include "sg/error.h"
+#include "sg/pixbuf.h"
+#include "sg/thread.h"
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+const size_t SG_CPIXBUF_BLOCKSIZE[SG_CPIXBUF_NFORMAT] = {
+    8, 16, 8
+};
+
+const char SG_CPIXBUF_FORMATNAME[SG_CPIXBUF_NFORMAT][4] = {
+    "BC1", "BC3", "BC4"
+};
+
+#define MAX_DIM 32768
+
+int
+sg_cpixbuf_alloc(struct sg_cpixbuf *cbuf, sg_cpixbuf_format_t format,
+                 int width, int height, struct sg_error **err)
+{
+    int rb, bh;
+    void *ptr;
+    if (width <= 0 || height <= 0 || width > MAX_DIM || height > MAX_DIM ||
+        (int) format < 0 || (int) format >= SG_CPIXBUF_NFORMAT) {
+        sg_error_invalid(err, __FUNCTION__, NULL);
+        return -1;
+    }
+    rb = ((width + 3) >> 2) * (int) SG_CPIXBUF_BLOCKSIZE[format];
+    bh = (height + 3) >> 2;
+    ptr = malloc((size_t) rb * bh);
+    if (!ptr) {
+        sg_error_nomem(err);
+        return -1;
+    }
+    cbuf->data = ptr;
+    cbuf->format = format;
+    cbuf->width = width;
+    cbuf->height = height;
+    cbuf->rowbytes = rb;
+    return 0;
+}
+
+/* ========================================================================
+   Encoding
+   ======================================================================== */
+
+/* Copy a 4x4 block of pixels into RGBA order, repeating the last row
+   and column of the image for partial blocks.  */
+static void
+sg_texcomp_getblock(unsigned char (*px)[4], const struct sg_pixbuf *pbuf,
+                    int bx, int by)
+{
+    const unsigned char *p;
+    int x, y, sx, sy;
+    for (y = 0; y < 4; y++) {
+        sy = by * 4 + y;
+        if (sy >= pbuf->height)
+            sy = pbuf->height - 1;
+        for (x = 0; x < 4; x++) {
+            sx = bx * 4 + x;
+            if (sx >= pbuf->width)
+                sx = pbuf->width - 1;
+            p = (const unsigned char *) pbuf->data + pbuf->rowbytes * sy;
+            switch (pbuf->format) {
+            case SG_R:
+                p += sx;
+                px[y*4+x][0] = p[0];
+                px[y*4+x][1] = px[y*4+x][2] = 0;
+                px[y*4+x][3] = 255;
+                break;
+            case SG_RG:
+                p += sx * 2;
+                px[y*4+x][0] = p[0];
+                px[y*4+x][1] = p[1];
+                px[y*4+x][2] = 0;
+                px[y*4+x][3] = 255;
+                break;
+            case SG_RGBX:
+                p += sx * 4;
+                memcpy(px[y*4+x], p, 3);
+                px[y*4+x][3] = 255;
+                break;
+            case SG_RGBA:
+                memcpy(px[y*4+x], p + sx * 4, 4);
+                break;
+            }
+        }
+    }
+}
+
+static unsigned
+sg_texcomp_pack565(const int *c)
+{
+    int r = (c[0] * 31 + 127) / 255, g = (c[1] * 63 + 127) / 255,
+        b = (c[2] * 31 + 127) / 255;
+    return ((unsigned) r << 11) | ((unsigned) g << 5) | (unsigned) b;
+}
+
+static void
+sg_texcomp_unpack565(int *c, unsigned v)
+{
+    int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+/* Get the four color palette for two endpoints, with c0 > c1.  */
+static void
+sg_texcomp_palette(int (*pal)[3], unsigned c0, unsigned c1)
+{
+    int i;
+    sg_texcomp_unpack565(pal[0], c0);
+    sg_texcomp_unpack565(pal[1], c1);
+    for (i = 0; i < 3; i++) {
+        pal[2][i] = (2 * pal[0][i] + pal[1][i]) / 3;
+        pal[3][i] = (pal[0][i] + 2 * pal[1][i]) / 3;
+    }
+}
+
+/* Choose the nearest palette entry for each pixel.  Return the total
+   squared error.  */
+static unsigned
+sg_texcomp_indexes(unsigned char *index, const unsigned char (*px)[4],
+                   const int (*pal)[3])
+{
+    unsigned total = 0, best, d;
+    int i, j, dr, dg, db;
+    for (i = 0; i < 16; i++) {
+        best = UINT_MAX;
+        for (j = 0; j < 4; j++) {
+            dr = px[i][0] - pal[j][0];
+            dg = px[i][1] - pal[j][1];
+            db = px[i][2] - pal[j][2];
+            d = (unsigned) (dr * dr + dg * dg + db * db);
+            if (d < best) {
+                best = d;
+                index[i] = (unsigned char) j;
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+/* Fit endpoints to a block, given the palette index of each pixel,
+   by least squares.  Return zero if the fit is degenerate.  */
+static int
+sg_texcomp_refine(int *e0, int *e1, const unsigned char (*px)[4],
+                  const unsigned char *index)
+{
+    static const float WEIGHT[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax[3] = { 0 }, bx[3] = { 0 },
+        a, b, det, v;
+    int i, c;
+    for (i = 0; i < 16; i++) {
+        a = WEIGHT[index[i]];
+        b = 1.0f - a;
+        aa += a * a;
+        bb += b * b;
+        ab += a * b;
+        for (c = 0; c < 3; c++) {
+            ax[c] += a * px[i][c];
+            bx[c] += b * px[i][c];
+        }
+    }
+    det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f)
+        return 0;
+    det = 1.0f / det;
+    for (c = 0; c < 3; c++) {
+        v = (ax[c] * bb - bx[c] * ab) * det;
+        e0[c] = v < 0.0f ? 0 : v > 255.0f ? 255 : (int) (v + 0.5f);
+        v = (bx[c] * aa - ax[c] * ab) * det;
+        e1[c] = v < 0.0f ? 0 : v > 255.0f ? 255 : (int) (v + 0.5f);
+    }
+    return 1;
+}
+
+/* Quantize endpoints and choose indexes.  Return the squared error,
+   and store the endpoints and indexes.  */
+static unsigned
+sg_texcomp_fit(unsigned *c0, unsigned *c1, unsigned char *index,
+               const unsigned char (*px)[4], const int *e0, const int *e1)
+{
+    int pal[4][3];
+    unsigned a = sg_texcomp_pack565(e0), b = sg_texcomp_pack565(e1), t;
+    if (a < b) {
+        t = a;
+        a = b;
+        b = t;
+    }
+    *c0 = a;
+    *c1 = b;
+    if (a == b) {
+        /* With equal endpoints, the block is in three color mode, but
+           index 0 is still the endpoint color.  */
+        sg_texcomp_unpack565(pal[0], a);
+        memcpy(pal[1], pal[0], sizeof(pal[0]));
+        memcpy(pal[2], pal[0], sizeof(pal[0]));
+        memcpy(pal[3], pal[0], sizeof(pal[0]));
+    } else {
+        sg_texcomp_palette(pal, a, b);
+    }
+    return sg_texcomp_indexes(index, px, (const int (*)[3]) pal);
+}
+
+/* Encode the color of a block as BC1, in four color mode.  */
+static void
+sg_texcomp_bc1(unsigned char *out, const unsigned char (*px)[4])
+{
+    float mean[3] = { 0 }, cov[6] = { 0 }, axis[3], t[3], d[3], v,
+        lo, hi;
+    int i, j, e0[3], e1[3], imin = 0, imax = 0;
+    unsigned c0, c1, d0, d1, err, err2, bits;
+    unsigned char index[16], index2[16];
+
+    /* Find the principal axis of the colors by power iteration,
+       starting from the variance of each channel.  */
+    for (i = 0; i < 16; i++)
+        for (j = 0; j < 3; j++)
+            mean[j] += px[i][j];
+    for (j = 0; j < 3; j++)
+        mean[j] *= 1.0f / 16.0f;
+    for (i = 0; i < 16; i++) {
+        for (j = 0; j < 3; j++)
+            d[j] = px[i][j] - mean[j];
+        cov[0] += d[0] * d[0];
+        cov[1] += d[0] * d[1];
+        cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1];
+        cov[4] += d[1] * d[2];
+        cov[5] += d[2] * d[2];
+    }
+    axis[0] = cov[0];
+    axis[1] = cov[3];
+    axis[2] = cov[5];
+    for (i = 0; i < 4; i++) {
+        t[0] = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        t[1] = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        t[2] = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        v = fabsf(t[0]);
+        if (fabsf(t[1]) > v)
+            v = fabsf(t[1]);
+        if (fabsf(t[2]) > v)
+            v = fabsf(t[2]);
+        if (v < 1e-6f)
+            break;
+        v = 1.0f / v;
+        for (j = 0; j < 3; j++)
+            axis[j] = t[j] * v;
+    }
+
+    /* Use the pixels at either end of the axis as endpoints.  */
+    lo = hi = px[0][0] * axis[0] + px[0][1] * axis[1] + px[0][2] * axis[2];
+    for (i = 1; i < 16; i++) {
+        v = px[i][0] * axis[0] + px[i][1] * axis[1] + px[i][2] * axis[2];
+        if (v < lo) {
+            lo = v;
+            imin = i;
+        }
+        if (v > hi) {
+            hi = v;
+            imax = i;
+        }
+    }
+    for (j = 0; j < 3; j++) {
+        e0[j] = px[imax][j];
+        e1[j] = px[imin][j];
+    }
+    err = sg_texcomp_fit(&c0, &c1, index, px, e0, e1);
+
+    /* Refine the endpoints once with least squares.  */
+    if (err && c0 != c1 && sg_texcomp_refine(e0, e1, px, index)) {
+        err2 = sg_texcomp_fit(&d0, &d1, index2, px, e0, e1);
+        if (err2 < err) {
+            c0 = d0;
+            c1 = d1;
+            memcpy(index, index2, 16);
+        }
+    }
+
+    bits = 0;
+    for (i = 15; i >= 0; i--)
+        bits = (bits << 2) | index[i];
+    out[0] = (unsigned char) c0;
+    out[1] = (unsigned char) (c0 >> 8);
+    out[2] = (unsigned char) c1;
+    out[3] = (unsigned char) (c1 >> 8);
+    out[4] = (unsigned char) bits;
+    out[5] = (unsigned char) (bits >> 8);
+    out[6] = (unsigned char) (bits >> 16);
+    out[7] = (unsigned char) (bits >> 24);
+}
+
+/* Encode one channel of a block as BC4, in eight value mode.  */
+static void
+sg_texcomp_bc4(unsigned char *out, const unsigned char (*px)[4], int chan)
+{
+    int i, v, lo = 255, hi = 0, range, s, idx;
+    unsigned long bits0 = 0, bits1 = 0;
+    for (i = 0; i < 16; i++) {
+        v = px[i][chan];
+        if (v < lo)
+            lo = v;
+        if (v > hi)
+            hi = v;
+    }
+    out[0] = (unsigned char) hi;
+    out[1] = (unsigned char) lo;
+    range = hi - lo;
+    for (i = 0; i < 16; i++) {
+        if (!range) {
+            idx = 0;
+        } else {
+            /* Palette entries 2 to 7 step from the high endpoint to
+               the low endpoint.  */
+            s = ((hi - px[i][chan]) * 14 + range) / (range * 2);
+            idx = s == 0 ? 0 : s == 7 ? 1 : s + 1;
+        }
+        if (i < 8)
+            bits0 |= (unsigned long) idx << (i * 3);
+        else
+            bits1 |= (unsigned long) idx << ((i - 8) * 3);
+    }
+    out[2] = (unsigned char) bits0;
+    out[3] = (unsigned char) (bits0 >> 8);
+    out[4] = (unsigned char) (bits0 >> 16);
+    out[5] = (unsigned char) bits1;
+    out[6] = (unsigned char) (bits1 >> 8);
+    out[7] = (unsigned char) (bits1 >> 16);
+}
+
+struct sg_texcomp_job {
+    struct sg_cpixbuf *dest;
+    const struct sg_pixbuf *src;
+    /* Index of the next row of blocks to encode.  */
+    sg_atomic_t next;
+};
+
+static void
+sg_texcomp_encode_task(void *arg, int index)
+{
+    struct sg_texcomp_job *job = arg;
+    struct sg_cpixbuf *dest = job->dest;
+    unsigned char px[16][4], *out;
+    int bx, by, bw = (dest->width + 3) >> 2, bh = (dest->height + 3) >> 2;
+
+    (void) index;
+    while (1) {
+        by = sg_atomic_fetch_add(&job->next, 1);
+        if (by >= bh)
+            break;
+        out = (unsigned char *) dest->data + dest->rowbytes * by;
+        for (bx = 0; bx < bw; bx++) {
+            sg_texcomp_getblock(px, job->src, bx, by);
+            switch (dest->format) {
+            case SG_BC1:
+                sg_texcomp_bc1(out, (const unsigned char (*)[4]) px);
+                out += 8;
+                break;
+            case SG_BC3:
+                sg_texcomp_bc4(out, (const unsigned char (*)[4]) px, 3);
+                sg_texcomp_bc1(out + 8, (const unsigned char (*)[4]) px);
+                out += 16;
+                break;
+            case SG_BC4:
+                sg_texcomp_bc4(out, (const unsigned char (*)[4]) px, 0);
+                out += 8;
+                break;
+            }
+        }
+    }
+}
+
+int
+sg_cpixbuf_encode(struct sg_cpixbuf *dest, const struct sg_pixbuf *src,
+                  int nthread, struct sg_error **err)
+{
+    struct sg_texcomp_job job;
+    int bh;
+
+    if (dest->width != src->width || dest->height != src->height ||
+        !dest->data || !src->data ||
+        (dest->format != SG_BC4 &&
+         src->format != SG_RGBX && src->format != SG_RGBA)) {
+        sg_error_invalid(err, __FUNCTION__, "src");
+        return -1;
+    }
+    bh = (dest->height + 3) >> 2;
+    if (nthread <= 0)
+        nthread = sg_thread_cpucount();
+    if (nthread > bh)
+        nthread = bh;
+    job.dest = dest;
+    job.src = src;
+    sg_atomic_set(&job.next, 0);
+    sg_thread_run(sg_texcomp_encode_task, &job, nthread);
+    return 0;
+}
+
+/* ========================================================================
+   Decoding
+   ======================================================================== */
+
+/* Decode a BC1 color block.  In BC3, the color block always uses four
+   color mode.  */
+static void
+sg_texcomp_decode_bc1(unsigned char (*px)[4], const unsigned char *in,
+                      int fourcolor)
+{
+    int pal[4][3], i;
+    unsigned c0 = in[0] | ((unsigned) in[1] << 8),
+        c1 = in[2] | ((unsigned) in[3] << 8), bits, idx;
+    bits = in[4] | ((unsigned) in[5] << 8) | ((unsigned) in[6] << 16) |
+        ((unsigned) in[7] << 24);
+    if (fourcolor || c0 > c1) {
+        sg_texcomp_palette(pal, c0, c1);
+    } else {
+        sg_texcomp_unpack565(pal[0], c0);
+        sg_texcomp_unpack565(pal[1], c1);
+        for (i = 0; i < 3; i++) {
+            pal[2][i] = (pal[0][i] + pal[1][i]) / 2;
+            pal[3][i] = 0;
+        }
+    }
+    for (i = 0; i < 16; i++) {
+        idx = (bits >> (i * 2)) & 3;
+        px[i][0] = (unsigned char) pal[idx][0];
+        px[i][1] = (unsigned char) pal[idx][1];
+        px[i][2] = (unsigned char) pal[idx][2];
+        px[i][3] = !fourcolor && c0 <= c1 && idx == 3 ? 0 : 255;
+    }
+}
+
+static void
+sg_texcomp_decode_bc4(unsigned char (*px)[4], const unsigned char *in,
+                      int chan)
+{
+    int pal[8], a0 = in[0], a1 = in[1], i;
+    unsigned long bits0, bits1;
+    unsigned idx;
+    pal[0] = a0;
+    pal[1] = a1;
+    if (a0 > a1) {
+        for (i = 1; i < 7; i++)
+            pal[i+1] = ((7 - i) * a0 + i * a1) / 7;
+    } else {
+        for (i = 1; i < 5; i++)
+            pal[i+1] = ((5 - i) * a0 + i * a1) / 5;
+        pal[6] = 0;
+        pal[7] = 255;
+    }
+    bits0 = in[2] | ((unsigned long) in[3] << 8) |
+        ((unsigned long) in[4] << 16);
+    bits1 = in[5] | ((unsigned long) in[6] << 8) |
+        ((unsigned long) in[7] << 16);
+    for (i = 0; i < 16; i++) {
+        idx = (unsigned) (i < 8 ? bits0 >> (i * 3) :
+                          bits1 >> ((i - 8) * 3)) & 7;
+        px[i][chan] = (unsigned char) pal[idx];
+    }
+}
+
+int
+sg_cpixbuf_decode(struct sg_pixbuf *dest, const struct sg_cpixbuf *src,
+                  struct sg_error **err)
+{
+    unsigned char px[16][4], *p;
+    const unsigned char *in;
+    int bx, by, bw, bh, x, y, n, psz;
+
+    if (dest->width != src->width || dest->height != src->height ||
+        !dest->data || !src->data ||
+        (src->format == SG_BC4 ? dest->format != SG_R :
+         dest->format != SG_RGBX && dest->format != SG_RGBA)) {
+        sg_error_invalid(err, __FUNCTION__, "dest");
+        return -1;
+    }
+    psz = (int) SG_PIXBUF_FORMATSIZE[dest->format];
+    bw = (src->width + 3) >> 2;
+    bh = (src->height + 3) >> 2;
+    for (by = 0; by < bh; by++) {
+        in = (const unsigned char *) src->data + src->rowbytes * by;
+        for (bx = 0; bx < bw; bx++) {
+            switch (src->format) {
+            case SG_BC1:
+                sg_texcomp_decode_bc1(px, in, 0);
+                in += 8;
+                break;
+            case SG_BC3:
+                sg_texcomp_decode_bc1(px, in + 8, 1);
+                sg_texcomp_decode_bc4(px, in, 3);
+                in += 16;
+                break;
+            case SG_BC4:
+                sg_texcomp_decode_bc4(px, in, 0);
+                in += 8;
+                break;
+            }
+            n = dest->width - bx * 4 < 4 ? dest->width - bx * 4 : 4;
+            for (y = 0; y < 4 && by * 4 + y < dest->height; y++) {
+                p = (unsigned char *) dest->data +
+                    dest->rowbytes * (by * 4 + y) + bx * 4 * psz;
+                for (x = 0; x < n; x++) {
+                    memcpy(p + x * psz, px[y*4+x], psz);
+                    if (dest->format == SG_RGBX)
+                        p[x*psz+3] = 255;
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -15,6 +15,12 @@ static const struct sg_texture_fmt SG_TEXTURE_FMT[SG_PIXBUF_NFORMAT] = {
     { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE }
 };
 
+static const GLenum SG_TEXTURE_CFMT[SG_CPIXBUF_NFORMAT] = {
+    GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+    GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+    GL_COMPRESSED_RED_RGTC1
+};
+
 void
 sg_pixbuf_texture(struct sg_pixbuf *pbuf)
 {
@@ -22,7 +28,21 @@ sg_pixbuf_texture(struct sg_pixbuf *pbuf)
     fmt = &SG_TEXTURE_FMT[pbuf->format];
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH,
+                  pbuf->rowbytes / (int) SG_PIXBUF_FORMATSIZE[pbuf->format]);
     glTexImage2D(GL_TEXTURE_2D, 0,
                  fmt->ifmt, pbuf->width, pbuf->height, 0,
                  fmt->fmt, fmt->type, pbuf->data);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void
+sg_cpixbuf_texture(struct sg_cpixbuf *cbuf, int level)
+{
+    glCompressedTexImage2D(
+        GL_TEXTURE_2D, level, SG_TEXTURE_CFMT[cbuf->format],
+        cbuf->width, cbuf->height, 0,
+        cbuf->rowbytes * ((cbuf->height + 3) >> 2), cbuf->data);
 }
@@ -197,6 +197,7 @@ sg_image_wc(struct sg_filedata *data, struct sg_error **err)
     im->img.flags = flags;
     im->img.free = sg_image_wic_free;
     im->img.draw = sg_image_wic_draw;
+    im->img.drawscaled = NULL;
     im->data = data;
     im->fac = fac;
     im->frame = frame;
@@ -9,6 +9,7 @@
 #include "sg/error.h"
 #include "sg/log.h"
 #include "sg/opengl.h"
+#include "sg/pixbuf.h"
 #include "sg/record.h"
 #include "sg/strbuf.h"
 #include "../core/private.h"
@@ -16,6 +17,7 @@
 #if defined ENABLE_VIDEO_RECORDING
 # include "videoio.h"
 # include "videoproc.h"
+# include "videoraw.h"
 # include "../core/file_impl.h"
 #endif
 
@@ -36,8 +38,8 @@ enum {
     /* Indicates a frame has started.  */
     SG_RECORD_INFRAME = 1u << 2,
 
-    /* Indicates which buffer will be used next */
-    SG_RECORD_WHICHBUF = 1u << 3,
+    /* Video is written to a raw video file instead of the encoder */
+    SG_RECORD_RAW = 1u << 3,
 
     /* Video recording is active */
     SG_RECORD_VIDEO = 1u << 4,
@@ -52,25 +54,53 @@ enum {
     SG_RECORD_FRAMEMASK = SG_RECORD_FRAME_SCREENSHOT | SG_RECORD_FRAME_VIDEO
 };
 
+/* Maximum number of frames being read back at once */
+#define SG_RECORD_MAXBUF 8
+
 /* Image buffer for readback from the renderer */
 struct sg_record_buf {
     unsigned flags;
     GLuint buf;
+    /* Fence signaled when the readback is complete, if fences are
+       supported */
+    GLsync sync;
     int width, height;
+    /* The frame number when the readback started */
+    unsigned serial;
+    /* Timestamp of the video frame */
+    unsigned timestamp;
 };
 
 struct sg_record {
     unsigned flags;
     int fwidth, fheight;
-    struct sg_record_buf buf[2];
+    /* Frame number, incremented at the end of each frame */
+    unsigned serial;
+    /* Timestamp of the video frame being drawn, in frames since
+       recording started */
+    unsigned timestamp;
+    /* Ring of buffers being read back, oldest first */
+    int bufhead, bufcount;
+    struct sg_record_buf buf[SG_RECORD_MAXBUF];
+
+    /* Frames dropped because the ring was full, frames where the ring
+       was full and a readback had to be waited for, and the time spent
+       capturing frames, in seconds */
+    unsigned ndrop, nstall;
+    double captime;
 
 #if defined ENABLE_VIDEO_RECORDING
     int vwidth, vheight;
     size_t framebytes;
     int vrate, vframe;
     double vtime;
+    /* Number of frames sent to the encoder */
+    int vcount;
+    /* Timestamp of the next video frame */
+    unsigned vstamp;
     struct sg_videoproc vproc;
     struct sg_videoio vio;
+    struct sg_videoraw vraw;
 #endif
 };
 
@@ -80,15 +110,19 @@ static struct sg_record sg_record;
 struct sg_recordcvar sg_recordcvar;
 #endif
 
-static void
+/* Start reading back a frame into a buffer.  Returns 0 if successful,
+   or -1 if the buffer could not be created.  */
+static int
 sg_record_buf_read(struct sg_record_buf *buf,
                    int x, int y, int width, int height,
                    unsigned flags)
 {
     if (!buf->buf) {
         glGenBuffers(1, &buf->buf);
-        if (!buf->buf)
-            goto err;
+        if (!buf->buf) {
+            sg_opengl_checkerror("sg_record_buf_read");
+            return -1;
+        }
     }
 
     glBindBuffer(GL_PIXEL_PACK_BUFFER, buf->buf);
@@ -97,13 +131,17 @@ sg_record_buf_read(struct sg_record_buf *buf,
     glReadPixels(x, y, width, height,
                  GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (GLEW_ARB_sync)
+        buf->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 
     buf->flags = flags;
     buf->width = width;
     buf->height = height;
+    buf->serial = sg_record.serial;
+    buf->timestamp = sg_record.timestamp;
 
-err:
     sg_opengl_checkerror("sg_record_buf_read");
+    return 0;
 }
 
 #if defined ENABLE_VIDEO_RECORDING
@@ -112,13 +150,30 @@ static void
 sg_record_stopvio(void)
 {
     struct sg_record_buf *buf;
+    struct sg_error *err = NULL;
     int i;
     sg_videoio_destroy(&sg_record.vio);
-    sg_videoproc_close(&sg_record.vproc);
-    sg_record.flags &= ~(SG_RECORD_HASVIO | SG_RECORD_VIDEO);
-    for (i = 0; i < 2; i++) {
+    if ((sg_record.flags & SG_RECORD_RAW) != 0) {
+        if (sg_videoraw_finish(&sg_record.vraw, &err)) {
+            sg_logerrs(SG_LOG_ERROR, err,
+                       "Could not finish raw video file.");
+            sg_error_clear(&err);
+        }
+    } else {
+        sg_videoproc_close(&sg_record.vproc);
+    }
+    sg_record.flags &= ~(SG_RECORD_HASVIO | SG_RECORD_VIDEO | SG_RECORD_RAW);
+    sg_logf(SG_LOG_INFO,
+            "Video recording stopped: %d frames, %u dropped, %u stalls, "
+            "%.2f ms capture time per frame",
+            sg_record.vcount, sg_record.ndrop, sg_record.nstall,
+            sg_record.vcount ?
+            sg_record.captime * 1e3 / sg_record.vcount : 0.0);
+    /* Buffers still being read back are deleted after they are
+       processed.  */
+    for (i = 0; i < SG_RECORD_MAXBUF; i++) {
         buf = &sg_record.buf[i];
-        if (buf->buf == 0 || (buf->flags & ~SG_RECORD_FRAME_VIDEO) != 0)
+        if (buf->buf == 0 || buf->flags != 0)
             continue;
         glDeleteBuffers(1, &buf->buf);
         buf->flags = 0;
@@ -137,35 +192,57 @@ sg_record_stopvproc(void)
     sg_record.flags &= ~SG_RECORD_HASVPROC;
 }
 
-static void
-sg_record_writevideo(void *mptr, int width, int height)
+/* Get a buffer for the next frame of video, or return NULL if video
+   is not being recorded.  */
+static void *
+sg_record_getvideo(int width, int height)
 {
-    int r;
+    void *ptr;
 
-    if ((sg_record.flags & SG_RECORD_HASVIO) == 0) {
-        free(mptr);
-        return;
-    }
+    if ((sg_record.flags & SG_RECORD_HASVIO) == 0)
+        return NULL;
     if (width != sg_record.vwidth || height != sg_record.vheight) {
         sg_logs(SG_LOG_WARN,
                 "Framebuffer changed size, stopping video recording.");
-        free(mptr);
-        r = 0;
-    } else {
-        r = sg_videoio_write(&sg_record.vio, mptr);
+        sg_record.flags &= ~SG_RECORD_VIDEO;
+        return NULL;
     }
-    if (!r)
+    ptr = sg_videoio_getframe(&sg_record.vio);
+    if (!ptr)
+        sg_record.flags &= ~SG_RECORD_VIDEO;
+    return ptr;
+}
+
+static void
+sg_record_writevideo(void *vptr, unsigned timestamp)
+{
+    if (sg_videoio_write(&sg_record.vio, vptr, timestamp))
+        sg_record.vcount++;
+    else
         sg_record.flags &= ~SG_RECORD_VIDEO;
 }
 
+/* Get the flags for all buffers in the ring.  */
+static unsigned
+sg_record_pending(void)
+{
+    unsigned flags = 0;
+    int i;
+    for (i = 0; i < sg_record.bufcount; i++)
+        flags |= sg_record.buf[
+            (sg_record.bufhead + i) % SG_RECORD_MAXBUF].flags;
+    return flags;
+}
+
 #endif
 
 static void
 sg_record_buf_process(struct sg_record_buf *buf)
 {
     struct sg_error *err = NULL;
-    void *mptr, *fptr;
-    int width, height, i;
+    struct sg_pixbuf src, dest;
+    void *mptr, *fptr, *sptr, *vptr;
+    int width, height;
     size_t sz;
 
     if (!buf->buf)
@@ -178,28 +255,46 @@ sg_record_buf_process(struct sg_record_buf *buf)
         width = buf->width;
         height = buf->height;
         sz = 4 * width * height;
-        fptr = malloc(sz);
-        if (!fptr) {
-            sg_error_nomem(&err);
-            sg_logerrs(SG_LOG_ERROR, err, "could not allocate video buffer");
-            sg_error_clear(&err);
-        } else {
-            for (i = 0; i < height; i++) {
-                memcpy(
-                    (char *) fptr + (height - i - 1) * (4 * width),
-                    (char *) mptr + i * (4 * width),
-                    4 * width);
+
+        /* Video frames come from a pool, screenshots are freed by the
+           screenshot writer.  */
+        vptr = NULL;
+#if defined ENABLE_VIDEO_RECORDING
+        if (buf->flags & SG_RECORD_FRAME_VIDEO)
+            vptr = sg_record_getvideo(width, height);
+#endif
+        sptr = NULL;
+        if (buf->flags & SG_RECORD_FRAME_SCREENSHOT) {
+            sptr = malloc(sz);
+            if (!sptr) {
+                sg_error_nomem(&err);
+                sg_logerrs(SG_LOG_ERROR, err,
+                           "could not allocate screenshot buffer");
+                sg_error_clear(&err);
             }
-            if (buf->flags & SG_RECORD_FRAME_SCREENSHOT) {
-                sg_screenshot_write(fptr, buf->width, buf->height);
+        }
+
+        fptr = vptr ? vptr : sptr;
+        if (fptr) {
+            /* OpenGL returns rows from bottom to top.  */
+            src.data = (char *) mptr + (height - 1) * (4 * width);
+            src.format = SG_RGBA;
+            src.width = width;
+            src.height = height;
+            src.rowbytes = -4 * width;
+            dest = src;
+            dest.data = fptr;
+            dest.rowbytes = 4 * width;
+            sg_pixbuf_convert(&dest, &src);
+            if (sptr) {
+                if (sptr != fptr)
+                    memcpy(sptr, fptr, sz);
+                sg_screenshot_write(sptr, width, height);
             }
 #if defined ENABLE_VIDEO_RECORDING
-            if (buf->flags & SG_RECORD_FRAME_VIDEO) {
-                sg_record_writevideo(fptr, buf->width, buf->height);
-                fptr = NULL;
-            }
+            if (vptr)
+                sg_record_writevideo(vptr, buf->timestamp);
 #endif
-            free(fptr);
         }
         glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
     } else {
@@ -208,6 +303,10 @@ sg_record_buf_process(struct sg_record_buf *buf)
     }
 
     glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (buf->sync) {
+        glDeleteSync(buf->sync);
+        buf->sync = 0;
+    }
     sg_opengl_checkerror("sg_record_buf_process");
 
     if ((sg_record.flags & SG_RECORD_VIDEO) == 0) {
@@ -242,6 +341,21 @@ sg_record_init(void)
     sg_cvar_defstring(
         "recording", "extension", "Video file extension",
         &r->extension, "mp4", SG_CVAR_PERSISTENT);
+    sg_cvar_defstring(
+        "recording", "pixfmt",
+        "Pixel format sent to the encoder (rgb0, yuv420p, nv12)",
+        &r->pixfmt, "rgb0", SG_CVAR_PERSISTENT);
+    sg_cvar_defbool(
+        "recording", "raw",
+        "Write video to a raw video file instead of the encoder",
+        &r->raw, 0, SG_CVAR_PERSISTENT);
+    sg_cvar_defbool(
+        "recording", "rawcompress", "Compress frames in raw video files",
+        &r->rawcompress, 1, SG_CVAR_PERSISTENT);
+    sg_cvar_defint(
+        "recording", "buffers",
+        "Number of frames read back from the GPU at once",
+        &r->buffers, 3, 2, SG_RECORD_MAXBUF, SG_CVAR_PERSISTENT);
 }
 
 void
@@ -259,6 +373,7 @@ sg_record_frame_begin(double *time)
         if (nextframe <= curtime) {
             *time = nextframe;
             flags |= SG_RECORD_FRAME_VIDEO;
+            sg_record.timestamp = sg_record.vstamp++;
             sg_record.vframe++;
             if (sg_record.vframe >= sg_record.vrate) {
                 sg_record.vtime += 1.0;
@@ -284,38 +399,98 @@ sg_record_frame_begin(double *time)
 
 #endif
 
+/* Get the number of buffers in the readback ring.  */
+static int
+sg_record_depth(void)
+{
+#if defined ENABLE_VIDEO_RECORDING
+    int depth = sg_recordcvar.buffers.value;
+    return depth >= 2 ? depth : 2;
+#else
+    return 2;
+#endif
+}
+
+/* Test whether a buffer has finished reading back.  Without fences,
+   a buffer is assumed to be ready once it is depth - 1 frames old.  */
+static int
+sg_record_buf_ready(struct sg_record_buf *buf, int depth)
+{
+    GLenum r;
+    if (buf->sync) {
+        r = glClientWaitSync(buf->sync, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        return r == GL_ALREADY_SIGNALED || r == GL_CONDITION_SATISFIED;
+    }
+    return sg_record.serial - buf->serial >= (unsigned) depth - 1;
+}
+
+/* Process the oldest buffer in the ring.  */
+static void
+sg_record_pop(void)
+{
+    sg_record_buf_process(&sg_record.buf[sg_record.bufhead]);
+    sg_record.bufhead = (sg_record.bufhead + 1) % SG_RECORD_MAXBUF;
+    sg_record.bufcount--;
+}
+
 void
 sg_record_frame_end(int x, int y, int width, int height)
 {
-    int whichbuf;
     unsigned flags;
+    int depth, timing;
+    double t = 0.0;
 
     flags = sg_record.flags;
     if ((flags & SG_RECORD_INFRAME) == 0)
         return;
     sg_record.fwidth = width;
     sg_record.fheight = height;
-    whichbuf = (flags & SG_RECORD_WHICHBUF) ? 1 : 0;
-    sg_record.flags = (flags ^ SG_RECORD_WHICHBUF) &
-        ~(SG_RECORD_FRAMEMASK | SG_RECORD_INFRAME);
-
-    if ((flags & SG_RECORD_FRAMEMASK) != 0) {
-        sg_record_buf_read(&sg_record.buf[whichbuf],
-                           x, y, width, height,
-                           flags & SG_RECORD_FRAMEMASK);
+    sg_record.flags = flags & ~(SG_RECORD_FRAMEMASK | SG_RECORD_INFRAME);
+    sg_record.serial++;
+    depth = sg_record_depth();
+    timing = (flags & SG_RECORD_VIDEO) != 0;
+    if (timing)
+        t = sg_clock_get();
+
+    while (sg_record.bufcount > 0 &&
+           sg_record_buf_ready(
+               &sg_record.buf[sg_record.bufhead], depth))
+        sg_record_pop();
+
+    /* If the ring is full, drop video frames, but wait for
+       screenshots.  */
+    flags &= SG_RECORD_FRAMEMASK;
+    if (flags != 0 && sg_record.bufcount >= depth) {
+        if (flags == SG_RECORD_FRAME_VIDEO) {
+            if (sg_record.ndrop == 0)
+                sg_logs(SG_LOG_WARN,
+                        "Video readback is behind, dropping frames.");
+            sg_record.ndrop++;
+            flags = 0;
+        } else {
+            sg_record.nstall++;
+            while (sg_record.bufcount >= depth)
+                sg_record_pop();
+        }
     }
 
-    if (sg_record.buf[!whichbuf].flags != 0) {
-        sg_record_buf_process(&sg_record.buf[!whichbuf]);
-    }
+    /* A frame which could not be read back is skipped.  */
+    if (flags != 0 &&
+        !sg_record_buf_read(
+            &sg_record.buf[(sg_record.bufhead + sg_record.bufcount) %
+                           SG_RECORD_MAXBUF],
+            x, y, width, height, flags))
+        sg_record.bufcount++;
+
+    if (timing)
+        sg_record.captime += sg_clock_get() - t;
 
 #if defined ENABLE_VIDEO_RECORDING
     flags = sg_record.flags;
     if ((flags & SG_RECORD_VIDEO) == 0 &&
         (flags & (SG_RECORD_HASVIO | SG_RECORD_HASVPROC)) != 0) {
         if ((sg_record.flags & SG_RECORD_HASVIO) != 0) {
-            flags = sg_record.buf[0].flags | sg_record.buf[1].flags;
-            if ((flags & SG_RECORD_FRAME_VIDEO) == 0)
+            if ((sg_record_pending() & SG_RECORD_FRAME_VIDEO) == 0)
                 sg_videoio_stop(&sg_record.vio);
             if (!sg_videoio_poll(&sg_record.vio))
                 sg_record_stopvio();
@@ -348,23 +523,33 @@ sg_record_start(double time)
     int r, width = sg_record.fwidth, height = sg_record.fheight;
     size_t framebytes;
     unsigned mask;
+    int format, raw;
     struct sg_error *err = NULL;
 
     mask = SG_RECORD_VIDEO | SG_RECORD_HASVIO | SG_RECORD_HASVPROC;
     if ((sg_record.flags & mask) != 0)
         return;
+    raw = cvar->raw.value;
 
     if (width == 0 || height == 0)
         return;
     framebytes = (size_t) 4 * width * height;
 
+    /* Raw video is kept lossless, and converted later.  */
+    format = raw ? SG_VIDEOFMT_RGB0 : sg_videofmt_find(cvar->pixfmt.value);
+    if (format < 0) {
+        sg_logf(SG_LOG_WARN, "Unknown video pixel format: %s",
+                cvar->pixfmt.value);
+        format = SG_VIDEOFMT_RGB0;
+    }
+
     sg_strbuf_init(&path, 31);
     sg_strbuf_puts(&path, "video/");
     sg_strbuf_reserve(&path, SG_DATE_LEN);
     r = sg_clock_getdate(path.p, 1);
     assert(r >= 0 && r < SG_DATE_LEN);
     sg_strbuf_forcelen(&path, sg_strbuf_len(&path) + r);
-    ext = cvar->extension.value;
+    ext = raw ? "sgraw" : cvar->extension.value;
     if (ext[0] != '.')
         sg_strbuf_putc(&path, '.');
     sg_strbuf_puts(&path, ext);
@@ -380,24 +565,54 @@ sg_record_start(double time)
     sg_record.vrate = cvar->rate.value;
     sg_record.vframe = 0;
     sg_record.vtime = time;
-
-    r = sg_videoproc_init(&sg_record.vproc, path2, width, height, &err);
-    free(path2);
-    if (r) {
-        sg_logerrs(SG_LOG_ERROR, err,
-                   "Could not start video encoder.");
-        sg_error_clear(&err);
-        return;
-    }
-
-    r = sg_videoio_init(&sg_record.vio, framebytes,
-                        sg_record.vproc.pipe, &err);
-    if (r) {
-        sg_logerrs(SG_LOG_ERROR, err,
-                   "Could not start video encoder IO thread.");
-        sg_error_clear(&err);
-        sg_videoproc_destroy(&sg_record.vproc, 1);
-        return;
+    sg_record.vcount = 0;
+    sg_record.ndrop = 0;
+    sg_record.nstall = 0;
+    sg_record.captime = 0.0;
+    sg_record.vstamp = 0;
+
+    if (raw) {
+        r = sg_videoraw_create(&sg_record.vraw, path2, format,
+                               width, height, sg_record.vrate,
+                               cvar->rawcompress.value, &err);
+        free(path2);
+        if (r) {
+            sg_logerrs(SG_LOG_ERROR, err,
+                       "Could not create raw video file.");
+            sg_error_clear(&err);
+            return;
+        }
+        r = sg_videoio_init(&sg_record.vio, width, height,
+                            (sg_videofmt_t) format, -1,
+                            &sg_record.vraw, &err);
+        if (r) {
+            sg_logerrs(SG_LOG_ERROR, err,
+                       "Could not start video IO thread.");
+            sg_error_clear(&err);
+            sg_videoraw_close(&sg_record.vraw);
+            return;
+        }
+        mask = SG_RECORD_VIDEO | SG_RECORD_HASVIO | SG_RECORD_RAW;
+    } else {
+        r = sg_videoproc_init(&sg_record.vproc, path2, width, height,
+                              SG_VIDEOFMT_NAME[format], &err);
+        free(path2);
+        if (r) {
+            sg_logerrs(SG_LOG_ERROR, err,
+                       "Could not start video encoder.");
+            sg_error_clear(&err);
+            return;
+        }
+        r = sg_videoio_init(&sg_record.vio, width, height,
+                            (sg_videofmt_t) format, sg_record.vproc.pipe,
+                            NULL, &err);
+        if (r) {
+            sg_logerrs(SG_LOG_ERROR, err,
+                       "Could not start video encoder IO thread.");
+            sg_error_clear(&err);
+            sg_videoproc_destroy(&sg_record.vproc, 1);
+            return;
+        }
     }
 
     sg_record.flags |= mask;
@@ -11,6 +11,10 @@ struct sg_recordcvar {
     struct sg_cvar_string command;
     struct sg_cvar_string arguments;
     struct sg_cvar_string extension;
+    struct sg_cvar_string pixfmt;
+    struct sg_cvar_bool raw;
+    struct sg_cvar_bool rawcompress;
+    struct sg_cvar_int buffers;
 };
 
 extern struct sg_recordcvar sg_recordcvar;
@@ -4,35 +4,86 @@
 #include "screenshot.h"
 #include "sg/clock.h"
 #include "sg/error.h"
+#include "sg/file.h"
 #include "sg/log.h"
 #include "sg/pixbuf.h"
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
-void
-sg_screenshot_write(const void *ptr, int width, int height)
-{
+/* Fast compression, with adaptive filtering.  The files are about the
+   same size as LibPNG's default settings, and much faster to write.  */
+static const struct sg_pngopts SG_SCREENSHOT_PNGOPTS = {
+    1, SG_PNG_FILTER_ADAPTIVE, 0
+};
+
+struct sg_screenshot {
+    void *ptr;
+    int width;
+    int height;
+    int namelen;
     char name[SG_DATE_LEN + 16]; /* screenshot/.png\0 */
+};
+
+/* Encode and write a screenshot, on the background writer thread.  */
+static void
+sg_screenshot_save(void *cxt)
+{
+    struct sg_screenshot *ss = cxt;
     struct sg_error *err = NULL;
     struct sg_pixbuf pbuf;
-    int len1, len2, r;
+    int r;
 
-    pbuf.data = (void *) ptr;
+    pbuf.data = ss->ptr;
     pbuf.format = SG_RGBX;
-    pbuf.width = width;
-    pbuf.height = height;
-    pbuf.rowbytes = width * 4;
+    pbuf.width = ss->width;
+    pbuf.height = ss->height;
+    pbuf.rowbytes = ss->width * 4;
 
-    len1 = strlen("screenshot/");
-    memcpy(name, "screenshot/", len1);
-    len2 = sg_clock_getdate(name + len1, 1);
-    assert(len2 >= 0 && len2 < SG_DATE_LEN);
-    memcpy(name + len1 + len2, ".png", 5);
-    r = sg_pixbuf_writepng(&pbuf, name, len1 + len2 + 4, &err);
+    r = sg_pixbuf_writepngopts(&pbuf, ss->name, ss->namelen,
+                               &SG_SCREENSHOT_PNGOPTS, &err);
     if (r) {
         sg_logerrs(SG_LOG_ERROR, err, "Could not save screenshot.");
         sg_error_clear(&err);
     } else {
-        sg_logf(SG_LOG_INFO, "Saved screenshot: %s", name);
+        sg_logf(SG_LOG_INFO, "Saved screenshot: %s", ss->name);
     }
+    free(ss->ptr);
+    free(ss);
+}
+
+void
+sg_screenshot_write(void *ptr, int width, int height)
+{
+    struct sg_error *err = NULL;
+    struct sg_screenshot *ss;
+    int len1, len2, r;
+
+    ss = malloc(sizeof(*ss));
+    if (!ss) {
+        sg_error_nomem(&err);
+        goto error;
+    }
+    ss->ptr = ptr;
+    ss->width = width;
+    ss->height = height;
+
+    len1 = strlen("screenshot/");
+    memcpy(ss->name, "screenshot/", len1);
+    len2 = sg_clock_getdate(ss->name + len1, 1);
+    assert(len2 >= 0 && len2 < SG_DATE_LEN);
+    memcpy(ss->name + len1 + len2, ".png", 5);
+    ss->namelen = len1 + len2 + 4;
+
+    r = sg_file_savecall(sg_screenshot_save, ss, &err);
+    if (r) {
+        free(ss);
+        goto error;
+    }
+    return;
+
+error:
+    sg_logerrs(SG_LOG_ERROR, err, "Could not save screenshot.");
+    sg_error_clear(&err);
+    free(ptr);
 }
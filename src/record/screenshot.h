@@ -2,6 +2,9 @@
    This file is part of SGLib.  SGLib is licensed under the terms of the
    2-clause BSD license.  For more information, see LICENSE.txt. */
 
-/* Write a screenshot to disk.  The buffer must contain RGBX data.  */
+/* Write a screenshot to disk.  The buffer must contain RGBX data, and
+   must be allocated with malloc().  The buffer is freed afterwards.
+   The image is encoded and written on the background writer
+   thread.  */
 void
-sg_screenshot_write(const void *ptr, int width, int height);
+sg_screenshot_write(void *ptr, int width, int height);
@@ -0,0 +1,195 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "videoconv.h"
+#include <string.h>
+
+#if defined __SSE2__ || defined _M_X64 || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2)
+# define SG_X_SSE2 1
+# include <emmintrin.h>
+#endif
+
+/* BT.601 limited range, in 8-bit fixed point.  Chroma is computed
+   from the sum of four pixels, so it has two more fractional bits.
+   The offsets include rounding.  */
+#define SG_Y_R 66
+#define SG_Y_G 129
+#define SG_Y_B 25
+#define SG_Y_OFFSET (128 + (16 << 8))
+#define SG_U_R (-38)
+#define SG_U_G (-74)
+#define SG_U_B 112
+#define SG_V_R 112
+#define SG_V_G (-94)
+#define SG_V_B (-18)
+#define SG_C_OFFSET (512 + (128 << 10))
+
+const char SG_VIDEOFMT_NAME[SG_VIDEOFMT_COUNT][8] = {
+    "rgb0", "yuv420p", "nv12"
+};
+
+int
+sg_videofmt_find(const char *name)
+{
+    int i;
+    for (i = 0; i < SG_VIDEOFMT_COUNT; i++)
+        if (!strcmp(name, SG_VIDEOFMT_NAME[i]))
+            return i;
+    return -1;
+}
+
+size_t
+sg_videofmt_framesize(sg_videofmt_t format, int width, int height)
+{
+    size_t cw = (width + 1) >> 1, ch = (height + 1) >> 1;
+    switch (format) {
+    case SG_VIDEOFMT_RGB0:
+        return (size_t) width * height * 4;
+    case SG_VIDEOFMT_YUV420P:
+    case SG_VIDEOFMT_NV12:
+        return (size_t) width * height + cw * ch * 2;
+    }
+    return 0;
+}
+
+/* Convert a row of pixels to luma.  */
+static void
+sg_videoconv_y(unsigned char *dest, const unsigned char *src, int width)
+{
+    int x = 0;
+#if defined SG_X_SSE2
+    const __m128i z = _mm_setzero_si128(),
+        c = _mm_setr_epi16(SG_Y_R, SG_Y_G, SG_Y_B, 0,
+                           SG_Y_R, SG_Y_G, SG_Y_B, 0),
+        off = _mm_set1_epi32(SG_Y_OFFSET);
+    __m128i v, y[4];
+    __m128 a, b;
+    int i;
+    for (; x + 16 <= width; x += 16) {
+        for (i = 0; i < 4; i++) {
+            v = _mm_loadu_si128((const __m128i *) (src + (x + i * 4) * 4));
+            a = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(v, z), c));
+            b = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(v, z), c));
+            v = _mm_add_epi32(
+                _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0))),
+                _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1))));
+            y[i] = _mm_srai_epi32(_mm_add_epi32(v, off), 8);
+        }
+        _mm_storeu_si128(
+            (__m128i *) (dest + x),
+            _mm_packus_epi16(_mm_packs_epi32(y[0], y[1]),
+                             _mm_packs_epi32(y[2], y[3])));
+    }
+#endif
+    for (; x < width; x++) {
+        dest[x] = (unsigned char)
+            ((SG_Y_R * src[x*4+0] + SG_Y_G * src[x*4+1] +
+              SG_Y_B * src[x*4+2] + SG_Y_OFFSET) >> 8);
+    }
+}
+
+/* Convert two rows of pixels to chroma.  The U and V samples are
+   stored with the given stride, so they can be planar or
+   interleaved.  */
+static void
+sg_videoconv_uv(unsigned char *udest, unsigned char *vdest, int stride,
+                const unsigned char *row0, const unsigned char *row1,
+                int width)
+{
+    int x = 0, x1, r, g, b;
+#if defined SG_X_SSE2
+    const __m128i z = _mm_setzero_si128(),
+        cu = _mm_setr_epi16(SG_U_R, SG_U_G, SG_U_B, 0,
+                            SG_U_R, SG_U_G, SG_U_B, 0),
+        cv = _mm_setr_epi16(SG_V_R, SG_V_G, SG_V_B, 0,
+                            SG_V_R, SG_V_G, SG_V_B, 0),
+        off = _mm_set1_epi32(SG_C_OFFSET);
+    __m128i v0, v1, s0, s1, h[2], u, v;
+    __m128 a, c;
+    int i;
+    for (; x + 8 <= width; x += 8) {
+        /* Sum each 2x2 block, giving one RGBX sum per block, two
+           blocks per register.  */
+        for (i = 0; i < 2; i++) {
+            v0 = _mm_loadu_si128((const __m128i *) (row0 + (x + i * 4) * 4));
+            v1 = _mm_loadu_si128((const __m128i *) (row1 + (x + i * 4) * 4));
+            s0 = _mm_add_epi16(_mm_unpacklo_epi8(v0, z),
+                               _mm_unpacklo_epi8(v1, z));
+            s1 = _mm_add_epi16(_mm_unpackhi_epi8(v0, z),
+                               _mm_unpackhi_epi8(v1, z));
+            h[i] = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1),
+                                 _mm_unpackhi_epi64(s0, s1));
+        }
+        a = _mm_castsi128_ps(_mm_madd_epi16(h[0], cu));
+        c = _mm_castsi128_ps(_mm_madd_epi16(h[1], cu));
+        u = _mm_add_epi32(
+            _mm_castps_si128(_mm_shuffle_ps(a, c, _MM_SHUFFLE(2,0,2,0))),
+            _mm_castps_si128(_mm_shuffle_ps(a, c, _MM_SHUFFLE(3,1,3,1))));
+        u = _mm_srai_epi32(_mm_add_epi32(u, off), 10);
+        a = _mm_castsi128_ps(_mm_madd_epi16(h[0], cv));
+        c = _mm_castsi128_ps(_mm_madd_epi16(h[1], cv));
+        v = _mm_add_epi32(
+            _mm_castps_si128(_mm_shuffle_ps(a, c, _MM_SHUFFLE(2,0,2,0))),
+            _mm_castps_si128(_mm_shuffle_ps(a, c, _MM_SHUFFLE(3,1,3,1))));
+        v = _mm_srai_epi32(_mm_add_epi32(v, off), 10);
+        /* Bytes U0 U1 U2 U3 V0 V1 V2 V3.  */
+        u = _mm_packs_epi32(u, v);
+        u = _mm_packus_epi16(u, u);
+        if (stride == 1) {
+            i = _mm_cvtsi128_si32(u);
+            memcpy(udest + (x >> 1), &i, 4);
+            i = _mm_cvtsi128_si32(_mm_srli_si128(u, 4));
+            memcpy(vdest + (x >> 1), &i, 4);
+        } else {
+            _mm_storel_epi64((__m128i *) (udest + x),
+                             _mm_unpacklo_epi8(u, _mm_srli_si128(u, 4)));
+        }
+    }
+#endif
+    for (; x < width; x += 2) {
+        x1 = x + 1 < width ? x + 1 : x;
+        r = row0[x*4+0] + row0[x1*4+0] + row1[x*4+0] + row1[x1*4+0];
+        g = row0[x*4+1] + row0[x1*4+1] + row1[x*4+1] + row1[x1*4+1];
+        b = row0[x*4+2] + row0[x1*4+2] + row1[x*4+2] + row1[x1*4+2];
+        udest[(x >> 1) * stride] = (unsigned char)
+            ((SG_U_R * r + SG_U_G * g + SG_U_B * b + SG_C_OFFSET) >> 10);
+        vdest[(x >> 1) * stride] = (unsigned char)
+            ((SG_V_R * r + SG_V_G * g + SG_V_B * b + SG_C_OFFSET) >> 10);
+    }
+}
+
+void
+sg_videoconv(void *dest, const void *src, sg_videofmt_t format,
+             int width, int height, int y0, int y1)
+{
+    unsigned char *yp = dest, *up, *vp;
+    const unsigned char *sp = src, *row0, *row1;
+    size_t rowbytes = (size_t) width * 4, cw = (width + 1) >> 1,
+        ch = (height + 1) >> 1;
+    int y, stride;
+
+    if (format == SG_VIDEOFMT_RGB0) {
+        memcpy(yp + rowbytes * y0, sp + rowbytes * y0,
+               rowbytes * (y1 - y0));
+        return;
+    }
+
+    up = yp + (size_t) width * height;
+    if (format == SG_VIDEOFMT_YUV420P) {
+        vp = up + cw * ch;
+        stride = 1;
+    } else {
+        vp = up + 1;
+        cw *= 2;
+        stride = 2;
+    }
+    for (y = y0; y < y1; y++)
+        sg_videoconv_y(yp + (size_t) width * y, sp + rowbytes * y, width);
+    for (y = y0; y < y1; y += 2) {
+        row0 = sp + rowbytes * y;
+        row1 = y + 1 < height ? row0 + rowbytes : row0;
+        sg_videoconv_uv(up + cw * (y >> 1), vp + cw * (y >> 1), stride,
+                        row0, row1, width);
+    }
+}
@@ -0,0 +1,38 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include <stddef.h>
+
+/* Pixel formats for video sent to the encoder.  The YUV formats use
+   BT.601 limited range, with chroma subsampled 2x2, the same as
+   FFmpeg's own conversion from RGB.  */
+typedef enum {
+    /* RGBX, unconverted */
+    SG_VIDEOFMT_RGB0,
+    /* Planar Y, U, V (I420) */
+    SG_VIDEOFMT_YUV420P,
+    /* Planar Y, then interleaved U and V */
+    SG_VIDEOFMT_NV12
+} sg_videofmt_t;
+
+#define SG_VIDEOFMT_COUNT 3
+
+/* FFmpeg names for each pixel format.  */
+extern const char SG_VIDEOFMT_NAME[SG_VIDEOFMT_COUNT][8];
+
+/* Get the pixel format with the given FFmpeg name, or return -1 if
+   there is no such format.  */
+int
+sg_videofmt_find(const char *name);
+
+/* Get the size of a frame in the given format, in bytes.  */
+size_t
+sg_videofmt_framesize(sg_videofmt_t format, int width, int height);
+
+/* Convert rows y0 to y1 of an RGBX frame to the given format, so a
+   frame can be converted in pieces.  Both y0 and y1 must be even,
+   except that y1 may be the height.  The source has no padding
+   between rows.  For RGB0, the rows are copied.  */
+void
+sg_videoconv(void *dest, const void *src, sg_videofmt_t format,
+             int width, int height, int y0, int y1);
@@ -2,31 +2,80 @@
    This file is part of SGLib.  SGLib is licensed under the terms of the
    2-clause BSD license.  For more information, see LICENSE.txt. */
 #include "videoio.h"
+#include "videoraw.h"
 #include "sg/error.h"
 #include "sg/log.h"
 #include <errno.h>
 #include <pthread.h>
 #include <stdlib.h>
-#include <string.h>
 #include <unistd.h>
 
+/* Return a frame buffer to the pool.  The mutex must be held.  */
+static void
+sg_videoio_release(struct sg_videoio *iop, void *frame)
+{
+    int r;
+    iop->pool[iop->poolcount++] = frame;
+    if (iop->poolcount == 1) {
+        r = pthread_cond_broadcast(&iop->cond);
+        if (r) abort();
+    }
+}
+
+/* Write a frame to the encoder pipe.  Returns nonzero on failure.  */
+static int
+sg_videoio_writepipe(int fdes, const unsigned char *ptr, size_t sz)
+{
+    struct sg_error *err = NULL;
+    size_t pos = 0;
+    ssize_t amt;
+    int e;
+    while (pos < sz) {
+        amt = write(fdes, ptr + pos, sz - pos);
+        if (amt < 0) {
+            e = errno;
+            if (e == EINTR)
+                continue;
+            if (e == EPIPE) {
+                sg_logs(SG_LOG_ERROR, "video encoder closed pipe.");
+            } else {
+                sg_error_errno(&err, e);
+                sg_logerrs(SG_LOG_ERROR, err,
+                           "Could not write to video encoder.");
+                sg_error_clear(&err);
+            }
+            return 1;
+        }
+        pos += amt;
+    }
+    return 0;
+}
+
 static void *
 sg_videoio_thread(void *arg)
 {
     struct sg_videoio *iop = arg;
-    int r, fdes, e, failed;
-    unsigned char *buf;
-    size_t pos, sz;
-    ssize_t amt;
+    int r, fdes, failed;
+    unsigned char *buf, *out = NULL;
+    const unsigned char *ptr;
+    unsigned timestamp;
+    size_t sz;
     struct sg_error *err = NULL;
 
-    sz = iop->framebytes;
+    sz = sg_videofmt_framesize(iop->format, iop->width, iop->height);
     fdes = iop->pipe;
+    failed = 0;
+    if (iop->format != SG_VIDEOFMT_RGB0) {
+        out = malloc(sz);
+        if (!out) {
+            sg_logs(SG_LOG_ERROR, "Could not allocate video frame.");
+            failed = 1;
+        }
+    }
 
     r = pthread_mutex_lock(&iop->mutex);
     if (r) abort();
 
-    failed = 0;
     while (failed == 0) {
         while (iop->state == SG_VIDEOIO_RUN && iop->framecount == 0) {
             r = pthread_cond_wait(&iop->cond, &iop->mutex);
@@ -34,15 +83,9 @@ sg_videoio_thread(void *arg)
         }
 
         if (iop->framecount > 0) {
-            buf = iop->frame[0];
-            if (iop->framecount > 1) {
-                memmove(iop->frame, iop->frame + 1,
-                        sizeof(*iop->frame) * (iop->framecount - 1));
-            }
-            if (iop->framecount == SG_VIDEOIO_NFRAME) {
-                r = pthread_cond_broadcast(&iop->cond);
-                if (r) abort();
-            }
+            buf = iop->frame[iop->framehead];
+            timestamp = iop->timestamp[iop->framehead];
+            iop->framehead = (iop->framehead + 1) % SG_VIDEOIO_NFRAME;
             iop->framecount--;
         } else {
             break;
@@ -51,32 +94,37 @@ sg_videoio_thread(void *arg)
         r = pthread_mutex_unlock(&iop->mutex);
         if (r) abort();
 
-        pos = 0;
-        while (pos < sz) {
-            amt = write(fdes, buf + pos, sz - pos);
-            if (amt < 0) {
-                e = errno;
-                if (e == EINTR)
-                    continue;
+        /* The frame buffer can go back to the pool as soon as it is
+           converted.  */
+        if (out) {
+            sg_videoconv(out, buf, iop->format,
+                         iop->width, iop->height, 0, iop->height);
+            r = pthread_mutex_lock(&iop->mutex);
+            if (r) abort();
+            sg_videoio_release(iop, buf);
+            r = pthread_mutex_unlock(&iop->mutex);
+            if (r) abort();
+            ptr = out;
+        } else {
+            ptr = buf;
+        }
+
+        if (iop->raw) {
+            if (sg_videoraw_write(iop->raw, ptr, timestamp, &err)) {
                 failed = 1;
-                if (e == EPIPE) {
-                    sg_logs(SG_LOG_ERROR, "video encoder closed pipe.");
-                } else {
-                    sg_error_errno(&err, e);
-                    sg_logerrs(SG_LOG_ERROR, err,
-                               "Could not write to video encoder.");
-                    sg_error_clear(&err);
-                }
-                break;
-            } else {
-                pos += amt;
+                sg_logerrs(SG_LOG_ERROR, err,
+                           "Could not write to raw video file.");
+                sg_error_clear(&err);
             }
+        } else {
+            failed = sg_videoio_writepipe(fdes, ptr, sz);
         }
 
-        free(buf);
-
         r = pthread_mutex_lock(&iop->mutex);
         if (r) abort();
+
+        if (!out)
+            sg_videoio_release(iop, buf);
     }
 
     iop->state = failed ? SG_VIDEOIO_FAILED : SG_VIDEOIO_STOPPED;
@@ -87,20 +135,29 @@ sg_videoio_thread(void *arg)
     r = pthread_mutex_unlock(&iop->mutex);
     if (r) abort();
 
+    free(out);
     return NULL;
 }
 
 int
-sg_videoio_init(struct sg_videoio *iop, size_t framebytes,
-                int video_pipe, struct sg_error **err)
+sg_videoio_init(struct sg_videoio *iop, int width, int height,
+                sg_videofmt_t format, int video_pipe,
+                struct sg_videoraw *raw, struct sg_error **err)
 {
     int r;
     pthread_mutexattr_t mattr;
     pthread_attr_t attr;
     pthread_t thread;
 
-    iop->framebytes = framebytes;
+    iop->width = width;
+    iop->height = height;
+    iop->format = format;
+    iop->framebytes = (size_t) width * height * 4;
     iop->pipe = video_pipe;
+    iop->raw = raw;
+    iop->buffercount = 0;
+    iop->poolcount = 0;
+    iop->framehead = 0;
     iop->framecount = 0;
     iop->state = SG_VIDEOIO_RUN;
 
@@ -165,8 +222,8 @@ sg_videoio_destroy(struct sg_videoio *iop)
     r = pthread_cond_destroy(&iop->cond);
     if (r) abort();
 
-    for (i = 0; i < iop->framecount; i++)
-        free(iop->frame[i]);
+    for (i = 0; i < iop->buffercount; i++)
+        free(iop->buffer[i]);
 
     return failed ? -1: 0;
 }
@@ -189,34 +246,63 @@ sg_videoio_stop(struct sg_videoio *iop)
     if (r) abort();
 }
 
-int
-sg_videoio_write(struct sg_videoio *iop, void *frame)
+void *
+sg_videoio_getframe(struct sg_videoio *iop)
 {
-    int r, running;
+    int r;
+    void *frame = NULL;
 
     r = pthread_mutex_lock(&iop->mutex);
     if (r) abort();
 
-    while (iop->framecount >= SG_VIDEOIO_NFRAME &&
+    while (iop->poolcount == 0 &&
+           iop->buffercount >= SG_VIDEOIO_NFRAME &&
            iop->state == SG_VIDEOIO_RUN) {
         r = pthread_cond_wait(&iop->cond, &iop->mutex);
         if (r) abort();
     }
 
+    if (iop->state == SG_VIDEOIO_RUN) {
+        if (iop->poolcount > 0) {
+            frame = iop->pool[--iop->poolcount];
+        } else {
+            frame = malloc(iop->framebytes);
+            if (frame)
+                iop->buffer[iop->buffercount++] = frame;
+            else
+                sg_logs(SG_LOG_ERROR, "Could not allocate video frame.");
+        }
+    }
+
+    r = pthread_mutex_unlock(&iop->mutex);
+    if (r) abort();
+
+    return frame;
+}
+
+int
+sg_videoio_write(struct sg_videoio *iop, void *frame, unsigned timestamp)
+{
+    int r, running, i;
+
+    r = pthread_mutex_lock(&iop->mutex);
+    if (r) abort();
+
     running = iop->state == SG_VIDEOIO_RUN;
     if (running) {
-        iop->frame[iop->framecount] = frame;
+        i = (iop->framehead + iop->framecount) % SG_VIDEOIO_NFRAME;
+        iop->frame[i] = frame;
+        iop->timestamp[i] = timestamp;
         iop->framecount++;
         r = pthread_cond_broadcast(&iop->cond);
         if (r) abort();
+    } else {
+        sg_videoio_release(iop, frame);
     }
 
     r = pthread_mutex_unlock(&iop->mutex);
     if (r) abort();
 
-    if (!running)
-        free(frame);
-
     return running;
 }
 
@@ -1,10 +1,13 @@
 /* Copyright 2012-2014 Dietrich Epp.
    This file is part of SGLib.  SGLib is licensed under the terms of the
    2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "videoconv.h"
 #include <sys/types.h>
 struct sg_error;
+struct sg_videoraw;
 
-/* Maximum number of pending frames.  */
+/* Maximum number of frame buffers, which limits the number of
+   pending frames.  */
 #define SG_VIDEOIO_NFRAME 8
 
 typedef enum {
@@ -14,21 +17,42 @@ typedef enum {
     SG_VIDEOIO_FAILED
 } sg_videoio_state_t;
 
-/* Video I/O handle */
+/* Video I/O handle.  Frame buffers are allocated as needed, up to
+   SG_VIDEOIO_NFRAME, and reused once written.  */
 struct sg_videoio {
+    /* Frames are RGBX, and converted to the output format by the I/O
+       thread before writing.  */
+    int width, height;
+    sg_videofmt_t format;
     size_t framebytes;
+    /* Frames are written to the pipe, or to the raw video file if it
+       is not NULL.  */
     int pipe;
+    struct sg_videoraw *raw;
     pthread_mutex_t mutex;
     pthread_cond_t cond;
+    /* All frame buffers allocated so far.  */
+    void *buffer[SG_VIDEOIO_NFRAME];
+    int buffercount;
+    /* Frame buffers which are not in use.  */
+    void *pool[SG_VIDEOIO_NFRAME];
+    int poolcount;
+    /* Ring buffer of pending frames and their timestamps, starting at
+       index framehead.  */
     void *frame[SG_VIDEOIO_NFRAME];
+    unsigned timestamp[SG_VIDEOIO_NFRAME];
+    int framehead;
     int framecount;
     sg_videoio_state_t state;
 };
 
-/* Initialize a video I/O handle */
+/* Initialize a video I/O handle.  Frames are written to the pipe, or
+   to the raw video file if it is not NULL, which must be open and
+   have the same size and format.  */
 int
-sg_videoio_init(struct sg_videoio *iop, size_t framebytes,
-                int video_pipe, struct sg_error **err);
+sg_videoio_init(struct sg_videoio *iop, int width, int height,
+                sg_videofmt_t format, int video_pipe,
+                struct sg_videoraw *raw, struct sg_error **err);
 
 /* Destroy a video I/O handle.  Returns zero if I/O finished cleanly,
    nonzero otherwise.  */
@@ -39,11 +63,19 @@ sg_videoio_destroy(struct sg_videoio *iop);
 void
 sg_videoio_stop(struct sg_videoio *iop);
 
-/* Write a frame of video.  This takes ownership of the video frame,
-   and will eventually free it with free().  This function will block
-   if the buffer is full.  */
+/* Get an empty RGBX frame buffer, with framebytes bytes.  This will block
+   if all buffers are in use.  Returns NULL if I/O has stopped or the
+   buffer could not be allocated.  */
+void *
+sg_videoio_getframe(struct sg_videoio *iop);
+
+/* Write a frame of video.  The frame must come from
+   sg_videoio_getframe(), and it is returned to the pool once it is
+   written.  The timestamp, in frames, is only used for raw video
+   files.  Returns zero if I/O has stopped, nonzero if I/O is
+   running.  */
 int
-sg_videoio_write(struct sg_videoio *iop, void *frame);
+sg_videoio_write(struct sg_videoio *iop, void *frame, unsigned timestamp);
 
 /* Test if video I/O is running.  Returns zero if I/O has stopped,
    nonzero if I/O is running.  */
@@ -54,7 +54,7 @@ sg_videoproc_child(const char *command,
 int
 sg_videoproc_init(struct sg_videoproc *pp,
                   const char *path, int width, int height,
-                  struct sg_error **err)
+                  const char *pixfmt, struct sg_error **err)
 {
     struct sg_recordcvar *cvar = &sg_recordcvar;
     struct sg_cmdargs cmd;
@@ -75,11 +75,11 @@ sg_videoproc_init(struct sg_videoproc *pp,
     r = sg_cmdargs_pushf(
         &cmd,
         " -f rawvideo"
-        " -pix_fmt rgb0"
+        " -pix_fmt %s"
         " -r %d"
         " -s %dx%d"
         " -i pipe:3",
-        cvar->rate.value, width, height);
+        pixfmt, cvar->rate.value, width, height);
     if (r) goto nomem;
     r = sg_cmdargs_pushs(&cmd, cvar->arguments.value);
     if (r) goto nomem;
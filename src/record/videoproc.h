@@ -17,11 +17,11 @@ struct sg_videoproc {
 };
 
 /* Initialize the video encoder, creating a pipe and running the
-   process.  */
+   process.  The pixel format is given by its FFmpeg name.  */
 int
 sg_videoproc_init(struct sg_videoproc *pp,
                   const char *path, int width, int height,
-                  struct sg_error **err);
+                  const char *pixfmt, struct sg_error **err);
 
 /* Dispose of the video encoder, closing the pipe and waiting for the
    video encoder to exit.  If do_kill is set, then the video encoder
@@ -0,0 +1,656 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+
+/* This gives us O_DIRECT, and 64-bit file offsets on 32-bit Linux */
+#define _GNU_SOURCE 1
+#define _FILE_OFFSET_BITS 64
+
+#include "videoconv.h"
+#include "videoraw.h"
+#include "sg/atomic.h"
+#include "sg/binary.h"
+#include "sg/error.h"
+#include "sg/thread.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char SG_VIDEORAW_MAGIC[8] = "SGRAWVID";
+static const char SG_VIDEORAW_FRAMEMAGIC[4] = "SGVF";
+
+#define SG_VIDEORAW_VERSION 1
+#define SG_VIDEORAW_MAXDIM 32768
+
+/* Compression parameters: the hash table size, and the number of
+   failed matches before the compressor starts skipping ahead.  */
+#define SG_LZ_HASHBITS 12
+#define SG_LZ_SKIPBITS 6
+#define SG_LZ_MAXOFFSET 65535
+
+static size_t
+sg_videoraw_roundup(size_t size)
+{
+    return (size + SG_VIDEORAW_ALIGN - 1) & ~(size_t) (SG_VIDEORAW_ALIGN - 1);
+}
+
+/* ========== Compression ========== */
+
+size_t
+sg_videoraw_bound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+static unsigned
+sg_lz_hash(const unsigned char *p)
+{
+    return (sg_read_lu32(p) * 2654435761u) >> (32 - SG_LZ_HASHBITS);
+}
+
+static unsigned char *
+sg_lz_putlen(unsigned char *op, size_t n)
+{
+    n -= 15;
+    while (n >= 255) {
+        *op++ = 255;
+        n -= 255;
+    }
+    *op++ = (unsigned char) n;
+    return op;
+}
+
+/* Write a sequence.  If the match length is zero, this is the last
+   sequence.  */
+static unsigned char *
+sg_lz_sequence(unsigned char *op, const unsigned char *lit, size_t nlit,
+               size_t offset, size_t mlen)
+{
+    unsigned char *token = op++;
+    unsigned t;
+    t = (nlit >= 15 ? 15 : (unsigned) nlit) << 4;
+    if (nlit >= 15)
+        op = sg_lz_putlen(op, nlit);
+    memcpy(op, lit, nlit);
+    op += nlit;
+    if (mlen) {
+        sg_write_lu16(op, (unsigned short) offset);
+        op += 2;
+        mlen -= 4;
+        t |= mlen >= 15 ? 15 : (unsigned) mlen;
+        if (mlen >= 15)
+            op = sg_lz_putlen(op, mlen);
+    }
+    *token = (unsigned char) t;
+    return op;
+}
+
+size_t
+sg_videoraw_compress(void *dest, const void *src, size_t size)
+{
+    /* Positions plus one, so zero is empty.  */
+    unsigned tab[1u << SG_LZ_HASHBITS];
+    const unsigned char *base = src, *end = base + size, *p, *anchor, *ref;
+    unsigned char *op = dest;
+    unsigned h, miss;
+    size_t len;
+
+    memset(tab, 0, sizeof(tab));
+    p = anchor = base;
+    miss = 0;
+    /* Matches must start 12 bytes and end 5 bytes before the end, so
+       the data can be decompressed by LZ4 decoders.  */
+    while (size >= 12 && p <= end - 12) {
+        h = sg_lz_hash(p);
+        ref = tab[h] ? base + tab[h] - 1 : NULL;
+        tab[h] = (unsigned) (p - base) + 1;
+        if (!ref || p - ref > SG_LZ_MAXOFFSET || memcmp(p, ref, 4)) {
+            p += 1 + (miss++ >> SG_LZ_SKIPBITS);
+            continue;
+        }
+        miss = 0;
+        len = 4;
+        while (p + len < end - 5 && p[len] == ref[len])
+            len++;
+        op = sg_lz_sequence(op, anchor, p - anchor, p - ref, len);
+        p += len;
+        anchor = p;
+    }
+    op = sg_lz_sequence(op, anchor, end - anchor, 0, 0);
+    return op - (unsigned char *) dest;
+}
+
+/* Read a length extension.  Returns -1 if the data ends first.  */
+static int
+sg_lz_getlen(const unsigned char **ipp, const unsigned char *iend,
+             size_t *n)
+{
+    const unsigned char *ip = *ipp;
+    unsigned b;
+    do {
+        if (ip >= iend)
+            return -1;
+        b = *ip++;
+        *n += b;
+    } while (b == 255);
+    *ipp = ip;
+    return 0;
+}
+
+int
+sg_videoraw_decompress(void *dest, size_t destsize,
+                       const void *src, size_t srcsize)
+{
+    const unsigned char *ip = src, *iend = ip + srcsize;
+    unsigned char *op = dest, *ostart = op, *oend = op + destsize;
+    size_t n, offset;
+    unsigned t;
+
+    for (;;) {
+        if (ip >= iend)
+            return -1;
+        t = *ip++;
+        n = t >> 4;
+        if (n == 15 && sg_lz_getlen(&ip, iend, &n))
+            return -1;
+        if ((size_t) (iend - ip) < n || (size_t) (oend - op) < n)
+            return -1;
+        memcpy(op, ip, n);
+        op += n;
+        ip += n;
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return -1;
+        offset = sg_read_lu16(ip);
+        ip += 2;
+        n = t & 15;
+        if (n == 15 && sg_lz_getlen(&ip, iend, &n))
+            return -1;
+        n += 4;
+        if (offset == 0 || offset > (size_t) (op - ostart) ||
+            (size_t) (oend - op) < n)
+            return -1;
+        if (offset >= n) {
+            memcpy(op, op - offset, n);
+            op += n;
+        } else {
+            for (; n > 0; n--, op++)
+                *op = op[-(ptrdiff_t) offset];
+        }
+    }
+    return op == oend ? 0 : -1;
+}
+
+/* ========== Writing ========== */
+
+struct sg_videoraw_job {
+    const unsigned char *frame;
+    size_t framesize;
+    unsigned char *scratch;
+    /* Stored size of each chunk.  */
+    size_t *size;
+    int nchunk;
+    /* Index of the next chunk to compress.  */
+    sg_atomic_t next;
+};
+
+static void
+sg_videoraw_task(void *arg, int index)
+{
+    struct sg_videoraw_job *job = arg;
+    size_t off, n, bound = sg_videoraw_bound(SG_VIDEORAW_CHUNK);
+    int i;
+    (void) index;
+    for (;;) {
+        i = sg_atomic_fetch_add(&job->next, 1);
+        if (i >= job->nchunk)
+            break;
+        off = (size_t) i * SG_VIDEORAW_CHUNK;
+        n = job->framesize - off;
+        if (n > SG_VIDEORAW_CHUNK)
+            n = SG_VIDEORAW_CHUNK;
+        job->size[i] = sg_videoraw_compress(
+            job->scratch + bound * i, job->frame + off, n);
+    }
+}
+
+static int
+sg_videoraw_nchunk(size_t framesize)
+{
+    return (int) ((framesize + SG_VIDEORAW_CHUNK - 1) / SG_VIDEORAW_CHUNK);
+}
+
+/* Get the maximum size of a record, including padding.  */
+static size_t
+sg_videoraw_maxrecord(size_t framesize)
+{
+    size_t n = sg_videoraw_nchunk(framesize), csize;
+    csize = 4 + 4 * n + n * sg_videoraw_bound(SG_VIDEORAW_CHUNK);
+    return sg_videoraw_roundup(
+        SG_VIDEORAW_RECORD + (csize > framesize ? csize : framesize));
+}
+
+static int
+sg_videoraw_alloc(struct sg_videoraw *rp, struct sg_error **err)
+{
+    void *ptr;
+    rp->bufsize = sg_videoraw_maxrecord(rp->framesize);
+    if (posix_memalign(&ptr, SG_VIDEORAW_ALIGN, rp->bufsize)) {
+        sg_error_nomem(err);
+        return -1;
+    }
+    rp->buf = ptr;
+    return 0;
+}
+
+/* Write blocks to the file.  If the file system does not support
+   direct I/O, the file is switched to normal I/O.  */
+static int
+sg_videoraw_put(struct sg_videoraw *rp, const unsigned char *data,
+                size_t size, struct sg_error **err)
+{
+    size_t pos = 0;
+    ssize_t amt;
+    int flags;
+    while (pos < size) {
+        amt = write(rp->fdes, data + pos, size - pos);
+        if (amt >= 0) {
+            pos += amt;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+#if defined O_DIRECT
+        if (errno == EINVAL && rp->direct) {
+            flags = fcntl(rp->fdes, F_GETFL);
+            if (flags != -1 &&
+                fcntl(rp->fdes, F_SETFL, flags & ~O_DIRECT) != -1) {
+                rp->direct = 0;
+                continue;
+            }
+        }
+#else
+        (void) flags;
+#endif
+        sg_error_errno(err, errno);
+        return -1;
+    }
+    return 0;
+}
+
+/* Write the header block at the start of the file.  */
+static int
+sg_videoraw_putheader(struct sg_videoraw *rp, unsigned long long index,
+                      struct sg_error **err)
+{
+    unsigned char *p = rp->buf;
+    memset(p, 0, SG_VIDEORAW_ALIGN);
+    memcpy(p, SG_VIDEORAW_MAGIC, 8);
+    sg_write_lu32(p + 8, SG_VIDEORAW_VERSION);
+    sg_write_lu32(p + 12, rp->format);
+    sg_write_lu32(p + 16, rp->width);
+    sg_write_lu32(p + 20, rp->height);
+    sg_write_lu32(p + 24, rp->rate);
+    sg_write_lu32(p + 28, index ? rp->count : 0);
+    sg_write_lu64(p + 32, index);
+    if (lseek(rp->fdes, 0, SEEK_SET) == (off_t) -1) {
+        sg_error_errno(err, errno);
+        return -1;
+    }
+    return sg_videoraw_put(rp, p, SG_VIDEORAW_ALIGN, err);
+}
+
+static void
+sg_videoraw_init(struct sg_videoraw *rp)
+{
+    rp->fdes = -1;
+    rp->direct = 0;
+    rp->count = 0;
+    rp->nframe = 0;
+    rp->pos = SG_VIDEORAW_ALIGN;
+    rp->indexpos = 0;
+    rp->index = NULL;
+    rp->indexalloc = 0;
+    rp->buf = NULL;
+    rp->bufsize = 0;
+    rp->scratch = NULL;
+}
+
+int
+sg_videoraw_create(struct sg_videoraw *rp, const char *path,
+                   int format, int width, int height, int rate,
+                   int compress, struct sg_error **err)
+{
+    int nchunk;
+
+    sg_videoraw_init(rp);
+    if (format < 0 || format >= SG_VIDEOFMT_COUNT ||
+        width < 1 || width > SG_VIDEORAW_MAXDIM ||
+        height < 1 || height > SG_VIDEORAW_MAXDIM) {
+        sg_error_invalid(err, __FUNCTION__, "format");
+        return -1;
+    }
+    rp->format = format;
+    rp->width = width;
+    rp->height = height;
+    rp->rate = rate;
+    rp->framesize = sg_videofmt_framesize(format, width, height);
+    rp->compress = compress;
+
+    if (sg_videoraw_alloc(rp, err))
+        goto error;
+    if (compress) {
+        nchunk = sg_videoraw_nchunk(rp->framesize);
+        rp->scratch = malloc(
+            nchunk * (sg_videoraw_bound(SG_VIDEORAW_CHUNK) + sizeof(size_t)));
+        if (!rp->scratch) {
+            sg_error_nomem(err);
+            goto error;
+        }
+    }
+
+#if defined O_DIRECT
+    rp->fdes = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+    rp->direct = rp->fdes >= 0;
+    if (rp->fdes < 0 && errno == EINVAL)
+#endif
+        rp->fdes = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (rp->fdes < 0) {
+        sg_error_errno(err, errno);
+        goto error;
+    }
+    if (sg_videoraw_putheader(rp, 0, err))
+        goto error;
+    return 0;
+
+error:
+    sg_videoraw_close(rp);
+    return -1;
+}
+
+int
+sg_videoraw_write(struct sg_videoraw *rp, const void *frame,
+                  unsigned timestamp, struct sg_error **err)
+{
+    struct sg_videoraw_job job;
+    struct sg_videoraw_entry *e;
+    unsigned char *p = rp->buf, *q;
+    size_t size, total, off, n, bound;
+    unsigned nalloc;
+    int i, nthread;
+
+    if (rp->count >= rp->indexalloc) {
+        nalloc = rp->indexalloc ? rp->indexalloc * 2 : 256;
+        e = realloc(rp->index, sizeof(*e) * nalloc);
+        if (!e) {
+            sg_error_nomem(err);
+            return -1;
+        }
+        rp->index = e;
+        rp->indexalloc = nalloc;
+    }
+
+    if (rp->compress) {
+        job.frame = frame;
+        job.framesize = rp->framesize;
+        job.nchunk = sg_videoraw_nchunk(rp->framesize);
+        bound = sg_videoraw_bound(SG_VIDEORAW_CHUNK);
+        job.size = (size_t *) (void *) rp->scratch;
+        job.scratch = rp->scratch + sizeof(size_t) * job.nchunk;
+        sg_atomic_set(&job.next, 0);
+        nthread = sg_thread_cpucount();
+        if (nthread > job.nchunk)
+            nthread = job.nchunk;
+        sg_thread_run(sg_videoraw_task, &job, nthread);
+
+        q = p + SG_VIDEORAW_RECORD;
+        sg_write_lu32(q, job.nchunk);
+        q += 4 + 4 * job.nchunk;
+        for (i = 0; i < job.nchunk; i++) {
+            off = (size_t) i * SG_VIDEORAW_CHUNK;
+            n = rp->framesize - off;
+            if (n > SG_VIDEORAW_CHUNK)
+                n = SG_VIDEORAW_CHUNK;
+            if (job.size[i] < n) {
+                memcpy(q, job.scratch + bound * i, job.size[i]);
+                n = job.size[i];
+            } else {
+                memcpy(q, (const unsigned char *) frame + off, n);
+            }
+            sg_write_lu32(p + SG_VIDEORAW_RECORD + 4 + 4 * i, (unsigned) n);
+            q += n;
+        }
+        size = q - (p + SG_VIDEORAW_RECORD);
+    } else {
+        memcpy(p + SG_VIDEORAW_RECORD, frame, rp->framesize);
+        size = rp->framesize;
+    }
+
+    memcpy(p, SG_VIDEORAW_FRAMEMAGIC, 4);
+    sg_write_lu32(p + 4, timestamp);
+    sg_write_lu32(p + 8, rp->compress ? SG_VIDEORAW_COMPRESSED : 0);
+    sg_write_lu32(p + 12, (unsigned) size);
+    size += SG_VIDEORAW_RECORD;
+    total = sg_videoraw_roundup(size);
+    memset(p + size, 0, total - size);
+    if (sg_videoraw_put(rp, p, total, err))
+        return -1;
+
+    e = &rp->index[rp->count++];
+    e->offset = rp->pos;
+    e->timestamp = timestamp;
+    e->size = (unsigned) size;
+    rp->pos += total;
+    return 0;
+}
+
+int
+sg_videoraw_finish(struct sg_videoraw *rp, struct sg_error **err)
+{
+    const struct sg_videoraw_entry *e;
+    unsigned char *p = rp->buf;
+    size_t n, pos, total;
+    unsigned i;
+    int r;
+
+    /* Write the index through the record buffer, in pieces.  */
+    n = rp->bufsize / SG_VIDEORAW_ENTRY;
+    for (i = 0; i < rp->count; i += (unsigned) n) {
+        if (n > rp->count - i)
+            n = rp->count - i;
+        for (pos = 0; pos < n; pos++) {
+            e = &rp->index[i + pos];
+            sg_write_lu64(p + pos * SG_VIDEORAW_ENTRY, e->offset);
+            sg_write_lu32(p + pos * SG_VIDEORAW_ENTRY + 8, e->timestamp);
+            sg_write_lu32(p + pos * SG_VIDEORAW_ENTRY + 12, e->size);
+        }
+        pos = n * SG_VIDEORAW_ENTRY;
+        total = sg_videoraw_roundup(pos);
+        memset(p + pos, 0, total - pos);
+        if (sg_videoraw_put(rp, p, total, err))
+            goto error;
+    }
+
+    if (sg_videoraw_putheader(rp, rp->pos, err))
+        goto error;
+    r = close(rp->fdes);
+    rp->fdes = -1;
+    if (r) {
+        sg_error_errno(err, errno);
+        goto error;
+    }
+    sg_videoraw_close(rp);
+    return 0;
+
+error:
+    sg_videoraw_close(rp);
+    return -1;
+}
+
+/* ========== Reading ========== */
+
+/* Read exactly the given number of bytes.  Returns the number of bytes
+   read, which is less at the end of the file, or -1 on error.  */
+static ssize_t
+sg_videoraw_get(struct sg_videoraw *rp, unsigned char *data, size_t size,
+                struct sg_error **err)
+{
+    size_t pos = 0;
+    ssize_t amt;
+    while (pos < size) {
+        amt = read(rp->fdes, data + pos, size - pos);
+        if (amt > 0) {
+            pos += amt;
+        } else if (amt == 0) {
+            break;
+        } else if (errno != EINTR) {
+            sg_error_errno(err, errno);
+            return -1;
+        }
+    }
+    rp->pos += pos;
+    return pos;
+}
+
+int
+sg_videoraw_open(struct sg_videoraw *rp, const char *path,
+                 struct sg_error **err)
+{
+    const unsigned char *p;
+    ssize_t amt;
+
+    sg_videoraw_init(rp);
+    rp->pos = 0;
+    rp->fdes = open(path, O_RDONLY);
+    if (rp->fdes < 0) {
+        sg_error_errno(err, errno);
+        return -1;
+    }
+    rp->framesize = 0;
+    rp->buf = malloc(SG_VIDEORAW_ALIGN);
+    if (!rp->buf) {
+        sg_error_nomem(err);
+        goto error;
+    }
+    amt = sg_videoraw_get(rp, rp->buf, SG_VIDEORAW_ALIGN, err);
+    if (amt < 0)
+        goto error;
+    p = rp->buf;
+    if (amt < SG_VIDEORAW_ALIGN || memcmp(p, SG_VIDEORAW_MAGIC, 8) ||
+        sg_read_lu32(p + 8) != SG_VIDEORAW_VERSION)
+        goto baddata;
+    rp->format = sg_read_lu32(p + 12);
+    rp->width = sg_read_lu32(p + 16);
+    rp->height = sg_read_lu32(p + 20);
+    rp->rate = sg_read_lu32(p + 24);
+    rp->nframe = sg_read_lu32(p + 28);
+    if (rp->format < 0 || rp->format >= SG_VIDEOFMT_COUNT ||
+        rp->width < 1 || rp->width > SG_VIDEORAW_MAXDIM ||
+        rp->height < 1 || rp->height > SG_VIDEORAW_MAXDIM)
+        goto baddata;
+    /* The index is not read, but it marks the end of the frames.  */
+    rp->indexpos = sg_read_lu64(p + 32);
+    rp->framesize = sg_videofmt_framesize(
+        rp->format, rp->width, rp->height);
+    free(rp->buf);
+    rp->buf = NULL;
+    if (sg_videoraw_alloc(rp, err))
+        goto error;
+    return 0;
+
+baddata:
+    sg_error_data(err, "raw video");
+error:
+    sg_videoraw_close(rp);
+    return -1;
+}
+
+int
+sg_videoraw_read(struct sg_videoraw *rp, void *frame,
+                 unsigned *timestamp, struct sg_error **err)
+{
+    unsigned char *p = rp->buf, *q, *dest = frame;
+    size_t size, total, off, n, stored;
+    unsigned flags, nchunk, i;
+    ssize_t amt;
+
+    if (rp->indexpos && rp->pos >= rp->indexpos)
+        return 0;
+    amt = sg_videoraw_get(rp, p, SG_VIDEORAW_ALIGN, err);
+    if (amt < 0)
+        return -1;
+    /* Files which were not closed can end in the middle of a record,
+       or in zeroes.  */
+    if (amt == 0 || (!rp->indexpos &&
+                     (amt < SG_VIDEORAW_ALIGN ||
+                      memcmp(p, SG_VIDEORAW_FRAMEMAGIC, 4))))
+        return 0;
+    if (amt < SG_VIDEORAW_ALIGN || memcmp(p, SG_VIDEORAW_FRAMEMAGIC, 4))
+        goto baddata;
+    flags = sg_read_lu32(p + 8);
+    size = sg_read_lu32(p + 12);
+    total = sg_videoraw_roundup(SG_VIDEORAW_RECORD + size);
+    if (total > rp->bufsize)
+        goto baddata;
+    amt = sg_videoraw_get(
+        rp, p + SG_VIDEORAW_ALIGN, total - SG_VIDEORAW_ALIGN, err);
+    if (amt < 0)
+        return -1;
+    if ((size_t) amt < total - SG_VIDEORAW_ALIGN) {
+        if (!rp->indexpos)
+            return 0;
+        goto baddata;
+    }
+    *timestamp = sg_read_lu32(p + 4);
+    q = p + SG_VIDEORAW_RECORD;
+
+    if ((flags & SG_VIDEORAW_COMPRESSED) == 0) {
+        if (size != rp->framesize)
+            goto baddata;
+        memcpy(frame, q, size);
+        rp->count++;
+        return 1;
+    }
+
+    nchunk = sg_videoraw_nchunk(rp->framesize);
+    if (size < 4 + 4 * nchunk || sg_read_lu32(q) != nchunk)
+        goto baddata;
+    off = 4 + 4 * nchunk;
+    for (i = 0; i < nchunk; i++) {
+        n = rp->framesize - (size_t) i * SG_VIDEORAW_CHUNK;
+        if (n > SG_VIDEORAW_CHUNK)
+            n = SG_VIDEORAW_CHUNK;
+        stored = sg_read_lu32(q + 4 + 4 * i);
+        if (stored > size - off)
+            goto baddata;
+        if (stored == n)
+            memcpy(dest, q + off, n);
+        else if (sg_videoraw_decompress(dest, n, q + off, stored))
+            goto baddata;
+        dest += n;
+        off += stored;
+    }
+    if (off != size)
+        goto baddata;
+    rp->count++;
+    return 1;
+
+baddata:
+    sg_error_data(err, "raw video");
+    return -1;
+}
+
+void
+sg_videoraw_close(struct sg_videoraw *rp)
+{
+    if (rp->fdes >= 0)
+        close(rp->fdes);
+    free(rp->index);
+    free(rp->buf);
+    free(rp->scratch);
+    sg_videoraw_init(rp);
+}
@@ -0,0 +1,152 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include <stddef.h>
+struct sg_error;
+
+/*
+  Raw video files store frames exactly as the recorder captured them,
+  so video can be recorded when no encoder is available or when the
+  encoder cannot keep up.  The rawvideo tool converts them to the input
+  the encoder expects.
+
+  All numbers are little endian.  The file is divided into blocks of
+  SG_VIDEORAW_ALIGN bytes, so it can be written with direct I/O.  The
+  file starts with a header block:
+
+  u8[8]  magic: "SGRAWVID"
+  u32    version: 1
+  u32    pixel format, an sg_videofmt_t
+  u32    width
+  u32    height
+  u32    frame rate
+  u32    number of frames, or 0 if the file was not closed
+  u64    offset of the index, or 0 if the file was not closed
+
+  Each frame is a record starting on a block boundary, padded with
+  zeroes to the next block boundary:
+
+  u32    magic: "SGVF"
+  u32    timestamp, in frames since recording started
+  u32    flags: SG_VIDEORAW_COMPRESSED
+  u32    size of the data following the record header
+
+  An uncompressed frame is stored as is.  A compressed frame is divided
+  into chunks of SG_VIDEORAW_CHUNK bytes, except for the last, which are
+  compressed independently.  The data is a u32 count of chunks, a u32
+  stored size for each chunk, then the chunks.  A chunk whose stored
+  size is equal to its size is not compressed.
+
+  Chunks are compressed as a series of sequences, each a token byte,
+  literal length extension, literals, u16 match offset, and match length
+  extension.  The high nibble of the token is the number of literals
+  and the low nibble is the match length minus 4.  A nibble of 15 is
+  followed by bytes which are added to it, ending with a byte other
+  than 255.  The last sequence has only literals.  This is the same as
+  the LZ4 block format.
+
+  The index follows the last frame, with one entry per frame:
+
+  u64    offset of the frame record
+  u32    timestamp
+  u32    record size, not including padding
+
+  Files which were not closed can still be read, by reading records
+  until the end of the file.
+*/
+
+/* Block size for raw video files.  */
+#define SG_VIDEORAW_ALIGN 4096
+
+/* Size of compressed chunks.  */
+#define SG_VIDEORAW_CHUNK (1024 * 1024)
+
+#define SG_VIDEORAW_HEADER 40
+#define SG_VIDEORAW_RECORD 16
+#define SG_VIDEORAW_ENTRY 16
+
+/* Frame flags.  */
+enum {
+    SG_VIDEORAW_COMPRESSED = 1u << 0
+};
+
+struct sg_videoraw_entry {
+    unsigned long long offset;
+    unsigned timestamp;
+    unsigned size;
+};
+
+/* A raw video file, for reading or writing.  */
+struct sg_videoraw {
+    int fdes;
+    /* Set if the file is open with direct I/O.  */
+    int direct;
+    int format, width, height, rate;
+    /* Size of an uncompressed frame.  */
+    size_t framesize;
+    /* Compress frames when writing.  */
+    int compress;
+    /* Number of frames written or read, and the file offset.  */
+    unsigned count;
+    unsigned long long pos;
+    /* When reading, the number of frames and the offset of the index
+       from the header.  Both are zero if the file was not closed.  */
+    unsigned nframe;
+    unsigned long long indexpos;
+    /* Index of frames written.  */
+    struct sg_videoraw_entry *index;
+    unsigned indexalloc;
+    /* Block aligned buffer for records, and a buffer for compressing
+       chunks.  */
+    unsigned char *buf;
+    size_t bufsize;
+    unsigned char *scratch;
+};
+
+/* Get the maximum size of a chunk after compression.  */
+size_t
+sg_videoraw_bound(size_t size);
+
+/* Compress a chunk, and return the compressed size.  The destination
+   must have room for sg_videoraw_bound(size) bytes.  */
+size_t
+sg_videoraw_compress(void *dest, const void *src, size_t size);
+
+/* Decompress a chunk.  Returns 0 if successful, or -1 if the data is
+   corrupt or does not decompress to exactly destsize bytes.  */
+int
+sg_videoraw_decompress(void *dest, size_t destsize,
+                       const void *src, size_t srcsize);
+
+/* Create a raw video file.  The frame size is given by the pixel
+   format, which is an sg_videofmt_t.  */
+int
+sg_videoraw_create(struct sg_videoraw *rp, const char *path,
+                   int format, int width, int height, int rate,
+                   int compress, struct sg_error **err);
+
+/* Write a frame to a raw video file.  Compression uses several
+   threads.  */
+int
+sg_videoraw_write(struct sg_videoraw *rp, const void *frame,
+                  unsigned timestamp, struct sg_error **err);
+
+/* Write the index and header and close a raw video file which was
+   created for writing.  */
+int
+sg_videoraw_finish(struct sg_videoraw *rp, struct sg_error **err);
+
+/* Open a raw video file for reading.  */
+int
+sg_videoraw_open(struct sg_videoraw *rp, const char *path,
+                 struct sg_error **err);
+
+/* Read the next frame from a raw video file.  Returns 1 if a frame was
+   read, 0 at the end of the file, or -1 on error.  */
+int
+sg_videoraw_read(struct sg_videoraw *rp, void *frame,
+                 unsigned *timestamp, struct sg_error **err);
+
+/* Close a raw video file and free its buffers.  */
+void
+sg_videoraw_close(struct sg_videoraw *rp);
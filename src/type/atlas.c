@@ -0,0 +1,243 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "private.h"
+#include "sg/error.h"
+#include "sg/file.h"
+#include "sg/pixbuf.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Space between glyphs, so linear filtering does not pick up pixels
+   from neighboring glyphs.  */
+#define SG_GLYPHATLAS_PAD 1
+
+/* New shelves are rounded up to a multiple of this height, so glyphs
+   of similar heights can share shelves.  */
+#define SG_GLYPHATLAS_SHELFALIGN 4
+
+void
+sg_glyphatlas_init(struct sg_glyphatlas *atlas, int pagesize)
+{
+    atlas->page = NULL;
+    atlas->pagecount = 0;
+    atlas->pagealloc = 0;
+    atlas->pagesize = pagesize;
+    atlas->data = NULL;
+    atlas->mapcount = 0;
+}
+
+void
+sg_glyphatlas_destroy(struct sg_glyphatlas *atlas)
+{
+    unsigned i;
+    for (i = 0; i < atlas->pagecount; i++) {
+        if (i >= atlas->mapcount)
+            free(atlas->page[i].pixbuf.data);
+        free(atlas->page[i].shelf);
+    }
+    free(atlas->page);
+    if (atlas->data)
+        sg_filedata_decref(atlas->data);
+}
+
+static struct sg_glyphpage *
+sg_glyphatlas_newpage(struct sg_glyphatlas *atlas, struct sg_error **err)
+{
+    struct sg_glyphpage *page;
+    unsigned nalloc;
+    int r;
+
+    if (atlas->pagecount >= atlas->pagealloc) {
+        nalloc = atlas->pagealloc ? atlas->pagealloc * 2 : 2;
+        page = realloc(atlas->page, sizeof(*page) * nalloc);
+        if (!page) {
+            sg_error_nomem(err);
+            return NULL;
+        }
+        atlas->page = page;
+        atlas->pagealloc = nalloc;
+    }
+    page = &atlas->page[atlas->pagecount];
+    r = sg_pixbuf_calloc(&page->pixbuf, SG_R,
+                         atlas->pagesize, atlas->pagesize, err);
+    if (r)
+        return NULL;
+    page->shelf = NULL;
+    page->shelfcount = 0;
+    page->shelfalloc = 0;
+    page->top = 0;
+    page->dirty.x0 = 0;
+    page->dirty.y0 = 0;
+    page->dirty.x1 = 0;
+    page->dirty.y1 = 0;
+    page->texture = 0;
+    atlas->pagecount++;
+    return page;
+}
+
+int
+sg_glyphatlas_map(struct sg_glyphatlas *atlas, struct sg_filedata *data,
+                  const void *pixels, unsigned count,
+                  struct sg_error **err)
+{
+    struct sg_glyphpage *page;
+    size_t psize = (size_t) atlas->pagesize * atlas->pagesize;
+    unsigned i;
+
+    if (atlas->pagecount || !count) {
+        sg_error_invalid(err, __FUNCTION__, "atlas");
+        return -1;
+    }
+    page = malloc(sizeof(*page) * count);
+    if (!page) {
+        sg_error_nomem(err);
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        page[i].pixbuf.data = (char *) pixels + psize * i;
+        page[i].pixbuf.format = SG_R;
+        page[i].pixbuf.width = atlas->pagesize;
+        page[i].pixbuf.height = atlas->pagesize;
+        page[i].pixbuf.rowbytes = atlas->pagesize;
+        page[i].shelf = NULL;
+        page[i].shelfcount = 0;
+        page[i].shelfalloc = 0;
+        /* No free space, so nothing is ever written to the page.  */
+        page[i].top = atlas->pagesize;
+        page[i].dirty.x0 = 0;
+        page[i].dirty.y0 = 0;
+        page[i].dirty.x1 = (short) atlas->pagesize;
+        page[i].dirty.y1 = (short) atlas->pagesize;
+        page[i].texture = 0;
+    }
+    free(atlas->page);
+    atlas->page = page;
+    atlas->pagecount = count;
+    atlas->pagealloc = count;
+    atlas->mapcount = count;
+    sg_filedata_incref(data);
+    atlas->data = data;
+    return 0;
+}
+
+/* Find space for a rectangle in a page.  Uses the shortest shelf
+   which the rectangle fits in, or creates a new shelf.  Returns the
+   shelf, or NULL if there is no room in the page.  */
+static struct sg_glyphshelf *
+sg_glyphpage_place(struct sg_glyphpage *page, int size, int w, int h,
+                   struct sg_error **err)
+{
+    struct sg_glyphshelf *shelf, *best = NULL;
+    unsigned i, nalloc;
+    int sh;
+
+    for (i = 0; i < page->shelfcount; i++) {
+        shelf = &page->shelf[i];
+        if (shelf->h >= h && shelf->x + w <= size &&
+            (!best || shelf->h < best->h))
+            best = shelf;
+    }
+    if (best)
+        return best;
+
+    sh = (h + SG_GLYPHATLAS_SHELFALIGN - 1) &
+        ~(SG_GLYPHATLAS_SHELFALIGN - 1);
+    if (sh > size - page->top) {
+        sh = h;
+        if (sh > size - page->top)
+            return NULL;
+    }
+    if (page->shelfcount >= page->shelfalloc) {
+        nalloc = page->shelfalloc ? page->shelfalloc * 2 : 16;
+        shelf = realloc(page->shelf, sizeof(*shelf) * nalloc);
+        if (!shelf) {
+            sg_error_nomem(err);
+            return NULL;
+        }
+        page->shelf = shelf;
+        page->shelfalloc = nalloc;
+    }
+    shelf = &page->shelf[page->shelfcount++];
+    shelf->y = page->top;
+    shelf->h = sh;
+    shelf->x = 0;
+    page->top += sh;
+    return shelf;
+}
+
+unsigned char *
+sg_glyphatlas_alloc(struct sg_glyphatlas *atlas, int w, int h,
+                    int *page, int *x, int *y, struct sg_error **err)
+{
+    struct sg_glyphpage *p;
+    struct sg_glyphshelf *shelf;
+    struct sg_textrect *d;
+    struct sg_error *e = NULL;
+    int size = atlas->pagesize, pw, ph, px, py;
+
+    if (w <= 0 || h <= 0) {
+        sg_error_invalid(err, __FUNCTION__, "size");
+        return NULL;
+    }
+    pw = w + SG_GLYPHATLAS_PAD;
+    ph = h + SG_GLYPHATLAS_PAD;
+    if (pw > size || ph > size) {
+        sg_error_sets(err, &SG_ERROR_GENERIC, 0,
+                      "glyph too large for atlas");
+        return NULL;
+    }
+
+    /* Only the most recent page is searched.  Older pages are
+       usually full, and this keeps insertion fast.  */
+    shelf = NULL;
+    p = NULL;
+    if (atlas->pagecount) {
+        p = &atlas->page[atlas->pagecount - 1];
+        shelf = sg_glyphpage_place(p, size, pw, ph, &e);
+        if (e) {
+            sg_error_move(err, &e);
+            return NULL;
+        }
+    }
+    if (!shelf) {
+        p = sg_glyphatlas_newpage(atlas, err);
+        if (!p)
+            return NULL;
+        shelf = sg_glyphpage_place(p, size, pw, ph, err);
+        if (!shelf)
+            return NULL;
+    }
+
+    px = shelf->x;
+    py = shelf->y;
+    shelf->x += pw;
+
+    d = &p->dirty;
+    if (d->y0 >= d->y1) {
+        d->x0 = px;
+        d->y0 = py;
+        d->x1 = px + w;
+        d->y1 = py + h;
+    } else {
+        if (px < d->x0) d->x0 = px;
+        if (py < d->y0) d->y0 = py;
+        if (px + w > d->x1) d->x1 = px + w;
+        if (py + h > d->y1) d->y1 = py + h;
+    }
+
+    *page = (int) (p - atlas->page);
+    *x = px;
+    *y = py;
+    return (unsigned char *) p->pixbuf.data + py * p->pixbuf.rowbytes + px;
+}
+
+void
+sg_glyphatlas_clean(struct sg_glyphatlas *atlas)
+{
+    unsigned i;
+    for (i = 0; i < atlas->pagecount; i++) {
+        atlas->page[i].dirty.y0 = 0;
+        atlas->page[i].dirty.y1 = 0;
+    }
+}
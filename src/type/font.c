@@ -2,15 +2,15 @@
    This file is part of SGLib.  SGLib is licensed under the terms of the
    2-clause BSD license.  For more information, see LICENSE.txt. */
 #include "private.h"
+#include FT_ADVANCES_H
+#include "sg/atomic.h"
 #include "sg/error.h"
-#include "sg/log.h"
-#include "sg/opengl.h"
-#include "sg/pack.h"
-#include "sg/pixbuf.h"
+#include "sg/file.h"
+#include "sg/thread.h"
 #include "sg/type.h"
-#include <assert.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 static void
 sg_font_free(struct sg_font *fp)
@@ -23,7 +23,7 @@ sg_font_free(struct sg_font *fp)
     while (1) {
         if (p == fp) {
             *prev = fp->next;
-            if (prev == &t->font)
+            if (!t->font)
                 sg_typeface_decref(t);
             break;
         } else if (!p) {
@@ -33,7 +33,10 @@ sg_font_free(struct sg_font *fp)
             p = *prev;
         }
     }
-    glDeleteTextures(1, &fp->texture);
+    if (fp->base)
+        sg_font_decref(fp->base);
+    sg_glyphatlas_deletetextures(&fp->atlas);
+    sg_glyphatlas_destroy(&fp->atlas);
     free(fp);
 }
 
@@ -50,152 +53,704 @@ sg_font_decref(struct sg_font *fp)
         sg_font_free(fp);
 }
 
-#include <stdio.h>
+/* Choose the atlas page size for a font with the given line height,
+   so a page holds a few hundred glyphs.  */
+static int
+sg_font_pagesize(int height)
+{
+    int size = 256;
+    while (size < 2048 && size < height * 16)
+        size *= 2;
+    return size;
+}
 
-struct sg_font *
-sg_font_new(struct sg_typeface *tp, float size, struct sg_error **err)
+/* Get the size the FreeType face is set to when rendering a font, in
+   26.6 units.  Distance field glyphs are rendered at a higher
+   resolution and downsampled.  */
+static int
+sg_font_facesize(struct sg_font *fp)
 {
-    struct sg_font *fp = NULL;
-    struct sg_font_glyph *glyph;
-    struct sg_pack_rect *grect = NULL;
-    struct sg_pack_size psize, maxsize;
-    struct sg_pixbuf pixbuf;
+    return (fp->flags & SG_FONT_SDF) ? fp->size * SG_SDF_OVERSAMPLE :
+        fp->size;
+}
+
+static int
+sg_font_setsize(struct sg_font *fp, struct sg_error **err)
+{
+    struct sg_typeface *tp = fp->typeface;
     FT_Error ferr;
-    FT_Face face = tp->face;
-    FT_GlyphSlot slot;
-    int isize, i, nglyph, r, w, h, x, y, irb, orb;
-    const unsigned char *ip;
-    unsigned char *op;
-    GLuint texture;
+    int size = sg_font_facesize(fp);
+    if (tp->cursize == size)
+        return 0;
+    ferr = FT_Set_Char_Size(tp->face, 0, size, 72, 72);
+    if (ferr) {
+        tp->cursize = 0;
+        sg_error_freetype(err, ferr);
+        return -1;
+    }
+    tp->cursize = size;
+    return 0;
+}
 
-    pixbuf.data = NULL;
+/* Convert a distance in font units to pixels at the given size, in
+   26.6 units.  */
+static int
+sg_font_unitstopixels(FT_Face face, long value, int size)
+{
+    return (int) floor((double) value * size /
+                       (64.0 * face->units_per_EM) + 0.5);
+}
 
-    isize = floorf((size * 64.0f) + 0.5f);
-    if (isize < 1 || isize > 64 * 1024) {
-        sg_error_invalid(err, __FUNCTION__, "size");
-        return NULL;
-    }
+/* Create a font, or return a reference to an existing font with the
+   same parameters.  */
+static struct sg_font *
+sg_font_create(struct sg_typeface *tp, int isize, unsigned flags,
+               struct sg_font *base, struct sg_error **err)
+{
+    struct sg_font *fp;
+    struct sg_font_glyph *glyph;
+    FT_Face face = tp->face;
+    int nglyph, height;
 
     for (fp = tp->font; fp; fp = fp->next) {
-        if (fp->size == isize) {
+        if (fp->size == isize && fp->flags == flags && fp->base == base) {
             fp->refcount++;
             return fp;
         }
     }
 
-    ferr = FT_Set_Char_Size(face, 0, isize, 72, 72);
-    if (ferr)
-        goto freetype_error;
-
     nglyph = face->num_glyphs;
-    grect = malloc(sizeof(*grect) * nglyph);
-    for (i = 0; i < nglyph; i++) {
-        ferr = FT_Load_Glyph(face, i, FT_LOAD_TARGET_NORMAL);
-        if (ferr)
-            goto freetype_error;
-        slot = face->glyph;
-        grect[i].w = slot->metrics.width >> 6;
-        grect[i].h = slot->metrics.height >> 6;
-    }
-    maxsize.width = 1024;
-    maxsize.height = 1024;
-    r = sg_pack(grect, nglyph, &psize, &maxsize, err);
-    if (r <= 0) {
-        if (r == 0) {
-            sg_error_sets(err, &SG_ERROR_GENERIC, 0,
-                          "could not pack font glyphs");
-        }
-        goto error;
-    }
-    sg_logf(SG_LOG_INFO,
-            "%s @%.2f: %d glyphs packed in %dx%d rect",
-            tp->path, (double) isize * (1.0 / 64.0),
-            nglyph, psize.width, psize.height);
-    r = sg_pixbuf_calloc(&pixbuf, SG_R, psize.width, psize.height, err);
-    if (r)
-        goto error;
-    orb = pixbuf.rowbytes;
     fp = malloc(sizeof(*fp) + sizeof(*glyph) * nglyph);
     if (!fp) {
         sg_error_nomem(err);
-        goto error;
+        return NULL;
     }
     glyph = (struct sg_font_glyph *) (fp + 1);
-    for (i = 0; i < nglyph; i++) {
-        ferr = FT_Load_Glyph(face, i, FT_LOAD_TARGET_NORMAL);
-        slot = face->glyph;
-        if (ferr)
-            goto freetype_error;
-        ferr = FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL);
-        if (ferr)
-            goto freetype_error;
-        w = grect[i].w;
-        h = grect[i].h;
-        assert(w == slot->bitmap.width);
-        assert(h == slot->bitmap.rows);
-        glyph[i].advance = slot->advance.x >> 6;
-        if (w == 0 || h == 0) {
-            glyph[i].w = 0;
-            glyph[i].h = 0;
-            glyph[i].x = 0;
-            glyph[i].y = 0;
-            glyph[i].bx = 0;
-            glyph[i].by = 0;
-        } else {
-            glyph[i].w = w;
-            glyph[i].h = h;
-            glyph[i].x = grect[i].x;
-            glyph[i].y = grect[i].y;
-            glyph[i].bx = slot->bitmap_left;
-            glyph[i].by = slot->bitmap_top;
-            ip = slot->bitmap.buffer;
-            irb = slot->bitmap.pitch;
-            op = (unsigned char *) pixbuf.data +
-                grect[i].y * orb + grect[i].x;
-            for (y = 0; y < h; y++)
-                for (x = 0; x < w; x++)
-                    op[y * orb + x] = ip[y * irb + x];
+    memset(glyph, 0, sizeof(*glyph) * nglyph);
+
+    fp->typeface = tp;
+    fp->size = isize;
+    fp->flags = flags;
+    fp->base = base;
+    if (flags & SG_FONT_SDF) {
+        /* Distance field fonts are drawn at any scale, so they use
+           unhinted metrics.  */
+        height = sg_font_unitstopixels(face, face->height, isize) +
+            2 * SG_SDF_SPREAD;
+        fp->ascender = sg_font_unitstopixels(face, face->ascender, isize);
+        fp->descender = sg_font_unitstopixels(face, face->descender, isize);
+    } else {
+        if (sg_font_setsize(fp, err)) {
+            free(fp);
+            return NULL;
         }
+        height = (int) (face->size->metrics.height >> 6);
+        fp->ascender = (int) face->size->metrics.ascender >> 6;
+        fp->descender = (int) face->size->metrics.descender >> 6;
     }
 
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    sg_pixbuf_texture(&pixbuf);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
     fp->refcount = 1;
-    fp->size = isize;
-    fp->ascender = (int) face->size->metrics.ascender >> 6;
-    fp->descender = (int) face->size->metrics.descender >> 6;
-    fp->typeface = tp;
     fp->next = tp->font;
     fp->glyph = glyph;
     fp->glyphcount = nglyph;
-    fp->texture = texture;
-    fp->texscale[0] = 1.0f / (float) pixbuf.width;
-    fp->texscale[1] = 1.0f / (float) pixbuf.height;
+    sg_glyphatlas_init(&fp->atlas, sg_font_pagesize(height));
+    if (!base)
+        sg_font_cacheload(fp);
     if (tp->font == NULL)
         tp->refcount++;
+    tp->font = fp;
+    if (base)
+        base->refcount++;
+
+    return fp;
+}
+
+/* Convert a font size to 26.6 units.  */
+static int
+sg_font_isize(float size, struct sg_error **err)
+{
+    int isize = (int) floorf((size * 64.0f) + 0.5f);
+    if (isize < 1 || isize > 64 * 1024) {
+        sg_error_invalid(err, __FUNCTION__, "size");
+        return 0;
+    }
+    return isize;
+}
 
-    free(pixbuf.data);
-    free(grect);
+struct sg_font *
+sg_font_new(struct sg_typeface *tp, float size, struct sg_error **err)
+{
+    int isize = sg_font_isize(size, err);
+    if (!isize)
+        return NULL;
+    return sg_font_create(tp, isize, 0, NULL, err);
+}
+
+struct sg_font *
+sg_font_newsdf(struct sg_typeface *tp, float size, struct sg_error **err)
+{
+    struct sg_font *base, *fp;
+    int isize = sg_font_isize(size, err);
+    if (!isize)
+        return NULL;
+    if (!FT_IS_SCALABLE(tp->face)) {
+        sg_error_sets(err, &SG_ERROR_GENERIC, 0,
+                      "typeface is not scalable");
+        return NULL;
+    }
+    base = sg_font_create(tp, SG_SDF_SIZE * 64, SG_FONT_SDF, NULL, err);
+    if (!base)
+        return NULL;
+    fp = sg_font_create(tp, isize, SG_FONT_SDF, base, err);
+    sg_font_decref(base);
     return fp;
+}
 
-freetype_error:
-    sg_error_freetype(err, ferr);
-    goto error;
+float
+sg_font_getsdfrange(struct sg_font *fp)
+{
+    if (!(fp->flags & SG_FONT_SDF))
+        return 0.0f;
+    return (float) SG_SDF_SPREAD * (float) fp->size /
+        (float) (SG_SDF_SIZE * 64);
+}
 
-error:
-    free(fp);
-    free(pixbuf.data);
-    free(grect);
-    return NULL;
+/* Scratch memory for rendering glyphs.  */
+struct sg_font_scratch {
+    struct sg_sdfbuf sdf;
+    unsigned char *buf;
+    size_t alloc;
+};
+
+static void
+sg_font_scratch_destroy(struct sg_font_scratch *s)
+{
+    sg_sdfbuf_destroy(&s->sdf);
+    free(s->buf);
 }
 
-void
-sg_font_gettexture(struct sg_font *fp, unsigned *texture, float *scale)
+/* A rendered glyph bitmap, before it is placed in an atlas.  The
+   bitmap points into the FreeType glyph slot or the scratch
+   memory.  */
+struct sg_font_raster {
+    int w, h, bx, by, advance;
+    const unsigned char *data;
+    int pitch;
+};
+
+/* Divide, rounding towards negative infinity.  */
+static int
+sg_font_floordiv(int x, int y)
+{
+    return x >= 0 ? x / y : -((y - 1 - x) / y);
+}
+
+/* Render a distance field glyph.  The outline is rendered at
+   SG_SDF_OVERSAMPLE times the font size, and the distance field
+   covers the pixels of the font which the outline touches, plus
+   SG_SDF_SPREAD pixels on each side.  */
+static FT_Error
+sg_font_rastersdf(FT_Face face, unsigned index,
+                  struct sg_font_raster *r, struct sg_font_scratch *s)
+{
+    const int k = SG_SDF_OVERSAMPLE, spread = SG_SDF_SPREAD;
+    FT_GlyphSlot slot = face->glyph;
+    FT_Error ferr;
+    int sw, sh, x0, x1, y0, y1;
+    size_t sz;
+    unsigned char *nbuf;
+
+    ferr = FT_Load_Glyph(face, index, FT_LOAD_NO_HINTING);
+    if (ferr)
+        return ferr;
+    ferr = FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL);
+    if (ferr)
+        return ferr;
+    sw = slot->bitmap.width;
+    sh = slot->bitmap.rows;
+    if (sw == 0 || sh == 0) {
+        r->w = 0;
+        r->h = 0;
+        return 0;
+    }
+
+    /* Bounds of the field, in font pixels, with y pointing up.  */
+    x0 = sg_font_floordiv(slot->bitmap_left, k) - spread;
+    x1 = -sg_font_floordiv(-(slot->bitmap_left + sw), k) + spread;
+    y1 = -sg_font_floordiv(-slot->bitmap_top, k) + spread;
+    y0 = sg_font_floordiv(slot->bitmap_top - sh, k) - spread;
+    r->w = x1 - x0;
+    r->h = y1 - y0;
+    r->bx = x0;
+    r->by = y1;
+    sz = (size_t) r->w * r->h;
+    if (sz > s->alloc) {
+        nbuf = realloc(s->buf, sz);
+        if (!nbuf)
+            return -1;
+        s->buf = nbuf;
+        s->alloc = sz;
+    }
+    if (sg_sdf_generate(&s->sdf, s->buf, r->w, r->h, r->w,
+                        slot->bitmap.buffer, sw, sh, slot->bitmap.pitch,
+                        slot->bitmap_left - x0 * k,
+                        y1 * k - slot->bitmap_top, k, spread))
+        return -1;
+    r->data = s->buf;
+    r->pitch = r->w;
+    return 0;
+}
+
+/* Render a glyph using the given FreeType face, which must already
+   be set to the font's face size.  Returns a FreeType error code, or
+   -1 if out of memory.  */
+static FT_Error
+sg_font_rasterize(struct sg_font *fp, FT_Face face, unsigned index,
+                  struct sg_font_raster *r, struct sg_font_scratch *s)
 {
-    *texture = fp->texture;
-    scale[0] = fp->texscale[0];
-    scale[1] = fp->texscale[1];
+    FT_GlyphSlot slot = face->glyph;
+    FT_Fixed adv;
+    FT_Error ferr;
+
+    if (fp->flags & SG_FONT_SDF) {
+        ferr = FT_Get_Advance(face, index, FT_LOAD_NO_SCALE, &adv);
+        if (ferr)
+            return ferr;
+        r->advance = sg_font_unitstopixels(face, adv, fp->size);
+        return sg_font_rastersdf(face, index, r, s);
+    }
+
+    ferr = FT_Load_Glyph(face, index, FT_LOAD_TARGET_NORMAL);
+    if (ferr)
+        return ferr;
+    ferr = FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL);
+    if (ferr)
+        return ferr;
+    r->w = slot->bitmap.width;
+    r->h = slot->bitmap.rows;
+    r->bx = slot->bitmap_left;
+    r->by = slot->bitmap_top;
+    r->advance = slot->advance.x >> 6;
+    r->data = slot->bitmap.buffer;
+    r->pitch = slot->bitmap.pitch;
+    return 0;
+}
+
+/* Find how far to move one edge of a glyph's texture rectangle
+   inwards, in texels, so the edge lands close to a pixel boundary
+   when scaled by 'k'.  The rectangle has SG_SDF_SPREAD texels of
+   margin, so moving it inwards a little does not clip the glyph.
+   Returns the offset, and stores the scaled position of the edge in
+   'pos'.  */
+static int
+sg_font_snapedge(int edge, int dir, float k, int *pos)
+{
+    int t, tmax, best = 0, p;
+    float e, beste = 2.0f;
+
+    *pos = 0;
+    tmax = (int) ceilf(1.0f / k);
+    if (tmax < SG_SDF_SPREAD / 2)
+        tmax = SG_SDF_SPREAD / 2;
+    if (tmax > SG_SDF_SPREAD)
+        tmax = SG_SDF_SPREAD;
+    for (t = 0; t <= tmax; t++) {
+        p = (int) floorf((edge + dir * t) * k + 0.5f);
+        e = fabsf(p - (edge + dir * t) * k);
+        if (e < beste - 1e-4f) {
+            beste = e;
+            best = t;
+            *pos = p;
+        }
+    }
+    return best;
+}
+
+/* Fill in the metrics for a glyph in a scaled distance field font
+   from the glyph in the base font.  Glyph positions are in whole
+   pixels and whole texels, so the edges of the texture rectangle are
+   chosen to land near pixel boundaries, to avoid stretching the
+   glyph.  */
+static int
+sg_font_loadscaled(struct sg_font *fp, unsigned index,
+                   struct sg_error **err)
+{
+    struct sg_font_glyph *g = &fp->glyph[index], *bg;
+    FT_Face face = fp->typeface->face;
+    FT_Fixed adv;
+    FT_Error ferr;
+    float k;
+    int x0, x1, y0, y1, t0, t1, t2, t3;
+
+    bg = sg_font_getglyph(fp->base, index, err);
+    if (!bg)
+        return -1;
+    ferr = FT_Get_Advance(face, index, FT_LOAD_NO_SCALE, &adv);
+    if (ferr) {
+        sg_error_freetype(err, ferr);
+        return -1;
+    }
+    g->advance = sg_font_unitstopixels(face, adv, fp->size);
+    g->page = bg->page;
+    g->flags = SG_FONT_GLYPH_LOADED;
+    k = (float) fp->size / (float) fp->base->size;
+    if (bg->w) {
+        t0 = sg_font_snapedge(bg->bx, 1, k, &x0);
+        t1 = sg_font_snapedge(bg->bx + bg->w, -1, k, &x1);
+        t2 = sg_font_snapedge(bg->by, -1, k, &y1);
+        t3 = sg_font_snapedge(bg->by - bg->h, 1, k, &y0);
+        if (x0 < x1 && y0 < y1) {
+            g->w = x1 - x0;
+            g->h = y1 - y0;
+            g->x = bg->x + t0;
+            g->y = bg->y + t2;
+            g->tw = bg->w - t0 - t1;
+            g->th = bg->h - t2 - t3;
+            g->bx = x0;
+            g->by = y1;
+            return 0;
+        }
+    }
+    g->w = 0;
+    g->h = 0;
+    g->x = 0;
+    g->y = 0;
+    g->tw = 0;
+    g->th = 0;
+    g->bx = 0;
+    g->by = 0;
+    return 0;
+}
+
+/* Place a rendered glyph in the font's atlas and fill in its metrics.
+   The bitmap is copied if 'copy' is set.  */
+static int
+sg_font_place(struct sg_font *fp, unsigned index,
+              const struct sg_font_raster *r, int copy,
+              struct sg_error **err)
+{
+    struct sg_font_glyph *g = &fp->glyph[index];
+    unsigned char *op;
+    int page, x0, y0, y, orb;
+
+    g->advance = r->advance;
+    if (r->w == 0 || r->h == 0) {
+        g->w = 0;
+        g->h = 0;
+        g->x = 0;
+        g->y = 0;
+        g->tw = 0;
+        g->th = 0;
+        g->bx = 0;
+        g->by = 0;
+        g->page = 0;
+        return 0;
+    }
+    op = sg_glyphatlas_alloc(&fp->atlas, r->w, r->h, &page, &x0, &y0, err);
+    if (!op)
+        return -1;
+    g->w = r->w;
+    g->h = r->h;
+    g->x = x0;
+    g->y = y0;
+    g->tw = r->w;
+    g->th = r->h;
+    g->bx = r->bx;
+    g->by = r->by;
+    g->page = page;
+    if (copy) {
+        orb = fp->atlas.page[page].pixbuf.rowbytes;
+        for (y = 0; y < r->h; y++)
+            memcpy(op + y * orb, r->data + y * r->pitch, r->w);
+    }
+    return 0;
+}
+
+int
+sg_font_loadglyph(struct sg_font *fp, unsigned index, struct sg_error **err)
+{
+    struct sg_font_scratch scratch;
+    struct sg_font_raster raster;
+    FT_Error ferr;
+    int r;
+
+    if (fp->base)
+        return sg_font_loadscaled(fp, index, err);
+    if (sg_font_setsize(fp, err))
+        return -1;
+    memset(&scratch, 0, sizeof(scratch));
+    ferr = sg_font_rasterize(fp, fp->typeface->face, index,
+                             &raster, &scratch);
+    if (ferr) {
+        if (ferr == -1)
+            sg_error_nomem(err);
+        else
+            sg_error_freetype(err, ferr);
+        r = -1;
+    } else {
+        r = sg_font_place(fp, index, &raster, 1, err);
+        if (!r)
+            fp->glyph[index].flags = SG_FONT_GLYPH_LOADED;
+    }
+    sg_font_scratch_destroy(&scratch);
+    return r;
+}
+
+/* ========== Parallel rendering ========== */
+
+/* Glyphs are handed out to workers in chunks of this size.  */
+#define SG_FONT_CHUNK 32
+
+/* A glyph rendered by a worker, before it is placed in the atlas.  */
+struct sg_font_rglyph {
+    unsigned index;
+    short w, h, bx, by, advance;
+    /* The worker which rendered the glyph, and the offset of the
+       bitmap in the worker's buffer.  */
+    short worker;
+    size_t offset;
+};
+
+struct sg_font_worker {
+    /* Rendered bitmaps, with rows packed together.  */
+    unsigned char *buf;
+    size_t size;
+    size_t alloc;
+    /* FreeType error code, or -1 for out of memory.  */
+    int ferr;
+};
+
+struct sg_font_job {
+    struct sg_font *fp;
+    struct sg_font_rglyph *glyph;
+    unsigned count;
+    struct sg_font_worker *worker;
+    sg_atomic_t next;
+    sg_atomic_t failed;
+};
+
+/* Render glyphs with a private FreeType face, and save the bitmaps in
+   the worker's buffer.  */
+static void
+sg_font_render_task(void *arg, int index)
+{
+    struct sg_font_job *job = arg;
+    struct sg_font_worker *wk = &job->worker[index];
+    struct sg_typeface *tp = job->fp->typeface;
+    struct sg_font_rglyph *g;
+    struct sg_font_raster r;
+    struct sg_font_scratch scratch;
+    FT_Library lib = NULL;
+    FT_Face face = NULL;
+    FT_Error ferr;
+    unsigned i, n, start;
+    size_t sz, nalloc;
+    unsigned char *nbuf;
+    int y;
+
+    memset(&scratch, 0, sizeof(scratch));
+    ferr = FT_Init_FreeType(&lib);
+    if (ferr)
+        goto done;
+    ferr = FT_New_Memory_Face(lib, tp->data->data, (long) tp->data->length,
+                              0, &face);
+    if (ferr)
+        goto done;
+    ferr = FT_Set_Char_Size(face, 0, sg_font_facesize(job->fp), 72, 72);
+    if (ferr)
+        goto done;
+
+    while (!sg_atomic_get(&job->failed)) {
+        start = sg_atomic_fetch_add(&job->next, SG_FONT_CHUNK);
+        if (start >= job->count)
+            break;
+        n = job->count - start;
+        if (n > SG_FONT_CHUNK)
+            n = SG_FONT_CHUNK;
+        for (i = start; i < start + n; i++) {
+            g = &job->glyph[i];
+            ferr = sg_font_rasterize(job->fp, face, g->index, &r, &scratch);
+            if (ferr)
+                goto done;
+            g->advance = r.advance;
+            g->worker = index;
+            if (r.w == 0 || r.h == 0) {
+                g->w = 0;
+                g->h = 0;
+                continue;
+            }
+            g->w = r.w;
+            g->h = r.h;
+            g->bx = r.bx;
+            g->by = r.by;
+            sz = (size_t) r.w * r.h;
+            if (sz > wk->alloc - wk->size) {
+                nalloc = wk->alloc ? wk->alloc : 64 * 1024;
+                while (sz > nalloc - wk->size)
+                    nalloc *= 2;
+                nbuf = realloc(wk->buf, nalloc);
+                if (!nbuf) {
+                    ferr = -1;
+                    goto done;
+                }
+                wk->buf = nbuf;
+                wk->alloc = nalloc;
+            }
+            g->offset = wk->size;
+            for (y = 0; y < r.h; y++)
+                memcpy(wk->buf + wk->size + y * r.w,
+                       r.data + y * r.pitch, r.w);
+            wk->size += sz;
+        }
+    }
+
+done:
+    if (ferr) {
+        wk->ferr = ferr;
+        sg_atomic_set(&job->failed, 1);
+    }
+    sg_font_scratch_destroy(&scratch);
+    if (face)
+        FT_Done_Face(face);
+    if (lib)
+        FT_Done_FreeType(lib);
+}
+
+/* Copy rendered bitmaps into the atlas.  */
+static void
+sg_font_copy_task(void *arg, int index)
+{
+    struct sg_font_job *job = arg;
+    struct sg_font *fp = job->fp;
+    struct sg_font_rglyph *rg;
+    struct sg_font_glyph *g;
+    struct sg_glyphpage *page;
+    const unsigned char *ip;
+    unsigned char *op;
+    unsigned i, n, start;
+    int y, rb;
+
+    (void) index;
+    while (1) {
+        start = sg_atomic_fetch_add(&job->next, SG_FONT_CHUNK);
+        if (start >= job->count)
+            break;
+        n = job->count - start;
+        if (n > SG_FONT_CHUNK)
+            n = SG_FONT_CHUNK;
+        for (i = start; i < start + n; i++) {
+            rg = &job->glyph[i];
+            if (!rg->w)
+                continue;
+            g = &fp->glyph[rg->index];
+            page = &fp->atlas.page[g->page];
+            rb = page->pixbuf.rowbytes;
+            ip = job->worker[rg->worker].buf + rg->offset;
+            op = (unsigned char *) page->pixbuf.data + g->y * rb + g->x;
+            for (y = 0; y < rg->h; y++)
+                memcpy(op + y * rb, ip + y * rg->w, rg->w);
+        }
+    }
+}
+
+int
+sg_font_renderall(struct sg_font *fp, int nthread, struct sg_error **err)
+{
+    struct sg_font_job job;
+    struct sg_font_rglyph *rg;
+    struct sg_font_raster raster;
+    unsigned i, count;
+    int j, r, ferr;
+
+    if (nthread <= 0)
+        nthread = sg_thread_cpucount();
+    job.glyph = NULL;
+    job.worker = NULL;
+
+    /* Scaled distance field fonts only need metrics, the bitmaps are
+       in the base font.  */
+    if (fp->base) {
+        if (sg_font_renderall(fp->base, nthread, err))
+            return -1;
+        for (i = 0; i < (unsigned) fp->glyphcount; i++)
+            if (!sg_font_getglyph(fp, i, err))
+                return -1;
+        return 0;
+    }
+
+    count = 0;
+    for (i = 0; i < (unsigned) fp->glyphcount; i++)
+        count += (fp->glyph[i].flags & SG_FONT_GLYPH_LOADED) == 0;
+    if (!count)
+        return 0;
+    if (nthread == 1 || count < 2 * SG_FONT_CHUNK) {
+        for (i = 0; i < (unsigned) fp->glyphcount; i++)
+            if (!sg_font_getglyph(fp, i, err))
+                return -1;
+        sg_font_cachesave(fp);
+        return 0;
+    }
+    if ((unsigned) nthread > count / SG_FONT_CHUNK)
+        nthread = count / SG_FONT_CHUNK;
+
+    job.fp = fp;
+    job.count = count;
+    job.glyph = malloc(sizeof(*job.glyph) * count);
+    job.worker = calloc(nthread, sizeof(*job.worker));
+    if (!job.glyph || !job.worker)
+        goto nomem;
+    for (i = 0, count = 0; i < (unsigned) fp->glyphcount; i++)
+        if ((fp->glyph[i].flags & SG_FONT_GLYPH_LOADED) == 0)
+            job.glyph[count++].index = i;
+
+    /* Render the glyphs in parallel.  */
+    sg_atomic_set(&job.next, 0);
+    sg_atomic_set(&job.failed, 0);
+    sg_thread_run(sg_font_render_task, &job, nthread);
+    if (sg_atomic_get(&job.failed)) {
+        for (j = 0; j < nthread; j++) {
+            ferr = job.worker[j].ferr;
+            if (ferr == -1)
+                goto nomem;
+            if (ferr) {
+                sg_error_freetype(err, ferr);
+                goto error;
+            }
+        }
+    }
+
+    /* Place the glyphs in index order, so the atlas is the same as if
+       the glyphs were loaded one at a time.  */
+    for (i = 0; i < count; i++) {
+        rg = &job.glyph[i];
+        raster.w = rg->w;
+        raster.h = rg->h;
+        raster.bx = rg->bx;
+        raster.by = rg->by;
+        raster.advance = rg->advance;
+        if (sg_font_place(fp, rg->index, &raster, 0, err))
+            goto error;
+    }
+
+    /* Copy the bitmaps into place in parallel.  */
+    sg_atomic_set(&job.next, 0);
+    sg_thread_run(sg_font_copy_task, &job, nthread);
+    for (i = 0; i < count; i++)
+        fp->glyph[job.glyph[i].index].flags = SG_FONT_GLYPH_LOADED;
+    sg_font_cachesave(fp);
+    r = 0;
+    goto done;
+
+nomem:
+    sg_error_nomem(err);
+error:
+    r = -1;
+done:
+    if (job.worker) {
+        for (j = 0; j < nthread; j++)
+            free(job.worker[j].buf);
+        free(job.worker);
+    }
+    free(job.glyph);
+    return r;
 }
@@ -0,0 +1,200 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "private.h"
+#include "sg/cvar.h"
+#include "sg/error.h"
+#include "sg/file.h"
+#include "sg/log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+  Fonts with every glyph rendered are cached in the user path, so they
+  do not have to be rendered again the next time the program runs.
+  The cache file is the font's glyph array and atlas pages, stored in
+  native byte order so the file can be mapped into memory and used
+  directly.  The file name contains the hash of the typeface file and
+  the font size, and whether it is a distance field font.  The header
+  records everything else which affects the rendered glyphs.
+
+  Layout: header, glyph array, padding to SG_FONTCACHE_ALIGN, pages.
+*/
+
+#define SG_FONTCACHE_VERSION 2
+#define SG_FONTCACHE_ALIGN 64
+#define SG_FONTCACHE_MAXSIZE (256 * 1024 * 1024)
+
+static const char SG_FONTCACHE_MAGIC[8] = "SGFontC";
+
+struct sg_fontcache_header {
+    char magic[8];
+    /* Written in native byte order, so this also checks endian.  */
+    uint32_t version;
+    /* FreeType version, as major * 10000 + minor * 100 + patch.  */
+    uint32_t ftversion;
+    uint64_t hash;
+    int32_t size;
+    int32_t ascender;
+    int32_t descender;
+    int32_t glyphcount;
+    int32_t glyphsize;
+    int32_t pagesize;
+    int32_t pagecount;
+    uint32_t flags;
+};
+
+static struct sg_cvar_bool sg_fontcache_enable;
+
+void
+sg_font_cacheinit(void)
+{
+    sg_cvar_defbool(
+        "font", "cache", "Cache rendered fonts in the user path",
+        &sg_fontcache_enable, 1, SG_CVAR_PERSISTENT);
+}
+
+static int
+sg_fontcache_path(char *buf, size_t bufsz, struct sg_font *fp)
+{
+    return snprintf(buf, bufsz, "cache/font/%016llx-%d%s.dat",
+                    (unsigned long long) fp->typeface->hash, fp->size,
+                    (fp->flags & SG_FONT_SDF) ? "-sdf" : "");
+}
+
+static void
+sg_fontcache_makeheader(struct sg_fontcache_header *h, struct sg_font *fp)
+{
+    FT_Int major, minor, patch;
+    FT_Library_Version(fp->typeface->face->glyph->library,
+                       &major, &minor, &patch);
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, SG_FONTCACHE_MAGIC, sizeof(h->magic));
+    h->version = SG_FONTCACHE_VERSION;
+    h->ftversion = (uint32_t) (major * 10000 + minor * 100 + patch);
+    h->hash = fp->typeface->hash;
+    h->size = fp->size;
+    h->ascender = fp->ascender;
+    h->descender = fp->descender;
+    h->glyphcount = fp->glyphcount;
+    h->glyphsize = (int32_t) sizeof(struct sg_font_glyph);
+    h->pagesize = fp->atlas.pagesize;
+    h->pagecount = fp->atlas.pagecount;
+    h->flags = fp->flags;
+}
+
+static size_t
+sg_fontcache_pageoffset(int glyphcount)
+{
+    size_t off = sizeof(struct sg_fontcache_header) +
+        sizeof(struct sg_font_glyph) * glyphcount;
+    return (off + SG_FONTCACHE_ALIGN - 1) &
+        ~(size_t) (SG_FONTCACHE_ALIGN - 1);
+}
+
+int
+sg_font_cacheload(struct sg_font *fp)
+{
+    struct sg_fontcache_header expect, h;
+    struct sg_filedata *data;
+    struct sg_error *err = NULL;
+    char path[SG_MAX_PATH];
+    size_t pageoff, psize;
+    const char *ptr;
+    int r, i;
+
+    if (!sg_fontcache_enable.value || fp->base)
+        return 0;
+    sg_fontcache_path(path, sizeof(path), fp);
+    r = sg_file_load(&data, path, strlen(path), SG_USERONLY | SG_FILE_MAP,
+                     NULL, SG_FONTCACHE_MAXSIZE, NULL, &err);
+    if (r) {
+        if (err && err->domain != &SG_ERROR_NOTFOUND)
+            sg_logerrf(SG_LOG_WARN, err, "Could not load font cache: %s",
+                       path);
+        sg_error_clear(&err);
+        return 0;
+    }
+
+    ptr = data->data;
+    if (data->length < sizeof(h))
+        goto invalid;
+    memcpy(&h, ptr, sizeof(h));
+    /* Everything but the page count must match.  */
+    sg_fontcache_makeheader(&expect, fp);
+    expect.pagecount = h.pagecount;
+    if (memcmp(&h, &expect, sizeof(h)))
+        goto invalid;
+    if (h.pagesize < 1 || h.pagesize > 4096 || h.pagecount < 1 ||
+        h.pagecount > 1024)
+        goto invalid;
+    pageoff = sg_fontcache_pageoffset(h.glyphcount);
+    psize = (size_t) h.pagesize * h.pagesize;
+    if (data->length != pageoff + psize * h.pagecount)
+        goto invalid;
+    for (i = 0; i < h.glyphcount; i++) {
+        struct sg_font_glyph g;
+        memcpy(&g, ptr + sizeof(h) + sizeof(g) * i, sizeof(g));
+        if (g.flags != SG_FONT_GLYPH_LOADED || g.tw != g.w || g.th != g.h ||
+            (g.w && (g.page >= h.pagecount || g.x < 0 || g.y < 0 ||
+                     g.x + g.w > h.pagesize || g.y + g.h > h.pagesize)))
+            goto invalid;
+    }
+
+    r = sg_glyphatlas_map(&fp->atlas, data, ptr + pageoff, h.pagecount,
+                          &err);
+    if (r) {
+        sg_logerrf(SG_LOG_WARN, err, "Could not load font cache: %s",
+                   path);
+        sg_error_clear(&err);
+        sg_filedata_decref(data);
+        return 0;
+    }
+    memcpy(fp->glyph, ptr + sizeof(h),
+           sizeof(struct sg_font_glyph) * h.glyphcount);
+    sg_filedata_decref(data);
+    sg_logf(SG_LOG_DEBUG, "Loaded font from cache: %s", path);
+    return 1;
+
+invalid:
+    sg_logf(SG_LOG_INFO, "Ignoring stale or invalid font cache: %s", path);
+    sg_filedata_decref(data);
+    return 0;
+}
+
+void
+sg_font_cachesave(struct sg_font *fp)
+{
+    struct sg_fontcache_header h;
+    struct sg_error *err = NULL;
+    char path[SG_MAX_PATH];
+    size_t pageoff, psize, len;
+    char *buf;
+    unsigned i;
+    int r;
+
+    if (!sg_fontcache_enable.value || fp->base || !fp->atlas.pagecount)
+        return;
+    sg_fontcache_path(path, sizeof(path), fp);
+    sg_fontcache_makeheader(&h, fp);
+    pageoff = sg_fontcache_pageoffset(fp->glyphcount);
+    psize = (size_t) fp->atlas.pagesize * fp->atlas.pagesize;
+    len = pageoff + psize * fp->atlas.pagecount;
+    buf = malloc(len);
+    if (!buf)
+        return;
+    memset(buf, 0, pageoff);
+    memcpy(buf, &h, sizeof(h));
+    memcpy(buf + sizeof(h), fp->glyph,
+           sizeof(struct sg_font_glyph) * fp->glyphcount);
+    for (i = 0; i < fp->atlas.pagecount; i++)
+        memcpy(buf + pageoff + psize * i,
+               fp->atlas.page[i].pixbuf.data, psize);
+    r = sg_file_save(path, strlen(path), buf, len, &err);
+    if (r) {
+        sg_logerrf(SG_LOG_WARN, err, "Could not save font cache: %s",
+                   path);
+        sg_error_clear(&err);
+    }
+}
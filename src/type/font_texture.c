@@ -0,0 +1,70 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "private.h"
+#include "sg/opengl.h"
+#include "sg/pixbuf.h"
+#include "sg/type.h"
+
+void
+sg_glyphatlas_upload(struct sg_glyphatlas *atlas)
+{
+    struct sg_glyphpage *p, *e;
+    GLuint texture;
+    int y0, y1;
+
+    for (p = atlas->page, e = p + atlas->pagecount; p != e; p++) {
+        y0 = p->dirty.y0;
+        y1 = p->dirty.y1;
+        if (p->texture && y0 >= y1)
+            continue;
+        if (!p->texture) {
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            sg_pixbuf_texture(&p->pixbuf);
+            p->texture = texture;
+        } else {
+            /* Whole rows are uploaded, but rows may be padded.  */
+            glBindTexture(GL_TEXTURE_2D, p->texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, p->pixbuf.rowbytes);
+            glTexSubImage2D(
+                GL_TEXTURE_2D, 0, 0, y0, p->pixbuf.width, y1 - y0,
+                GL_RED, GL_UNSIGNED_BYTE,
+                (const unsigned char *) p->pixbuf.data +
+                y0 * p->pixbuf.rowbytes);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+        p->dirty.y0 = 0;
+        p->dirty.y1 = 0;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void
+sg_glyphatlas_deletetextures(struct sg_glyphatlas *atlas)
+{
+    unsigned i;
+    for (i = 0; i < atlas->pagecount; i++) {
+        if (atlas->page[i].texture) {
+            glDeleteTextures(1, &atlas->page[i].texture);
+            atlas->page[i].texture = 0;
+        }
+    }
+}
+
+int
+sg_font_gettexture(struct sg_font *fp, int page,
+                   unsigned *texture, float *scale)
+{
+    if (fp->base)
+        fp = fp->base;
+    if (page < 0 || (unsigned) page >= fp->atlas.pagecount)
+        return -1;
+    sg_glyphatlas_upload(&fp->atlas);
+    *texture = fp->atlas.page[page].texture;
+    scale[0] = 1.0f / (float) fp->atlas.pagesize;
+    scale[1] = 1.0f / (float) fp->atlas.pagesize;
+    return 0;
+}
@@ -1,11 +1,17 @@
 /* Copyright 2014 Dietrich Epp.
    This file is part of SGLib.  SGLib is licensed under the terms of the
    2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "sg/defs.h"
+#include "sg/hashmap.h"
+#include "sg/pixbuf.h"
 #include "sg/type.h"
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include <stddef.h>
+#include <stdint.h>
 
 struct sg_error;
+struct sg_filedata;
 
 struct sg_typeface {
     int refcount;
@@ -16,44 +22,238 @@ struct sg_typeface {
 
     /* Buffer containing the typeface file.  */
     struct sg_filedata *data;
+    /* Hash of the typeface file contents.  */
+    uint64_t hash;
     /* The FreeType typeface.  */
     FT_Face face;
     /* Linked list of all fonts derived from this typeface.  */
     struct sg_font *font;
+    /* The size the FreeType face is currently set to, in 26.6 units,
+       or 0 if it has not been set.  */
+    int cursize;
+    /* Glyph indexes for Latin-1 characters.  */
+    unsigned short latin1[256];
+    /* Glyph indexes for other characters which have been used, with
+       entries of type struct sg_typeface_char.  */
+    struct sg_hashmap charmap;
 };
 
+struct sg_typeface_char {
+    uint32_t c;
+    uint32_t glyph;
+};
+
+/* Get the glyph index for a character not in Latin-1.  */
+unsigned
+sg_typeface_getchar2(struct sg_typeface *tp, unsigned c);
+
+/* Get the glyph index for a character, or 0 if the typeface has no
+   glyph for the character.  */
+SG_INLINE unsigned
+sg_typeface_getchar(struct sg_typeface *tp, unsigned c)
+{
+    return c < 256 ? tp->latin1[c] : sg_typeface_getchar2(tp, c);
+}
+
+/* Decode UTF-8 text, starting at *ptr, into at most 'count'
+   characters.  Invalid sequences are decoded as U+FFFD.  Returns the
+   number of characters decoded, and advances *ptr past the decoded
+   text.  */
+size_t
+sg_utf8_decode(unsigned *SG_RESTRICT out, size_t count,
+               const unsigned char **ptr, const unsigned char *end);
+
+/* A shelf in a glyph atlas page.  Glyphs are placed left to right in
+   a shelf, and shelves are stacked top to bottom in a page.  */
+struct sg_glyphshelf {
+    short y, h, x;
+};
+
+/* A page in a glyph atlas.  */
+struct sg_glyphpage {
+    /* Glyph bitmaps, in SG_R format.  */
+    struct sg_pixbuf pixbuf;
+    /* Shelves in the page, and the top of the free space below them.  */
+    struct sg_glyphshelf *shelf;
+    unsigned shelfcount;
+    unsigned shelfalloc;
+    int top;
+    /* Region which has been modified since the last upload, empty if
+       y0 >= y1.  */
+    struct sg_textrect dirty;
+    /* OpenGL texture, or 0 if the page has not been uploaded.  */
+    unsigned texture;
+};
+
+/* A glyph atlas is a set of pages containing glyph bitmaps.  Glyphs
+   are added one at a time, and new pages are created as necessary.
+   The atlas itself does not use OpenGL, uploading the pages to
+   textures is a separate step.  */
+struct sg_glyphatlas {
+    struct sg_glyphpage *page;
+    unsigned pagecount;
+    unsigned pagealloc;
+    /* Width and height of each page.  */
+    int pagesize;
+    /* File containing the pixels for the first 'mapcount' pages, or
+       NULL.  These pages are read-only, and are full.  */
+    struct sg_filedata *data;
+    unsigned mapcount;
+};
+
+/* Initialize an empty glyph atlas.  */
+void
+sg_glyphatlas_init(struct sg_glyphatlas *atlas, int pagesize);
+
+/* Free the memory used by a glyph atlas.  This does not delete any
+   textures, see sg_glyphatlas_deletetextures().  */
+void
+sg_glyphatlas_destroy(struct sg_glyphatlas *atlas);
+
+/* Add read-only pages to an empty atlas, using pixel data from a
+   file.  The pixels for each page are stored contiguously with no
+   padding between rows.  */
+int
+sg_glyphatlas_map(struct sg_glyphatlas *atlas, struct sg_filedata *data,
+                  const void *pixels, unsigned count,
+                  struct sg_error **err);
+
+/* Allocate space for a bitmap in a glyph atlas, and mark the space as
+   dirty.  The space is initially filled with zero bytes.  Returns a
+   pointer to the first row of the bitmap, or NULL on failure.  Rows
+   are separated by the page's rowbytes.  */
+unsigned char *
+sg_glyphatlas_alloc(struct sg_glyphatlas *atlas, int w, int h,
+                    int *page, int *x, int *y, struct sg_error **err);
+
+/* Mark all pages in a glyph atlas as clean.  */
+void
+sg_glyphatlas_clean(struct sg_glyphatlas *atlas);
+
+/* Upload dirty regions of the glyph atlas to OpenGL textures,
+   creating the textures if necessary.  */
+void
+sg_glyphatlas_upload(struct sg_glyphatlas *atlas);
+
+/* Delete the OpenGL textures for a glyph atlas.  */
+void
+sg_glyphatlas_deletetextures(struct sg_glyphatlas *atlas);
+
+enum {
+    /* The font's atlas contains signed distance fields instead of
+       coverage bitmaps.  */
+    SG_FONT_SDF = 1u << 0
+};
+
+/* Distance field fonts share one atlas per typeface, which belongs to
+   a base font rendered at SG_SDF_SIZE pixels.  Glyph outlines are
+   rendered at SG_SDF_OVERSAMPLE times that size, and the field
+   extends SG_SDF_SPREAD pixels on each side of the outline.  */
+#define SG_SDF_SIZE 32
+#define SG_SDF_OVERSAMPLE 4
+#define SG_SDF_SPREAD 4
+
 struct sg_font {
     int refcount;
 
     /* Size, in FreeType 26.6 units.  */
     int size;
+    /* Font flags.  */
+    unsigned flags;
+    /* For distance field fonts at other sizes, the base font
+       containing the atlas, or NULL.  Glyph locations in the atlas
+       refer to the base font's atlas, but glyph sizes and metrics are
+       scaled to this font's size.  */
+    struct sg_font *base;
     /* Coordinates of ascender and descender lines, in pixels.  */
     short ascender, descender;
     /* The typeface this font is derived from.  */
     struct sg_typeface *typeface;
     /* The next font derived from the same typeface.  */
     struct sg_font *next;
-    /* Array of information about each bitmap glyph.  */
+    /* Array of information about each glyph in the typeface.  Glyphs
+       are rendered the first time they are used.  */
     struct sg_font_glyph *glyph;
     /* Number of glyphs.  */
     int glyphcount;
-    /* OpenGL texture containing glyph bitmaps.  */
-    unsigned texture;
-    /* Factor for scaling from pixel to texture coordinates.  */
-    float texscale[2];
+    /* Bitmaps for glyphs which have been rendered.  */
+    struct sg_glyphatlas atlas;
+};
+
+enum {
+    /* The glyph has been rendered and its metrics are valid.  */
+    SG_FONT_GLYPH_LOADED = 1u << 0
 };
 
 struct sg_font_glyph {
     /* Glyph size */
     short w, h;
-    /* Glyph location in the texture */
-    short x, y;
+    /* Glyph location and size in the texture.  The size is different
+       from the glyph size for scaled distance field fonts.  */
+    short x, y, tw, th;
     /* Bitmap location relative to pen */
     short bx, by;
     /* Pen advance */
     short advance;
+    /* Atlas page containing the bitmap */
+    unsigned short page;
+    /* Glyph flags */
+    unsigned short flags;
+};
+
+/* Render a glyph into the font's atlas and fill in its metrics.  */
+int
+sg_font_loadglyph(struct sg_font *fp, unsigned index, struct sg_error **err);
+
+/* Scratch memory for generating distance fields.  */
+struct sg_sdfbuf {
+    void *ptr;
+    size_t size;
 };
 
+/* Free scratch memory for generating distance fields.  */
+void
+sg_sdfbuf_destroy(struct sg_sdfbuf *buf);
+
+/* Generate a signed distance field from a coverage bitmap.  The
+   output is width x height pixels, and covers an area 'scale' times
+   larger in the source bitmap, which is placed with its top left
+   corner at (sx, sy) in that area.  Source pixels with coverage of at
+   least 50% are inside.  The output maps distances from -range to
+   +range output pixels to 255 to 0, so the edge is at 128.  Returns 0
+   on success, or -1 if out of memory.  */
+int
+sg_sdf_generate(struct sg_sdfbuf *buf,
+                unsigned char *out, int width, int height, int outpitch,
+                const unsigned char *src, int swidth, int sheight,
+                int spitch, int sx, int sy, int scale, int range);
+
+/* Define the font cache cvars.  Called when the first typeface is
+   loaded.  */
+void
+sg_font_cacheinit(void);
+
+/* Load a font's glyphs and atlas from the on-disk cache.  Returns 1
+   if the font was loaded from the cache, or 0 otherwise.  */
+int
+sg_font_cacheload(struct sg_font *fp);
+
+/* Save a font with every glyph rendered to the on-disk cache.  The
+   file is written in the background.  */
+void
+sg_font_cachesave(struct sg_font *fp);
+
+/* Get a glyph, rendering it if it has not been rendered yet.  */
+SG_INLINE struct sg_font_glyph *
+sg_font_getglyph(struct sg_font *fp, unsigned index, struct sg_error **err)
+{
+    struct sg_font_glyph *g = &fp->glyph[index];
+    if ((g->flags & SG_FONT_GLYPH_LOADED) == 0 &&
+        sg_font_loadglyph(fp, index, err))
+        return NULL;
+    return g;
+}
+
 /* A text flow is a sequence of glyphs, but without locations.  */
 struct sg_textflow {
     /* The error that occurred when creating this text flow.  */
@@ -70,6 +270,8 @@ struct sg_textflow {
     unsigned drawcount;
     /* If positive, the width at which words are wrapped.  */
     int width;
+    /* The vertex format for layouts.  */
+    enum sg_textformat format;
 };
 
 struct sg_textflow_run {
@@ -90,6 +292,73 @@ struct sg_textflow_glyph {
     unsigned short flags;
 };
 
+/* A line of text in a layout.  */
+struct sg_textlayout_line {
+    /* The range of glyphs in the line, including trailing spaces.  */
+    unsigned start;
+    unsigned end;
+    /* The width of the line, excluding trailing spaces.  */
+    int width;
+    short ascender, descender;
+    /* The Y coordinate of the baseline.  */
+    int y;
+};
+
+/* Number of lines in each block of a layout.  */
+#define SG_TEXTLAYOUT_BLOCK 32
+
+/* A block of consecutive lines in a layout.  The vertexes for each
+   block are grouped into batches separately, so a layout can be
+   updated by replacing the blocks at the end.  */
+struct sg_textlayout_block {
+    /* Index of the first vertex or quad in the block.  */
+    unsigned vert;
+    /* Index of the batch containing the first vertex, and the number
+       of vertexes in that batch which belong to earlier blocks.  */
+    unsigned batch;
+    unsigned batchprev;
+    /* Pixel bounds of the glyphs in the block, empty if x0 > x1.  */
+    struct sg_textrect bounds;
+};
+
+/* The data a layout keeps so it can be updated.  This includes a copy
+   of the text flow the layout was created from, with a reference to
+   each font, so changes to the flow can be found.  */
+struct sg_textlayout_state {
+    int width;
+    enum sg_textformat format;
+    struct sg_textflow_run *run;
+    unsigned runcount;
+    unsigned runalloc;
+    struct sg_textflow_glyph *glyph;
+    unsigned glyphcount;
+    unsigned glyphalloc;
+    /* Advance and X coordinate of each glyph, with glyphalloc
+       entries.  */
+    short *adv;
+    short *x;
+    struct sg_textlayout_line *line;
+    unsigned linecount;
+    unsigned linealloc;
+    struct sg_textlayout_block *block;
+    unsigned blockcount;
+    unsigned blockalloc;
+    /* Batches for the block being written.  */
+    struct sg_textbatch *key;
+    unsigned keyalloc;
+    /* Vertex or quad data, and its size in vertexes or quads.  */
+    void *data;
+    unsigned datacount;
+    unsigned dataalloc;
+    unsigned batchalloc;
+};
+
+/* Find the first glyph which differs between a text flow and the copy
+   of a text flow in a layout.  */
+unsigned
+sg_textlayout_firstchange(const struct sg_textlayout_state *st,
+                          const struct sg_textflow *flow);
+
 extern const struct sg_error_domain SG_ERROR_FREETYPE;
 
 void
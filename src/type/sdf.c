@@ -0,0 +1,241 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "private.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined __SSE2__ || defined _M_X64 || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2)
+# define SG_SDF_SSE2 1
+# include <emmintrin.h>
+#endif
+
+/*
+  Signed distance fields are computed from a coverage bitmap rendered
+  at a higher resolution than the output.  The bitmap is thresholded,
+  and for each pixel we find the squared distance to the nearest pixel
+  on the other side of the edge.  This is done separably: first each
+  column is swept up and down to find the vertical distance to the
+  nearest feature pixel, then each row is searched horizontally within
+  the range of the field.  Distances beyond the range are clamped, so
+  the bounded search is exact.
+
+  Both passes work on whole rows at a time, so they use SIMD across
+  columns.  The SIMD and scalar versions perform the same operations
+  in the same order and give identical results.
+*/
+
+/* Row lengths are rounded up to a multiple of this.  */
+#define SG_SDF_VEC 8
+
+void
+sg_sdfbuf_destroy(struct sg_sdfbuf *buf)
+{
+    free(buf->ptr);
+}
+
+static void *
+sg_sdfbuf_get(struct sg_sdfbuf *buf, size_t size)
+{
+    void *ptr;
+    if (size > buf->size) {
+        ptr = realloc(buf->ptr, size);
+        if (!ptr)
+            return NULL;
+        buf->ptr = ptr;
+        buf->size = size;
+    }
+    return buf->ptr;
+}
+
+/* Sweep distances down the columns and back up, so each entry is the
+   vertical distance to the nearest zero entry in its column, clamped
+   to the initial value of non-zero entries.  */
+static void
+sg_sdf_columns(short *g, int pitch, int height)
+{
+    short *row, *prev;
+    int x, y;
+#if defined SG_SDF_SSE2
+    __m128i one = _mm_set1_epi16(1), a, b;
+#endif
+
+    for (y = 1; y < height; y++) {
+        row = g + y * pitch;
+        prev = row - pitch;
+#if defined SG_SDF_SSE2
+        for (x = 0; x < pitch; x += 8) {
+            a = _mm_load_si128((const __m128i *) (row + x));
+            b = _mm_load_si128((const __m128i *) (prev + x));
+            a = _mm_min_epi16(a, _mm_adds_epi16(b, one));
+            _mm_store_si128((__m128i *) (row + x), a);
+        }
+#else
+        for (x = 0; x < pitch; x++)
+            if (prev[x] + 1 < row[x])
+                row[x] = prev[x] + 1;
+#endif
+    }
+    for (y = height - 2; y >= 0; y--) {
+        row = g + y * pitch;
+        prev = row + pitch;
+#if defined SG_SDF_SSE2
+        for (x = 0; x < pitch; x += 8) {
+            a = _mm_load_si128((const __m128i *) (row + x));
+            b = _mm_load_si128((const __m128i *) (prev + x));
+            a = _mm_min_epi16(a, _mm_adds_epi16(b, one));
+            _mm_store_si128((__m128i *) (row + x), a);
+        }
+#else
+        for (x = 0; x < pitch; x++)
+            if (prev[x] + 1 < row[x])
+                row[x] = prev[x] + 1;
+#endif
+    }
+}
+
+/* Compute squared distances along a row.  The input 'f' contains the
+   squared vertical distance for each column, with 'radius' entries of
+   padding on each side, and the output 'd' gets the minimum of
+   f[x+dx] + dx^2 for |dx| <= radius.  */
+static void
+sg_sdf_row(float *SG_RESTRICT d, const float *SG_RESTRICT f,
+           int width, int radius)
+{
+    int x, dx;
+#if defined SG_SDF_SSE2
+    __m128 acc, a, b, vdd;
+    for (x = 0; x < width; x += 4) {
+        acc = _mm_loadu_ps(f + radius + x);
+        for (dx = 1; dx <= radius; dx++) {
+            vdd = _mm_set1_ps((float) (dx * dx));
+            a = _mm_loadu_ps(f + radius + x - dx);
+            b = _mm_loadu_ps(f + radius + x + dx);
+            acc = _mm_min_ps(acc, _mm_add_ps(_mm_min_ps(a, b), vdd));
+        }
+        _mm_storeu_ps(d + x, acc);
+    }
+#else
+    float acc, a, b, dd;
+    for (x = 0; x < width; x++) {
+        acc = f[radius + x];
+        for (dx = 1; dx <= radius; dx++) {
+            dd = (float) (dx * dx);
+            a = f[radius + x - dx];
+            b = f[radius + x + dx];
+            a = (a < b ? a : b) + dd;
+            acc = a < acc ? a : acc;
+        }
+        d[x] = acc;
+    }
+#endif
+}
+
+int
+sg_sdf_generate(struct sg_sdfbuf *buf,
+                unsigned char *out, int width, int height, int outpitch,
+                const unsigned char *src, int swidth, int sheight,
+                int spitch, int sx, int sy, int scale, int range)
+{
+    int hw = width * scale, hh = height * scale, pitch, radius, cap;
+    int x, y, u, v, i, j, nsample, off, hx, hy, rlen;
+    short *gin, *gout, *rin, *rout;
+    float *f, *din, *dout, big, sum, dist, s, val;
+    float *rowsum;
+    unsigned char *p, *o;
+    const unsigned char *sp;
+    size_t gsize;
+
+    pitch = (hw + SG_SDF_VEC - 1) & ~(SG_SDF_VEC - 1);
+    radius = (range + 1) * scale;
+    cap = radius + 1;
+    rlen = pitch + 2 * radius + 4;
+    gsize = sizeof(short) * pitch * hh;
+    p = sg_sdfbuf_get(buf, 16 + 2 * gsize +
+                      sizeof(float) * (rlen + 2 * pitch + width));
+    if (!p)
+        return -1;
+    /* Align to 16 bytes for the column pass.  */
+    p += (16 - ((size_t) p & 15)) & 15;
+    gin = (short *) p;
+    gout = (short *) (p + gsize);
+    f = (float *) (p + 2 * gsize);
+    din = f + rlen;
+    dout = din + pitch;
+    rowsum = dout + pitch;
+
+    /* Distance to the nearest pixel inside is zero for pixels inside,
+       and likewise for outside.  */
+    for (y = 0; y < hh; y++) {
+        rin = gin + y * pitch;
+        rout = gout + y * pitch;
+        for (x = 0; x < pitch; x++) {
+            rin[x] = cap;
+            rout[x] = 0;
+        }
+        j = y - sy;
+        if (j < 0 || j >= sheight)
+            continue;
+        sp = src + j * spitch;
+        for (i = 0; i < swidth; i++) {
+            if (sp[i] >= 128) {
+                rin[sx + i] = 0;
+                rout[sx + i] = cap;
+            }
+        }
+    }
+    sg_sdf_columns(gin, pitch, hh);
+    sg_sdf_columns(gout, pitch, hh);
+
+    /* Each output pixel averages the samples nearest its center,
+       one sample for odd scales and 2x2 for even scales.  */
+    nsample = (scale & 1) ? 1 : 2;
+    off = (scale - nsample) / 2;
+    big = (float) cap * (float) cap;
+    for (i = 0; i < radius; i++) {
+        f[i] = big;
+        f[radius + pitch + i] = big;
+    }
+    for (i = pitch + 2 * radius; i < rlen; i++)
+        f[i] = big;
+    s = 127.5f / (float) (range * scale * nsample * nsample);
+    for (v = 0; v < height; v++) {
+        for (u = 0; u < width; u++)
+            rowsum[u] = 0.0f;
+        for (j = 0; j < nsample; j++) {
+            hy = v * scale + off + j;
+            rin = gin + hy * pitch;
+            rout = gout + hy * pitch;
+            for (x = 0; x < pitch; x++)
+                f[radius + x] = (float) rin[x] * (float) rin[x];
+            sg_sdf_row(din, f, pitch, radius);
+            for (x = 0; x < pitch; x++)
+                f[radius + x] = (float) rout[x] * (float) rout[x];
+            sg_sdf_row(dout, f, pitch, radius);
+            for (u = 0; u < width; u++) {
+                sum = 0.0f;
+                for (i = 0; i < nsample; i++) {
+                    hx = u * scale + off + i;
+                    if (rin[hx] == 0)
+                        dist = 0.5f - sqrtf(dout[hx]);
+                    else
+                        dist = sqrtf(din[hx]) - 0.5f;
+                    sum += dist;
+                }
+                rowsum[u] += sum;
+            }
+        }
+        o = out + v * outpitch;
+        for (u = 0; u < width; u++) {
+            val = 127.5f - rowsum[u] * s;
+            if (val < 0.0f)
+                val = 0.0f;
+            else if (val > 255.0f)
+                val = 255.0f;
+            o[u] = (unsigned char) (val + 0.5f);
+        }
+    }
+    return 0;
+}
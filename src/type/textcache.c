@@ -0,0 +1,147 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "private.h"
+#include "sg/error.h"
+#include "sg/hash.h"
+#include "sg/hashmap.h"
+#include "sg/type.h"
+#include <stdlib.h>
+
+struct sg_textcache_entry {
+    uint64_t key;
+    unsigned slot;
+};
+
+struct sg_textcache_slot {
+    uint64_t key;
+    /* Value of the clock when the slot was last used.  */
+    unsigned last;
+    struct sg_textlayout layout;
+};
+
+struct sg_textcache {
+    /* Map from key to slot index.  */
+    struct sg_hashmap map;
+    struct sg_textcache_slot *slot;
+    unsigned slotcount;
+    unsigned capacity;
+    unsigned clock;
+};
+
+/* Get the cache key for a text flow.  */
+static uint64_t
+sg_textcache_key(struct sg_textflow *flow)
+{
+    struct sg_hash64_state h;
+    unsigned i;
+    sg_hash64_init(&h, (uint64_t) (unsigned) flow->width |
+                   ((uint64_t) flow->format << 32));
+    for (i = 0; i < flow->runcount; i++) {
+        sg_hash64_update(&h, &flow->run[i].font, sizeof(flow->run[i].font));
+        sg_hash64_update(&h, &flow->run[i].count, sizeof(flow->run[i].count));
+    }
+    sg_hash64_update(&h, flow->glyph,
+                     sizeof(*flow->glyph) * flow->glyphcount);
+    return sg_hash64_final(&h);
+}
+
+struct sg_textcache *
+sg_textcache_new(unsigned capacity, struct sg_error **err)
+{
+    struct sg_textcache *cache;
+    if (!capacity) {
+        sg_error_invalid(err, __FUNCTION__, "capacity");
+        return NULL;
+    }
+    cache = malloc(sizeof(*cache));
+    if (!cache)
+        goto nomem;
+    cache->slot = malloc(sizeof(*cache->slot) * capacity);
+    if (!cache->slot) {
+        free(cache);
+        goto nomem;
+    }
+    sg_hashmap_init(&cache->map, &SG_HASHMAP_U64,
+                    sizeof(struct sg_textcache_entry));
+    cache->slotcount = 0;
+    cache->capacity = capacity;
+    cache->clock = 0;
+    return cache;
+
+nomem:
+    sg_error_nomem(err);
+    return NULL;
+}
+
+void
+sg_textcache_free(struct sg_textcache *cache)
+{
+    unsigned i;
+    for (i = 0; i < cache->slotcount; i++)
+        sg_textlayout_destroy(&cache->slot[i].layout);
+    sg_hashmap_destroy(&cache->map);
+    free(cache->slot);
+    free(cache);
+}
+
+const struct sg_textlayout *
+sg_textcache_get(struct sg_textcache *cache, struct sg_textflow *flow,
+                 struct sg_error **err)
+{
+    struct sg_textcache_entry *e;
+    struct sg_textcache_slot *s;
+    struct sg_textlayout_state *st;
+    uint64_t key;
+    unsigned i, idx;
+
+    if (flow->err) {
+        sg_error_move(err, &flow->err);
+        return NULL;
+    }
+
+    key = sg_textcache_key(flow);
+    e = sg_hashmap_get64(&cache->map, key);
+    if (e) {
+        s = &cache->slot[e->slot];
+        st = s->layout.state_;
+        if (st->glyphcount == flow->glyphcount &&
+            sg_textlayout_firstchange(st, flow) == flow->glyphcount &&
+            st->width == flow->width) {
+            s->last = ++cache->clock;
+            return &s->layout;
+        }
+    }
+
+    if (cache->slotcount < cache->capacity) {
+        idx = cache->slotcount;
+        s = &cache->slot[idx];
+        if (sg_textlayout_create(&s->layout, flow, err))
+            return NULL;
+        cache->slotcount++;
+    } else {
+        /* Replace the least recently used layout.  */
+        idx = 0;
+        for (i = 1; i < cache->slotcount; i++)
+            if (cache->clock - cache->slot[i].last >
+                cache->clock - cache->slot[idx].last)
+                idx = i;
+        s = &cache->slot[idx];
+        e = sg_hashmap_get64(&cache->map, s->key);
+        if (e && e->slot == idx)
+            sg_hashmap_erase(&cache->map, e);
+        if (sg_textlayout_update(&s->layout, flow, err)) {
+            /* The layout is empty, but stays in the cache as the
+               least recently used.  */
+            s->key = 0;
+            return NULL;
+        }
+    }
+    s->key = key;
+    s->last = ++cache->clock;
+
+    e = sg_hashmap_insert64(&cache->map, key, NULL);
+    if (e)
+        e->slot = idx;
+    return &s->layout;
+}
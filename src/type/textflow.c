@@ -4,6 +4,7 @@
 #include "private.h"
 #include "sg/error.h"
 #include "sg/type.h"
+#include <limits.h>
 #include <math.h>
 #include <stdlib.h>
 
@@ -25,6 +26,7 @@ sg_textflow_new(struct sg_error **err)
     flow->glyphalloc = 0;
     flow->drawcount = 0;
     flow->width = 0;
+    flow->format = SG_TEXTFORMAT_TRIANGLES;
     return flow;
 }
 
@@ -42,17 +44,22 @@ sg_textflow_free(struct sg_textflow *flow)
     free(flow);
 }
 
+/* Number of characters decoded at a time.  */
+#define SG_TEXTFLOW_CHUNK 256
+
 void
 sg_textflow_addtext(struct sg_textflow *flow,
                     const char *text, size_t length)
 {
     struct sg_textflow_glyph *glyph;
     struct sg_textflow_run *run;
+    struct sg_typeface *tp;
     struct sg_font *font;
-    struct sg_font_glyph *fglyph;
+    struct sg_font_glyph *fg;
     const unsigned char *ptr, *end;
-    unsigned c, glyphindex, glyphcount, glyphalloc, drawcount, nalloc, flags;
-    FT_Face face;
+    unsigned chars[SG_TEXTFLOW_CHUNK];
+    unsigned c, glyphindex, glyphcount, drawcount, nalloc, flags;
+    size_t i, n;
 
     if (flow->err)
         return;
@@ -62,68 +69,57 @@ sg_textflow_addtext(struct sg_textflow *flow,
         return;
     }
 
+    /* Each character is at least one byte, so reserve one glyph for
+       each byte of text.  */
+    glyphcount = flow->glyphcount;
+    if (length > flow->glyphalloc - glyphcount) {
+        if (length > UINT_MAX - glyphcount)
+            goto nomem;
+        nalloc = flow->glyphalloc ? flow->glyphalloc : 8;
+        while (nalloc - glyphcount < length) {
+            if (nalloc > UINT_MAX / 2) {
+                nalloc = glyphcount + (unsigned) length;
+                break;
+            }
+            nalloc *= 2;
+        }
+        glyph = realloc(flow->glyph, sizeof(*glyph) * nalloc);
+        if (!glyph)
+            goto nomem;
+        flow->glyph = glyph;
+        flow->glyphalloc = nalloc;
+    }
+
     run = &flow->run[flow->runcount-1];
     font = run->font;
-    fglyph = font->glyph;
-    face = font->typeface->face;
+    tp = font->typeface;
     glyph = flow->glyph;
-    glyphcount = flow->glyphcount;
-    glyphalloc = flow->glyphalloc;
     drawcount = 0;
     ptr = (const unsigned char *) text;
     end = ptr + length;
     while (ptr < end) {
-        c = *ptr;
-        if (c < 0x80) {
-            ptr += 1;
-        } else if ((c & 0xe0) == 0xc0) {
-            if (end - ptr < 2)
-                break;
-            c = ((c & 0x1f) << 6) | (ptr[1] & 0x3f);
-            ptr += 2;
-        } else if ((c & 0xf0) == 0xe0) {
-            if (end - ptr < 3)
-                break;
-            c = ((c & 0x0f) << 12) |
-                ((ptr[1] & 0x3f) << 6) |
-                (ptr[2] & 0x3f);
-            ptr += 3;
-        } else if ((c & 0xf8) == 0xf0) {
-            if (end - ptr < 4)
-                break;
-            c = ((c & 0x07) << 18) |
-                ((ptr[1] & 0x3f) << 12) |
-                ((ptr[2] & 0x3f) << 6) |
-                (ptr[3] & 0x3f);
-            ptr += 4;
-        } else {
-            break;
-        }
-
-        glyphindex = FT_Get_Char_Index(face, c);
-        if (glyphcount >= glyphalloc) {
-            nalloc = glyphalloc ? glyphalloc * 2 : 8;
-            if (!nalloc)
-                goto nomem;
-            glyph = realloc(glyph, sizeof(*glyph) * nalloc);
-            if (!glyph)
-                goto nomem;
-            flow->glyph = glyph;
-            flow->glyphalloc = glyphalloc = nalloc;
-        }
-        if (fglyph[glyphindex].w != 0) {
-            drawcount++;
-            flags = SG_TEXTFLOW_VISIBLE;
-        } else {
-            flags = 0;
+        n = sg_utf8_decode(chars, SG_TEXTFLOW_CHUNK, &ptr, end);
+        for (i = 0; i < n; i++) {
+            c = chars[i];
+            glyphindex = sg_typeface_getchar(tp, c);
+            fg = sg_font_getglyph(font, glyphindex, &flow->err);
+            if (!fg)
+                goto done;
+            if (fg->w != 0) {
+                drawcount++;
+                flags = SG_TEXTFLOW_VISIBLE;
+            } else {
+                flags = 0;
+            }
+            if (c == ' ')
+                flags |= SG_TEXTFLOW_SPACE;
+            glyph[glyphcount].index = glyphindex;
+            glyph[glyphcount].flags = flags;
+            glyphcount++;
         }
-        if (c == ' ')
-            flags |= SG_TEXTFLOW_SPACE;
-        glyph[glyphcount].index = glyphindex;
-        glyph[glyphcount].flags = flags;
-        glyphcount++;
     }
 
+done:
     run->count += glyphcount - flow->glyphcount;
     run->drawcount += drawcount;
     flow->glyphcount = glyphcount;
@@ -179,3 +175,9 @@ sg_textflow_setwidth(struct sg_textflow *flow, float width)
 {
     flow->width = (int) floorf(width + 0.5f);
 }
+
+void
+sg_textflow_setformat(struct sg_textflow *flow, enum sg_textformat format)
+{
+    flow->format = format;
+}
@@ -4,65 +4,188 @@
 #include "private.h"
 #include "sg/error.h"
 #include "sg/type.h"
-#include <assert.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define MAX_WIDTH 16384
 
-struct sg_textlayout_line {
-    unsigned start;
-    unsigned end;
-    int width;
-    short ascender, descender;
+/*
+  A layout keeps its line breaks and a copy of the text flow, so it
+  can be updated when the text changes.  Each line only depends on
+  the glyphs in that line and the line after it, so when the first
+  changed glyph is in line L, the lines before L-1 are kept.
+
+  Vertexes are stored in blocks of lines, and the vertexes in each
+  block are grouped by font and page.  Updating the layout rewrites
+  the blocks starting with the block containing the first line which
+  changed.  A block's first batch is merged with the previous block's
+  last batch when they use the same font and page, so text which
+  fits on one page uses one batch no matter how many blocks it has.
+*/
+
+/* Number of elements and size of each element for each glyph, for
+   each vertex format.  */
+static const unsigned char sg_textlayout_nelem[3] = { 6, 4, 1 };
+static const unsigned char sg_textlayout_elemsize[3] = {
+    sizeof(struct sg_textvert),
+    sizeof(struct sg_textvert),
+    sizeof(struct sg_textquad)
 };
 
+/* Make sure an array has room for at least 'n' elements.  */
 static int
-sg_textlayout_layout(
-    struct sg_textflow *flow,
-    struct sg_textpoint *gloc,
-    struct sg_textrect *bounds,
-    int *baseline)
+sg_textlayout_reserve(void **ptr, unsigned *alloc, unsigned n, size_t size)
 {
-    struct sg_textflow_run *run = flow->run;
-    struct sg_textflow_glyph *glyph = flow->glyph;
-    struct sg_font *font;
+    unsigned nalloc;
+    void *narr;
+    if (n <= *alloc)
+        return 0;
+    nalloc = *alloc ? *alloc : 4;
+    while (nalloc < n) {
+        if (nalloc > UINT_MAX / 2) {
+            nalloc = n;
+            break;
+        }
+        nalloc *= 2;
+    }
+    if ((size_t) nalloc > (size_t) -1 / size)
+        return -1;
+    narr = realloc(*ptr, size * nalloc);
+    if (!narr)
+        return -1;
+    *ptr = narr;
+    *alloc = nalloc;
+    return 0;
+}
+
+unsigned
+sg_textlayout_firstchange(const struct sg_textlayout_state *st,
+                          const struct sg_textflow *flow)
+{
+    const struct sg_textflow_glyph *a = st->glyph, *b = flow->glyph;
+    unsigned i, n, pos, ca, cb;
+
+    if (st->width != flow->width || st->format != flow->format)
+        return 0;
+    n = st->glyphcount < flow->glyphcount ?
+        st->glyphcount : flow->glyphcount;
+
+    /* Glyphs are only the same if they use the same font.  */
+    pos = 0;
+    for (i = 0; i < st->runcount && i < flow->runcount && pos < n; i++) {
+        if (st->run[i].font != flow->run[i].font) {
+            n = pos;
+            break;
+        }
+        ca = st->run[i].count;
+        cb = flow->run[i].count;
+        if (ca != cb) {
+            pos += ca < cb ? ca : cb;
+            if (pos < n)
+                n = pos;
+            break;
+        }
+        pos += ca;
+    }
+
+    i = 0;
+    while (i + 64 <= n && !memcmp(a + i, b + i, sizeof(*a) * 64))
+        i += 64;
+    for (; i < n; i++)
+        if (a[i].index != b[i].index || a[i].flags != b[i].flags)
+            break;
+    return i;
+}
+
+/* Copy the text flow into the layout state, starting at glyph
+   'start'.  */
+static int
+sg_textlayout_copyflow(struct sg_textlayout_state *st,
+                       struct sg_textflow *flow, unsigned start)
+{
+    unsigned i, n = flow->glyphcount, alloc;
+    short *narr;
+
+    if (n > st->glyphalloc) {
+        alloc = st->glyphalloc;
+        if (sg_textlayout_reserve((void **) &st->glyph, &alloc, n,
+                                  sizeof(*st->glyph)))
+            return -1;
+        narr = realloc(st->adv, sizeof(*narr) * alloc);
+        if (!narr)
+            return -1;
+        st->adv = narr;
+        narr = realloc(st->x, sizeof(*narr) * alloc);
+        if (!narr)
+            return -1;
+        st->x = narr;
+        st->glyphalloc = alloc;
+    }
+    if (sg_textlayout_reserve((void **) &st->run, &st->runalloc,
+                              flow->runcount, sizeof(*st->run)))
+        return -1;
+    for (i = 0; i < flow->runcount; i++)
+        sg_font_incref(flow->run[i].font);
+    for (i = 0; i < st->runcount; i++)
+        sg_font_decref(st->run[i].font);
+    memcpy(st->run, flow->run, sizeof(*st->run) * flow->runcount);
+    st->runcount = flow->runcount;
+    if (start < n)
+        memcpy(st->glyph + start, flow->glyph + start,
+               sizeof(*st->glyph) * (n - start));
+    st->glyphcount = n;
+    st->width = flow->width;
+    if (st->format != flow->format) {
+        st->dataalloc = st->dataalloc *
+            sg_textlayout_elemsize[st->format] /
+            sg_textlayout_elemsize[flow->format];
+        st->datacount = 0;
+        st->format = flow->format;
+    }
+    return 0;
+}
+
+/* Break the glyphs starting at 'gstart' into lines, appending them to
+   the line array, and calculate the glyph horizontal positions.  */
+static int
+sg_textlayout_breaklines(struct sg_textlayout_state *st, unsigned gstart)
+{
+    struct sg_textflow_run *run = st->run;
+    struct sg_textflow_glyph *glyph = st->glyph;
     struct sg_font_glyph *fglyph;
-    struct sg_textlayout_line *line = NULL, *nline;
-    unsigned ridx, rcount = flow->runcount,
-        gidx, gend, gcount = flow->glyphcount, gbreak, gline,
-        lidx, lcount, lalloc, nalloc;
-    short *adv = NULL;
-    short maxx, miny, ascender, descender;
+    struct sg_textlayout_line *line;
+    unsigned ridx, rcount = st->runcount,
+        gidx, gend, gcount = st->glyphcount, gbreak, gline;
+    short *adv = st->adv, *x = st->x;
     int pos, bpos, width;
 
     /* Calculate glyph advances.  */
-    adv = malloc(sizeof(*adv) * gcount);
-    if (!adv)
-        goto nomem;
     gidx = 0;
     for (ridx = 0; ridx < rcount; ridx++) {
-        font = run[ridx].font;
-        fglyph = font->glyph;
         gend = gidx + run[ridx].count;
+        if (gend <= gstart) {
+            gidx = gend;
+            continue;
+        }
+        if (gidx < gstart)
+            gidx = gstart;
+        fglyph = run[ridx].font->glyph;
         for (; gidx != gend; gidx++)
             adv[gidx] = fglyph[glyph[gidx].index].advance;
     }
 
     /* Calculate glyph horizontal positions and line breaks.  */
-    width = flow->width;
+    width = st->width;
     if (width < 1 || width > MAX_WIDTH)
         width = MAX_WIDTH;
     pos = 0;
-    gline = 0;
-    gidx = 0;
-    lcount = 0;
-    lalloc = 0;
+    gline = gstart;
+    gidx = gstart;
     while (1) {
         if (gidx >= gcount)
             goto endline;
-        gloc[gidx].x = pos;
+        x[gidx] = pos;
         pos += adv[gidx];
         gidx++;
         if (pos <= width)
@@ -90,7 +213,7 @@ sg_textlayout_layout(
             /* No break found by scanning backwards, scan forwards */
             while (gidx < gcount &&
                    (glyph[gidx].flags & SG_TEXTFLOW_SPACE) == 0) {
-                gloc[gidx].x = pos;
+                x[gidx] = pos;
                 pos += adv[gidx];
                 gidx++;
             }
@@ -99,229 +222,465 @@ sg_textlayout_layout(
         /* Consume trailing spaces */
         while (gidx < gcount &&
                (glyph[gidx].flags & SG_TEXTFLOW_SPACE) != 0) {
-            gloc[gidx].x = pos;
+            x[gidx] = pos;
             pos += adv[gidx];
             gidx++;
         }
         /* Write line data */
-        if (lcount >= lalloc) {
-            nalloc = lalloc ? lalloc * 2 : 4;
-            if (!nalloc)
-                goto nomem;
-            nline = realloc(line, sizeof(*line) * nalloc);
-            if (!nline)
-                goto nomem;
-            line = nline;
-            lalloc = nalloc;
-        }
-        line[lcount].start = gline;
-        line[lcount].end = gidx;
-        line[lcount].width = bpos;
-        line[lcount].ascender = 0;
-        line[lcount].descender = 0;
-        lcount++;
+        if (sg_textlayout_reserve((void **) &st->line, &st->linealloc,
+                                  st->linecount + 1, sizeof(*st->line)))
+            return -1;
+        line = &st->line[st->linecount++];
+        line->start = gline;
+        line->end = gidx;
+        line->width = bpos;
+        line->ascender = 0;
+        line->descender = 0;
+        line->y = 0;
         if (gidx >= gcount)
             break;
         gline = gidx;
         pos = 0;
     }
+    return 0;
+}
 
-    /* Calculate vertical positions and bounding box */
-    gidx = 0;
-    lidx = 0;
-    for (ridx = 0; ridx < rcount; ridx++) {
-        gend = gidx + run[ridx].count;
-        font = run[ridx].font;
-        ascender = font->ascender;
-        descender = font->descender;
-        while (1) {
-            if (ascender > line[lidx].ascender)
-                line[lidx].ascender = ascender;
-            if (descender < line[lidx].descender)
-                line[lidx].descender = descender;
-            if (gend < line[lidx].end)
-                break;
-            if (gend == line[lidx].end) {
-                lidx++;
-                break;
-            }
-            lidx++;
+/* Calculate the vertical positions of the lines starting at line
+   'lstart'.  */
+static void
+sg_textlayout_vertical(struct sg_textlayout_state *st, unsigned lstart)
+{
+    struct sg_textflow_run *run = st->run;
+    struct sg_textlayout_line *line = st->line;
+    struct sg_font *font;
+    unsigned ridx, rcount = st->runcount, rstart, r, gidx,
+        lidx, lcount = st->linecount;
+    int pos;
+
+    ridx = 0;
+    rstart = 0;
+    pos = lstart > 0 ?
+        line[lstart-1].y + line[lstart-1].descender : 0;
+    for (lidx = lstart; lidx < lcount; lidx++) {
+        /* Skip runs which end before the line.  */
+        while (ridx < rcount && rstart + run[ridx].count <= line[lidx].start) {
+            rstart += run[ridx].count;
+            ridx++;
+        }
+        gidx = rstart;
+        for (r = ridx; r < rcount && gidx < line[lidx].end; r++) {
+            gidx += run[r].count;
+            if (!run[r].count)
+                continue;
+            font = run[r].font;
+            if (font->ascender > line[lidx].ascender)
+                line[lidx].ascender = font->ascender;
+            if (font->descender < line[lidx].descender)
+                line[lidx].descender = font->descender;
         }
-    }
-    miny = maxx = 0;
-    pos = 0;
-    for (lidx = 0; lidx < lcount; lidx++) {
         pos -= line[lidx].ascender;
-        gidx = line[lidx].start;
-        gend = line[lidx].end;
-        for (; gidx < gend; gidx++)
-            gloc[gidx].y = pos;
+        line[lidx].y = pos;
         pos += line[lidx].descender;
-        if (pos < miny) miny = pos;
-        if (line[lidx].width > maxx) maxx = line[lidx].width;
     }
-    bounds->x0 = 0;
-    bounds->y0 = miny;
-    bounds->x1 = maxx;
-    bounds->y1 = 0;
-    *baseline = -line[0].ascender;
-    free(adv);
-    free(line);
-    return 0;
+}
 
-nomem:
-    free(adv);
-    free(line);
-    return -1;
+/* Get the index of the batch for the given font and page, creating
+   it if necessary.  The search starts at the batch 'hint'.  Returns
+   -1 if out of memory.  */
+static int
+sg_textlayout_getbatch(struct sg_textbatch **batch, unsigned *bcount,
+                       unsigned *balloc, int hint,
+                       struct sg_font *font, int page)
+{
+    struct sg_textbatch *b = *batch;
+    unsigned i, n = *bcount;
+
+    if ((unsigned) hint < n && b[hint].font == font && b[hint].page == page)
+        return hint;
+    for (i = 0; i < n; i++)
+        if (b[i].font == font && b[i].page == page)
+            return i;
+    if (sg_textlayout_reserve((void **) batch, balloc, n + 1, sizeof(*b)))
+        return -1;
+    b = *batch;
+    b[n].font = font;
+    b[n].page = page;
+    b[n].offset = 0;
+    b[n].count = 0;
+    *bcount = n + 1;
+    return n;
 }
 
-int
-sg_textlayout_create(struct sg_textlayout *layout, struct sg_textflow *flow,
-                     struct sg_error **err)
+/* Write the vertexes for the lines in a block.  The key array holds
+   the batches for this block while it is written.  */
+static int
+sg_textlayout_writeblock(struct sg_textlayout *layout,
+                         struct sg_textlayout_state *st,
+                         struct sg_textlayout_block *block,
+                         unsigned lstart, unsigned lend)
 {
-    struct sg_textvert *vert, *v;
+    struct sg_textflow_run *run = st->run;
+    struct sg_textflow_glyph *glyph = st->glyph;
+    struct sg_textlayout_line *line;
+    struct sg_textbatch *key, *b, tmp;
+    struct sg_textvert *v;
+    struct sg_textquad *q;
     struct sg_font *font;
     struct sg_font_glyph *fglyph, g;
-    struct sg_textflow_run *run;
-    struct sg_textflow_glyph *glyph;
-    struct sg_textbatch *batch;
-    struct sg_textpoint *gloc;
-    struct sg_textrect *r, bounds;
-    unsigned bidx, bcount, ridx, rcount, drawcount, gidx, gend;
+    unsigned ridx, rend, gidx, lidx, kcount, kidx, vcount, bcount,
+        nelem = sg_textlayout_nelem[st->format];
+    int hint, pass;
     short vx0, vx1, vy0, vy1, tx0, tx1, ty0, ty1;
     short bx0, bx1, by0, by1;
-    int baseline;
+
+    /* The first pass counts the glyphs for each batch, and the second
+       pass writes the vertexes.  */
+    kcount = 0;
+    bx0 = by0 = SHRT_MAX;
+    bx1 = by1 = SHRT_MIN;
+    for (pass = 0; pass < 2; pass++) {
+        ridx = 0;
+        rend = run[0].count;
+        hint = 0;
+        for (lidx = lstart; lidx < lend; lidx++) {
+            line = &st->line[lidx];
+            for (gidx = line->start; gidx < line->end; gidx++) {
+                while (gidx >= rend)
+                    rend += run[++ridx].count;
+                if ((glyph[gidx].flags & SG_TEXTFLOW_VISIBLE) == 0)
+                    continue;
+                font = run[ridx].font;
+                fglyph = &font->glyph[glyph[gidx].index];
+                hint = sg_textlayout_getbatch(
+                    &st->key, &kcount, &st->keyalloc, hint,
+                    font, fglyph->page);
+                if (hint < 0)
+                    return -1;
+                b = &st->key[hint];
+                if (!pass) {
+                    b->count++;
+                    continue;
+                }
+                g = *fglyph;
+                vx0 = st->x[gidx] + g.bx; vx1 = vx0 + g.w;
+                vy1 = line->y + g.by; vy0 = vy1 - g.h;
+                tx0 = g.x; tx1 = tx0 + g.tw;
+                ty1 = g.y; ty0 = ty1 + g.th;
+                switch (st->format) {
+                case SG_TEXTFORMAT_TRIANGLES:
+                    v = (struct sg_textvert *) st->data +
+                        b->offset + 6 * b->count++;
+                    v[0].vx = vx0; v[0].vy = vy0;
+                    v[0].tx = tx0; v[0].ty = ty0;
+                    v[1].vx = vx1; v[1].vy = vy0;
+                    v[1].tx = tx1; v[1].ty = ty0;
+                    v[2].vx = vx0; v[2].vy = vy1;
+                    v[2].tx = tx0; v[2].ty = ty1;
+                    v[3].vx = vx0; v[3].vy = vy1;
+                    v[3].tx = tx0; v[3].ty = ty1;
+                    v[4].vx = vx1; v[4].vy = vy0;
+                    v[4].tx = tx1; v[4].ty = ty0;
+                    v[5].vx = vx1; v[5].vy = vy1;
+                    v[5].tx = tx1; v[5].ty = ty1;
+                    break;
+                case SG_TEXTFORMAT_QUADS:
+                    v = (struct sg_textvert *) st->data +
+                        b->offset + 4 * b->count++;
+                    v[0].vx = vx0; v[0].vy = vy0;
+                    v[0].tx = tx0; v[0].ty = ty0;
+                    v[1].vx = vx1; v[1].vy = vy0;
+                    v[1].tx = tx1; v[1].ty = ty0;
+                    v[2].vx = vx0; v[2].vy = vy1;
+                    v[2].tx = tx0; v[2].ty = ty1;
+                    v[3].vx = vx1; v[3].vy = vy1;
+                    v[3].tx = tx1; v[3].ty = ty1;
+                    break;
+                case SG_TEXTFORMAT_INSTANCES:
+                    q = (struct sg_textquad *) st->data +
+                        b->offset + b->count++;
+                    q->vx = vx0; q->vy = vy0; q->vw = g.w; q->vh = g.h;
+                    q->tx = tx0; q->ty = ty0; q->tw = g.tw; q->th = -g.th;
+                    break;
+                }
+                if (vx0 < bx0) bx0 = vx0;
+                if (vy0 < by0) by0 = vy0;
+                if (vx1 > bx1) bx1 = vx1;
+                if (vy1 > by1) by1 = vy1;
+            }
+        }
+        if (pass)
+            break;
+
+        /* Put the batch which continues the previous block first, and
+           calculate the batch offsets.  */
+        key = st->key;
+        bcount = layout->batchcount;
+        if (bcount > 0) {
+            b = &layout->batch[bcount - 1];
+            for (kidx = 0; kidx < kcount; kidx++) {
+                if (key[kidx].font == b->font && key[kidx].page == b->page) {
+                    tmp = key[kidx];
+                    key[kidx] = key[0];
+                    key[0] = tmp;
+                    break;
+                }
+            }
+        }
+        vcount = st->datacount;
+        for (kidx = 0; kidx < kcount; kidx++) {
+            if ((unsigned) key[kidx].count > (INT_MAX - vcount) / nelem)
+                return -1;
+            key[kidx].offset = vcount;
+            vcount += key[kidx].count * nelem;
+            key[kidx].count = 0;
+        }
+        if (sg_textlayout_reserve(&st->data, &st->dataalloc, vcount,
+                                  sg_textlayout_elemsize[st->format]))
+            return -1;
+    }
+
+    /* Add the batches to the layout.  */
+    key = st->key;
+    bcount = layout->batchcount;
+    block->vert = st->datacount;
+    block->bounds.x0 = bx0;
+    block->bounds.y0 = by0;
+    block->bounds.x1 = bx1;
+    block->bounds.y1 = by1;
+    kidx = 0;
+    if (bcount > 0 && kcount > 0 &&
+        layout->batch[bcount - 1].font == key[0].font &&
+        layout->batch[bcount - 1].page == key[0].page) {
+        block->batch = bcount - 1;
+        block->batchprev = layout->batch[bcount - 1].count;
+        layout->batch[bcount - 1].count += key[0].count * nelem;
+        kidx = 1;
+    } else {
+        block->batch = bcount;
+        block->batchprev = 0;
+    }
+    if (sg_textlayout_reserve((void **) &layout->batch, &st->batchalloc,
+                              bcount + kcount - kidx,
+                              sizeof(*layout->batch)))
+        return -1;
+    vcount = st->datacount;
+    for (; kidx < kcount; kidx++) {
+        b = &layout->batch[bcount++];
+        *b = key[kidx];
+        b->count *= nelem;
+    }
+    for (kidx = 0; kidx < kcount; kidx++)
+        vcount += key[kidx].count * nelem;
+    layout->batchcount = bcount;
+    st->datacount = vcount;
+    return 0;
+}
+
+/* Set the layout's data pointers from the layout state.  */
+static void
+sg_textlayout_setdata(struct sg_textlayout *layout)
+{
+    struct sg_textlayout_state *st = layout->state_;
+    layout->format = st->format;
+    if (st->format == SG_TEXTFORMAT_INSTANCES) {
+        layout->vert = NULL;
+        layout->vertcount = 0;
+        layout->quad = st->data;
+        layout->quadcount = st->datacount;
+    } else {
+        layout->vert = st->data;
+        layout->vertcount = st->datacount;
+        layout->quad = NULL;
+        layout->quadcount = 0;
+    }
+}
+
+/* Remove all text from the layout.  */
+static void
+sg_textlayout_clear(struct sg_textlayout *layout)
+{
+    struct sg_textlayout_state *st = layout->state_;
+    unsigned i;
+    memset(&layout->metrics, 0, sizeof(layout->metrics));
+    st->datacount = 0;
+    sg_textlayout_setdata(layout);
+    layout->batchcount = 0;
+    for (i = 0; i < st->runcount; i++)
+        sg_font_decref(st->run[i].font);
+    st->runcount = 0;
+    st->glyphcount = 0;
+    st->linecount = 0;
+    st->blockcount = 0;
+}
+
+int
+sg_textlayout_update(struct sg_textlayout *layout, struct sg_textflow *flow,
+                     struct sg_error **err)
+{
+    struct sg_textlayout_state *st = layout->state_;
+    struct sg_textlayout_line *line;
+    struct sg_textlayout_block *block;
+    struct sg_textrect *r;
+    unsigned gfirst, gstart, lstart, lidx, lend, lcount, bidx, lo, hi, mid;
+    short bx0, bx1, by0, by1;
+    int maxx;
 
     if (flow->err) {
         sg_error_move(err, &flow->err);
+        sg_textlayout_clear(layout);
         return -1;
     }
 
+    /* Find the first line which may have changed.  */
+    gfirst = sg_textlayout_firstchange(st, flow);
+    lstart = 0;
+    if (gfirst > 0 && st->linecount > 0) {
+        lo = 0;
+        hi = st->linecount;
+        while (hi - lo > 1) {
+            mid = lo + (hi - lo) / 2;
+            if (st->line[mid].start <= gfirst)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        lstart = lo > 0 ? lo - 1 : 0;
+    }
+    gstart = lstart > 0 ? st->line[lstart].start : 0;
+
+    if (sg_textlayout_copyflow(st, flow, gfirst))
+        goto nomem;
+    st->linecount = lstart;
     if (flow->drawcount == 0) {
         memset(&layout->metrics, 0, sizeof(layout->metrics));
-        layout->vert = NULL;
-        layout->vertcount = 0;
-        layout->batch = NULL;
+        st->datacount = 0;
+        sg_textlayout_setdata(layout);
         layout->batchcount = 0;
+        st->linecount = 0;
+        st->blockcount = 0;
         return 0;
     }
 
-    gloc = NULL;
-    batch = NULL;
-    vert = NULL;
-    run = flow->run;
-    rcount = flow->runcount;
-    glyph = flow->glyph;
-
-    /* Calculate glyph positions */
-    gloc = malloc(sizeof(*gloc) * flow->glyphcount);
-    if (!gloc)
-        goto nomem;
-    if (sg_textlayout_layout(flow, gloc, &bounds, &baseline))
+    /* Calculate glyph positions.  */
+    if (sg_textlayout_breaklines(st, gstart))
         goto nomem;
+    sg_textlayout_vertical(st, lstart);
 
-    /* Assign runs to batches */
-    bcount = 0;
-    batch = malloc(sizeof(*batch) * rcount);
-    if (!batch)
-        goto nomem;
-    for (ridx = 0; ridx < rcount; ridx++) {
-        if (run[ridx].drawcount == 0)
-            continue;
-        font = run[ridx].font;
-        for (bidx = 0; bidx < bcount; bidx++)
-            if (font == batch[bidx].font)
-                break;
-        if (bidx < bcount) {
-            batch[bidx].count += run[ridx].drawcount;
+    /* Remove the blocks which changed.  */
+    bidx = lstart / SG_TEXTLAYOUT_BLOCK;
+    if (bidx < st->blockcount) {
+        block = &st->block[bidx];
+        st->datacount = block->vert;
+        if (block->batchprev) {
+            layout->batch[block->batch].count = block->batchprev;
+            layout->batchcount = block->batch + 1;
         } else {
-            batch[bidx].font = font;
-            batch[bidx].count = run[ridx].drawcount;
-            bcount++;
+            layout->batchcount = block->batch;
         }
+    } else {
+        st->datacount = 0;
+        layout->batchcount = 0;
+        bidx = 0;
     }
+    st->blockcount = bidx;
 
-    /* Calculate batch offsets */
-    drawcount = 0;
-    for (bidx = 0; bidx < bcount; bidx++) {
-        batch[bidx].offset = drawcount;
-        drawcount += batch[bidx].count;
-        batch[bidx].count = 0;
+    /* Write the new blocks.  */
+    lcount = st->linecount;
+    if (sg_textlayout_reserve(
+            (void **) &st->block, &st->blockalloc,
+            (lcount + SG_TEXTLAYOUT_BLOCK - 1) / SG_TEXTLAYOUT_BLOCK,
+            sizeof(*st->block)))
+        goto nomem;
+    for (lidx = bidx * SG_TEXTLAYOUT_BLOCK; lidx < lcount;
+         lidx = lend, bidx++) {
+        lend = lidx + SG_TEXTLAYOUT_BLOCK;
+        if (lend > lcount)
+            lend = lcount;
+        if (sg_textlayout_writeblock(layout, st, &st->block[bidx],
+                                     lidx, lend))
+            goto nomem;
+        st->blockcount = bidx + 1;
     }
-    assert(drawcount == flow->drawcount);
 
-    /* Write glyphs to array */
+    /* Calculate the bounding boxes.  */
+    line = st->line;
+    maxx = 0;
+    for (lidx = 0; lidx < lcount; lidx++)
+        if (line[lidx].width > maxx)
+            maxx = line[lidx].width;
+    r = &layout->metrics.logical;
+    r->x0 = 0;
+    r->y0 = line[lcount-1].y + line[lcount-1].descender;
+    r->x1 = maxx;
+    r->y1 = 0;
     bx0 = by0 = SHRT_MAX;
     bx1 = by1 = SHRT_MIN;
-    vert = malloc(sizeof(*vert) * 6 * drawcount);
-    if (!vert) {
-        sg_error_nomem(err);
-        return -1;
-    }
-    gidx = 0;
-    for (ridx = 0; ridx < rcount; ridx++) {
-        gend = gidx + run[ridx].count;
-        if (run[ridx].drawcount == 0) {
-            gidx = gend;
+    for (bidx = 0; bidx < st->blockcount; bidx++) {
+        r = &st->block[bidx].bounds;
+        if (r->x0 > r->x1)
             continue;
-        }
-        font = run[ridx].font;
-        for (bidx = 0; font != batch[bidx].font; bidx++) { }
-        v = vert + (batch[bidx].offset + batch[bidx].count) * 24;
-        batch[bidx].count += run[ridx].drawcount;
-        fglyph = font->glyph;
-        for (; gidx != gend; gidx++) {
-            if ((glyph[gidx].flags & SG_TEXTFLOW_VISIBLE) == 0)
-                continue;
-            g = fglyph[glyph[gidx].index];
-            vx0 = gloc[gidx].x + g.bx; vx1 = vx0 + g.w;
-            vy1 = gloc[gidx].y + g.by; vy0 = vy1 - g.h;
-            tx0 = g.x; tx1 = tx0 + g.w;
-            ty1 = g.y; ty0 = ty1 + g.h;
-            v[0].vx = vx0; v[0].vy = vy0; v[0].tx = tx0; v[0].ty = ty0;
-            v[1].vx = vx1; v[1].vy = vy0; v[1].tx = tx1; v[1].ty = ty0;
-            v[2].vx = vx0; v[2].vy = vy1; v[2].tx = tx0; v[2].ty = ty1;
-            v[3].vx = vx0; v[3].vy = vy1; v[3].tx = tx0; v[3].ty = ty1;
-            v[4].vx = vx1; v[4].vy = vy0; v[4].tx = tx1; v[4].ty = ty0;
-            v[5].vx = vx1; v[5].vy = vy1; v[5].tx = tx1; v[5].ty = ty1;
-            v += 6;
-            if (vx0 < bx0) bx0 = vx0;
-            if (vy0 < by0) by0 = vy0;
-            if (vx1 > bx1) bx1 = vx1;
-            if (vy1 > by1) by1 = vy1;
-        }
+        if (r->x0 < bx0) bx0 = r->x0;
+        if (r->y0 < by0) by0 = r->y0;
+        if (r->x1 > bx1) bx1 = r->x1;
+        if (r->y1 > by1) by1 = r->y1;
     }
-
-    /* Convert glyph counts to vertex counts */
-    for (bidx = 0; bidx < bcount; bidx++) {
-        batch[bidx].offset *= 6;
-        batch[bidx].count *= 6;
-    }
-
-    /* Create layout object */
-    layout->metrics.logical = bounds;
     r = &layout->metrics.pixel;
     r->x0 = bx0; r->y0 = by0; r->x1 = bx1; r->y1 = by1;
-    layout->metrics.baseline = baseline;
-    layout->vert = vert;
-    layout->vertcount = drawcount * 6;
-    layout->batch = batch;
-    layout->batchcount = bcount;
-
-    free(gloc);
+    layout->metrics.baseline = -line[0].ascender;
+    sg_textlayout_setdata(layout);
     return 0;
 
 nomem:
     sg_error_nomem(err);
-    free(vert);
-    free(batch);
-    free(gloc);
+    sg_textlayout_clear(layout);
     return -1;
 }
 
+int
+sg_textlayout_create(struct sg_textlayout *layout, struct sg_textflow *flow,
+                     struct sg_error **err)
+{
+    struct sg_textlayout_state *st;
+
+    st = malloc(sizeof(*st));
+    if (!st) {
+        sg_error_nomem(err);
+        return -1;
+    }
+    memset(st, 0, sizeof(*st));
+    memset(&layout->metrics, 0, sizeof(layout->metrics));
+    layout->format = SG_TEXTFORMAT_TRIANGLES;
+    layout->vert = NULL;
+    layout->vertcount = 0;
+    layout->quad = NULL;
+    layout->quadcount = 0;
+    layout->batch = NULL;
+    layout->batchcount = 0;
+    layout->state_ = st;
+    if (sg_textlayout_update(layout, flow, err)) {
+        sg_textlayout_destroy(layout);
+        return -1;
+    }
+    return 0;
+}
+
 void
 sg_textlayout_destroy(struct sg_textlayout *layout)
 {
-    free(layout->vert);
+    struct sg_textlayout_state *st = layout->state_;
+    unsigned i;
     free(layout->batch);
+    if (!st)
+        return;
+    free(st->data);
+    for (i = 0; i < st->runcount; i++)
+        sg_font_decref(st->run[i].font);
+    free(st->run);
+    free(st->glyph);
+    free(st->adv);
+    free(st->x);
+    free(st->line);
+    free(st->block);
+    free(st->key);
+    free(st);
 }
@@ -4,6 +4,7 @@
 #include "private.h"
 #include "sg/error.h"
 #include "sg/file.h"
+#include "sg/hash.h"
 #include "sg/type.h"
 
 static const char SG_FONT_EXTENSIONS[] = "ttf:otf:woff";
@@ -16,6 +17,7 @@ sg_typeface_free(struct sg_typeface *fp)
 {
     FT_Done_Face(fp->face);
     sg_filedata_decref(fp->data);
+    sg_hashmap_destroy(&fp->charmap);
     free(fp);
 }
 
@@ -32,6 +34,20 @@ sg_typeface_decref(struct sg_typeface *fp)
         sg_typeface_free(fp);
 }
 
+unsigned
+sg_typeface_getchar2(struct sg_typeface *tp, unsigned c)
+{
+    struct sg_typeface_char *e;
+    int created;
+
+    e = sg_hashmap_insert32(&tp->charmap, c, &created);
+    if (!e)
+        return FT_Get_Char_Index(tp->face, c);
+    if (created)
+        e->glyph = FT_Get_Char_Index(tp->face, c);
+    return e->glyph;
+}
+
 struct sg_typeface *
 sg_typeface_file(const char *path, size_t pathlen, struct sg_error **err)
 {
@@ -56,6 +72,7 @@ sg_typeface_file(const char *path, size_t pathlen, struct sg_error **err)
         ferr = FT_Init_FreeType(&sg_font_library);
         if (ferr)
             goto freetype_error;
+        sg_font_cacheinit();
     }
 
     ferr = FT_New_Memory_Face(
@@ -89,8 +106,14 @@ sg_typeface_file(const char *path, size_t pathlen, struct sg_error **err)
     tp->path = pp;
     tp->pathlen = npathlen;
     tp->data = data;
+    tp->hash = sg_hash64(data->data, data->length, 0);
     tp->face = face;
     tp->font = NULL;
+    tp->cursize = 0;
+    for (i = 0; i < 256; i++)
+        tp->latin1[i] = (unsigned short) FT_Get_Char_Index(face, i);
+    sg_hashmap_init(&tp->charmap, &SG_HASHMAP_U32,
+                    sizeof(struct sg_typeface_char));
     memcpy(pp, npath, npathlen + 1);
 
     return tp;
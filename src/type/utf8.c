@@ -0,0 +1,120 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "private.h"
+
+#if defined __SSE2__ || defined _M_X64 || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2)
+# define SG_UTF8_SSE2 1
+# include <emmintrin.h>
+#endif
+
+/*
+  Most text is ASCII, so runs of ASCII characters are converted 16
+  bytes at a time.  Other characters are decoded one at a time, and
+  rejected if they are overlong, surrogates, or out of range.  An
+  invalid sequence is replaced with U+FFFD, consuming the longest
+  prefix of the sequence which could have started a valid character,
+  or one byte if there is no such prefix.
+*/
+
+#define SG_UTF8_REPLACEMENT 0xfffd
+
+size_t
+sg_utf8_decode(unsigned *SG_RESTRICT out, size_t count,
+               const unsigned char **ptr, const unsigned char *end)
+{
+    const unsigned char *p = *ptr;
+    size_t n = 0;
+    unsigned c, lo, hi;
+    int len, i;
+#if defined SG_UTF8_SSE2
+    __m128i v, zero = _mm_setzero_si128(), w;
+    int mask;
+#endif
+
+    while (n < count && p < end) {
+#if defined SG_UTF8_SSE2
+        while (count - n >= 16 && end - p >= 16) {
+            v = _mm_loadu_si128((const __m128i *) p);
+            mask = _mm_movemask_epi8(v);
+            if (mask) {
+                /* Copy the ASCII bytes before the first non-ASCII
+                   byte.  */
+                while (!(mask & 1)) {
+                    out[n++] = *p++;
+                    mask >>= 1;
+                }
+                break;
+            }
+            w = _mm_unpacklo_epi8(v, zero);
+            _mm_storeu_si128((__m128i *) (out + n),
+                             _mm_unpacklo_epi16(w, zero));
+            _mm_storeu_si128((__m128i *) (out + n + 4),
+                             _mm_unpackhi_epi16(w, zero));
+            w = _mm_unpackhi_epi8(v, zero);
+            _mm_storeu_si128((__m128i *) (out + n + 8),
+                             _mm_unpacklo_epi16(w, zero));
+            _mm_storeu_si128((__m128i *) (out + n + 12),
+                             _mm_unpackhi_epi16(w, zero));
+            p += 16;
+            n += 16;
+        }
+        if (n >= count || p >= end)
+            break;
+#endif
+
+        c = *p;
+        if (c < 0x80) {
+            out[n++] = c;
+            p++;
+            continue;
+        }
+
+        /* Get the sequence length and the valid range of the second
+           byte, which excludes overlong forms, surrogates, and
+           characters above U+10FFFF.  */
+        lo = 0x80;
+        hi = 0xbf;
+        if (c < 0xc2) {
+            len = 0;
+        } else if (c < 0xe0) {
+            len = 2;
+            c &= 0x1f;
+        } else if (c < 0xf0) {
+            len = 3;
+            if (c == 0xe0)
+                lo = 0xa0;
+            else if (c == 0xed)
+                hi = 0x9f;
+            c &= 0x0f;
+        } else if (c < 0xf5) {
+            len = 4;
+            if (c == 0xf0)
+                lo = 0x90;
+            else if (c == 0xf4)
+                hi = 0x8f;
+            c &= 0x07;
+        } else {
+            len = 0;
+        }
+        if (!len) {
+            out[n++] = SG_UTF8_REPLACEMENT;
+            p++;
+            continue;
+        }
+
+        for (i = 1; i < len; i++) {
+            if (p + i >= end || p[i] < lo || p[i] > hi)
+                break;
+            c = (c << 6) | (p[i] & 0x3f);
+            lo = 0x80;
+            hi = 0xbf;
+        }
+        out[n++] = i == len ? c : SG_UTF8_REPLACEMENT;
+        p += i;
+    }
+
+    *ptr = p;
+    return n;
+}
@@ -1,8 +1,10 @@
-/* Copyright 2012 Dietrich Epp.
+/* Copyright 2012-2014 Dietrich Epp.
    This file is part of SGLib.  SGLib is licensed under the terms of the
    2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "sg/binary.h"
 #include "sg/hash.h"
 #include "sg/util.h"
+#include <string.h>
 
 /*
   This is an implementation of Austin Appleby's MurmurHash3.  The
@@ -21,7 +23,7 @@ sg_hash(const void *data, size_t len)
     unsigned long long z;
 
     for (i = 0; i < n; i++) {
-        x = *(unsigned *) (p + 4*i);
+        memcpy(&x, p + 4*i, sizeof(x));
         x *= c1;
         x = (x << 15) | (x >> 17);
         x *= c2;
@@ -34,8 +36,10 @@ sg_hash(const void *data, size_t len)
     switch (len & 3) {
     case 3:
         x = p[4*n+2] << 16;
+        /* fall through */
     case 2:
         x |= p[4*n+1] << 8;
+        /* fall through */
     case 1:
         x |= p[4*n+0];
         x *= c1;
@@ -55,3 +59,165 @@ sg_hash(const void *data, size_t len)
 
     return y;
 }
+
+/*
+  This is an implementation of Yann Collet's XXH64.  The input is
+  processed in 32-byte stripes with four independent accumulators,
+  which lets the processor overlap the multiplications.
+
+  https://github.com/Cyan4973/xxHash
+*/
+
+#define SG_HASH64_P1 0x9e3779b185ebca87ull
+#define SG_HASH64_P2 0xc2b2ae3d27d4eb4full
+#define SG_HASH64_P3 0x165667b19e3779f9ull
+#define SG_HASH64_P4 0x85ebca77c2b2ae63ull
+#define SG_HASH64_P5 0x27d4eb2f165667c5ull
+
+SG_INLINE uint64_t
+sg_hash64_rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+SG_INLINE uint64_t
+sg_hash64_round(uint64_t acc, uint64_t x)
+{
+    acc += x * SG_HASH64_P2;
+    acc = sg_hash64_rotl(acc, 31);
+    return acc * SG_HASH64_P1;
+}
+
+SG_INLINE uint64_t
+sg_hash64_merge(uint64_t acc, uint64_t v)
+{
+    acc ^= sg_hash64_round(0, v);
+    return acc * SG_HASH64_P1 + SG_HASH64_P4;
+}
+
+/* Process whole stripes, and return the number of bytes consumed.  */
+static size_t
+sg_hash64_stripes(uint64_t *SG_RESTRICT v, const unsigned char *p,
+                  size_t len)
+{
+    uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+    size_t i, n = len & ~(size_t) 31;
+    for (i = 0; i < n; i += 32) {
+        v0 = sg_hash64_round(v0, sg_read_lu64(p + i));
+        v1 = sg_hash64_round(v1, sg_read_lu64(p + i + 8));
+        v2 = sg_hash64_round(v2, sg_read_lu64(p + i + 16));
+        v3 = sg_hash64_round(v3, sg_read_lu64(p + i + 24));
+    }
+    v[0] = v0;
+    v[1] = v1;
+    v[2] = v2;
+    v[3] = v3;
+    return n;
+}
+
+void
+sg_hash64_init(struct sg_hash64_state *state, uint64_t seed)
+{
+    state->v[0] = seed + SG_HASH64_P1 + SG_HASH64_P2;
+    state->v[1] = seed + SG_HASH64_P2;
+    state->v[2] = seed;
+    state->v[3] = seed - SG_HASH64_P1;
+    state->seed = seed;
+    state->total = 0;
+    state->buflen = 0;
+}
+
+void
+sg_hash64_update(struct sg_hash64_state *state,
+                 const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    size_t amt;
+
+    state->total += len;
+    if (state->buflen) {
+        amt = 32 - state->buflen;
+        if (len < amt) {
+            memcpy(state->buf + state->buflen, p, len);
+            state->buflen += (unsigned) len;
+            return;
+        }
+        memcpy(state->buf + state->buflen, p, amt);
+        sg_hash64_stripes(state->v, state->buf, 32);
+        state->buflen = 0;
+        p += amt;
+        len -= amt;
+    }
+    amt = sg_hash64_stripes(state->v, p, len);
+    p += amt;
+    len -= amt;
+    memcpy(state->buf, p, len);
+    state->buflen = (unsigned) len;
+}
+
+/* Compute the final hash from the accumulators and the data which
+   did not fill a stripe.  */
+static uint64_t
+sg_hash64_finish(const uint64_t *v, uint64_t seed, uint64_t total,
+                 const unsigned char *p, size_t len)
+{
+    const unsigned char *e = p + len;
+    uint64_t h;
+
+    if (total >= 32) {
+        h = sg_hash64_rotl(v[0], 1) + sg_hash64_rotl(v[1], 7) +
+            sg_hash64_rotl(v[2], 12) + sg_hash64_rotl(v[3], 18);
+        h = sg_hash64_merge(h, v[0]);
+        h = sg_hash64_merge(h, v[1]);
+        h = sg_hash64_merge(h, v[2]);
+        h = sg_hash64_merge(h, v[3]);
+    } else {
+        h = seed + SG_HASH64_P5;
+    }
+    h += total;
+
+    for (; e - p >= 8; p += 8) {
+        h ^= sg_hash64_round(0, sg_read_lu64(p));
+        h = sg_hash64_rotl(h, 27) * SG_HASH64_P1 + SG_HASH64_P4;
+    }
+    if (e - p >= 4) {
+        h ^= (uint64_t) sg_read_lu32(p) * SG_HASH64_P1;
+        h = sg_hash64_rotl(h, 23) * SG_HASH64_P2 + SG_HASH64_P3;
+        p += 4;
+    }
+    for (; p != e; p++) {
+        h ^= *p * SG_HASH64_P5;
+        h = sg_hash64_rotl(h, 11) * SG_HASH64_P1;
+    }
+
+    h ^= h >> 33;
+    h *= SG_HASH64_P2;
+    h ^= h >> 29;
+    h *= SG_HASH64_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t
+sg_hash64_final(const struct sg_hash64_state *state)
+{
+    return sg_hash64_finish(state->v, state->seed, state->total,
+                            state->buf, state->buflen);
+}
+
+uint64_t
+sg_hash64(const void *data, size_t len, uint64_t seed)
+{
+    const unsigned char *p = data;
+    uint64_t v[4];
+    size_t amt = 0;
+
+    if (len >= 32) {
+        v[0] = seed + SG_HASH64_P1 + SG_HASH64_P2;
+        v[1] = seed + SG_HASH64_P2;
+        v[2] = seed;
+        v[3] = seed - SG_HASH64_P1;
+        amt = sg_hash64_stripes(v, p, len);
+    }
+    return sg_hash64_finish(v, seed, len, p + amt, len - amt);
+}
@@ -0,0 +1,547 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "sg/defs.h"
+#include "sg/hashmap.h"
+#include "sg/util.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined __SSE2__ || defined _M_X64 || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2)
+# define SG_HASHMAP_SSE2 1
+# include <emmintrin.h>
+#endif
+
+/*
+  This is an open addressing hash table in the style of Google's
+  "Swiss table".  Each entry has a control byte, which is either
+  EMPTY, DELETED, or the top seven bits of the entry's hash.  Probing
+  examines a group of sixteen consecutive control bytes at once, and
+  only compares keys when the hash bits match.  The table is never
+  more than 7/8 full, so every probe sequence ends at an EMPTY byte.
+
+  The control array has sixteen extra bytes at the end which mirror
+  the first sixteen, so a group can be loaded from any position
+  without wrapping.
+*/
+
+enum {
+    SG_HASHMAP_GROUP = 16,
+    SG_HASHMAP_MINCAP = 16,
+    SG_HASHMAP_EMPTY = 0x80,
+    SG_HASHMAP_DELETED = 0xfe
+};
+
+/* Key types with specialized lookup.  */
+enum {
+    SG_HASHMAP_KGENERIC,
+    SG_HASHMAP_K32,
+    SG_HASHMAP_K64
+};
+
+#define SG_HASHMAP_NONE ((size_t) -1)
+
+/* ===== Group operations ===== */
+
+#if defined SG_HASHMAP_SSE2
+
+typedef __m128i sg_hashmap_group_t;
+
+SG_INLINE sg_hashmap_group_t
+sg_hashmap_load(const unsigned char *p)
+{
+    return _mm_loadu_si128((const __m128i *) p);
+}
+
+/* Bit mask of control bytes equal to the given hash bits.  */
+SG_INLINE unsigned
+sg_hashmap_match(sg_hashmap_group_t g, unsigned h2)
+{
+    return (unsigned) _mm_movemask_epi8(
+        _mm_cmpeq_epi8(g, _mm_set1_epi8((char) h2)));
+}
+
+/* Bit mask of EMPTY control bytes.  */
+SG_INLINE unsigned
+sg_hashmap_matchempty(sg_hashmap_group_t g)
+{
+    return sg_hashmap_match(g, SG_HASHMAP_EMPTY);
+}
+
+/* Bit mask of EMPTY or DELETED control bytes.  */
+SG_INLINE unsigned
+sg_hashmap_matchfree(sg_hashmap_group_t g)
+{
+    return (unsigned) _mm_movemask_epi8(g);
+}
+
+#else
+
+typedef const unsigned char *sg_hashmap_group_t;
+
+SG_INLINE sg_hashmap_group_t
+sg_hashmap_load(const unsigned char *p)
+{
+    return p;
+}
+
+SG_INLINE unsigned
+sg_hashmap_match(sg_hashmap_group_t g, unsigned h2)
+{
+    unsigned i, m = 0;
+    for (i = 0; i < SG_HASHMAP_GROUP; i++)
+        m |= (unsigned) (g[i] == h2) << i;
+    return m;
+}
+
+SG_INLINE unsigned
+sg_hashmap_matchempty(sg_hashmap_group_t g)
+{
+    return sg_hashmap_match(g, SG_HASHMAP_EMPTY);
+}
+
+SG_INLINE unsigned
+sg_hashmap_matchfree(sg_hashmap_group_t g)
+{
+    unsigned i, m = 0;
+    for (i = 0; i < SG_HASHMAP_GROUP; i++)
+        m |= (unsigned) (g[i] >> 7) << i;
+    return m;
+}
+
+#endif
+
+/* Index of the lowest set bit.  The argument must be nonzero.  */
+SG_INLINE unsigned
+sg_hashmap_ctz(unsigned x)
+{
+#if defined __GNUC__
+    return (unsigned) __builtin_ctz(x);
+#else
+    unsigned n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/* Number of leading zeros in a 16-bit mask.  */
+SG_INLINE unsigned
+sg_hashmap_clz16(unsigned x)
+{
+    unsigned n = 16;
+    while (x) {
+        x >>= 1;
+        n--;
+    }
+    return n;
+}
+
+/* ===== Integer hashes ===== */
+
+/* These are the MurmurHash3 finalizers.  */
+
+SG_INLINE unsigned
+sg_hashmap_hash32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return x;
+}
+
+SG_INLINE unsigned
+sg_hashmap_hash64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return (unsigned) x;
+}
+
+static unsigned
+sg_hashmap_u32hash(const void *key)
+{
+    uint32_t x;
+    memcpy(&x, key, sizeof(x));
+    return sg_hashmap_hash32(x);
+}
+
+static int
+sg_hashmap_u32equal(const void *key, const void *entry)
+{
+    return !memcmp(key, entry, sizeof(uint32_t));
+}
+
+static unsigned
+sg_hashmap_u64hash(const void *key)
+{
+    uint64_t x;
+    memcpy(&x, key, sizeof(x));
+    return sg_hashmap_hash64(x);
+}
+
+static int
+sg_hashmap_u64equal(const void *key, const void *entry)
+{
+    return !memcmp(key, entry, sizeof(uint64_t));
+}
+
+const struct sg_hashmap_type SG_HASHMAP_U32 = {
+    sg_hashmap_u32hash,
+    sg_hashmap_u32hash,
+    sg_hashmap_u32equal
+};
+
+const struct sg_hashmap_type SG_HASHMAP_U64 = {
+    sg_hashmap_u64hash,
+    sg_hashmap_u64hash,
+    sg_hashmap_u64equal
+};
+
+/* ===== Table operations ===== */
+
+SG_INLINE unsigned
+sg_hashmap_h2(unsigned hash)
+{
+    return (hash >> 25) & 0x7f;
+}
+
+static void
+sg_hashmap_setctrl(struct sg_hashmap *m, size_t i, unsigned c)
+{
+    m->ctrl[i] = (unsigned char) c;
+    if (i < SG_HASHMAP_GROUP)
+        m->ctrl[m->capacity + i] = (unsigned char) c;
+}
+
+/* Find the index of the entry with the given key, or return
+   SG_HASHMAP_NONE.  The key kind is a constant in each caller, so the
+   comparison is specialized when this is inlined.  */
+SG_INLINE size_t
+sg_hashmap_find(struct sg_hashmap *m, const void *key, unsigned hash,
+                int kind)
+{
+    const unsigned char *ctrl = m->ctrl;
+    const char *entry = m->entry;
+    size_t mask, pos, step, i, esize = m->entrysize;
+    sg_hashmap_group_t g;
+    unsigned bits, h2;
+    uint32_t k32, e32;
+    uint64_t k64, e64;
+
+    if (!m->capacity)
+        return SG_HASHMAP_NONE;
+    k32 = 0;
+    k64 = 0;
+    if (kind == SG_HASHMAP_K32)
+        memcpy(&k32, key, sizeof(k32));
+    else if (kind == SG_HASHMAP_K64)
+        memcpy(&k64, key, sizeof(k64));
+
+    mask = m->capacity - 1;
+    pos = hash & mask;
+    step = 0;
+    h2 = sg_hashmap_h2(hash);
+    while (1) {
+        g = sg_hashmap_load(ctrl + pos);
+        bits = sg_hashmap_match(g, h2);
+        while (bits) {
+            i = (pos + sg_hashmap_ctz(bits)) & mask;
+            switch (kind) {
+            case SG_HASHMAP_K32:
+                memcpy(&e32, entry + i * esize, sizeof(e32));
+                if (e32 == k32)
+                    return i;
+                break;
+            case SG_HASHMAP_K64:
+                memcpy(&e64, entry + i * esize, sizeof(e64));
+                if (e64 == k64)
+                    return i;
+                break;
+            default:
+                if (m->type->equal(key, entry + i * esize))
+                    return i;
+                break;
+            }
+            bits &= bits - 1;
+        }
+        if (sg_hashmap_matchempty(g))
+            return SG_HASHMAP_NONE;
+        step += SG_HASHMAP_GROUP;
+        pos = (pos + step) & mask;
+    }
+}
+
+/* Find the first EMPTY or DELETED entry in the probe sequence for the
+   given hash.  */
+static size_t
+sg_hashmap_findfree(struct sg_hashmap *m, unsigned hash)
+{
+    size_t mask = m->capacity - 1, pos = hash & mask, step = 0;
+    unsigned bits;
+    while (1) {
+        bits = sg_hashmap_matchfree(sg_hashmap_load(m->ctrl + pos));
+        if (bits)
+            return (pos + sg_hashmap_ctz(bits)) & mask;
+        step += SG_HASHMAP_GROUP;
+        pos = (pos + step) & mask;
+    }
+}
+
+/* Get the smallest capacity which can hold the given number of
+   entries, or 0 if the capacity would overflow.  */
+static size_t
+sg_hashmap_capacity(struct sg_hashmap *m, size_t n)
+{
+    size_t cap;
+    if (n > ((size_t) -1 / 2) / (m->entrysize + 1))
+        return 0;
+    cap = sg_round_up_pow2(n + n / 7 + 1);
+    return cap < SG_HASHMAP_MINCAP ? SG_HASHMAP_MINCAP : cap;
+}
+
+/* Move all entries into new arrays with the given capacity, which
+   must be a power of two no smaller than SG_HASHMAP_MINCAP, or zero
+   if the map is empty.  Returns 0 or ENOMEM.  */
+static int
+sg_hashmap_rehash(struct sg_hashmap *m, size_t capacity)
+{
+    struct sg_hashmap old = *m;
+    size_t i, j, esize = m->entrysize;
+    char *block;
+    unsigned hash;
+
+    if (!capacity) {
+        free(m->entry);
+        m->ctrl = NULL;
+        m->entry = NULL;
+        m->capacity = 0;
+        m->growth = 0;
+        return 0;
+    }
+
+    block = malloc(capacity * esize + capacity + SG_HASHMAP_GROUP);
+    if (!block)
+        return ENOMEM;
+    m->entry = block;
+    m->ctrl = (unsigned char *) block + capacity * esize;
+    m->capacity = capacity;
+    m->growth = capacity - capacity / 8 - m->size;
+    memset(m->ctrl, SG_HASHMAP_EMPTY, capacity + SG_HASHMAP_GROUP);
+
+    for (i = 0; i < old.capacity; i++) {
+        if (old.ctrl[i] & 0x80)
+            continue;
+        hash = m->type->entryhash(old.entry + i * esize);
+        j = sg_hashmap_findfree(m, hash);
+        sg_hashmap_setctrl(m, j, sg_hashmap_h2(hash));
+        memcpy(m->entry + j * esize, old.entry + i * esize, esize);
+    }
+    free(old.entry);
+    return 0;
+}
+
+/* Make room for one more entry.  If most of the used entries are
+   tombstones, the map is rehashed at the same size.  */
+static int
+sg_hashmap_grow(struct sg_hashmap *m)
+{
+    size_t cap = m->capacity;
+    if (cap && m->size <= cap / 2 - cap / 16)
+        return sg_hashmap_rehash(m, cap);
+    cap = cap ? cap * 2 : SG_HASHMAP_MINCAP;
+    if (cap > ((size_t) -1 / 2) / (m->entrysize + 1))
+        return ENOMEM;
+    return sg_hashmap_rehash(m, cap);
+}
+
+SG_INLINE void *
+sg_hashmap_insertk(struct sg_hashmap *m, const void *key, unsigned hash,
+                   int kind, int *created)
+{
+    size_t i;
+    char *entry;
+
+    i = sg_hashmap_find(m, key, hash, kind);
+    if (i != SG_HASHMAP_NONE) {
+        if (created)
+            *created = 0;
+        return m->entry + i * m->entrysize;
+    }
+
+    i = SG_HASHMAP_NONE;
+    if (m->capacity) {
+        i = sg_hashmap_findfree(m, hash);
+        if (!m->growth && m->ctrl[i] == SG_HASHMAP_EMPTY)
+            i = SG_HASHMAP_NONE;
+    }
+    if (i == SG_HASHMAP_NONE) {
+        if (sg_hashmap_grow(m))
+            return NULL;
+        i = sg_hashmap_findfree(m, hash);
+    }
+    if (m->ctrl[i] == SG_HASHMAP_EMPTY)
+        m->growth--;
+    sg_hashmap_setctrl(m, i, sg_hashmap_h2(hash));
+    m->size++;
+    entry = m->entry + i * m->entrysize;
+    memset(entry, 0, m->entrysize);
+    if (created)
+        *created = 1;
+    return entry;
+}
+
+void
+sg_hashmap_init(struct sg_hashmap *m, const struct sg_hashmap_type *type,
+                size_t entrysize)
+{
+    m->ctrl = NULL;
+    m->entry = NULL;
+    m->entrysize = entrysize;
+    m->size = 0;
+    m->capacity = 0;
+    m->growth = 0;
+    m->type = type;
+}
+
+void
+sg_hashmap_destroy(struct sg_hashmap *m)
+{
+    free(m->entry);
+    m->ctrl = NULL;
+    m->entry = NULL;
+    m->size = 0;
+    m->capacity = 0;
+    m->growth = 0;
+}
+
+void *
+sg_hashmap_get(struct sg_hashmap *m, const void *key)
+{
+    size_t i;
+    i = sg_hashmap_find(m, key, m->type->hash(key), SG_HASHMAP_KGENERIC);
+    return i != SG_HASHMAP_NONE ? m->entry + i * m->entrysize : NULL;
+}
+
+void *
+sg_hashmap_insert(struct sg_hashmap *m, const void *key, int *created)
+{
+    return sg_hashmap_insertk(
+        m, key, m->type->hash(key), SG_HASHMAP_KGENERIC, created);
+}
+
+void *
+sg_hashmap_get32(struct sg_hashmap *m, uint32_t key)
+{
+    size_t i;
+    i = sg_hashmap_find(m, &key, sg_hashmap_hash32(key), SG_HASHMAP_K32);
+    return i != SG_HASHMAP_NONE ? m->entry + i * m->entrysize : NULL;
+}
+
+void *
+sg_hashmap_insert32(struct sg_hashmap *m, uint32_t key, int *created)
+{
+    void *entry;
+    int c;
+    entry = sg_hashmap_insertk(
+        m, &key, sg_hashmap_hash32(key), SG_HASHMAP_K32, &c);
+    if (entry && c)
+        memcpy(entry, &key, sizeof(key));
+    if (created)
+        *created = c;
+    return entry;
+}
+
+void *
+sg_hashmap_get64(struct sg_hashmap *m, uint64_t key)
+{
+    size_t i;
+    i = sg_hashmap_find(m, &key, sg_hashmap_hash64(key), SG_HASHMAP_K64);
+    return i != SG_HASHMAP_NONE ? m->entry + i * m->entrysize : NULL;
+}
+
+void *
+sg_hashmap_insert64(struct sg_hashmap *m, uint64_t key, int *created)
+{
+    void *entry;
+    int c;
+    entry = sg_hashmap_insertk(
+        m, &key, sg_hashmap_hash64(key), SG_HASHMAP_K64, &c);
+    if (entry && c)
+        memcpy(entry, &key, sizeof(key));
+    if (created)
+        *created = c;
+    return entry;
+}
+
+void
+sg_hashmap_erase(struct sg_hashmap *m, void *entry)
+{
+    size_t i, mask = m->capacity - 1;
+    unsigned before, after;
+
+    i = ((char *) entry - m->entry) / m->entrysize;
+    /* If there is no full group containing this entry, then no probe
+       sequence ever continued past it, and it can be marked EMPTY
+       instead of DELETED.  */
+    before = sg_hashmap_matchempty(
+        sg_hashmap_load(m->ctrl + ((i - SG_HASHMAP_GROUP) & mask)));
+    after = sg_hashmap_matchempty(sg_hashmap_load(m->ctrl + i));
+    if (before && after &&
+        sg_hashmap_ctz(after) + sg_hashmap_clz16(before) <
+        SG_HASHMAP_GROUP) {
+        sg_hashmap_setctrl(m, i, SG_HASHMAP_EMPTY);
+        m->growth++;
+    } else {
+        sg_hashmap_setctrl(m, i, SG_HASHMAP_DELETED);
+    }
+    m->size--;
+}
+
+void *
+sg_hashmap_next(struct sg_hashmap *m, void *entry)
+{
+    size_t i, n = m->capacity;
+    i = entry ? ((char *) entry - m->entry) / m->entrysize + 1 : 0;
+    for (; i < n; i++) {
+        if (!(m->ctrl[i] & 0x80))
+            return m->entry + i * m->entrysize;
+    }
+    return NULL;
+}
+
+int
+sg_hashmap_reserve(struct sg_hashmap *m, size_t n)
+{
+    size_t cap;
+    if (n <= m->size + m->growth)
+        return 0;
+    cap = sg_hashmap_capacity(m, n);
+    if (!cap)
+        return ENOMEM;
+    return sg_hashmap_rehash(m, cap > m->capacity ? cap : m->capacity);
+}
+
+int
+sg_hashmap_compact(struct sg_hashmap *m)
+{
+    size_t cap;
+    if (!m->size)
+        return sg_hashmap_rehash(m, 0);
+    cap = sg_hashmap_capacity(m, m->size);
+    if (!cap)
+        return ENOMEM;
+    if (cap == m->capacity &&
+        m->growth == cap - cap / 8 - m->size)
+        return 0;
+    return sg_hashmap_rehash(m, cap);
+}
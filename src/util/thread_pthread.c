@@ -6,6 +6,7 @@
 #include "sg/thread.h"
 #include <errno.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 void
 sg_lock_init(struct sg_lock *p)
@@ -253,3 +254,59 @@ sg_evt_wait(struct sg_evt *p)
 err:
     abort();
 }
+
+struct sg_thread_start {
+    sg_thread_func_t func;
+    void *arg;
+};
+
+static void *
+sg_thread_main(void *arg)
+{
+    struct sg_thread_start st = *(struct sg_thread_start *) arg;
+    free(arg);
+    st.func(st.arg);
+    return NULL;
+}
+
+int
+sg_thread_start(sg_thread_func_t func, void *arg)
+{
+    struct sg_thread_start *st;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int r;
+
+    st = malloc(sizeof(*st));
+    if (!st)
+        return -1;
+    st->func = func;
+    st->arg = arg;
+    r = pthread_attr_init(&attr);
+    if (r) goto err;
+    r = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (r) goto err;
+    r = pthread_create(&thread, &attr, sg_thread_main, st);
+    if (r) {
+        free(st);
+        pthread_attr_destroy(&attr);
+        return -1;
+    }
+    r = pthread_attr_destroy(&attr);
+    if (r) goto err;
+    return 0;
+
+err:
+    abort();
+}
+
+int
+sg_thread_cpucount(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1)
+        return 1;
+    if (n > 256)
+        return 256;
+    return (int) n;
+}
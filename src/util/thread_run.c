@@ -0,0 +1,83 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "sg/thread.h"
+#include <stdlib.h>
+
+struct sg_thread_runstate {
+    sg_thread_task_t func;
+    void *arg;
+    struct sg_lock lock;
+    struct sg_evt done;
+    int remaining;
+};
+
+struct sg_thread_runarg {
+    struct sg_thread_runstate *state;
+    int index;
+};
+
+static void
+sg_thread_runmain(void *arg)
+{
+    struct sg_thread_runarg *a = arg;
+    struct sg_thread_runstate *s = a->state;
+    int last;
+
+    s->func(s->arg, a->index);
+    sg_lock_acquire(&s->lock);
+    last = --s->remaining == 0;
+    if (last)
+        sg_evt_signal(&s->done);
+    sg_lock_release(&s->lock);
+}
+
+void
+sg_thread_run(sg_thread_task_t func, void *arg, int count)
+{
+    struct sg_thread_runstate s;
+    struct sg_thread_runarg *a = NULL;
+    int i, started, r;
+
+    if (count > 1)
+        a = malloc(sizeof(*a) * (count - 1));
+    if (!a) {
+        for (i = 0; i < count; i++)
+            func(arg, i);
+        return;
+    }
+
+    s.func = func;
+    s.arg = arg;
+    sg_lock_init(&s.lock);
+    sg_evt_init(&s.done);
+    s.remaining = count - 1;
+    started = 0;
+    for (i = 1; i < count; i++) {
+        a[i - 1].state = &s;
+        a[i - 1].index = i;
+        r = sg_thread_start(sg_thread_runmain, &a[i - 1]);
+        if (r)
+            break;
+        started++;
+    }
+    if (started < count - 1) {
+        sg_lock_acquire(&s.lock);
+        s.remaining -= count - 1 - started;
+        if (!s.remaining)
+            sg_evt_signal(&s.done);
+        sg_lock_release(&s.lock);
+    }
+
+    func(arg, 0);
+    for (i = started + 1; i < count; i++)
+        func(arg, i);
+
+    sg_evt_wait(&s.done);
+    /* The last thread may still hold the lock after signaling.  */
+    sg_lock_acquire(&s.lock);
+    sg_lock_release(&s.lock);
+    sg_evt_destroy(&s.done);
+    sg_lock_destroy(&s.lock);
+    free(a);
+}
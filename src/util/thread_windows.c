@@ -2,6 +2,7 @@
    This file is part of SGLib.  SGLib is licensed under the terms of the
    2-clause BSD license.  For more information, see LICENSE.txt. */
 #include <stdio.h>
+#include <stdlib.h>
 #include "sg/thread.h"
 
 void
@@ -58,3 +59,49 @@ sg_evt_wait(struct sg_evt *p)
     if (r)
         abort();
 }
+
+struct sg_thread_start {
+    sg_thread_func_t func;
+    void *arg;
+};
+
+static DWORD WINAPI
+sg_thread_main(LPVOID arg)
+{
+    struct sg_thread_start st = *(struct sg_thread_start *) arg;
+    free(arg);
+    st.func(st.arg);
+    return 0;
+}
+
+int
+sg_thread_start(sg_thread_func_t func, void *arg)
+{
+    struct sg_thread_start *st;
+    HANDLE h;
+
+    st = malloc(sizeof(*st));
+    if (!st)
+        return -1;
+    st->func = func;
+    st->arg = arg;
+    h = CreateThread(NULL, 0, sg_thread_main, st, 0, NULL);
+    if (!h) {
+        free(st);
+        return -1;
+    }
+    CloseHandle(h);
+    return 0;
+}
+
+int
+sg_thread_cpucount(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    if (info.dwNumberOfProcessors < 1)
+        return 1;
+    if (info.dwNumberOfProcessors > 256)
+        return 256;
+    return (int) info.dwNumberOfProcessors;
+}
@@ -2,17 +2,50 @@
    This file is part of SGLib.  SGLib is licensed under the terms of the
    2-clause BSD license.  For more information, see LICENSE.txt. */
 #include "defs.h"
+#include "sg/file.h"
+#include <string.h>
 
+/* Install a newly loaded program.  The first time a program is
+   loaded, its shaders are watched so the program is reloaded when
+   they change.  If a reload fails, the old program is kept.  Returns
+   0 if the old program was kept, 1 otherwise.  */
+static int
+set_program(GLuint *progp, GLuint prog, const char *path,
+            sg_filewatch_func_t reload, void *cxt)
+{
+    if (!*progp) {
+        sg_filewatch_remove(reload, cxt);
+        sg_filewatch_add(path, strlen(path), 0, "vert:frag",
+                         reload, cxt, NULL);
+    } else {
+        if (!prog)
+            return 0;
+        glDeleteProgram(*progp);
+    }
+    *progp = prog;
+    return 1;
+}
+
+#define LOAD(name, path) \
+    if (!set_program(&p->prog, load_program(path, path), path, \
+                     reload_prog_ ## name, p)) \
+        return; \
+    prog = p->prog
 #define ATTR(x) p->x = glGetAttribLocation(prog, #x)
 #define UNIFORM(x) p->x = glGetUniformLocation(prog, #x)
 
+static void
+reload_prog_plain(void *cxt)
+{
+    load_prog_plain(cxt);
+}
+
 void
 load_prog_plain(struct prog_plain *p)
 {
     GLuint prog;
     sg_opengl_checkerror("load_prog_plain start");
-    p->prog = prog = load_program(
-        "shader/plain", "shader/plain");
+    LOAD(plain, "shader/plain");
     ATTR(a_loc);
     UNIFORM(u_vertoff);
     UNIFORM(u_vertscale);
@@ -20,13 +53,18 @@ load_prog_plain(struct prog_plain *p)
     sg_opengl_checkerror("load_prog_plain");
 }
 
+static void
+reload_prog_bkg(void *cxt)
+{
+    load_prog_bkg(cxt);
+}
+
 void
 load_prog_bkg(struct prog_bkg *p)
 {
     GLuint prog;
     sg_opengl_checkerror("load_prog_bkg start");
-    p->prog = prog = load_program(
-        "shader/bkg", "shader/bkg");
+    LOAD(bkg, "shader/bkg");
     ATTR(a_loc);
     UNIFORM(u_texoff);
     UNIFORM(u_texmat);
@@ -36,13 +74,18 @@ load_prog_bkg(struct prog_bkg *p)
     sg_opengl_checkerror("load_prog_bkg");
 }
 
+static void
+reload_prog_textured(void *cxt)
+{
+    load_prog_textured(cxt);
+}
+
 void
 load_prog_textured(struct prog_textured *p)
 {
     GLuint prog;
     sg_opengl_checkerror("load_prog_textured start");
-    p->prog = prog = load_program(
-        "shader/textured", "shader/textured");
+    LOAD(textured, "shader/textured");
     ATTR(a_loc);
     ATTR(a_texcoord);
     UNIFORM(u_vertoff);
@@ -52,13 +95,18 @@ load_prog_textured(struct prog_textured *p)
     sg_opengl_checkerror("load_prog_textured");
 }
 
+static void
+reload_prog_text(void *cxt)
+{
+    load_prog_text(cxt);
+}
+
 void
 load_prog_text(struct prog_text *p)
 {
     GLuint prog;
     sg_opengl_checkerror("load_prog_text start");
-    p->prog = prog = load_program(
-        "shader/text", "shader/text");
+    LOAD(text, "shader/text");
     ATTR(a_vert);
     UNIFORM(u_vertoff);
     UNIFORM(u_vertscale);
@@ -69,5 +117,6 @@ load_prog_text(struct prog_text *p)
     sg_opengl_checkerror("load_prog_text");
 }
 
+#undef LOAD
 #undef ATTR
 #undef UNIFORM
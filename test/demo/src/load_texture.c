@@ -5,8 +5,6 @@
 #include "sg/file.h"
 #include "sg/pixbuf.h"
 #include "sg/log.h"
-#include "sg/util.h"
-#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -33,17 +31,13 @@ load_texture(const char *path)
     struct sg_image *image;
     struct sg_pixbuf pixbuf;
     int r;
-    unsigned twidth, theight;
     GLuint texture;
 
     image = sg_image_file(path, strlen(path), NULL);
     if (!image)
         abort();
-    twidth = sg_round_up_pow2_32(image->width);
-    theight = sg_round_up_pow2_32(image->height);
-    if (!twidth || twidth > INT_MAX || !theight || theight > INT_MAX)
-        abort();
-    r = sg_pixbuf_calloc(&pixbuf, SG_RGBA, (int) twidth, (int) theight, NULL);
+    r = sg_pixbuf_allocflags(&pixbuf, SG_RGBA, image->width, image->height,
+                             SG_PIXBUF_POW2 | SG_PIXBUF_ZERO, NULL);
     if (r)
         abort();
     r = image->draw(image, &pixbuf, 0, 0, NULL);
@@ -0,0 +1,142 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Benchmark for sg_writer.  Writes a large file in chunks of various
+   sizes, with and without the write buffer, and reports throughput.
+   The time to commit the file (which syncs it to disk) is reported
+   separately.  */
+#define _POSIX_C_SOURCE 200112L
+#include "sg/error.h"
+#include "sg/file.h"
+#include "src/core/file_impl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct sg_paths sg_paths;
+
+static const size_t CHUNK_SIZE[] = {
+    64, 4096, 1024 * 1024
+};
+
+static const char OUTPUT_NAME[] = "file_write.dat";
+
+static void
+die(const char *reason)
+{
+    fprintf(stderr, "error: %s\n", reason);
+    exit(1);
+}
+
+static void
+die_error(const char *what, struct sg_error *err)
+{
+    fprintf(stderr, "error: %s: %s\n", what,
+            err && err->msg ? err->msg : "unknown error");
+    exit(1);
+}
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+bench(size_t total, size_t chunk, size_t bufsize, const char *data)
+{
+    struct sg_writer *fp;
+    struct sg_error *err = NULL;
+    size_t pos, amt;
+    double t0, t1, t2, mb;
+    int r;
+
+    fp = sg_writer_open(OUTPUT_NAME, strlen(OUTPUT_NAME), &err);
+    if (!fp)
+        die_error("open", err);
+    if (bufsize) {
+        r = sg_writer_setbuffer(fp, bufsize, &err);
+        if (r)
+            die_error("setbuffer", err);
+    }
+
+    t0 = get_time();
+    pos = 0;
+    while (pos < total) {
+        amt = total - pos < chunk ? total - pos : chunk;
+        r = sg_writer_write(fp, data, amt, &err);
+        if (r < 0)
+            die_error("write", err);
+        pos += r;
+    }
+    t1 = get_time();
+    r = sg_writer_commit(fp, &err);
+    if (r)
+        die_error("commit", err);
+    t2 = get_time();
+    sg_writer_close(fp);
+
+    mb = (double) total / (1024 * 1024);
+    printf("chunk %8zu  buffer %8zu  write %8.1f MB/s  "
+           "with commit %8.1f MB/s\n",
+           chunk, bufsize, mb / (t1 - t0), mb / (t2 - t0));
+    fflush(stdout);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct sg_path path;
+    const char *dir;
+    char *data, *pbuf;
+    size_t total, maxchunk, dirlen;
+    unsigned i;
+
+    if (argc < 2 || argc > 3) {
+        fputs("Usage: file_write DIR [SIZE_MB]\n", stderr);
+        return 1;
+    }
+    dir = argv[1];
+    total = (size_t) 2048 * 1024 * 1024;
+    if (argc >= 3)
+        total = (size_t) strtoul(argv[2], NULL, 0) * 1024 * 1024;
+
+    dirlen = strlen(dir);
+    pbuf = malloc(dirlen + sizeof(OUTPUT_NAME) + 1);
+    if (!pbuf)
+        die("out of memory");
+    memcpy(pbuf, dir, dirlen);
+    if (!dirlen || pbuf[dirlen - 1] != '/')
+        pbuf[dirlen++] = '/';
+    pbuf[dirlen] = '\0';
+    path.path = pbuf;
+    path.len = dirlen;
+    sg_paths.path = &path;
+    sg_paths.pathcount = 1;
+    sg_paths.maxlen = (unsigned) dirlen;
+
+    maxchunk = 0;
+    for (i = 0; i < sizeof(CHUNK_SIZE) / sizeof(*CHUNK_SIZE); i++) {
+        if (CHUNK_SIZE[i] > maxchunk)
+            maxchunk = CHUNK_SIZE[i];
+    }
+    data = malloc(maxchunk);
+    if (!data)
+        die("out of memory");
+    for (i = 0; i < maxchunk; i++)
+        data[i] = (char) (i * 37);
+
+    for (i = 0; i < sizeof(CHUNK_SIZE) / sizeof(*CHUNK_SIZE); i++) {
+        bench(total, CHUNK_SIZE[i], 0, data);
+        bench(total, CHUNK_SIZE[i], SG_WRITER_BUFSIZE, data);
+    }
+
+    memcpy(pbuf + dirlen, OUTPUT_NAME, sizeof(OUTPUT_NAME));
+    remove(pbuf);
+    free(data);
+    free(pbuf);
+    return 0;
+}
@@ -0,0 +1,70 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Benchmark for hash functions.  Reports throughput for various
+   input sizes.  Build with optimization, e.g. "make CFLAGS=-O2".  */
+#define _POSIX_C_SOURCE 200112L
+#include "sg/hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const size_t SIZES[] = {
+    16, 256, 4096, 65536, 16 * 1024 * 1024
+};
+
+/* Total number of bytes hashed for each test.  */
+#define TOTAL_SIZE ((size_t) 1 << 30)
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned char *buf;
+    size_t maxsize = 0, size, i, j, n;
+    double t32, t64;
+    volatile uint64_t sink = 0;
+
+    (void) argc;
+    (void) argv;
+
+    for (i = 0; i < sizeof(SIZES) / sizeof(*SIZES); i++)
+        if (SIZES[i] > maxsize)
+            maxsize = SIZES[i];
+    buf = malloc(maxsize);
+    if (!buf) {
+        fputs("error: out of memory\n", stderr);
+        return 1;
+    }
+    for (i = 0; i < maxsize; i++)
+        buf[i] = (unsigned char) (i * 7 + 3);
+
+    for (i = 0; i < sizeof(SIZES) / sizeof(*SIZES); i++) {
+        size = SIZES[i];
+        n = TOTAL_SIZE / size;
+
+        t32 = get_time();
+        for (j = 0; j < n; j++)
+            sink += sg_hash(buf, size - (j & 1));
+        t32 = get_time() - t32;
+
+        t64 = get_time();
+        for (j = 0; j < n; j++)
+            sink += sg_hash64(buf, size - (j & 1), j);
+        t64 = get_time() - t64;
+
+        printf("size %9zu  sg_hash %8.2f GB/s  sg_hash64 %8.2f GB/s\n",
+               size, (double) size * n / t32 * 1e-9,
+               (double) size * n / t64 * 1e-9);
+    }
+
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,91 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "sg/hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Known answers, computed with the reference XXH64 implementation.
+   The input is the first 'len' bytes of the test buffer.  */
+struct test_case {
+    unsigned len;
+    uint64_t seed;
+    uint64_t hash;
+};
+
+static const struct test_case TEST_CASES[] = {
+    {    0, 0x0000000000000000ull, 0xef46db3751d8e999ull },
+    {    0, 0x9e3779b97f4a7c15ull, 0xc4349fc93c010000ull },
+    {    1, 0x0000000000000000ull, 0x1f25c8d0bc1f4bb6ull },
+    {    1, 0x9e3779b97f4a7c15ull, 0x79826bcd749d267aull },
+    {    3, 0x0000000000000000ull, 0x31d2363f52e564c9ull },
+    {    3, 0x9e3779b97f4a7c15ull, 0x78efd77575e26575ull },
+    {    4, 0x0000000000000000ull, 0x9bb64b7d66ee9fdaull },
+    {    4, 0x9e3779b97f4a7c15ull, 0x6f0a6c97d68bf353ull },
+    {    8, 0x0000000000000000ull, 0xdab99d95c6f90092ull },
+    {    8, 0x9e3779b97f4a7c15ull, 0xa2f1e28437a78a1bull },
+    {   14, 0x0000000000000000ull, 0xc7f1d4d0acfa5a14ull },
+    {   14, 0x9e3779b97f4a7c15ull, 0x11c9ca8b8889a9f1ull },
+    {   31, 0x0000000000000000ull, 0xa2aa5f33cc4a6119ull },
+    {   31, 0x9e3779b97f4a7c15ull, 0x755437271d1d0a84ull },
+    {   32, 0x0000000000000000ull, 0x23c3c17ef790fd97ull },
+    {   32, 0x9e3779b97f4a7c15ull, 0xbf624b932c090428ull },
+    {   33, 0x0000000000000000ull, 0x50a7cfc7ba588784ull },
+    {   33, 0x9e3779b97f4a7c15ull, 0x7aceaf1e9d34ea35ull },
+    {   64, 0x0000000000000000ull, 0x0eb64b3ef6eeb01full },
+    {   64, 0x9e3779b97f4a7c15ull, 0x4af341f14e3a6fc9ull },
+    {  100, 0x0000000000000000ull, 0xa61f8d4c170fe531ull },
+    {  100, 0x9e3779b97f4a7c15ull, 0xf6d8f65c625abb4full },
+    { 1000, 0x0000000000000000ull, 0x5f235fa033f1a3fbull },
+    { 1000, 0x9e3779b97f4a7c15ull, 0x442acd0a822e86f6ull }
+};
+
+static unsigned char test_buf[1000];
+
+int
+main(int argc, char **argv)
+{
+    const struct test_case *t;
+    struct sg_hash64_state state;
+    unsigned i, j, k, n = sizeof(TEST_CASES) / sizeof(*TEST_CASES);
+    uint64_t h;
+    int failed = 0;
+
+    (void) argc;
+    (void) argv;
+
+    for (i = 0; i < sizeof(test_buf); i++)
+        test_buf[i] = (unsigned char) (i * 7 + 3);
+
+    for (i = 0; i < n; i++) {
+        t = &TEST_CASES[i];
+        h = sg_hash64(test_buf, t->len, t->seed);
+        if (h != t->hash) {
+            fprintf(stderr, "len=%u: sg_hash64 = %016llx, expected %016llx\n",
+                    t->len, (unsigned long long) h,
+                    (unsigned long long) t->hash);
+            failed = 1;
+        }
+
+        /* Feed the data in pieces of every size.  */
+        for (j = 1; j <= 40 && j <= t->len; j++) {
+            sg_hash64_init(&state, t->seed);
+            for (k = 0; k < t->len; k += j)
+                sg_hash64_update(&state, test_buf + k,
+                                 t->len - k < j ? t->len - k : j);
+            h = sg_hash64_final(&state);
+            if (h != t->hash) {
+                fprintf(stderr, "len=%u, step=%u: sg_hash64_final = %016llx, "
+                        "expected %016llx\n",
+                        t->len, j, (unsigned long long) h,
+                        (unsigned long long) t->hash);
+                failed = 1;
+            }
+        }
+    }
+
+    if (failed)
+        return 1;
+    fputs("ok\n", stderr);
+    return 0;
+}
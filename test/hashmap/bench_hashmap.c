@@ -0,0 +1,292 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Benchmark for sg_hashmap and sg_hashtable.  Measures insert,
+   successful lookup, failed lookup, and erase throughput, for string
+   keys made from a word list and for random integer keys.  Build with
+   optimization, e.g. "make CFLAGS=-O2".  */
+#define _POSIX_C_SOURCE 200112L
+#include "sg/hashmap.h"
+#include "sg/hashtable.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct entry32 {
+    uint32_t key;
+    uint32_t value;
+};
+
+struct entry64 {
+    uint64_t key;
+    uint64_t value;
+};
+
+static unsigned rand_state = 1618033988;
+
+static unsigned
+rand_next(void)
+{
+    rand_state = rand_state * 1664525u + 1013904223u;
+    return rand_state;
+}
+
+static uint64_t
+rand_next64(void)
+{
+    uint64_t x = rand_next();
+    return (x << 32) ^ rand_next();
+}
+
+static void
+die(const char *reason)
+{
+    fprintf(stderr, "error: %s\n", reason);
+    exit(1);
+}
+
+static void *
+xmalloc(size_t sz)
+{
+    void *p = malloc(sz);
+    if (!p)
+        die("out of memory");
+    return p;
+}
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+report(const char *name, const char *op, unsigned count, double t)
+{
+    printf("%-8s %-8s %8.2f Mop/s\n", name, op, count / t * 1e-6);
+}
+
+/* Read the word list, and make 'count' distinct keys for insertion
+   and 'count' keys which are not inserted.  */
+static void
+make_words(const char *path, unsigned count, char ***keys, char ***misses)
+{
+    FILE *fp;
+    char buf[64], **words = NULL, **k, **m;
+    unsigned nwords = 0, walloc = 0, i;
+    size_t len;
+
+    fp = fopen(path, "r");
+    if (!fp)
+        die("could not open word list");
+    while (fgets(buf, sizeof(buf), fp)) {
+        len = strlen(buf);
+        if (len && buf[len - 1] == '\n')
+            buf[--len] = '\0';
+        if (!len)
+            continue;
+        if (nwords >= walloc) {
+            walloc = walloc ? walloc * 2 : 256;
+            words = realloc(words, sizeof(*words) * walloc);
+            if (!words)
+                die("out of memory");
+        }
+        words[nwords] = xmalloc(len + 1);
+        memcpy(words[nwords], buf, len + 1);
+        nwords++;
+    }
+    fclose(fp);
+    if (!nwords)
+        die("empty word list");
+
+    k = xmalloc(sizeof(*k) * count);
+    m = xmalloc(sizeof(*m) * count);
+    for (i = 0; i < count; i++) {
+        k[i] = xmalloc(80);
+        snprintf(k[i], 80, "%s%u", words[i % nwords], i / nwords);
+        m[i] = xmalloc(80);
+        snprintf(m[i], 80, "%s-%u", words[i % nwords], i / nwords);
+    }
+    for (i = 0; i < nwords; i++)
+        free(words[i]);
+    free(words);
+    *keys = k;
+    *misses = m;
+}
+
+static void
+bench_words(char **keys, char **misses, unsigned count)
+{
+    struct sg_hashtable d;
+    struct sg_hashtable_entry *e;
+    unsigned i, found;
+    double t;
+
+    sg_hashtable_init(&d);
+
+    t = get_time();
+    for (i = 0; i < count; i++) {
+        e = sg_hashtable_insert(&d, keys[i]);
+        if (!e)
+            die("out of memory");
+        e->value = keys[i];
+    }
+    report("words", "insert", count, get_time() - t);
+
+    t = get_time();
+    found = 0;
+    for (i = 0; i < count; i++)
+        found += sg_hashtable_get(&d, keys[i]) != NULL;
+    report("words", "hit", count, get_time() - t);
+    if (found != count)
+        die("lookup failed");
+
+    t = get_time();
+    found = 0;
+    for (i = 0; i < count; i++)
+        found += sg_hashtable_get(&d, misses[i]) != NULL;
+    report("words", "miss", count, get_time() - t);
+    if (found)
+        die("lookup succeeded");
+
+    t = get_time();
+    for (i = 0; i < count; i++)
+        sg_hashtable_erase(&d, sg_hashtable_get(&d, keys[i]));
+    report("words", "erase", count, get_time() - t);
+    if (d.map.size)
+        die("erase failed");
+
+    sg_hashtable_destroy(&d, NULL);
+}
+
+static void
+bench_u32(unsigned count)
+{
+    struct sg_hashmap m;
+    struct entry32 *e;
+    uint32_t *keys;
+    unsigned i, found;
+    double t;
+
+    keys = xmalloc(sizeof(*keys) * count * 2);
+    for (i = 0; i < count * 2; i++)
+        keys[i] = rand_next();
+    sg_hashmap_init(&m, &SG_HASHMAP_U32, sizeof(struct entry32));
+
+    t = get_time();
+    for (i = 0; i < count; i++) {
+        e = sg_hashmap_insert32(&m, keys[i], NULL);
+        if (!e)
+            die("out of memory");
+        e->value = i;
+    }
+    report("u32", "insert", count, get_time() - t);
+
+    t = get_time();
+    found = 0;
+    for (i = 0; i < count; i++)
+        found += sg_hashmap_get32(&m, keys[i]) != NULL;
+    report("u32", "hit", count, get_time() - t);
+
+    t = get_time();
+    found = 0;
+    for (i = 0; i < count; i++)
+        found += sg_hashmap_get32(&m, keys[count + i]) != NULL;
+    report("u32", "miss", count, get_time() - t);
+
+    t = get_time();
+    for (i = 0; i < count; i++) {
+        e = sg_hashmap_get32(&m, keys[i]);
+        if (e)
+            sg_hashmap_erase(&m, e);
+    }
+    report("u32", "erase", count, get_time() - t);
+    if (m.size)
+        die("erase failed");
+
+    sg_hashmap_destroy(&m);
+    free(keys);
+}
+
+static void
+bench_u64(unsigned count)
+{
+    struct sg_hashmap m;
+    struct entry64 *e;
+    uint64_t *keys;
+    unsigned i, found;
+    double t;
+
+    keys = xmalloc(sizeof(*keys) * count * 2);
+    for (i = 0; i < count * 2; i++)
+        keys[i] = rand_next64();
+    sg_hashmap_init(&m, &SG_HASHMAP_U64, sizeof(struct entry64));
+
+    t = get_time();
+    for (i = 0; i < count; i++) {
+        e = sg_hashmap_insert64(&m, keys[i], NULL);
+        if (!e)
+            die("out of memory");
+        e->value = i;
+    }
+    report("u64", "insert", count, get_time() - t);
+
+    t = get_time();
+    found = 0;
+    for (i = 0; i < count; i++)
+        found += sg_hashmap_get64(&m, keys[i]) != NULL;
+    report("u64", "hit", count, get_time() - t);
+    if (found != count)
+        die("lookup failed");
+
+    t = get_time();
+    found = 0;
+    for (i = 0; i < count; i++)
+        found += sg_hashmap_get64(&m, keys[count + i]) != NULL;
+    report("u64", "miss", count, get_time() - t);
+    if (found)
+        die("lookup succeeded");
+
+    t = get_time();
+    for (i = 0; i < count; i++)
+        sg_hashmap_erase(&m, sg_hashmap_get64(&m, keys[i]));
+    report("u64", "erase", count, get_time() - t);
+    if (m.size)
+        die("erase failed");
+
+    sg_hashmap_destroy(&m);
+    free(keys);
+}
+
+int
+main(int argc, char **argv)
+{
+    char **keys, **misses;
+    unsigned count, i;
+
+    if (argc < 2 || argc > 3) {
+        fputs("Usage: bench_hashmap WORDLIST [COUNT]\n", stderr);
+        return 1;
+    }
+    count = 1000000;
+    if (argc >= 3)
+        count = (unsigned) strtoul(argv[2], NULL, 0);
+    if (!count)
+        die("invalid count");
+
+    make_words(argv[1], count, &keys, &misses);
+    bench_words(keys, misses, count);
+    for (i = 0; i < count; i++) {
+        free(keys[i]);
+        free(misses[i]);
+    }
+    free(keys);
+    free(misses);
+
+    bench_u32(count);
+    bench_u64(count);
+    return 0;
+}
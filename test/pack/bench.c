@@ -0,0 +1,108 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Benchmark for rectangle packing.  Packs 100 to 100k random
+   rectangles with each method and reports the time and occupancy,
+   the fraction of the packing area covered by rectangles.  Build with
+   optimization, e.g. "make CFLAGS=-O2".  */
+#define _POSIX_C_SOURCE 200112L
+#include "sg/error.h"
+#include "sg/pack.h"
+#include "sg/rand.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NRUN 3
+
+static struct sg_rand_state state = {
+    1234567, 7654321, 1234321
+};
+
+static const char *const METHOD_NAME[] = {
+    "skyline-bl", "skyline-waste", "maxrects-bl", "maxrects-short",
+    "maxrects-area"
+};
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+bench(const struct sg_pack_rect *src, unsigned count,
+      int method, unsigned flags)
+{
+    struct sg_pack_rect *rect;
+    struct sg_pack_size size, maxsize;
+    double t, best = 0.0, area = 0.0;
+    unsigned i;
+    int run, r = 0;
+
+    rect = malloc(sizeof(*rect) * count);
+    if (!rect) {
+        fputs("error: out of memory\n", stderr);
+        exit(1);
+    }
+    for (i = 0; i < count; i++)
+        area += (double) src[i].w * src[i].h;
+    maxsize.width = 16384;
+    maxsize.height = 16384;
+    for (run = 0; run < NRUN; run++) {
+        for (i = 0; i < count; i++)
+            rect[i] = src[i];
+        t = get_time();
+        r = sg_pack2(rect, count, &size, &maxsize,
+                     (enum sg_pack_method) method, flags, NULL);
+        t = get_time() - t;
+        if (!run || t < best)
+            best = t;
+    }
+    if (r > 0)
+        printf("%6u  %-14s %4s  %10.2f ms  %5u x %-5u  %5.1f%%\n",
+               count, METHOD_NAME[method], flags & SG_PACK_POW2 ? "pow2" : "",
+               best * 1e3, size.width, size.height,
+               100.0 * area / ((double) size.width * size.height));
+    else
+        printf("%6u  %-14s %4s  failed\n", count, METHOD_NAME[method],
+               flags & SG_PACK_POW2 ? "pow2" : "");
+    free(rect);
+}
+
+int
+main(int argc, char **argv)
+{
+    static const unsigned COUNT[] = { 100, 1000, 10000, 100000 };
+    struct sg_pack_rect *rect;
+    unsigned i, j, n;
+    int method;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: bench\n", stderr);
+        return 1;
+    }
+
+    n = COUNT[sizeof(COUNT) / sizeof(*COUNT) - 1];
+    rect = malloc(sizeof(*rect) * n);
+    if (!rect) {
+        fputs("error: out of memory\n", stderr);
+        return 1;
+    }
+    for (i = 0; i < n; i++) {
+        rect[i].w = (sg_irand(&state) % 29) + 4;
+        rect[i].h = (sg_irand(&state) % 29) + 4;
+        rect[i].x = 0;
+        rect[i].y = 0;
+    }
+    for (j = 0; j < sizeof(COUNT) / sizeof(*COUNT); j++) {
+        for (method = 0; method <= SG_PACK_MAXRECTS_AREA; method++)
+            bench(rect, COUNT[j], method, 0);
+        bench(rect, COUNT[j], SG_PACK_SKYLINE_BOTTOMLEFT, SG_PACK_POW2);
+    }
+    free(rect);
+    return 0;
+}
@@ -31,11 +31,47 @@ xmalloc(size_t sz)
     return p;
 }
 
+static const char *const METHOD_NAME[] = {
+    "skyline-bl", "skyline-waste", "maxrects-bl", "maxrects-short",
+    "maxrects-area"
+};
+
+/* Check that the rectangles fit in the size and do not overlap.
+   Rectangles with zero width are skipped.  */
+static void
+check_rects(const struct sg_pack_rect *rect, unsigned count,
+            unsigned width, unsigned height)
+{
+    unsigned i, j;
+    for (i = 0; i < count; i++) {
+        if (!rect[i].w)
+            continue;
+        assert(rect[i].w <= width);
+        assert(rect[i].x <= width - rect[i].w);
+        assert(rect[i].h <= height);
+        assert(rect[i].y <= height - rect[i].h);
+        for (j = i + 1; j < count; j++) {
+            if (rect[j].w &&
+                rect[i].x < rect[j].x + rect[j].w &&
+                rect[i].y < rect[j].y + rect[j].h &&
+                rect[j].x < rect[i].x + rect[i].w &&
+                rect[j].y < rect[i].y + rect[i].h) {
+                puts("Collision");
+                printf("%d x %d @ %d, %d\n",
+                       rect[i].w, rect[i].h, rect[i].x, rect[i].y);
+                printf("%d x %d @ %d, %d\n",
+                       rect[j].w, rect[j].h, rect[j].x, rect[j].y);
+                exit(1);
+            }
+        }
+    }
+}
+
 static void
 test_pack(unsigned count, unsigned rectw, unsigned recth,
-          unsigned packw, unsigned packh)
+          unsigned packw, unsigned packh, int method)
 {
-    unsigned i, j, area, pack_area;
+    unsigned i, area, pack_area;
     unsigned short *dim;
     struct sg_pack_rect *rect;
     struct sg_pack_size sz, maxsz;
@@ -57,7 +93,11 @@ test_pack(unsigned count, unsigned rectw, unsigned recth,
 
     sz.width = 0xffff;
     sz.height = 0xffff;
-    r = sg_pack(rect, count, &sz, &maxsz, NULL);
+    if (method < 0)
+        r = sg_pack(rect, count, &sz, &maxsz, NULL);
+    else
+        r = sg_pack2(rect, count, &sz, &maxsz,
+                     (enum sg_pack_method) method, 0, NULL);
     for (i = 0; i < count; i++) {
         assert(rect[i].w == dim[i*2+0]);
         assert(rect[i].h == dim[i*2+1]);
@@ -67,31 +107,17 @@ test_pack(unsigned count, unsigned rectw, unsigned recth,
         exit(1);
     } else if (r > 0) {
         assert(sz.width > 0);
-        assert((sz.width & (sz.width - 1)) == 0);
         assert(sz.height > 0);
-        assert((sz.height & (sz.height - 1)) == 0);
-        for (i = 0; i < count; i++) {
-            assert(rect[i].w <= sz.width);
-            assert(rect[i].x <= sz.width - rect[i].w);
-            assert(rect[i].h <= sz.height);
-            assert(rect[i].y <= sz.height - rect[i].h);
-            for (j = i + 1; j < count; j++) {
-                if (rect[i].x < rect[j].x + rect[j].w &&
-                    rect[i].y < rect[j].y + rect[j].h &&
-                    rect[j].x < rect[i].x + rect[i].w &&
-                    rect[j].y < rect[i].y + rect[i].h) {
-                    puts("Collision");
-                    printf("%d x %d @ %d, %d\n",
-                           rect[i].w, rect[i].h, rect[i].x, rect[i].y);
-                    printf("%d x %d @ %d, %d\n",
-                           rect[j].w, rect[j].h, rect[j].x, rect[j].y);
-                    exit(1);
-                }
-            }
+        if (method < 0) {
+            assert((sz.width & (sz.width - 1)) == 0);
+            assert((sz.height & (sz.height - 1)) == 0);
         }
+        assert(sz.width <= packw && sz.height <= packh);
+        check_rects(rect, count, sz.width, sz.height);
 
         pack_area = (unsigned) sz.width * (unsigned) sz.height;
-        printf("Rects: %u; size: %d x %d; efficiency: %0.4f\n",
+        printf("%s: rects: %u; size: %d x %d; efficiency: %0.4f\n",
+               method < 0 ? "pow2" : METHOD_NAME[method],
                count, sz.width, sz.height,
                (double) area / (double) pack_area);
     }
@@ -100,18 +126,78 @@ test_pack(unsigned count, unsigned rectw, unsigned recth,
     free(rect);
 }
 
+/* Insert and remove rectangles at random, growing the area when it
+   is full.  */
+static void
+test_incremental(int method)
+{
+    struct sg_pack_rect rect[500];
+    struct sg_pack_size ext;
+    struct sg_packer *pk;
+    unsigned i, j, count = 500, width = 128, height = 128, live = 0;
+    int r;
+
+    pk = sg_packer_new((enum sg_pack_method) method, width, height, NULL);
+    if (!pk)
+        die("sg_packer_new");
+    for (i = 0; i < count; i++)
+        rect[i].w = 0;
+    for (i = 0; i < 20000; i++) {
+        j = sg_irand(&state) % count;
+        if (rect[j].w) {
+            if (sg_packer_remove(pk, &rect[j], NULL))
+                die("sg_packer_remove");
+            rect[j].w = 0;
+            live--;
+            continue;
+        }
+        rect[j].w = (sg_irand(&state) % 24) + 1;
+        rect[j].h = (sg_irand(&state) % 24) + 1;
+        for (;;) {
+            r = sg_packer_insert(pk, &rect[j], NULL);
+            if (r < 0)
+                die("sg_packer_insert");
+            if (r > 0)
+                break;
+            if (width >= 2048)
+                die("packer full");
+            width *= 2;
+            height *= 2;
+            if (sg_packer_grow(pk, width, height, NULL))
+                die("sg_packer_grow");
+        }
+        live++;
+        if (i % 64 == 0)
+            check_rects(rect, count, width, height);
+    }
+    check_rects(rect, count, width, height);
+    sg_packer_extent(pk, &ext);
+    assert(ext.width <= width && ext.height <= height);
+    sg_packer_clear(pk);
+    sg_packer_free(pk);
+    printf("%s: incremental: %u live; size: %u x %u\n",
+           METHOD_NAME[method], live, width, height);
+}
+
 int
 main(int argc, char **argv)
 {
-    int i;
+    int i, method;
     (void) argc;
     (void) argv;
 
-    test_pack(1, 100, 100, 1024, 1024);
+    test_pack(1, 100, 100, 1024, 1024, -1);
     for (i = 0; i < 50; i++)
-        test_pack(100, 100, 100, 1024, 1024);
+        test_pack(100, 100, 100, 1024, 1024, -1);
     for (i = 0; i < 10; i++)
-        test_pack(10000, 32, 32, 4096, 4096);
+        test_pack(10000, 32, 32, 4096, 4096, -1);
+    for (method = 0; method <= SG_PACK_MAXRECTS_AREA; method++) {
+        test_pack(1, 100, 100, 1024, 1024, method);
+        for (i = 0; i < 5; i++)
+            test_pack(100, 100, 100, 1024, 1024, method);
+        test_pack(2000, 32, 32, 4096, 4096, method);
+        test_incremental(method);
+    }
 
     return 0;
 }
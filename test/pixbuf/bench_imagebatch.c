@@ -0,0 +1,98 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Benchmark for batch image loading.  Loads the demo textures and
+   icons repeatedly with sg_image_loadbatch(), with one thread and
+   with more threads up to twice the processor count.  Build with
+   optimization, e.g. "make CFLAGS=-O2".  */
+#define _POSIX_C_SOURCE 200112L
+#include "sg/error.h"
+#include "sg/pixbuf.h"
+#include "sg/thread.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *const IMAGES[] = {
+    "data/imgtest/png_rgb8",
+    "data/imgtest/png_rgba8",
+    "data/imgtest/png_ya8",
+    "data/tex/brick",
+    "data/tex/ivy",
+    "data/tex/roughstone",
+    "icon/icon128",
+    "icon/icon256",
+    "icon/icon512"
+};
+
+#define NIMAGE (sizeof(IMAGES) / sizeof(*IMAGES))
+#define NREQ (NIMAGE * 40)
+#define NRUN 5
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Free each image as it arrives, as a texture loader would after
+   uploading it.  */
+static void
+callback(void *cxt, struct sg_image_request *req, unsigned index)
+{
+    double *pixels = cxt;
+    (void) index;
+    if (req->err) {
+        fprintf(stderr, "error: %s: %s\n", req->path,
+                req->err->msg ? req->err->msg : "unknown error");
+        exit(1);
+    }
+    *pixels += (double) req->pixbuf.width * req->pixbuf.height;
+    free(req->pixbuf.data);
+    req->pixbuf.data = NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+    static struct sg_image_request req[NREQ];
+    double t, best, base = 0.0, pixels;
+    unsigned i;
+    int nthread, maxthread, run;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: bench_imagebatch\n", stderr);
+        return 1;
+    }
+    test_paths(NULL);
+
+    maxthread = 2 * sg_thread_cpucount();
+    if (maxthread < 4)
+        maxthread = 4;
+    printf("%d images, %d processors\n", (int) NREQ, sg_thread_cpucount());
+    for (nthread = 1; nthread <= maxthread; nthread *= 2) {
+        best = 0.0;
+        for (run = 0; run < NRUN; run++) {
+            for (i = 0; i < NREQ; i++) {
+                req[i].path = IMAGES[i % NIMAGE];
+                req[i].pathlen = strlen(req[i].path);
+            }
+            pixels = 0.0;
+            t = get_time();
+            sg_image_loadbatch(req, NREQ, nthread, callback, &pixels);
+            t = get_time() - t;
+            if (!run || t < best)
+                best = t;
+        }
+        if (nthread == 1)
+            base = best;
+        printf("%2d threads  %7.1f ms  %7.1f Mpx/s  %4.2fx\n",
+               nthread, best * 1e3, pixels / best * 1e-6, base / best);
+    }
+    return 0;
+}
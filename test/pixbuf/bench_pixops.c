@@ -0,0 +1,153 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Benchmark for pixel operations on a 1920x1080 image, in megapixels
+   per second.  The "scalar premultiply" row is a plain C loop, for
+   comparison.  Build with optimization, e.g. "make CFLAGS=-O2", and
+   add -U__SSE2__ to measure the scalar code.  */
+#define _POSIX_C_SOURCE 200112L
+#include "sg/pixbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define NRUN 20
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned rand_state = 1618033988;
+
+static unsigned
+rand_next(void)
+{
+    rand_state = rand_state * 1664525u + 1013904223u;
+    return rand_state >> 8;
+}
+
+static void
+scalar_premultiply(struct sg_pixbuf *pbuf)
+{
+    unsigned char *p;
+    unsigned a, c;
+    int x, y, i;
+    for (y = 0; y < pbuf->height; y++) {
+        p = (unsigned char *) pbuf->data + pbuf->rowbytes * y;
+        for (x = 0; x < pbuf->width; x++) {
+            a = p[x*4+3];
+            for (i = 0; i < 3; i++) {
+                c = p[x*4+i] * a;
+                p[x*4+i] = (unsigned char) ((c + 1 + (c >> 8)) >> 8);
+            }
+        }
+    }
+}
+
+static void
+make_pixbuf(struct sg_pixbuf *pbuf, sg_pixbuf_format_t format)
+{
+    size_t i, n;
+    unsigned char *p;
+    pbuf->format = format;
+    pbuf->width = WIDTH;
+    pbuf->height = HEIGHT;
+    pbuf->rowbytes = (int) SG_PIXBUF_FORMATSIZE[format] * WIDTH;
+    n = (size_t) pbuf->rowbytes * HEIGHT;
+    p = malloc(n);
+    if (!p) {
+        fputs("error: out of memory\n", stderr);
+        exit(1);
+    }
+    for (i = 0; i < n; i++)
+        p[i] = (unsigned char) rand_next();
+    pbuf->data = p;
+}
+
+enum {
+    OP_SCALAR_PREMULTIPLY,
+    OP_PREMULTIPLY,
+    OP_UNPREMULTIPLY,
+    OP_SWIZZLE,
+    OP_FLIP,
+    OP_COPYFLIP,
+    OP_CONVERT
+};
+
+static void
+bench(const char *name, int op, sg_pixbuf_format_t sf,
+      sg_pixbuf_format_t df)
+{
+    static const unsigned char BGRA[4] = { 2, 1, 0, 3 };
+    struct sg_pixbuf src, dest;
+    double t, best = 0.0;
+    int i;
+
+    make_pixbuf(&src, sf);
+    make_pixbuf(&dest, df);
+    if (op == OP_COPYFLIP) {
+        src.data = (char *) src.data + src.rowbytes * (HEIGHT - 1);
+        src.rowbytes = -src.rowbytes;
+    }
+    for (i = 0; i < NRUN; i++) {
+        t = get_time();
+        switch (op) {
+        case OP_SCALAR_PREMULTIPLY:
+            scalar_premultiply(&src);
+            break;
+        case OP_PREMULTIPLY:
+            sg_pixbuf_premultiply(&src);
+            break;
+        case OP_UNPREMULTIPLY:
+            sg_pixbuf_unpremultiply(&src);
+            break;
+        case OP_SWIZZLE:
+            sg_pixbuf_swizzle(&src, BGRA);
+            break;
+        case OP_FLIP:
+            sg_pixbuf_flip(&src);
+            break;
+        default:
+            sg_pixbuf_convert(&dest, &src);
+            break;
+        }
+        t = get_time() - t;
+        if (!i || t < best)
+            best = t;
+    }
+    printf("%-22s %8.1f Mpx/s\n", name, WIDTH * HEIGHT / best * 1e-6);
+    if (op == OP_COPYFLIP)
+        src.data = (char *) src.data + src.rowbytes * (HEIGHT - 1);
+    free(src.data);
+    free(dest.data);
+}
+
+int
+main(int argc, char **argv)
+{
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: bench_pixops\n", stderr);
+        return 1;
+    }
+    bench("scalar premultiply", OP_SCALAR_PREMULTIPLY, SG_RGBA, SG_RGBA);
+    bench("premultiply", OP_PREMULTIPLY, SG_RGBA, SG_RGBA);
+    bench("unpremultiply", OP_UNPREMULTIPLY, SG_RGBA, SG_RGBA);
+    bench("swizzle RGBA to BGRA", OP_SWIZZLE, SG_RGBA, SG_RGBA);
+    bench("flip RGBA", OP_FLIP, SG_RGBA, SG_RGBA);
+    bench("copy and flip RGBA", OP_COPYFLIP, SG_RGBA, SG_RGBA);
+    bench("convert R to RG", OP_CONVERT, SG_R, SG_RG);
+    bench("convert R to RGBA", OP_CONVERT, SG_R, SG_RGBA);
+    bench("convert RG to R", OP_CONVERT, SG_RG, SG_R);
+    bench("convert RG to RGBA", OP_CONVERT, SG_RG, SG_RGBA);
+    bench("convert RGBA to R", OP_CONVERT, SG_RGBA, SG_R);
+    bench("convert RGBA to RG", OP_CONVERT, SG_RGBA, SG_RG);
+    bench("convert RGBX to RGBA", OP_CONVERT, SG_RGBX, SG_RGBA);
+    return 0;
+}
@@ -0,0 +1,164 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Benchmark for writing PNG images.  Screenshot sized images, 1080p
+   and 4K, are tiled from the demo textures and written with LibPNG
+   and with the parallel writer at several settings and thread counts.
+   Build with optimization, e.g. "make CFLAGS=-O2".  */
+#define _POSIX_C_SOURCE 200809L
+#include "sg/error.h"
+#include "sg/pixbuf.h"
+#include "sg/thread.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *const TEXTURES[] = {
+    "data/tex/brick",
+    "data/tex/ivy",
+    "data/tex/roughstone"
+};
+
+#define NTEXTURE (sizeof(TEXTURES) / sizeof(*TEXTURES))
+#define NRUN 3
+
+static const char OUTPUT[] = "bench.png";
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Make an image from a grid of textures, with a flat colored band
+   across the middle like a user interface.  */
+static void
+make_image(struct sg_pixbuf *pbuf, const struct sg_pixbuf *tex,
+           int width, int height)
+{
+    const struct sg_pixbuf *t;
+    unsigned char *p;
+    int x, y;
+    xalloc(pbuf, SG_RGBX, width, height);
+    for (y = 0; y < height; y++) {
+        p = (unsigned char *) pbuf->data + pbuf->rowbytes * y;
+        for (x = 0; x < width; x++) {
+            if (y > height * 2 / 5 && y < height * 3 / 5) {
+                p[x*4+0] = 40;
+                p[x*4+1] = 60;
+                p[x*4+2] = (unsigned char) (80 + x * 100 / width);
+                p[x*4+3] = 255;
+                continue;
+            }
+            t = &tex[(x / 256 + y / 256) % NTEXTURE];
+            memcpy(p + x * 4, (const char *) t->data +
+                   t->rowbytes * (y % t->height) + (x % t->width) * 4, 4);
+        }
+    }
+}
+
+static long
+file_size(const char *dir)
+{
+    char path[64];
+    struct stat st;
+    sprintf(path, "%s/%s", dir, OUTPUT);
+    if (stat(path, &st))
+        return -1;
+    return (long) st.st_size;
+}
+
+/* Write the image and return the best time.  */
+static double
+bench(struct sg_pixbuf *pbuf, const struct sg_pngopts *opts)
+{
+    struct sg_error *err = NULL;
+    double t, best = 0.0;
+    int run, r;
+    for (run = 0; run < NRUN; run++) {
+        t = get_time();
+        if (opts)
+            r = sg_pixbuf_writepngopts(pbuf, OUTPUT, strlen(OUTPUT),
+                                       opts, &err);
+        else
+            r = sg_pixbuf_writepng(pbuf, OUTPUT, strlen(OUTPUT), &err);
+        t = get_time() - t;
+        if (r) {
+            fputs("error: could not write image\n", stderr);
+            exit(1);
+        }
+        if (!run || t < best)
+            best = t;
+    }
+    return best;
+}
+
+int
+main(int argc, char **argv)
+{
+    static const int SIZES[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+    static const struct sg_pngopts OPTS[] = {
+        { 1, SG_PNG_FILTER_UP, 0 },
+        { 1, SG_PNG_FILTER_ADAPTIVE, 0 },
+        { 3, SG_PNG_FILTER_ADAPTIVE, 0 },
+        { 6, SG_PNG_FILTER_ADAPTIVE, 0 }
+    };
+    char tmpdir[] = "/tmp/sgbench.XXXXXX", buf[64];
+    struct sg_pixbuf tex[NTEXTURE], pbuf;
+    struct sg_pngopts opts;
+    double t, base;
+    unsigned i, j;
+    int nthread, maxthread;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: bench_pngwrite\n", stderr);
+        return 1;
+    }
+    if (!mkdtemp(tmpdir)) {
+        fputs("error: could not create temporary directory\n", stderr);
+        return 1;
+    }
+    test_paths(tmpdir);
+
+    for (i = 0; i < NTEXTURE; i++)
+        load_pixbuf(&tex[i], SG_RGBX, TEXTURES[i]);
+
+    maxthread = 2 * sg_thread_cpucount();
+    if (maxthread < 4)
+        maxthread = 4;
+    printf("%d processors\n", sg_thread_cpucount());
+    for (i = 0; i < sizeof(SIZES) / sizeof(*SIZES); i++) {
+        make_image(&pbuf, tex, SIZES[i][0], SIZES[i][1]);
+        printf("%dx%d\n", SIZES[i][0], SIZES[i][1]);
+        base = bench(&pbuf, NULL);
+        printf("  LibPNG                %7.1f ms  %8ld bytes\n",
+               base * 1e3, file_size(tmpdir));
+        for (j = 0; j < sizeof(OPTS) / sizeof(*OPTS); j++) {
+            opts = OPTS[j];
+            for (nthread = 1; nthread <= maxthread; nthread *= 2) {
+                opts.nthread = nthread;
+                t = bench(&pbuf, &opts);
+                printf("  level %d %-8s %2d thr  %7.1f ms  %8ld bytes"
+                       "  %5.2fx\n",
+                       opts.level,
+                       opts.filter == SG_PNG_FILTER_UP ? "up" : "adaptive",
+                       nthread, t * 1e3, file_size(tmpdir), base / t);
+            }
+        }
+        free(pbuf.data);
+    }
+
+    for (i = 0; i < NTEXTURE; i++)
+        free(tex[i].data);
+    sprintf(buf, "%s/%s", tmpdir, OUTPUT);
+    unlink(buf);
+    rmdir(tmpdir);
+    return 0;
+}
@@ -0,0 +1,137 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Benchmark for mipmap generation and block compression.  A 1024x1024
+   image is tiled from a demo texture, then a full mipmap chain is
+   generated with each filter, and the image is compressed in each
+   format with one thread and with more threads up to twice the
+   processor count.  Build with optimization, e.g. "make CFLAGS=-O2".  */
+#define _POSIX_C_SOURCE 200112L
+#include "sg/error.h"
+#include "sg/pixbuf.h"
+#include "sg/thread.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char IMAGE[] = "data/tex/brick";
+
+#define SIZE 1024
+#define NRUN 5
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+load(struct sg_pixbuf *pbuf)
+{
+    struct sg_pixbuf tile;
+    int x, y, n;
+    load_pixbuf(&tile, SG_RGBA, IMAGE);
+    xalloc(pbuf, SG_RGBA, SIZE, SIZE);
+    for (y = 0; y < SIZE; y++) {
+        for (x = 0; x < SIZE; x += tile.width) {
+            n = SIZE - x < tile.width ? SIZE - x : tile.width;
+            memcpy((char *) pbuf->data + pbuf->rowbytes * y + x * 4,
+                   (char *) tile.data + tile.rowbytes * (y % tile.height),
+                   n * 4);
+        }
+    }
+    free(tile.data);
+}
+
+/* Generate the full mipmap chain, and return the time taken.  */
+static double
+bench_mipmap(const struct sg_pixbuf *src, sg_mipmap_filter_t filter)
+{
+    struct sg_pixbuf level[2];
+    const struct sg_pixbuf *prev = src;
+    double t;
+    int i, n = sg_pixbuf_miplevels(src->width, src->height);
+    level[0].data = level[1].data = NULL;
+    t = get_time();
+    for (i = 1; i < n; i++) {
+        free(level[i & 1].data);
+        xalloc(&level[i & 1], src->format,
+               prev->width > 1 ? prev->width >> 1 : 1,
+               prev->height > 1 ? prev->height >> 1 : 1);
+        sg_pixbuf_mipmap(&level[i & 1], prev, filter, SG_MIPMAP_SRGB, NULL);
+        prev = &level[i & 1];
+    }
+    t = get_time() - t;
+    free(level[0].data);
+    free(level[1].data);
+    return t;
+}
+
+int
+main(int argc, char **argv)
+{
+    static const char *const FILTERS[] = { "box", "Kaiser" };
+    struct sg_pixbuf src, gray;
+    struct sg_cpixbuf cbuf;
+    sg_cpixbuf_format_t format;
+    double t, best, base = 0.0, pixels = (double) SIZE * SIZE;
+    int filter, nthread, maxthread, run;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: bench_texcomp\n", stderr);
+        return 1;
+    }
+    test_paths(NULL);
+
+    load(&src);
+    xalloc(&gray, SG_R, SIZE, SIZE);
+    sg_pixbuf_convert(&gray, &src);
+
+    printf("%dx%d image, %d processors\n",
+           SIZE, SIZE, sg_thread_cpucount());
+    for (filter = 0; filter < 2; filter++) {
+        best = 0.0;
+        for (run = 0; run < NRUN; run++) {
+            t = bench_mipmap(&src, (sg_mipmap_filter_t) filter);
+            if (!run || t < best)
+                best = t;
+        }
+        printf("mipmap %-6s  %7.1f ms  %7.1f Mpx/s\n",
+               FILTERS[filter], best * 1e3, pixels / best * 1e-6);
+    }
+
+    maxthread = 2 * sg_thread_cpucount();
+    if (maxthread < 4)
+        maxthread = 4;
+    for (format = SG_BC1; format < SG_CPIXBUF_NFORMAT; format++) {
+        if (sg_cpixbuf_alloc(&cbuf, format, SIZE, SIZE, NULL)) {
+            fputs("error: out of memory\n", stderr);
+            return 1;
+        }
+        for (nthread = 1; nthread <= maxthread; nthread *= 2) {
+            best = 0.0;
+            for (run = 0; run < NRUN; run++) {
+                t = get_time();
+                sg_cpixbuf_encode(&cbuf, format == SG_BC4 ? &gray : &src,
+                                  nthread, NULL);
+                t = get_time() - t;
+                if (!run || t < best)
+                    best = t;
+            }
+            if (nthread == 1)
+                base = best;
+            printf("%s %2d threads  %7.1f ms  %7.1f Mpx/s  %4.2fx\n",
+                   SG_CPIXBUF_FORMATNAME[format], nthread, best * 1e3,
+                   pixels / best * 1e-6, base / best);
+        }
+        free(cbuf.data);
+    }
+    free(src.data);
+    free(gray.data);
+    return 0;
+}
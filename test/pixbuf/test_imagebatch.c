@@ -0,0 +1,140 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Test batch image loading.  The demo images are loaded with several
+   threads, and the results must match loading on one thread and be
+   delivered in order.  A missing image must fail without affecting
+   the others.  */
+#include "sg/error.h"
+#include "sg/pixbuf.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const IMAGES[] = {
+    "data/imgtest/png_i4",
+    "data/imgtest/png_i8",
+    "data/imgtest/png_ia4",
+    "data/imgtest/png_ia8",
+    "data/imgtest/png_rgb16",
+    "data/imgtest/png_rgb8",
+    "data/imgtest/png_rgba16",
+    "data/imgtest/png_rgba8",
+    "data/imgtest/png_y1",
+    "data/imgtest/png_y16",
+    "data/imgtest/png_y2",
+    "data/imgtest/png_y4",
+    "data/imgtest/png_y8",
+    "data/imgtest/png_ya16",
+    "data/imgtest/png_ya8",
+    "data/tex/brick",
+    "data/tex/ivy",
+    "data/tex/roughstone",
+    "icon/icon256",
+    "data/missing"
+};
+
+#define NIMAGE (sizeof(IMAGES) / sizeof(*IMAGES))
+#define NREQ (NIMAGE * 5)
+
+static int failed;
+static unsigned nextindex;
+
+static void
+callback(void *cxt, struct sg_image_request *req, unsigned index)
+{
+    struct sg_image_request *base = cxt;
+    if (index != nextindex || req != base + index) {
+        fprintf(stderr, "FAIL: delivered %u, expected %u\n",
+                index, nextindex);
+        failed = 1;
+    }
+    nextindex = index + 1;
+}
+
+static void
+init_requests(struct sg_image_request *req)
+{
+    unsigned i;
+    for (i = 0; i < NREQ; i++) {
+        req[i].path = IMAGES[i % NIMAGE];
+        req[i].pathlen = strlen(req[i].path);
+    }
+}
+
+static int
+same_image(const struct sg_image_request *x,
+           const struct sg_image_request *y)
+{
+    int j;
+    size_t n;
+    if (!x->pixbuf.data || !y->pixbuf.data)
+        return !x->pixbuf.data && !y->pixbuf.data;
+    if (x->flags != y->flags || x->pixbuf.format != y->pixbuf.format ||
+        x->pixbuf.width != y->pixbuf.width ||
+        x->pixbuf.height != y->pixbuf.height)
+        return 0;
+    n = SG_PIXBUF_FORMATSIZE[x->pixbuf.format] * x->pixbuf.width;
+    for (j = 0; j < x->pixbuf.height; j++)
+        if (memcmp((char *) x->pixbuf.data + x->pixbuf.rowbytes * j,
+                   (char *) y->pixbuf.data + y->pixbuf.rowbytes * j, n))
+            return 0;
+    return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+    static struct sg_image_request ref[NREQ], req[NREQ];
+    unsigned i;
+    int r, nthread;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: test_imagebatch\n", stderr);
+        return 1;
+    }
+    test_paths(NULL);
+
+    init_requests(ref);
+    r = sg_image_loadbatch(ref, NREQ, 1, NULL, NULL);
+    if (!r) {
+        fputs("FAIL: missing image loaded\n", stderr);
+        failed = 1;
+    }
+    for (i = 0; i < NREQ; i++) {
+        if ((i % NIMAGE == NIMAGE - 1) != (ref[i].err != NULL)) {
+            fprintf(stderr, "FAIL: %s: wrong result\n", ref[i].path);
+            failed = 1;
+        }
+    }
+
+    for (nthread = 2; nthread <= 8; nthread *= 2) {
+        init_requests(req);
+        nextindex = 0;
+        r = sg_image_loadbatch(req, NREQ, nthread, callback, req);
+        if (!r || nextindex != NREQ) {
+            fputs("FAIL: wrong result from batch\n", stderr);
+            failed = 1;
+        }
+        for (i = 0; i < NREQ; i++) {
+            if (!same_image(&ref[i], &req[i])) {
+                fprintf(stderr, "FAIL: %s: different with %d threads\n",
+                        req[i].path, nthread);
+                failed = 1;
+            }
+            free(req[i].pixbuf.data);
+            sg_error_clear(&req[i].err);
+        }
+    }
+
+    for (i = 0; i < NREQ; i++) {
+        free(ref[i].pixbuf.data);
+        sg_error_clear(&ref[i].err);
+    }
+    if (failed)
+        return 1;
+    fputs("ok\n", stderr);
+    return 0;
+}
@@ -0,0 +1,270 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Test reduced image decoding.  Reduced PNG images must exactly match
+   the full size image averaged over each block, including partial
+   blocks on the edges.  Reduced JPEG images are scaled by LibJPEG, so
+   they only need to be close.  */
+#define _POSIX_C_SOURCE 200809L
+#include "sg/error.h"
+#include "sg/pixbuf.h"
+#include "src/pixbuf/private.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Offset of the image in the target buffer, and padding around it.  */
+#define OFFSET 3
+#define FILL 0x5a
+
+static int failed;
+
+static unsigned rand_state = 1618033988;
+
+static unsigned
+rand_next(void)
+{
+    rand_state = rand_state * 1664525u + 1013904223u;
+    return rand_state >> 8;
+}
+
+/* Allocate an RGBA buffer filled with FILL.  */
+static void *
+alloc_fill(struct sg_pixbuf *pbuf, int width, int height)
+{
+    xalloc(pbuf, SG_RGBA, width, height);
+    memset(pbuf->data, FILL, (size_t) pbuf->rowbytes * height);
+    return pbuf->data;
+}
+
+/* Reduce an image by averaging, the slow way.  */
+static void
+ref_reduce(struct sg_pixbuf *dest, const struct sg_pixbuf *src, int shift)
+{
+    const unsigned char *p;
+    unsigned char *q;
+    unsigned sum[4], count;
+    int x, y, i, j, c, n = 1 << shift;
+    for (y = 0; y < dest->height; y++) {
+        for (x = 0; x < dest->width; x++) {
+            memset(sum, 0, sizeof(sum));
+            count = 0;
+            for (j = y * n; j < (y + 1) * n && j < src->height; j++) {
+                for (i = x * n; i < (x + 1) * n && i < src->width; i++) {
+                    p = (const unsigned char *) src->data +
+                        src->rowbytes * j + i * 4;
+                    for (c = 0; c < 4; c++)
+                        sum[c] += p[c];
+                    count++;
+                }
+            }
+            q = (unsigned char *) dest->data + dest->rowbytes * y + x * 4;
+            for (c = 0; c < 4; c++)
+                q[c] = (unsigned char) ((sum[c] + count / 2) / count);
+        }
+    }
+}
+
+/* Compare the reduced image with the reference, and check that the
+   pixels around it are unmodified.  Return the largest difference in
+   any channel, and store the average difference.  */
+static int
+compare(const struct sg_pixbuf *pbuf, const struct sg_pixbuf *ref,
+        double *avgdiff)
+{
+    const unsigned char *p, *q;
+    int x, y, c, d, maxdiff = 0;
+    double total = 0.0;
+    for (y = 0; y < pbuf->height; y++) {
+        for (x = 0; x < pbuf->width; x++) {
+            p = (const unsigned char *) pbuf->data +
+                pbuf->rowbytes * y + x * 4;
+            if (x < OFFSET || x >= OFFSET + ref->width ||
+                y < OFFSET || y >= OFFSET + ref->height) {
+                for (c = 0; c < 4; c++)
+                    if (p[c] != FILL)
+                        return 256;
+                continue;
+            }
+            q = (const unsigned char *) ref->data +
+                ref->rowbytes * (y - OFFSET) + (x - OFFSET) * 4;
+            for (c = 0; c < 4; c++) {
+                d = p[c] > q[c] ? p[c] - q[c] : q[c] - p[c];
+                if (d > maxdiff)
+                    maxdiff = d;
+                total += d;
+            }
+        }
+    }
+    *avgdiff = total / (4.0 * ref->width * ref->height);
+    return maxdiff;
+}
+
+/* Test all reductions of an image.  The reduced PNG images must be
+   exact, and reduced JPEG images must be close.  */
+static void
+test_image(const char *path, int exact)
+{
+    struct sg_image *img;
+    struct sg_pixbuf full, ref, pbuf;
+    struct sg_error *err = NULL;
+    int shift, w, h, maxdiff, pass, r;
+    double avgdiff = 0.0;
+
+    img = load_image(path);
+    alloc_fill(&full, img->width, img->height);
+    if (img->draw(img, &full, 0, 0, NULL)) {
+        fprintf(stderr, "FAIL: %s: could not draw image\n", path);
+        failed = 1;
+        return;
+    }
+    img->free(img);
+
+    for (shift = 0; shift <= 8; shift++) {
+        w = SG_IMAGE_REDUCE(full.width, shift);
+        h = SG_IMAGE_REDUCE(full.height, shift);
+        alloc_fill(&ref, w, h);
+        ref_reduce(&ref, &full, shift);
+        for (pass = 0; pass < 2; pass++) {
+            img = load_image(path);
+            alloc_fill(&pbuf, w + OFFSET * 2, h + OFFSET * 2);
+            if (pass == 0)
+                r = sg_image_drawscaled(img, &pbuf, OFFSET, OFFSET,
+                                        w, h, &err);
+            else
+                r = sg_image_drawreduced(img, &pbuf, OFFSET, OFFSET,
+                                         shift, &err);
+            img->free(img);
+            if (r) {
+                fprintf(stderr, "FAIL: %s: shift %d: draw failed\n",
+                        path, shift);
+                sg_error_clear(&err);
+                failed = 1;
+            } else {
+                maxdiff = compare(&pbuf, &ref, &avgdiff);
+                if (exact ? maxdiff != 0 :
+                    (maxdiff > 64 || avgdiff > 2.0)) {
+                    fprintf(stderr, "FAIL: %s: shift %d%s: "
+                            "max diff %d, avg diff %.2f\n",
+                            path, shift, pass ? " (full decode)" : "",
+                            maxdiff, avgdiff);
+                    failed = 1;
+                }
+            }
+            free(pbuf.data);
+        }
+        free(ref.data);
+    }
+    free(full.data);
+}
+
+static void
+test_png(const char *name, sg_pixbuf_format_t format, int width,
+         int height)
+{
+    struct sg_pixbuf pbuf;
+    struct sg_error *err = NULL;
+    unsigned char *p;
+    char path[32];
+    size_t i, n;
+    int a;
+
+    if (sg_pixbuf_alloc(&pbuf, format, width, height, NULL)) {
+        fputs("error: out of memory\n", stderr);
+        exit(1);
+    }
+    p = pbuf.data;
+    n = (size_t) pbuf.rowbytes * height;
+    for (i = 0; i < n; i += 4) {
+        p[i+0] = (unsigned char) rand_next();
+        p[i+1] = (unsigned char) rand_next();
+        p[i+2] = (unsigned char) rand_next();
+        a = (int) (rand_next() % 4);
+        p[i+3] = (unsigned char) (a == 0 ? 0 : a == 1 ? 255 : rand_next());
+    }
+    sprintf(path, "%s.png", name);
+    if (sg_pixbuf_writepng(&pbuf, path, strlen(path), &err)) {
+        fprintf(stderr, "error: %s: could not write image\n", path);
+        exit(1);
+    }
+    free(pbuf.data);
+    test_image(name, 1);
+}
+
+static void
+test_size(void)
+{
+    static const int SIZES[][5] = {
+        /* target width, height; shift, width, height */
+        { 77, 53, 0, 77, 53 },
+        { 100, 100, 0, 77, 53 },
+        { 30, 20, 1, 39, 27 },
+        { 10, 10, 2, 20, 14 },
+        { 10, 7, 3, 10, 7 },
+        { 1, 1, 7, 1, 1 },
+        { 0, 0, 7, 1, 1 }
+    };
+    struct sg_image img;
+    struct sg_pixbuf pbuf;
+    struct sg_error *err = NULL;
+    int i, shift, w, h;
+
+    img.width = 77;
+    img.height = 53;
+    for (i = 0; i < (int) (sizeof(SIZES) / sizeof(*SIZES)); i++) {
+        shift = sg_image_scaledsize(&img, SIZES[i][0], SIZES[i][1], &w, &h);
+        if (shift != SIZES[i][2] || w != SIZES[i][3] || h != SIZES[i][4]) {
+            fprintf(stderr, "FAIL: scaled size for %dx%d is %dx%d\n",
+                    SIZES[i][0], SIZES[i][1], w, h);
+            failed = 1;
+        }
+    }
+
+    /* Sizes which are not reductions must be rejected.  */
+    alloc_fill(&pbuf, 64, 64);
+    if (!sg_image_drawscaled(&img, &pbuf, 0, 0, 39, 26, &err) || !err) {
+        fputs("FAIL: drawscaled accepted invalid size\n", stderr);
+        failed = 1;
+    }
+    sg_error_clear(&err);
+    free(pbuf.data);
+}
+
+int
+main(int argc, char **argv)
+{
+    static const char *const NAMES[] = { "alpha", "opaque" };
+    char tmpdir[] = "/tmp/sgtest.XXXXXX", buf[64];
+    unsigned i;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: test_imagescale\n", stderr);
+        return 1;
+    }
+    if (!mkdtemp(tmpdir)) {
+        fputs("error: could not create temporary directory\n", stderr);
+        return 1;
+    }
+    test_paths(tmpdir);
+
+    test_size();
+    test_png(NAMES[0], SG_RGBA, 77, 53);
+    test_png(NAMES[1], SG_RGBX, 130, 3);
+    test_image("data/imgtest/png_ia8", 1);
+    test_image("data/tex/brick", 0);
+    test_image("data/tex/ivy", 0);
+    test_image("data/tex/roughstone", 0);
+
+    for (i = 0; i < sizeof(NAMES) / sizeof(*NAMES); i++) {
+        sprintf(buf, "%s/%s.png", tmpdir, NAMES[i]);
+        unlink(buf);
+    }
+    rmdir(tmpdir);
+    if (failed)
+        return 1;
+    fputs("ok\n", stderr);
+    return 0;
+}
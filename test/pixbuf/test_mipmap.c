@@ -0,0 +1,310 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Test mipmap generation.  The box filter is compared with a slow
+   reference, constant images must stay constant, and sRGB filtering
+   must average in linear space.  Build with "make CFLAGS=-U__SSE2__"
+   to test the scalar code.  */
+#include "sg/error.h"
+#include "sg/pixbuf.h"
+#include "testutil.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failed;
+
+static unsigned rand_state = 1618033988;
+
+static unsigned
+rand_next(void)
+{
+    rand_state = rand_state * 1664525u + 1013904223u;
+    return rand_state >> 8;
+}
+
+static void
+next_level(struct sg_pixbuf *dest, const struct sg_pixbuf *src)
+{
+    xalloc(dest, src->format,
+           src->width > 1 ? src->width >> 1 : 1,
+           src->height > 1 ? src->height >> 1 : 1);
+}
+
+static unsigned char *
+pixel(const struct sg_pixbuf *pbuf, int x, int y)
+{
+    return (unsigned char *) pbuf->data + pbuf->rowbytes * y +
+        SG_PIXBUF_FORMATSIZE[pbuf->format] * x;
+}
+
+static void
+test_levels(void)
+{
+    static const int LEVELS[][3] = {
+        { 1, 1, 1 }, { 2, 1, 2 }, { 256, 256, 9 }, { 1025, 3, 11 }
+    };
+    unsigned i;
+    int n;
+    for (i = 0; i < sizeof(LEVELS) / sizeof(*LEVELS); i++) {
+        n = sg_pixbuf_miplevels(LEVELS[i][0], LEVELS[i][1]);
+        if (n != LEVELS[i][2]) {
+            fprintf(stderr, "FAIL: %dx%d has %d levels, expected %d\n",
+                    LEVELS[i][0], LEVELS[i][1], n, LEVELS[i][2]);
+            failed = 1;
+        }
+    }
+}
+
+/* A constant image must not change, for any filter or format.  */
+static void
+test_constant(void)
+{
+    static const int SIZES[][2] = { { 13, 7 }, { 1, 9 }, { 64, 64 } };
+    struct sg_pixbuf src, dest;
+    sg_pixbuf_format_t format;
+    unsigned char value[4] = { 17, 200, 93, 140 }, expect[4];
+    int x, y, filter, flags, psz;
+    unsigned i;
+
+    for (format = SG_R; format <= SG_RGBA; format++) {
+        psz = (int) SG_PIXBUF_FORMATSIZE[format];
+        memcpy(expect, value, 4);
+        if (format == SG_RGBX)
+            expect[3] = 255;
+        for (i = 0; i < sizeof(SIZES) / sizeof(*SIZES); i++) {
+            xalloc(&src, format, SIZES[i][0], SIZES[i][1]);
+            for (y = 0; y < src.height; y++)
+                for (x = 0; x < src.width; x++)
+                    memcpy(pixel(&src, x, y), value, psz);
+            next_level(&dest, &src);
+            for (filter = 0; filter < 2; filter++) {
+                for (flags = 0; flags < 2; flags++) {
+                    if (sg_pixbuf_mipmap(
+                            &dest, &src, (sg_mipmap_filter_t) filter,
+                            flags ? SG_MIPMAP_SRGB : 0, NULL)) {
+                        fputs("FAIL: mipmap failed\n", stderr);
+                        failed = 1;
+                        continue;
+                    }
+                    for (y = 0; y < dest.height; y++) {
+                        for (x = 0; x < dest.width; x++) {
+                            if (memcmp(pixel(&dest, x, y), expect, psz))
+                                goto fail;
+                        }
+                    }
+                    continue;
+                fail:
+                    fprintf(stderr, "FAIL: constant %s %dx%d, "
+                            "filter %d, flags %d\n",
+                            SG_PIXBUF_FORMATNAME[format],
+                            src.width, src.height, filter, flags);
+                    failed = 1;
+                }
+            }
+            free(src.data);
+            free(dest.data);
+        }
+    }
+}
+
+/* A black and white checkerboard averages to 50% linear gray, which
+   is 188 in sRGB.  Alpha is always linear.  */
+static void
+test_srgb(void)
+{
+    struct sg_pixbuf src, dest;
+    unsigned char *p, v;
+    int x, y, flags, i;
+
+    xalloc(&src, SG_RGBA, 8, 8);
+    xalloc(&dest, SG_RGBA, 4, 4);
+    for (y = 0; y < 8; y++) {
+        for (x = 0; x < 8; x++) {
+            v = (x ^ y) & 1 ? 255 : 0;
+            memset(pixel(&src, x, y), v, 4);
+        }
+    }
+    for (flags = 0; flags < 2; flags++) {
+        sg_pixbuf_mipmap(&dest, &src, SG_MIPMAP_BOX,
+                         flags ? SG_MIPMAP_SRGB : 0, NULL);
+        for (y = 0; y < 4; y++) {
+            for (x = 0; x < 4; x++) {
+                p = pixel(&dest, x, y);
+                for (i = 0; i < 4; i++) {
+                    if (p[i] != (flags && i < 3 ? 188 : 128)) {
+                        fprintf(stderr, "FAIL: checkerboard, flags %d: "
+                                "got %d\n", flags, p[i]);
+                        failed = 1;
+                        return;
+                    }
+                }
+            }
+        }
+    }
+    free(src.data);
+    free(dest.data);
+}
+
+/* Reference box filter, covering the exact area of each pixel.  */
+static void
+ref_box(struct sg_pixbuf *dest, const struct sg_pixbuf *src)
+{
+    double rx = (double) src->width / dest->width,
+        ry = (double) src->height / dest->height, sum[4], w, wx, wy, a, b;
+    int x, y, i, j, c;
+    unsigned char *p;
+    for (y = 0; y < dest->height; y++) {
+        for (x = 0; x < dest->width; x++) {
+            memset(sum, 0, sizeof(sum));
+            for (j = 0; j < src->height; j++) {
+                a = y * ry > j ? y * ry : j;
+                b = (y + 1) * ry < j + 1 ? (y + 1) * ry : j + 1;
+                wy = b - a;
+                if (wy <= 0.0)
+                    continue;
+                for (i = 0; i < src->width; i++) {
+                    a = x * rx > i ? x * rx : i;
+                    b = (x + 1) * rx < i + 1 ? (x + 1) * rx : i + 1;
+                    wx = b - a;
+                    if (wx <= 0.0)
+                        continue;
+                    w = wx * wy / (rx * ry);
+                    p = pixel(src, i, j);
+                    for (c = 0; c < 4; c++)
+                        sum[c] += w * p[c];
+                }
+            }
+            p = pixel(dest, x, y);
+            for (c = 0; c < 4; c++)
+                p[c] = (unsigned char) floor(sum[c] + 0.5);
+        }
+    }
+}
+
+/* Compare the box filter with the reference on random images, down to
+   a single pixel.  */
+static void
+test_box(void)
+{
+    static const int SIZES[][2] = { { 77, 53 }, { 16, 3 }, { 2, 31 } };
+    struct sg_pixbuf src, dest, ref;
+    unsigned char *p, *q;
+    unsigned i;
+    int x, y, c, d, maxdiff;
+    size_t j, n;
+
+    for (i = 0; i < sizeof(SIZES) / sizeof(*SIZES); i++) {
+        xalloc(&src, SG_RGBA, SIZES[i][0], SIZES[i][1]);
+        n = (size_t) src.rowbytes * src.height;
+        for (j = 0; j < n; j++)
+            ((unsigned char *) src.data)[j] = (unsigned char) rand_next();
+        while (src.width > 1 || src.height > 1) {
+            next_level(&dest, &src);
+            next_level(&ref, &src);
+            sg_pixbuf_mipmap(&dest, &src, SG_MIPMAP_BOX, 0, NULL);
+            ref_box(&ref, &src);
+            maxdiff = 0;
+            for (y = 0; y < dest.height; y++) {
+                for (x = 0; x < dest.width; x++) {
+                    p = pixel(&dest, x, y);
+                    q = pixel(&ref, x, y);
+                    for (c = 0; c < 4; c++) {
+                        d = abs(p[c] - q[c]);
+                        if (d > maxdiff)
+                            maxdiff = d;
+                    }
+                }
+            }
+            if (maxdiff > 1) {
+                fprintf(stderr, "FAIL: box %dx%d: max diff %d\n",
+                        src.width, src.height, maxdiff);
+                failed = 1;
+            }
+            free(src.data);
+            free(ref.data);
+            src = dest;
+        }
+        free(src.data);
+    }
+}
+
+/* The Kaiser filter should be close to the box filter on a smooth
+   image.  */
+static void
+test_kaiser(void)
+{
+    struct sg_pixbuf src, box, kaiser;
+    double err = 0.0, psnr;
+    unsigned char *p, *q;
+    int x, y, c;
+
+    xalloc(&src, SG_RGBX, 200, 120);
+    for (y = 0; y < src.height; y++) {
+        for (x = 0; x < src.width; x++) {
+            p = pixel(&src, x, y);
+            p[0] = (unsigned char) (128 + 100 * sin(x * 0.05));
+            p[1] = (unsigned char) (128 + 100 * cos(y * 0.07));
+            p[2] = (unsigned char) (x + y);
+            p[3] = 255;
+        }
+    }
+    next_level(&box, &src);
+    next_level(&kaiser, &src);
+    sg_pixbuf_mipmap(&box, &src, SG_MIPMAP_BOX, SG_MIPMAP_SRGB, NULL);
+    sg_pixbuf_mipmap(&kaiser, &src, SG_MIPMAP_KAISER, SG_MIPMAP_SRGB, NULL);
+    for (y = 0; y < box.height; y++) {
+        for (x = 0; x < box.width; x++) {
+            p = pixel(&box, x, y);
+            q = pixel(&kaiser, x, y);
+            for (c = 0; c < 3; c++)
+                err += (double) (p[c] - q[c]) * (p[c] - q[c]);
+        }
+    }
+    err /= 3.0 * box.width * box.height;
+    psnr = err > 0.0 ? 10.0 * log10(255.0 * 255.0 / err) : 99.0;
+    if (psnr < 40.0) {
+        fprintf(stderr, "FAIL: Kaiser PSNR %.1f dB\n", psnr);
+        failed = 1;
+    }
+    free(src.data);
+    free(box.data);
+    free(kaiser.data);
+}
+
+static void
+test_invalid(void)
+{
+    struct sg_pixbuf src, dest;
+    struct sg_error *err = NULL;
+    xalloc(&src, SG_RGBA, 10, 10);
+    xalloc(&dest, SG_RGBA, 6, 5);
+    if (!sg_pixbuf_mipmap(&dest, &src, SG_MIPMAP_BOX, 0, &err) || !err) {
+        fputs("FAIL: mipmap accepted wrong size\n", stderr);
+        failed = 1;
+    }
+    sg_error_clear(&err);
+    free(src.data);
+    free(dest.data);
+}
+
+int
+main(int argc, char **argv)
+{
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: test_mipmap\n", stderr);
+        return 1;
+    }
+    test_levels();
+    test_constant();
+    test_srgb();
+    test_box();
+    test_kaiser();
+    test_invalid();
+    if (failed)
+        return 1;
+    fputs("ok\n", stderr);
+    return 0;
+}
@@ -0,0 +1,104 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Test pixel buffer allocation.  Rows must be aligned and no larger
+   than necessary, unless power of two dimensions are requested.  */
+#include "sg/error.h"
+#include "sg/pixbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static int failed;
+
+static int
+pow2(int x)
+{
+    int y = 1;
+    while (y < x)
+        y *= 2;
+    return y;
+}
+
+static void
+test_alloc(sg_pixbuf_format_t format, int width, int height,
+           unsigned flags)
+{
+    struct sg_pixbuf pbuf;
+    struct sg_error *err = NULL;
+    int psz = (int) SG_PIXBUF_FORMATSIZE[format], w, h, i, n;
+    const unsigned char *p;
+
+    if (sg_pixbuf_allocflags(&pbuf, format, width, height, flags, &err)) {
+        fprintf(stderr, "FAIL: %s %dx%d: allocation failed\n",
+                SG_PIXBUF_FORMATNAME[format], width, height);
+        sg_error_clear(&err);
+        failed = 1;
+        return;
+    }
+    w = (flags & SG_PIXBUF_POW2) != 0 ? pow2(width) : width;
+    h = (flags & SG_PIXBUF_POW2) != 0 ? pow2(height) : height;
+    if (pbuf.format != format || pbuf.width != w || pbuf.height != h ||
+        pbuf.rowbytes % SG_PIXBUF_ALIGN != 0 ||
+        pbuf.rowbytes < w * psz ||
+        pbuf.rowbytes >= w * psz + SG_PIXBUF_ALIGN) {
+        fprintf(stderr, "FAIL: %s %dx%d: got %dx%d, rowbytes %d\n",
+                SG_PIXBUF_FORMATNAME[format], width, height,
+                pbuf.width, pbuf.height, pbuf.rowbytes);
+        failed = 1;
+    }
+    if ((flags & SG_PIXBUF_ZERO) != 0) {
+        p = pbuf.data;
+        n = pbuf.rowbytes * pbuf.height;
+        for (i = 0; i < n; i++) {
+            if (p[i]) {
+                fprintf(stderr, "FAIL: %s %dx%d: not zeroed\n",
+                        SG_PIXBUF_FORMATNAME[format], width, height);
+                failed = 1;
+                break;
+            }
+        }
+    }
+    free(pbuf.data);
+}
+
+static void
+test_invalid(int width, int height)
+{
+    struct sg_pixbuf pbuf;
+    struct sg_error *err = NULL;
+    if (!sg_pixbuf_alloc(&pbuf, SG_RGBA, width, height, &err) || !err) {
+        fprintf(stderr, "FAIL: %dx%d: allocation succeeded\n",
+                width, height);
+        failed = 1;
+    }
+    sg_error_clear(&err);
+}
+
+int
+main(int argc, char **argv)
+{
+    static const int SIZES[][2] = {
+        { 1, 1 }, { 3, 7 }, { 16, 16 }, { 17, 5 }, { 64, 3 },
+        { 65, 65 }, { 1025, 1025 }, { 1920, 1080 }
+    };
+    sg_pixbuf_format_t format;
+    unsigned i, flags;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: test_pixbuf\n", stderr);
+        return 1;
+    }
+    for (format = SG_R; format <= SG_RGBA; format++)
+        for (i = 0; i < sizeof(SIZES) / sizeof(*SIZES); i++)
+            for (flags = 0; flags < 4; flags++)
+                test_alloc(format, SIZES[i][0], SIZES[i][1], flags);
+    test_invalid(0, 1);
+    test_invalid(1, -1);
+    test_invalid(32769, 1);
+    test_invalid(32768, 32768);
+    if (failed)
+        return 1;
+    fputs("ok\n", stderr);
+    return 0;
+}
@@ -0,0 +1,282 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Test pixel operations against simple reference implementations.
+   Images have odd widths and padded or negative row strides, and the
+   padding must not be modified.  Build with "make CFLAGS=-U__SSE2__"
+   to test the scalar code.  */
+#include "sg/pixbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAXWIDTH 70
+#define HEIGHT 5
+#define PAD 13
+
+static int failed;
+
+static unsigned rand_state = 1618033988;
+
+static unsigned
+rand_next(void)
+{
+    rand_state = rand_state * 1664525u + 1013904223u;
+    return rand_state >> 8;
+}
+
+/* A pixel buffer inside a larger buffer filled with random data.  */
+struct image {
+    unsigned char mem[(MAXWIDTH * 4 + PAD) * HEIGHT];
+    struct sg_pixbuf pbuf;
+};
+
+static void
+image_init(struct image *im, sg_pixbuf_format_t format, int width,
+           int flip)
+{
+    int rb = (int) SG_PIXBUF_FORMATSIZE[format] * width + PAD;
+    size_t i;
+    for (i = 0; i < sizeof(im->mem); i++)
+        im->mem[i] = (unsigned char) rand_next();
+    im->pbuf.format = format;
+    im->pbuf.width = width;
+    im->pbuf.height = HEIGHT;
+    if (flip) {
+        im->pbuf.data = im->mem + rb * (HEIGHT - 1);
+        im->pbuf.rowbytes = -rb;
+    } else {
+        im->pbuf.data = im->mem;
+        im->pbuf.rowbytes = rb;
+    }
+}
+
+static unsigned char *
+pixel(struct image *im, int x, int y)
+{
+    return (unsigned char *) im->pbuf.data +
+        im->pbuf.rowbytes * y +
+        SG_PIXBUF_FORMATSIZE[im->pbuf.format] * x;
+}
+
+/* Use alpha values which exercise the edge cases.  */
+static void
+image_alpha(struct image *im)
+{
+    int x, y;
+    unsigned char *p;
+    for (y = 0; y < HEIGHT; y++) {
+        for (x = 0; x < im->pbuf.width; x++) {
+            p = pixel(im, x, y);
+            switch (rand_next() % 4) {
+            case 0: p[3] = 0; break;
+            case 1: p[3] = 255; break;
+            default: break;
+            }
+        }
+    }
+}
+
+static void
+check(const char *name, int width, struct image *x, struct image *y)
+{
+    if (!memcmp(x->mem, y->mem, sizeof(x->mem)))
+        return;
+    fprintf(stderr, "FAIL: %s, width %d\n", name, width);
+    failed = 1;
+}
+
+static unsigned
+ref_luma(const unsigned char *p)
+{
+    return (p[0] * 77 + p[1] * 150 + p[2] * 29 + 128) >> 8;
+}
+
+static void
+test_premultiply(int width, int flip)
+{
+    struct image x, y;
+    unsigned char *p;
+    unsigned c, a;
+    int i, j, k;
+
+    image_init(&x, SG_RGBA, width, flip);
+    image_alpha(&x);
+    y = x;
+    y.pbuf.data = y.mem + ((unsigned char *) x.pbuf.data - x.mem);
+    sg_pixbuf_premultiply(&x.pbuf);
+    for (j = 0; j < HEIGHT; j++) {
+        for (i = 0; i < width; i++) {
+            p = pixel(&y, i, j);
+            a = p[3];
+            for (k = 0; k < 3; k++)
+                p[k] = (unsigned char) (p[k] * a / 255);
+        }
+    }
+    check("premultiply", width, &x, &y);
+
+    image_init(&x, SG_RGBA, width, flip);
+    image_alpha(&x);
+    y = x;
+    y.pbuf.data = y.mem + ((unsigned char *) x.pbuf.data - x.mem);
+    sg_pixbuf_unpremultiply(&x.pbuf);
+    for (j = 0; j < HEIGHT; j++) {
+        for (i = 0; i < width; i++) {
+            p = pixel(&y, i, j);
+            a = p[3];
+            for (k = 0; k < 3; k++) {
+                c = a ? (p[k] * 255 * 2 + a) / (2 * a) : 0;
+                p[k] = (unsigned char) (c > 255 ? 255 : c);
+            }
+        }
+    }
+    check("unpremultiply", width, &x, &y);
+}
+
+static void
+test_swizzle(int width, int flip)
+{
+    static const unsigned char ORDER[3][4] = {
+        { 2, 1, 0, 3 }, { 3, 2, 1, 0 }, { 0, 0, 0, 1 }
+    };
+    struct image x, y;
+    unsigned char *p, t[4];
+    int i, j, k, n;
+
+    for (n = 0; n < 3; n++) {
+        image_init(&x, SG_RGBA, width, flip);
+        y = x;
+        y.pbuf.data = y.mem + ((unsigned char *) x.pbuf.data - x.mem);
+        sg_pixbuf_swizzle(&x.pbuf, ORDER[n]);
+        for (j = 0; j < HEIGHT; j++) {
+            for (i = 0; i < width; i++) {
+                p = pixel(&y, i, j);
+                for (k = 0; k < 4; k++)
+                    t[k] = p[ORDER[n][k]];
+                memcpy(p, t, 4);
+            }
+        }
+        check("swizzle", width, &x, &y);
+    }
+}
+
+static void
+test_flip(int width, int flip)
+{
+    struct image x, y;
+    sg_pixbuf_format_t format;
+    size_t psz;
+    int i, j;
+
+    for (format = SG_R; format <= SG_RGBA; format++) {
+        psz = SG_PIXBUF_FORMATSIZE[format];
+        image_init(&x, format, width, flip);
+        y = x;
+        y.pbuf.data = y.mem + ((unsigned char *) x.pbuf.data - x.mem);
+        sg_pixbuf_flip(&x.pbuf);
+        for (j = 0; j < HEIGHT; j++)
+            for (i = 0; i < width; i++)
+                memcpy(pixel(&y, i, j), pixel(&x, i, HEIGHT - 1 - j), psz);
+        sg_pixbuf_flip(&x.pbuf);
+        check("flip", width, &x, &y);
+    }
+}
+
+static void
+test_convert(int width, int flip)
+{
+    struct image src, x, y;
+    sg_pixbuf_format_t sf, df;
+    unsigned char *s, *d, v[4];
+    int i, j;
+
+    for (sf = SG_R; sf <= SG_RGBA; sf++) {
+        for (df = SG_R; df <= SG_RGBA; df++) {
+            image_init(&src, sf, width, flip);
+            image_init(&x, df, width, !flip);
+            y = x;
+            y.pbuf.data = y.mem + ((unsigned char *) x.pbuf.data - x.mem);
+            sg_pixbuf_convert(&x.pbuf, &src.pbuf);
+            for (j = 0; j < HEIGHT; j++) {
+                for (i = 0; i < width; i++) {
+                    s = pixel(&src, i, j);
+                    d = pixel(&y, i, j);
+                    switch (sf) {
+                    case SG_R:
+                        v[0] = v[1] = v[2] = s[0];
+                        v[3] = 255;
+                        break;
+                    case SG_RG:
+                        v[0] = v[1] = v[2] = s[0];
+                        v[3] = s[1];
+                        break;
+                    case SG_RGBX:
+                        memcpy(v, s, 3);
+                        v[3] = 255;
+                        break;
+                    case SG_RGBA:
+                        memcpy(v, s, 4);
+                        break;
+                    }
+                    if (sf == df) {
+                        memcpy(d, s, SG_PIXBUF_FORMATSIZE[sf]);
+                        continue;
+                    }
+                    switch (df) {
+                    case SG_R:
+                        d[0] = sf == SG_RG ? v[0] :
+                            (unsigned char) ref_luma(v);
+                        break;
+                    case SG_RG:
+                        d[0] = sf == SG_R ? v[0] :
+                            (unsigned char) ref_luma(v);
+                        d[1] = v[3];
+                        break;
+                    case SG_RGBX:
+                        memcpy(d, v, 3);
+                        d[3] = 255;
+                        break;
+                    case SG_RGBA:
+                        memcpy(d, v, 4);
+                        break;
+                    }
+                }
+            }
+            check("convert", width, &x, &y);
+        }
+    }
+
+    /* In place conversion.  */
+    image_init(&x, SG_RGBA, width, flip);
+    y = x;
+    y.pbuf.data = y.mem + ((unsigned char *) x.pbuf.data - x.mem);
+    x.pbuf.format = SG_RGBX;
+    sg_pixbuf_convert(&x.pbuf, &y.pbuf);
+    for (j = 0; j < HEIGHT; j++)
+        for (i = 0; i < width; i++)
+            pixel(&y, i, j)[3] = 255;
+    check("convert in place", width, &x, &y);
+}
+
+int
+main(int argc, char **argv)
+{
+    int width, flip;
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: test_pixops\n", stderr);
+        return 1;
+    }
+    for (width = 1; width <= MAXWIDTH; width++) {
+        for (flip = 0; flip < 2; flip++) {
+            test_premultiply(width, flip);
+            test_swizzle(width, flip);
+            test_flip(width, flip);
+            test_convert(width, flip);
+        }
+    }
+    if (failed)
+        return 1;
+    fputs("ok\n", stderr);
+    return 0;
+}
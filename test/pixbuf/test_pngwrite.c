@@ -0,0 +1,257 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Test the parallel PNG writer.  Images are written with each filter
+   and several compression levels, read back with LibPNG, and must
+   match exactly, after premultiplying alpha.  The file must not depend
+   on the number of threads, and must not be much larger than the file
+   LibPNG writes.  */
+#define _POSIX_C_SOURCE 200809L
+#include "sg/error.h"
+#include "sg/pixbuf.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char tmpdir[] = "/tmp/sgtest.XXXXXX";
+
+static int failed;
+
+static struct sg_pixbuf texture;
+
+/* Read a file into memory.  */
+static unsigned char *
+read_file(const char *name, size_t *size)
+{
+    char path[64];
+    FILE *fp;
+    unsigned char *data;
+    long n;
+    sprintf(path, "%s/%s.png", tmpdir, name);
+    fp = fopen(path, "rb");
+    if (!fp || fseek(fp, 0, SEEK_END) || (n = ftell(fp)) < 0) {
+        fprintf(stderr, "error: %s: could not read file\n", path);
+        exit(1);
+    }
+    rewind(fp);
+    data = malloc(n ? n : 1);
+    if (!data || fread(data, 1, n, fp) != (size_t) n) {
+        fprintf(stderr, "error: %s: could not read file\n", path);
+        exit(1);
+    }
+    fclose(fp);
+    *size = n;
+    return data;
+}
+
+/* Write an image, and return nonzero if it succeeded.  Without
+   options, the image is written with LibPNG.  */
+static int
+write_image(struct sg_pixbuf *pbuf, const char *name,
+            const struct sg_pngopts *opts)
+{
+    struct sg_error *err = NULL;
+    char path[32];
+    int r;
+    sprintf(path, "%s.png", name);
+    if (opts)
+        r = sg_pixbuf_writepngopts(pbuf, path, strlen(path), opts, &err);
+    else
+        r = sg_pixbuf_writepng(pbuf, path, strlen(path), &err);
+    if (r) {
+        fprintf(stderr, "FAIL: %s: could not write image: %s\n", name,
+                err && err->msg ? err->msg : "unknown error");
+        sg_error_clear(&err);
+        failed = 1;
+    }
+    return !r;
+}
+
+/* Fill an image with the demo texture, with varying alpha.  */
+static void
+make_image(struct sg_pixbuf *pbuf, sg_pixbuf_format_t format,
+           int width, int height)
+{
+    unsigned char *p;
+    const unsigned char *q;
+    int x, y;
+    xalloc(pbuf, format, width, height);
+    for (y = 0; y < height; y++) {
+        p = (unsigned char *) pbuf->data + pbuf->rowbytes * y;
+        q = (const unsigned char *) texture.data +
+            texture.rowbytes * (y % texture.height);
+        for (x = 0; x < width; x++) {
+            memcpy(p + x * 4, q + (x % texture.width) * 4, 3);
+            p[x*4+3] = format == SG_RGBX ? 255 :
+                (unsigned char) (x * 7 + y * 3);
+        }
+    }
+}
+
+static int
+same_image(const struct sg_pixbuf *x, const struct sg_pixbuf *y)
+{
+    int i;
+    if (x->width != y->width || x->height != y->height)
+        return 0;
+    for (i = 0; i < x->height; i++) {
+        if (memcmp((const char *) x->data + x->rowbytes * i,
+                   (const char *) y->data + y->rowbytes * i,
+                   (size_t) x->width * 4))
+            return 0;
+    }
+    return 1;
+}
+
+static void
+test_opts(struct sg_pixbuf *pbuf, const struct sg_pixbuf *expect,
+          int level, sg_png_filter_t filter)
+{
+    struct sg_pngopts opts;
+    struct sg_pixbuf result;
+    unsigned char *data1, *data3;
+    size_t size1, size3;
+
+    opts.level = level;
+    opts.filter = filter;
+    opts.nthread = 1;
+    if (!write_image(pbuf, "single", &opts))
+        return;
+    opts.nthread = 3;
+    if (!write_image(pbuf, "multi", &opts))
+        return;
+    load_pixbuf(&result, pbuf->format, "multi");
+    if (!same_image(expect, &result)) {
+        fprintf(stderr, "FAIL: %s %dx%d, level %d, filter %d: "
+                "image does not match\n",
+                SG_PIXBUF_FORMATNAME[pbuf->format],
+                pbuf->width, pbuf->height, level, (int) filter);
+        failed = 1;
+    }
+    free(result.data);
+    data1 = read_file("single", &size1);
+    data3 = read_file("multi", &size3);
+    if (size1 != size3 || memcmp(data1, data3, size1)) {
+        fprintf(stderr, "FAIL: %s %dx%d, level %d, filter %d: "
+                "output depends on threads\n",
+                SG_PIXBUF_FORMATNAME[pbuf->format],
+                pbuf->width, pbuf->height, level, (int) filter);
+        failed = 1;
+    }
+    free(data1);
+    free(data3);
+}
+
+/* Write images with every filter at the default level, and every
+   level with the default filter.  The sizes give single strips,
+   several strips, strips of one row, and strips larger than the
+   window.  */
+static void
+test_write(void)
+{
+    static const int SIZES[][2] = {
+        { 1, 1 }, { 7, 3 }, { 300, 500 }, { 3, 30000 }, { 4000, 200 }
+    };
+    static const int LEVELS[] = { 0, 1, 9 };
+    struct sg_pixbuf pbuf, expect;
+    sg_pixbuf_format_t format;
+    unsigned i, j;
+    int filter;
+
+    for (i = 0; i < sizeof(SIZES) / sizeof(*SIZES); i++) {
+        for (format = SG_RGBX; format <= SG_RGBA; format++) {
+            make_image(&pbuf, format, SIZES[i][0], SIZES[i][1]);
+            make_image(&expect, format, SIZES[i][0], SIZES[i][1]);
+            sg_pixbuf_premultiply(&expect);
+            for (filter = 0; filter <= SG_PNG_FILTER_ADAPTIVE; filter++)
+                test_opts(&pbuf, &expect, 6, (sg_png_filter_t) filter);
+            for (j = 0; j < sizeof(LEVELS) / sizeof(*LEVELS); j++)
+                test_opts(&pbuf, &expect, LEVELS[j], SG_PNG_FILTER_ADAPTIVE);
+            free(pbuf.data);
+            free(expect.data);
+        }
+    }
+}
+
+/* The default options should compress about as well as LibPNG.  */
+static void
+test_size(void)
+{
+    struct sg_pixbuf pbuf;
+    struct sg_pngopts opts;
+    unsigned char *data;
+    size_t size, refsize;
+
+    opts.level = 6;
+    opts.filter = SG_PNG_FILTER_ADAPTIVE;
+    opts.nthread = 0;
+    make_image(&pbuf, SG_RGBX, 1920, 1080);
+    if (!write_image(&pbuf, "multi", &opts) ||
+        !write_image(&pbuf, "single", NULL))
+        return;
+    data = read_file("multi", &size);
+    free(data);
+    data = read_file("single", &refsize);
+    free(data);
+    if (size > refsize + refsize / 20) {
+        fprintf(stderr, "FAIL: file is %lu bytes, LibPNG is %lu bytes\n",
+                (unsigned long) size, (unsigned long) refsize);
+        failed = 1;
+    }
+    free(pbuf.data);
+}
+
+static void
+test_invalid(void)
+{
+    struct sg_pixbuf pbuf;
+    struct sg_pngopts opts;
+    struct sg_error *err = NULL;
+    xalloc(&pbuf, SG_RGBA, 4, 4);
+    opts.level = 10;
+    opts.filter = SG_PNG_FILTER_NONE;
+    opts.nthread = 1;
+    if (!sg_pixbuf_writepngopts(&pbuf, "x.png", 5, &opts, &err) || !err) {
+        fputs("FAIL: invalid level accepted\n", stderr);
+        failed = 1;
+    }
+    sg_error_clear(&err);
+    free(pbuf.data);
+}
+
+int
+main(int argc, char **argv)
+{
+    static const char *const NAMES[] = { "single", "multi" };
+    char buf[64];
+    unsigned i;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: test_pngwrite\n", stderr);
+        return 1;
+    }
+    if (!mkdtemp(tmpdir)) {
+        fputs("error: could not create temporary directory\n", stderr);
+        return 1;
+    }
+    test_paths(tmpdir);
+
+    load_pixbuf(&texture, SG_RGBX, "data/tex/brick");
+    test_write();
+    test_size();
+    test_invalid();
+    free(texture.data);
+
+    for (i = 0; i < sizeof(NAMES) / sizeof(*NAMES); i++) {
+        sprintf(buf, "%s/%s.png", tmpdir, NAMES[i]);
+        unlink(buf);
+    }
+    rmdir(tmpdir);
+    if (failed)
+        return 1;
+    fputs("ok\n", stderr);
+    return 0;
+}
@@ -0,0 +1,186 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Test block compression.  The demo images are compressed and
+   decompressed, and must have a minimum PSNR.  The output must not
+   depend on the number of threads.  */
+#include "sg/error.h"
+#include "sg/pixbuf.h"
+#include "testutil.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failed;
+
+static void
+xcalloc(struct sg_cpixbuf *cbuf, sg_cpixbuf_format_t format,
+        int width, int height)
+{
+    if (sg_cpixbuf_alloc(cbuf, format, width, height, NULL)) {
+        fputs("error: out of memory\n", stderr);
+        exit(1);
+    }
+}
+
+static void
+load(struct sg_pixbuf *pbuf, const char *path)
+{
+    struct sg_image *img = load_image(path);
+    draw_image(pbuf, (img->flags & SG_IMAGE_ALPHA) != 0 ? SG_RGBA : SG_RGBX,
+               img, path);
+}
+
+/* Get the PSNR of the first nchan channels of two images.  */
+static double
+psnr(const struct sg_pixbuf *x, const struct sg_pixbuf *y, int nchan)
+{
+    const unsigned char *p, *q;
+    double err = 0.0, d;
+    int i, j, c, psz = (int) SG_PIXBUF_FORMATSIZE[x->format],
+        qsz = (int) SG_PIXBUF_FORMATSIZE[y->format];
+    for (j = 0; j < x->height; j++) {
+        p = (const unsigned char *) x->data + x->rowbytes * j;
+        q = (const unsigned char *) y->data + y->rowbytes * j;
+        for (i = 0; i < x->width; i++) {
+            for (c = 0; c < nchan; c++) {
+                d = p[i*psz+c] - q[i*qsz+c];
+                err += d * d;
+            }
+        }
+    }
+    err /= (double) nchan * x->width * x->height;
+    return err > 0.0 ? 10.0 * log10(255.0 * 255.0 / err) : 99.0;
+}
+
+static int
+same_blocks(const struct sg_cpixbuf *x, const struct sg_cpixbuf *y)
+{
+    return !memcmp(x->data, y->data,
+                   (size_t) x->rowbytes * ((x->height + 3) >> 2));
+}
+
+/* Compress an image with one and several threads, and check the
+   quality of the result.  */
+static void
+test_format(const char *name, const struct sg_pixbuf *src,
+            sg_cpixbuf_format_t format, double minpsnr)
+{
+    struct sg_cpixbuf c1, c4;
+    struct sg_pixbuf dec;
+    double q;
+    int nchan;
+
+    xcalloc(&c1, format, src->width, src->height);
+    xcalloc(&c4, format, src->width, src->height);
+    if (sg_cpixbuf_encode(&c1, src, 1, NULL) ||
+        sg_cpixbuf_encode(&c4, src, 4, NULL)) {
+        fprintf(stderr, "FAIL: %s %s: encoding failed\n",
+                name, SG_CPIXBUF_FORMATNAME[format]);
+        failed = 1;
+        goto done;
+    }
+    if (!same_blocks(&c1, &c4)) {
+        fprintf(stderr, "FAIL: %s %s: output depends on threads\n",
+                name, SG_CPIXBUF_FORMATNAME[format]);
+        failed = 1;
+    }
+    switch (format) {
+    case SG_BC1: nchan = 3; break;
+    case SG_BC3: nchan = 4; break;
+    default: nchan = 1; break;
+    }
+    xalloc(&dec, format == SG_BC4 ? SG_R : SG_RGBA,
+           src->width, src->height);
+    sg_cpixbuf_decode(&dec, &c1, NULL);
+    q = psnr(src, &dec, nchan);
+    if (q < minpsnr) {
+        fprintf(stderr, "FAIL: %s %s: PSNR %.2f dB, expected %.2f\n",
+                name, SG_CPIXBUF_FORMATNAME[format], q, minpsnr);
+        failed = 1;
+    }
+    free(dec.data);
+done:
+    free(c1.data);
+    free(c4.data);
+}
+
+static void
+test_image(const char *path, double bc1, double bc3, double bc4)
+{
+    struct sg_pixbuf src, gray;
+    load(&src, path);
+    test_format(path, &src, SG_BC1, bc1);
+    test_format(path, &src, SG_BC3, bc3);
+    xalloc(&gray, SG_R, src.width, src.height);
+    sg_pixbuf_convert(&gray, &src);
+    test_format(path, &gray, SG_BC4, bc4);
+    free(gray.data);
+    free(src.data);
+}
+
+/* Odd sizes, and blocks with a single color, which should be nearly
+   exact.  */
+static void
+test_solid(void)
+{
+    struct sg_pixbuf src;
+    unsigned char *p;
+    int x, y;
+    xalloc(&src, SG_RGBA, 13, 7);
+    for (y = 0; y < src.height; y++) {
+        p = (unsigned char *) src.data + src.rowbytes * y;
+        for (x = 0; x < src.width; x++) {
+            p[x*4+0] = x < 4 ? 255 : 33;
+            p[x*4+1] = x < 4 ? 0 : 190;
+            p[x*4+2] = 77;
+            p[x*4+3] = y < 4 ? 255 : 128;
+        }
+    }
+    test_format("solid", &src, SG_BC1, 42.0);
+    test_format("solid", &src, SG_BC3, 43.0);
+    test_format("solid", &src, SG_BC4, 99.0);
+    free(src.data);
+}
+
+static void
+test_invalid(void)
+{
+    struct sg_pixbuf src;
+    struct sg_cpixbuf dest;
+    struct sg_error *err = NULL;
+    xalloc(&src, SG_R, 8, 8);
+    xcalloc(&dest, SG_BC1, 8, 8);
+    if (!sg_cpixbuf_encode(&dest, &src, 1, &err) || !err) {
+        fputs("FAIL: BC1 accepted R source\n", stderr);
+        failed = 1;
+    }
+    sg_error_clear(&err);
+    free(src.data);
+    free(dest.data);
+}
+
+int
+main(int argc, char **argv)
+{
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: test_texcomp\n", stderr);
+        return 1;
+    }
+    test_paths(NULL);
+
+    test_image("data/tex/brick", 30.0, 31.5, 37.5);
+    test_image("data/tex/ivy", 28.5, 30.0, 34.5);
+    test_image("data/tex/roughstone", 30.0, 31.0, 36.5);
+    test_image("data/imgtest/png_rgba8", 34.0, 34.5, 44.5);
+    test_image("icon/icon256", 39.5, 40.0, 46.0);
+    test_solid();
+    test_invalid();
+    if (failed)
+        return 1;
+    fputs("ok\n", stderr);
+    return 0;
+}
@@ -0,0 +1,97 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "sg/version.h"
+#include "src/core/file_impl.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct sg_paths sg_paths;
+
+static char DATA_PATH[] = "../demo/";
+
+/* Library versions are not logged.  */
+void
+sg_version_lib(const char *libname,
+               const char *compileversion, const char *runversion)
+{
+    (void) libname;
+    (void) compileversion;
+    (void) runversion;
+}
+
+void
+test_paths(const char *dir)
+{
+    static struct sg_path path[2];
+    static char buf[256];
+    unsigned n = 0, maxlen;
+    size_t len;
+
+    if (dir) {
+        len = strlen(dir);
+        if (len + 2 > sizeof(buf)) {
+            fputs("error: path too long\n", stderr);
+            exit(1);
+        }
+        memcpy(buf, dir, len);
+        if (!len || buf[len - 1] != '/')
+            buf[len++] = '/';
+        buf[len] = '\0';
+        path[n].path = buf;
+        path[n].len = len;
+        n++;
+    }
+    path[n].path = DATA_PATH;
+    path[n].len = strlen(DATA_PATH);
+    n++;
+    maxlen = (unsigned) path[0].len;
+    if (maxlen < path[n - 1].len)
+        maxlen = (unsigned) path[n - 1].len;
+    sg_paths.path = path;
+    sg_paths.pathcount = n;
+    sg_paths.maxlen = maxlen;
+}
+
+void
+xalloc(struct sg_pixbuf *pbuf, sg_pixbuf_format_t format,
+       int width, int height)
+{
+    if (sg_pixbuf_alloc(pbuf, format, width, height, NULL)) {
+        fputs("error: out of memory\n", stderr);
+        exit(1);
+    }
+}
+
+struct sg_image *
+load_image(const char *path)
+{
+    struct sg_image *img;
+    img = sg_image_file(path, strlen(path), NULL);
+    if (!img) {
+        fprintf(stderr, "error: %s: could not load image\n", path);
+        exit(1);
+    }
+    return img;
+}
+
+void
+draw_image(struct sg_pixbuf *pbuf, sg_pixbuf_format_t format,
+           struct sg_image *img, const char *path)
+{
+    xalloc(pbuf, format, img->width, img->height);
+    if (img->draw(img, pbuf, 0, 0, NULL)) {
+        fprintf(stderr, "error: %s: could not draw image\n", path);
+        exit(1);
+    }
+    img->free(img);
+}
+
+void
+load_pixbuf(struct sg_pixbuf *pbuf, sg_pixbuf_format_t format,
+            const char *path)
+{
+    draw_image(pbuf, format, load_image(path), path);
+}
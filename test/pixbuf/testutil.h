@@ -0,0 +1,32 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Helpers shared by the pixel buffer tests and benchmarks.  The
+   helpers exit if anything fails.  Linking with testutil.o also
+   provides sg_paths and a stub for sg_version_lib.  */
+#include "sg/pixbuf.h"
+
+/* Search for files in the demo data directory.  If dir is not NULL,
+   search it first.  */
+void
+test_paths(const char *dir);
+
+/* Allocate a pixel buffer.  */
+void
+xalloc(struct sg_pixbuf *pbuf, sg_pixbuf_format_t format,
+       int width, int height);
+
+/* Open an image file.  */
+struct sg_image *
+load_image(const char *path);
+
+/* Draw an image into a new pixel buffer and free the image.  The path
+   is used for error messages.  */
+void
+draw_image(struct sg_pixbuf *pbuf, sg_pixbuf_format_t format,
+           struct sg_image *img, const char *path);
+
+/* Load an image file into a new pixel buffer.  */
+void
+load_pixbuf(struct sg_pixbuf *pbuf, sg_pixbuf_format_t format,
+            const char *path);
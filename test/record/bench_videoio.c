@@ -0,0 +1,184 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Benchmark for video recording I/O.  Synthetic frames are flipped
+   into frame buffers and written with sg_videoio to a child process
+   which discards them, like /dev/null, once for each pixel format the
+   frames can be converted to.  Without I/O, it also compares
+   flipping into a reused buffer with flipping into a newly allocated
+   buffer for each frame, as the recorder did before frame buffers
+   were pooled.  Build with optimization, e.g. "make CFLAGS=-O2".  */
+#define _POSIX_C_SOURCE 200112L
+#include <pthread.h>
+#include "sg/error.h"
+#include "sg/pixbuf.h"
+#include "src/record/videoio.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Start a process which reads and discards everything from a pipe,
+   and return the write end.  */
+static int
+start_sink(pid_t *pid)
+{
+    static char buf[65536];
+    int fdes[2];
+    if (pipe(fdes)) {
+        perror("pipe");
+        exit(1);
+    }
+    *pid = fork();
+    if (*pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (*pid == 0) {
+        close(fdes[1]);
+        while (read(fdes[0], buf, sizeof(buf)) > 0) { }
+        _exit(0);
+    }
+    close(fdes[0]);
+    return fdes[1];
+}
+
+/* Flip the source into a frame, as the recorder does with frames
+   read from OpenGL.  */
+static void
+flip(void *dest, const struct sg_pixbuf *src)
+{
+    struct sg_pixbuf s = *src, d = *src;
+    s.data = (char *) src->data + (src->height - 1) * src->rowbytes;
+    s.rowbytes = -src->rowbytes;
+    d.data = dest;
+    sg_pixbuf_convert(&d, &s);
+}
+
+static void
+bench_pool(const struct sg_pixbuf *src, int nframe, sg_videofmt_t format)
+{
+    struct sg_videoio vio;
+    struct sg_error *err = NULL;
+    size_t outbytes =
+        sg_videofmt_framesize(format, src->width, src->height);
+    double t;
+    void *frame;
+    pid_t pid;
+    int i, fdes, status, nbuf;
+
+    fdes = start_sink(&pid);
+    if (sg_videoio_init(&vio, src->width, src->height, format, fdes, NULL,
+                        &err)) {
+        fputs("error: could not start video I/O\n", stderr);
+        exit(1);
+    }
+    t = get_time();
+    for (i = 0; i < nframe; i++) {
+        frame = sg_videoio_getframe(&vio);
+        if (!frame) {
+            fputs("error: video I/O stopped\n", stderr);
+            exit(1);
+        }
+        flip(frame, src);
+        sg_videoio_write(&vio, frame, (unsigned) i);
+    }
+    nbuf = vio.buffercount;
+    if (sg_videoio_destroy(&vio)) {
+        fputs("error: video I/O failed\n", stderr);
+        exit(1);
+    }
+    t = get_time() - t;
+    close(fdes);
+    waitpid(pid, &status, 0);
+    printf("  %-7s  %7.1f fps  %7.1f MB/s  %d buffers\n",
+           SG_VIDEOFMT_NAME[format], nframe / t,
+           nframe * (double) outbytes / t * 1e-6, nbuf);
+}
+
+/* Flip frames without writing them, either into a fixed set of
+   buffers or into a new buffer each frame.  Buffers are released in
+   order, a few frames later, as if they were in the I/O queue.  */
+static void
+bench_flip(const struct sg_pixbuf *src, int nframe, int fresh)
+{
+    size_t framebytes = (size_t) src->rowbytes * src->height;
+    double t;
+    void *frame[SG_VIDEOIO_NFRAME];
+    int i, j;
+
+    for (i = 0; i < SG_VIDEOIO_NFRAME; i++) {
+        frame[i] = fresh ? NULL : malloc(framebytes);
+        if (!fresh && !frame[i]) {
+            fputs("error: out of memory\n", stderr);
+            exit(1);
+        }
+    }
+    t = get_time();
+    for (i = 0; i < nframe; i++) {
+        j = i % SG_VIDEOIO_NFRAME;
+        if (fresh) {
+            free(frame[j]);
+            frame[j] = malloc(framebytes);
+            if (!frame[j]) {
+                fputs("error: out of memory\n", stderr);
+                exit(1);
+            }
+        }
+        flip(frame[j], src);
+    }
+    t = get_time() - t;
+    for (i = 0; i < SG_VIDEOIO_NFRAME; i++)
+        free(frame[i]);
+    printf("  %-7s  %7.1f fps  %7.1f MB/s  (no I/O)\n",
+           fresh ? "malloc" : "reuse",
+           nframe / t, nframe * (double) framebytes / t * 1e-6);
+}
+
+int
+main(int argc, char **argv)
+{
+    static const int SIZES[][3] = {
+        { 1920, 1080, 240 }, { 3840, 2160, 60 }
+    };
+    struct sg_pixbuf src;
+    unsigned i;
+    size_t j, n;
+    int format;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: bench_videoio\n", stderr);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    for (i = 0; i < sizeof(SIZES) / sizeof(*SIZES); i++) {
+        if (sg_pixbuf_alloc(&src, SG_RGBA, SIZES[i][0], SIZES[i][1], NULL)) {
+            fputs("error: out of memory\n", stderr);
+            return 1;
+        }
+        /* The recorder's frames have no row padding.  */
+        src.rowbytes = src.width * 4;
+        n = (size_t) src.rowbytes * src.height;
+        for (j = 0; j < n; j++)
+            ((unsigned char *) src.data)[j] = (unsigned char) (j * 7);
+        printf("%dx%d, %d frames\n", src.width, src.height, SIZES[i][2]);
+        for (format = 0; format < SG_VIDEOFMT_COUNT; format++)
+            bench_pool(&src, SIZES[i][2], (sg_videofmt_t) format);
+        bench_flip(&src, SIZES[i][2], 0);
+        bench_flip(&src, SIZES[i][2], 1);
+        free(src.data);
+    }
+    return 0;
+}
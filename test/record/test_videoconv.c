@@ -0,0 +1,307 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Test conversion of video frames from RGBX to YUV 4:2:0.  Frames are
+   converted and compared exactly with a simple reference conversion,
+   which is in turn checked against the BT.601 formulas in floating
+   point.  Frames are also written through sg_videoio to "cat", which
+   stands in for the encoder, and the output must match.  */
+#define _POSIX_C_SOURCE 200809L
+#include "sg/error.h"
+#include "src/record/videoio.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static int failed;
+
+static void *
+xmalloc(size_t size)
+{
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        fputs("error: out of memory\n", stderr);
+        exit(1);
+    }
+    return p;
+}
+
+/* Make a frame with gradients, noise, and saturated colors.  */
+static unsigned char *
+make_frame(int width, int height, unsigned seed)
+{
+    unsigned char *p = xmalloc((size_t) width * height * 4), *q;
+    unsigned s = seed * 2654435761u + 1;
+    int x, y, i;
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            q = p + ((size_t) y * width + x) * 4;
+            s = s * 1103515245u + 12345u;
+            switch ((x / 8 + y / 8 + seed) % 3) {
+            case 0:
+                for (i = 0; i < 4; i++)
+                    q[i] = (unsigned char) (s >> (8 * i));
+                break;
+            case 1:
+                q[0] = (unsigned char) (x * 255 / width);
+                q[1] = (unsigned char) (y * 255 / height);
+                q[2] = (unsigned char) (x + y);
+                q[3] = 0;
+                break;
+            default:
+                for (i = 0; i < 3; i++)
+                    q[i] = (s >> (28 + i)) & 1 ? 255 : 0;
+                q[3] = 255;
+                break;
+            }
+        }
+    }
+    return p;
+}
+
+/* Reference conversion, one sample at a time.  */
+static void
+ref_convert(unsigned char *dest, const unsigned char *src,
+            sg_videofmt_t format, int width, int height)
+{
+    int cw = (width + 1) >> 1, ch = (height + 1) >> 1;
+    int x, y, dx, dy, sx, sy, r, g, b;
+    const unsigned char *p;
+    unsigned char *up, *vp;
+    size_t ustride;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            p = src + ((size_t) y * width + x) * 4;
+            dest[(size_t) y * width + x] = (unsigned char)
+                ((66 * p[0] + 129 * p[1] + 25 * p[2] + 128 + 4096) >> 8);
+        }
+    }
+    up = dest + (size_t) width * height;
+    if (format == SG_VIDEOFMT_YUV420P) {
+        vp = up + (size_t) cw * ch;
+        ustride = 1;
+    } else {
+        vp = up + 1;
+        ustride = 2;
+    }
+    for (y = 0; y < ch; y++) {
+        for (x = 0; x < cw; x++) {
+            r = g = b = 0;
+            for (dy = 0; dy < 2; dy++) {
+                for (dx = 0; dx < 2; dx++) {
+                    sx = 2 * x + dx < width ? 2 * x + dx : width - 1;
+                    sy = 2 * y + dy < height ? 2 * y + dy : height - 1;
+                    p = src + ((size_t) sy * width + sx) * 4;
+                    r += p[0];
+                    g += p[1];
+                    b += p[2];
+                }
+            }
+            up[((size_t) y * cw + x) * ustride] = (unsigned char)
+                ((-38 * r - 74 * g + 112 * b + 512 + (128 << 10)) >> 10);
+            vp[((size_t) y * cw + x) * ustride] = (unsigned char)
+                ((112 * r - 94 * g - 18 * b + 512 + (128 << 10)) >> 10);
+        }
+    }
+}
+
+/* Check that the reference conversion is within one step of BT.601,
+   for the corners of the RGB cube and some grays.  */
+static void
+test_reference(void)
+{
+    unsigned char src[16], dest[6];
+    double r, g, b, e[3];
+    int i, j, k, v;
+
+    for (i = 0; i < 16; i++) {
+        for (j = 0; j < 4; j++) {
+            src[j*4+0] = (unsigned char) (i & 1 ? 255 : (i * 17) & 0xf0);
+            src[j*4+1] = (unsigned char) (i & 2 ? 255 : (i * 17) & 0xf0);
+            src[j*4+2] = (unsigned char) (i & 4 ? 255 : (i * 17) & 0xf0);
+            src[j*4+3] = 0;
+        }
+        ref_convert(dest, src, SG_VIDEOFMT_YUV420P, 2, 2);
+        r = src[0] / 255.0;
+        g = src[1] / 255.0;
+        b = src[2] / 255.0;
+        e[0] = 16 + 219 * (0.299 * r + 0.587 * g + 0.114 * b);
+        e[1] = 128 + 224 * (-0.168736 * r - 0.331264 * g + 0.5 * b);
+        e[2] = 128 + 224 * (0.5 * r - 0.418688 * g - 0.081312 * b);
+        for (k = 0; k < 3; k++) {
+            v = dest[k ? 3 + k : 0];
+            if (v < e[k] - 1.0 || v > e[k] + 1.0) {
+                fprintf(stderr, "FAIL: reference: RGB %d %d %d, "
+                        "component %d is %d, expected %.2f\n",
+                        src[0], src[1], src[2], k, v, e[k]);
+                failed = 1;
+            }
+        }
+    }
+}
+
+/* Convert a frame whole and in pieces, and compare with the
+   reference.  */
+static void
+test_convert(int width, int height)
+{
+    unsigned char *src, *dest, *expect;
+    size_t size;
+    int format, y, y1;
+
+    src = make_frame(width, height, (unsigned) (width ^ height));
+    for (format = 0; format < SG_VIDEOFMT_COUNT; format++) {
+        size = sg_videofmt_framesize(format, width, height);
+        dest = xmalloc(size);
+        expect = xmalloc(size);
+        if (format == SG_VIDEOFMT_RGB0)
+            memcpy(expect, src, size);
+        else
+            ref_convert(expect, src, format, width, height);
+
+        memset(dest, 0xcc, size);
+        sg_videoconv(dest, src, format, width, height, 0, height);
+        if (memcmp(dest, expect, size)) {
+            fprintf(stderr, "FAIL: %s %dx%d: frame does not match\n",
+                    SG_VIDEOFMT_NAME[format], width, height);
+            failed = 1;
+        }
+
+        memset(dest, 0xcc, size);
+        for (y = 0; y < height; y = y1) {
+            y1 = y + 2 + (y & 6);
+            if (y1 > height)
+                y1 = height;
+            sg_videoconv(dest, src, format, width, height, y, y1);
+        }
+        if (memcmp(dest, expect, size)) {
+            fprintf(stderr, "FAIL: %s %dx%d: frame converted in pieces "
+                    "does not match\n",
+                    SG_VIDEOFMT_NAME[format], width, height);
+            failed = 1;
+        }
+
+        free(dest);
+        free(expect);
+    }
+    free(src);
+}
+
+/* Write frames through sg_videoio to "cat", and check the file it
+   writes.  */
+static void
+test_videoio(sg_videofmt_t format, int width, int height)
+{
+    enum { NFRAME = 5 };
+    char path[] = "/tmp/sgtest.XXXXXX";
+    struct sg_videoio vio;
+    struct sg_error *err = NULL;
+    unsigned char *src, *expect, *data;
+    void *frame;
+    size_t size, total;
+    int fdes[2], out, status, i;
+    pid_t pid;
+    FILE *fp;
+
+    out = mkstemp(path);
+    if (out < 0 || pipe(fdes)) {
+        fputs("error: could not create file\n", stderr);
+        exit(1);
+    }
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(fdes[1]);
+        dup2(fdes[0], 0);
+        dup2(out, 1);
+        execlp("cat", "cat", (char *) NULL);
+        _exit(127);
+    }
+    close(fdes[0]);
+    close(out);
+
+    if (sg_videoio_init(&vio, width, height, format, fdes[1], NULL,
+                        &err)) {
+        fputs("error: could not start video I/O\n", stderr);
+        exit(1);
+    }
+    for (i = 0; i < NFRAME; i++) {
+        frame = sg_videoio_getframe(&vio);
+        if (!frame) {
+            fputs("FAIL: video I/O stopped\n", stderr);
+            failed = 1;
+            break;
+        }
+        src = make_frame(width, height, (unsigned) i);
+        memcpy(frame, src, (size_t) width * height * 4);
+        free(src);
+        sg_videoio_write(&vio, frame, (unsigned) i);
+    }
+    if (sg_videoio_destroy(&vio)) {
+        fputs("FAIL: video I/O failed\n", stderr);
+        failed = 1;
+    }
+    close(fdes[1]);
+    waitpid(pid, &status, 0);
+
+    size = sg_videofmt_framesize(format, width, height);
+    total = size * NFRAME;
+    data = xmalloc(total + 1);
+    fp = fopen(path, "rb");
+    if (!fp || fread(data, 1, total + 1, fp) != total) {
+        fprintf(stderr, "FAIL: %s %dx%d: wrong output size\n",
+                SG_VIDEOFMT_NAME[format], width, height);
+        failed = 1;
+    } else {
+        expect = xmalloc(size);
+        for (i = 0; i < NFRAME; i++) {
+            src = make_frame(width, height, (unsigned) i);
+            sg_videoconv(expect, src, format, width, height, 0, height);
+            free(src);
+            if (memcmp(data + size * i, expect, size)) {
+                fprintf(stderr, "FAIL: %s %dx%d: frame %d does not match\n",
+                        SG_VIDEOFMT_NAME[format], width, height, i);
+                failed = 1;
+            }
+        }
+        free(expect);
+    }
+    if (fp)
+        fclose(fp);
+    free(data);
+    unlink(path);
+}
+
+int
+main(int argc, char **argv)
+{
+    static const int SIZES[][2] = {
+        { 1, 1 }, { 2, 2 }, { 3, 5 }, { 16, 2 }, { 17, 9 }, { 31, 31 },
+        { 64, 48 }, { 641, 359 }
+    };
+    unsigned i;
+    int format;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: test_videoconv\n", stderr);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    test_reference();
+    for (i = 0; i < sizeof(SIZES) / sizeof(*SIZES); i++)
+        test_convert(SIZES[i][0], SIZES[i][1]);
+    for (format = 0; format < SG_VIDEOFMT_COUNT; format++)
+        test_videoio((sg_videofmt_t) format, 101, 63);
+    if (failed)
+        return 1;
+    fputs("ok\n", stderr);
+    return 0;
+}
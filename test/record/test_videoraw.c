@@ -0,0 +1,293 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Test raw video files.  The chunk compressor must round trip random,
+   constant, and repetitive data, and the decompressor must reject
+   truncated data.  Files are written with and without compression,
+   directly and through sg_videoio, and must read back exactly,
+   including files which were never finished.  */
+#define _POSIX_C_SOURCE 200809L
+#include "sg/error.h"
+#include "src/record/videoio.h"
+#include "src/record/videoraw.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int failed;
+
+static char path[] = "/tmp/sgtest.XXXXXX";
+
+static void *
+xmalloc(size_t size)
+{
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        fputs("error: out of memory\n", stderr);
+        exit(1);
+    }
+    return p;
+}
+
+/* Fill a buffer with data of the given kind: noise, constant,
+   repeated short pattern, or noise with runs.  */
+static void
+make_data(unsigned char *p, size_t size, int kind, unsigned seed)
+{
+    unsigned s = seed * 2654435761u + 1;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        s = s * 1103515245u + 12345u;
+        switch (kind) {
+        case 0: p[i] = (unsigned char) (s >> 24); break;
+        case 1: p[i] = 0x5a; break;
+        case 2: p[i] = (unsigned char) (i % 7 * 31); break;
+        default:
+            p[i] = (s >> 30) ? (unsigned char) (i >> 6) :
+                (unsigned char) (s >> 16);
+            break;
+        }
+    }
+}
+
+static void
+test_compress(void)
+{
+    static const size_t SIZES[] = {
+        0, 1, 4, 11, 12, 13, 17, 100, 255, 4096, 70000,
+        SG_VIDEORAW_CHUNK
+    };
+    unsigned char *src, *comp, *dest;
+    size_t size, csize;
+    unsigned i;
+    int kind;
+
+    for (i = 0; i < sizeof(SIZES) / sizeof(*SIZES); i++) {
+        size = SIZES[i];
+        src = xmalloc(size);
+        comp = xmalloc(sg_videoraw_bound(size));
+        dest = xmalloc(size + 1);
+        for (kind = 0; kind < 4; kind++) {
+            make_data(src, size, kind, (unsigned) i);
+            csize = sg_videoraw_compress(comp, src, size);
+            if (csize > sg_videoraw_bound(size)) {
+                fprintf(stderr, "FAIL: size %lu, kind %d: exceeds bound\n",
+                        (unsigned long) size, kind);
+                failed = 1;
+                continue;
+            }
+            if (sg_videoraw_decompress(dest, size, comp, csize) ||
+                memcmp(dest, src, size)) {
+                fprintf(stderr, "FAIL: size %lu, kind %d: round trip\n",
+                        (unsigned long) size, kind);
+                failed = 1;
+            }
+            if (size >= 4096 && (kind == 1 || kind == 2) &&
+                csize > size / 20) {
+                fprintf(stderr, "FAIL: size %lu, kind %d: "
+                        "compressed to %lu bytes\n",
+                        (unsigned long) size, kind, (unsigned long) csize);
+                failed = 1;
+            }
+            if (!sg_videoraw_decompress(dest, size, comp, csize - 1) ||
+                !sg_videoraw_decompress(dest, size + 1, comp, csize)) {
+                fprintf(stderr, "FAIL: size %lu, kind %d: "
+                        "bad data accepted\n", (unsigned long) size, kind);
+                failed = 1;
+            }
+        }
+        free(src);
+        free(comp);
+        free(dest);
+    }
+}
+
+/* Frame contents for a timestamp.  */
+static void
+make_frame(unsigned char *p, size_t size, unsigned timestamp)
+{
+    make_data(p, size, timestamp % 2 ? 3 : 2, timestamp);
+}
+
+/* Read a file back and check it against the frames written.  */
+static void
+check_file(const char *name, const unsigned *stamps, unsigned count,
+           int closed)
+{
+    struct sg_videoraw raw;
+    struct sg_error *err = NULL;
+    unsigned char *frame, *expect;
+    unsigned i, timestamp;
+    int r;
+
+    if (sg_videoraw_open(&raw, path, &err)) {
+        fprintf(stderr, "FAIL: %s: could not open: %s\n", name,
+                err && err->msg ? err->msg : "unknown error");
+        sg_error_clear(&err);
+        failed = 1;
+        return;
+    }
+    if ((closed && (!raw.indexpos || raw.nframe != count)) ||
+        (!closed && raw.indexpos)) {
+        fprintf(stderr, "FAIL: %s: wrong header\n", name);
+        failed = 1;
+    }
+    frame = xmalloc(raw.framesize);
+    expect = xmalloc(raw.framesize);
+    for (i = 0; ; i++) {
+        r = sg_videoraw_read(&raw, frame, &timestamp, &err);
+        if (r <= 0) {
+            if (r < 0) {
+                fprintf(stderr, "FAIL: %s: could not read: %s\n", name,
+                        err && err->msg ? err->msg : "unknown error");
+                sg_error_clear(&err);
+                failed = 1;
+            }
+            break;
+        }
+        if (i >= count) {
+            fprintf(stderr, "FAIL: %s: too many frames\n", name);
+            failed = 1;
+            break;
+        }
+        make_frame(expect, raw.framesize, stamps[i]);
+        if (timestamp != stamps[i] ||
+            memcmp(frame, expect, raw.framesize)) {
+            fprintf(stderr, "FAIL: %s: frame %u does not match\n",
+                    name, i);
+            failed = 1;
+        }
+    }
+    if (r == 0 && i != count) {
+        fprintf(stderr, "FAIL: %s: read %u frames, expected %u\n",
+                name, i, count);
+        failed = 1;
+    }
+    free(frame);
+    free(expect);
+    sg_videoraw_close(&raw);
+}
+
+/* Write a file directly, with a gap in the timestamps.  */
+static void
+test_file(int format, int width, int height, int compress, int finish)
+{
+    static const unsigned STAMPS[] = { 0, 1, 2, 5, 6 };
+    enum { NFRAME = sizeof(STAMPS) / sizeof(*STAMPS) };
+    struct sg_videoraw raw;
+    struct sg_error *err = NULL;
+    unsigned char *frame;
+    char name[64];
+    unsigned i;
+
+    sprintf(name, "%s %dx%d%s%s", SG_VIDEOFMT_NAME[format], width, height,
+            compress ? " compressed" : "", finish ? "" : " unfinished");
+    if (sg_videoraw_create(&raw, path, format, width, height, 30,
+                           compress, &err)) {
+        fprintf(stderr, "FAIL: %s: could not create: %s\n", name,
+                err && err->msg ? err->msg : "unknown error");
+        sg_error_clear(&err);
+        failed = 1;
+        return;
+    }
+    frame = xmalloc(raw.framesize);
+    for (i = 0; i < NFRAME; i++) {
+        make_frame(frame, raw.framesize, STAMPS[i]);
+        if (sg_videoraw_write(&raw, frame, STAMPS[i], &err)) {
+            fprintf(stderr, "FAIL: %s: could not write: %s\n", name,
+                    err && err->msg ? err->msg : "unknown error");
+            sg_error_clear(&err);
+            failed = 1;
+        }
+    }
+    free(frame);
+    if (finish) {
+        if (sg_videoraw_finish(&raw, &err)) {
+            fprintf(stderr, "FAIL: %s: could not finish: %s\n", name,
+                    err && err->msg ? err->msg : "unknown error");
+            sg_error_clear(&err);
+            failed = 1;
+        }
+    } else {
+        sg_videoraw_close(&raw);
+    }
+    check_file(name, STAMPS, NFRAME, finish);
+}
+
+/* Write a file through sg_videoio.  */
+static void
+test_videoio(void)
+{
+    enum { NFRAME = 12, WIDTH = 333, HEIGHT = 211 };
+    unsigned stamps[NFRAME];
+    struct sg_videoraw raw;
+    struct sg_videoio vio;
+    struct sg_error *err = NULL;
+    void *frame;
+    unsigned i;
+
+    if (sg_videoraw_create(&raw, path, SG_VIDEOFMT_RGB0, WIDTH, HEIGHT,
+                           30, 1, &err) ||
+        sg_videoio_init(&vio, WIDTH, HEIGHT, SG_VIDEOFMT_RGB0, -1, &raw,
+                        &err)) {
+        fputs("FAIL: videoio: could not start\n", stderr);
+        sg_error_clear(&err);
+        failed = 1;
+        return;
+    }
+    for (i = 0; i < NFRAME; i++) {
+        stamps[i] = i * 3 / 2;
+        frame = sg_videoio_getframe(&vio);
+        if (!frame) {
+            fputs("FAIL: videoio: stopped\n", stderr);
+            failed = 1;
+            break;
+        }
+        make_frame(frame, (size_t) WIDTH * HEIGHT * 4, stamps[i]);
+        sg_videoio_write(&vio, frame, stamps[i]);
+    }
+    if (sg_videoio_destroy(&vio)) {
+        fputs("FAIL: videoio: failed\n", stderr);
+        failed = 1;
+    }
+    if (sg_videoraw_finish(&raw, &err)) {
+        fputs("FAIL: videoio: could not finish\n", stderr);
+        sg_error_clear(&err);
+        failed = 1;
+    }
+    check_file("videoio", stamps, i, 1);
+}
+
+int
+main(int argc, char **argv)
+{
+    int fdes, compress;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: test_videoraw\n", stderr);
+        return 1;
+    }
+    fdes = mkstemp(path);
+    if (fdes < 0) {
+        fputs("error: could not create file\n", stderr);
+        return 1;
+    }
+    close(fdes);
+
+    test_compress();
+    for (compress = 0; compress < 2; compress++) {
+        test_file(SG_VIDEOFMT_RGB0, 1, 1, compress, 1);
+        test_file(SG_VIDEOFMT_RGB0, 640, 481, compress, 1);
+        test_file(SG_VIDEOFMT_YUV420P, 97, 55, compress, 1);
+        test_file(SG_VIDEOFMT_RGB0, 100, 100, compress, 0);
+    }
+    test_videoio();
+
+    unlink(path);
+    if (failed)
+        return 1;
+    fputs("ok\n", stderr);
+    return 0;
+}
@@ -0,0 +1,140 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Benchmark for writing sprites to vertex buffers.  Compares six
+   vertexes per sprite with sg_sprite_write2(), four vertexes per
+   sprite with sg_sprite_write4(), and one instance record per sprite
+   with sg_sprite_writeinstance(), and writing whole arrays with
+   sg_sprite_writearray2() and sg_sprite_writearray4().  Build with
+   optimization, e.g. "make CFLAGS=-O2".  */
+#define _POSIX_C_SOURCE 200112L
+#include "sg/sprite.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NSPRITE 100000
+#define NRUN 20
+#define NMODE 5
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned rand_state = 1618033988;
+
+static unsigned
+rand_next(void)
+{
+    rand_state = rand_state * 1664525u + 1013904223u;
+    return rand_state >> 8;
+}
+
+struct item {
+    struct sg_sprite sp;
+    short x, y;
+    sg_sprite_xform_t xform;
+};
+
+int
+main(int argc, char **argv)
+{
+    static const char *const NAME[NMODE] = {
+        "write2", "write4", "instance", "array2", "array4"
+    };
+    static const int NVERT[NMODE] = { 6, 4, 1, 6, 4 };
+    struct item *item;
+    struct sg_sprite *sp;
+    short *pos;
+    unsigned char *xform;
+    void *buf;
+    unsigned char *p;
+    double t, best[NMODE];
+    size_t size[NMODE];
+    int i, mode, run;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: bench_write\n", stderr);
+        return 1;
+    }
+
+    item = malloc(sizeof(*item) * NSPRITE);
+    sp = malloc(sizeof(*sp) * NSPRITE);
+    pos = malloc(sizeof(*pos) * 2 * NSPRITE);
+    xform = malloc(NSPRITE);
+    buf = malloc(sizeof(short) * 4 * 6 * NSPRITE);
+    if (!item || !sp || !pos || !xform || !buf) {
+        fputs("error: out of memory\n", stderr);
+        return 1;
+    }
+    for (i = 0; i < NSPRITE; i++) {
+        item[i].sp.x = rand_next() % 1024;
+        item[i].sp.y = rand_next() % 1024;
+        item[i].sp.w = 8 + rand_next() % 56;
+        item[i].sp.h = 8 + rand_next() % 56;
+        item[i].sp.cx = item[i].sp.w / 2;
+        item[i].sp.cy = item[i].sp.h / 2;
+        item[i].x = rand_next() % 1920;
+        item[i].y = rand_next() % 1080;
+        item[i].xform = (sg_sprite_xform_t) (rand_next() % 8);
+        sp[i] = item[i].sp;
+        pos[i*2+0] = item[i].x;
+        pos[i*2+1] = item[i].y;
+        xform[i] = (unsigned char) item[i].xform;
+    }
+
+    size[0] = sizeof(short) * 4 * 6;
+    size[1] = sizeof(short) * 4 * 4;
+    size[2] = sizeof(struct sg_sprite_instance);
+    size[3] = size[0];
+    size[4] = size[1];
+    for (run = 0; run < NRUN; run++) {
+        for (mode = 0; mode < NMODE; mode++) {
+            p = buf;
+            t = get_time();
+            switch (mode) {
+            case 0:
+                for (i = 0; i < NSPRITE; i++, p += size[0])
+                    sg_sprite_write2(p, sizeof(short) * 4, item[i].sp,
+                                     item[i].x, item[i].y, item[i].xform);
+                break;
+            case 1:
+                for (i = 0; i < NSPRITE; i++, p += size[1])
+                    sg_sprite_write4(p, sizeof(short) * 4, item[i].sp,
+                                     item[i].x, item[i].y, item[i].xform);
+                break;
+            case 2:
+                for (i = 0; i < NSPRITE; i++, p += size[2])
+                    sg_sprite_writeinstance(
+                        (struct sg_sprite_instance *) p, item[i].sp,
+                        item[i].x, item[i].y, item[i].xform);
+                break;
+            case 3:
+                sg_sprite_writearray2(buf, sp, pos, xform, NSPRITE);
+                break;
+            default:
+                sg_sprite_writearray4(buf, sp, pos, xform, NSPRITE);
+                break;
+            }
+            t = get_time() - t;
+            if (!run || t < best[mode])
+                best[mode] = t;
+        }
+    }
+
+    for (mode = 0; mode < NMODE; mode++)
+        printf("%-8s  %7.1f Msprite/s  %7.1f Mvertex/s  %2d bytes/quad\n",
+               NAME[mode], NSPRITE / best[mode] * 1e-6,
+               NSPRITE * NVERT[mode] / best[mode] * 1e-6, (int) size[mode]);
+    free(item);
+    free(sp);
+    free(pos);
+    free(xform);
+    free(buf);
+    return 0;
+}
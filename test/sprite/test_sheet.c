@@ -0,0 +1,294 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Test loading sprite sheets.  Sheets are written to a temporary
+   directory and loaded with sg_spritesheet_file(), which maps them
+   into memory.  */
+#define _POSIX_C_SOURCE 200809L
+#include "sg/error.h"
+#include "sg/hash.h"
+#include "sg/pixbuf.h"
+#include "sg/sprite.h"
+#include "src/core/file_impl.h"
+#include "src/core/sprite_impl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct sg_paths sg_paths;
+
+#define NSPRITE 100
+#define WIDTH 256
+#define HEIGHT 128
+
+static char tmpdir[] = "/tmp/test_sheet.XXXXXX";
+static char filepath[sizeof(tmpdir) + 16];
+static int failed;
+
+static void
+fail(const char *msg)
+{
+    fprintf(stderr, "FAIL: %s\n", msg);
+    failed = 1;
+}
+
+static unsigned rand_state = 1618033988;
+
+static unsigned
+rand_next(void)
+{
+    rand_state = rand_state * 1664525u + 1013904223u;
+    return rand_state >> 8;
+}
+
+static char names[NSPRITE * 16];
+
+static int
+entry_compare(const void *xp, const void *yp)
+{
+    const struct sg_spritesheet_entry *x = xp, *y = yp;
+    int r;
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+    r = memcmp(names + x->name, names + y->name,
+               x->namelen < y->namelen ? x->namelen : y->namelen);
+    return r ? r : (int) x->namelen - (int) y->namelen;
+}
+
+/* Create the contents of a sprite sheet file, with entries sorted by
+   hash.  */
+static char *
+make_sheet(struct sg_spritesheet_entry *entry, unsigned count,
+           size_t namesize, size_t *length)
+{
+    struct sg_spritesheet_header h;
+    size_t pixoff, i;
+    char *buf;
+
+    memcpy(h.magic, SG_SPRITESHEET_MAGIC, sizeof(h.magic));
+    h.version = SG_SPRITESHEET_VERSION;
+    h.spritecount = count;
+    h.namesize = (uint32_t) namesize;
+    h.width = WIDTH;
+    h.height = HEIGHT;
+    pixoff = sg_spritesheet_pixeloffset(count, h.namesize);
+    *length = pixoff + WIDTH * HEIGHT * 4;
+    buf = calloc(1, *length);
+    if (!buf) {
+        fputs("error: out of memory\n", stderr);
+        exit(1);
+    }
+    qsort(entry, count, sizeof(*entry), entry_compare);
+    memcpy(buf, &h, sizeof(h));
+    memcpy(buf + sizeof(h), entry, sizeof(*entry) * count);
+    memcpy(buf + sizeof(h) + sizeof(*entry) * count, names, namesize);
+    for (i = 0; i < WIDTH * HEIGHT * 4; i++)
+        buf[pixoff + i] = (char) i;
+    return buf;
+}
+
+static void
+write_file(const void *data, size_t length)
+{
+    FILE *fp = fopen(filepath, "wb");
+    if (!fp || fwrite(data, 1, length, fp) != length || fclose(fp)) {
+        fputs("error: could not write file\n", stderr);
+        exit(1);
+    }
+}
+
+static struct sg_spritesheet *
+load_sheet(const void *data, size_t length, struct sg_error **err)
+{
+    write_file(data, length);
+    return sg_spritesheet_file("sheet", 5, err);
+}
+
+static void
+test_lookup(struct sg_spritesheet_entry *entry, const char *buf,
+            size_t length)
+{
+    struct sg_error *err = NULL;
+    struct sg_spritesheet *sheet;
+    struct sg_sprite sp;
+    struct sg_pixbuf pbuf;
+    sg_sprite_xform_t xform;
+    char name[16];
+    unsigned i;
+    int len;
+
+    sheet = load_sheet(buf, length, &err);
+    if (!sheet) {
+        fprintf(stderr, "error: %s\n", err && err->msg ? err->msg : "?");
+        exit(1);
+    }
+    /* Names were generated in order, so name i is at entry.name ==
+       i * 16 after sorting.  */
+    for (i = 0; i < NSPRITE; i++) {
+        const struct sg_spritesheet_entry *e = NULL;
+        unsigned j;
+        len = sprintf(name, "dir/sprite%u", i);
+        for (j = 0; j < NSPRITE; j++) {
+            if (entry[j].name == i * 16)
+                e = &entry[j];
+        }
+        if (sg_spritesheet_get(sheet, name, len, &sp, &xform)) {
+            fail("sprite not found");
+            continue;
+        }
+        if (sp.x != e->sprite.x || sp.y != e->sprite.y ||
+            sp.w != e->sprite.w || sp.h != e->sprite.h ||
+            sp.cx != e->sprite.cx || sp.cy != e->sprite.cy ||
+            (int) xform != e->xform)
+            fail("wrong sprite");
+    }
+    if (!sg_spritesheet_get(sheet, "dir/sprite", 10, &sp, &xform))
+        fail("found prefix");
+    if (!sg_spritesheet_get(sheet, "dir/sprite1000", 14, &sp, &xform))
+        fail("found missing sprite");
+    if (!sg_spritesheet_get(sheet, "", 0, &sp, &xform))
+        fail("found empty name");
+
+    sg_spritesheet_pixbuf(sheet, &pbuf);
+    if (pbuf.format != SG_RGBA || pbuf.width != WIDTH ||
+        pbuf.height != HEIGHT || pbuf.rowbytes != WIDTH * 4 ||
+        memcmp(pbuf.data, buf + length - WIDTH * HEIGHT * 4,
+               WIDTH * HEIGHT * 4))
+        fail("wrong pixel data");
+    sg_spritesheet_free(sheet);
+}
+
+/* Check that a corrupted file is rejected.  */
+static void
+test_invalid(const char *what, const char *buf, size_t length)
+{
+    struct sg_error *err = NULL;
+    struct sg_spritesheet *sheet;
+    sheet = load_sheet(buf, length, &err);
+    if (sheet) {
+        fprintf(stderr, "FAIL: loaded sheet with %s\n", what);
+        failed = 1;
+        sg_spritesheet_free(sheet);
+    } else if (!err || err->domain != &SG_ERROR_DATA) {
+        fprintf(stderr, "FAIL: wrong error for sheet with %s\n", what);
+        failed = 1;
+    }
+    sg_error_clear(&err);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct sg_spritesheet_entry entry[NSPRITE], copy[NSPRITE];
+    struct sg_path path;
+    struct sg_spritesheet_header h;
+    size_t namesize, length, off;
+    char *buf, *bad;
+    unsigned i;
+    int len;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: test_sheet\n", stderr);
+        return 1;
+    }
+    if (!mkdtemp(tmpdir)) {
+        fputs("error: could not create temporary directory\n", stderr);
+        return 1;
+    }
+    sprintf(filepath, "%s/sheet.sheet", tmpdir);
+    path.len = strlen(tmpdir) + 1;
+    path.path = malloc(path.len + 1);
+    if (!path.path) {
+        fputs("error: out of memory\n", stderr);
+        return 1;
+    }
+    sprintf(path.path, "%s/", tmpdir);
+    sg_paths.path = &path;
+    sg_paths.pathcount = 1;
+    sg_paths.maxlen = (unsigned) path.len;
+
+    memset(entry, 0, sizeof(entry));
+    memset(names, 0, sizeof(names));
+    for (i = 0; i < NSPRITE; i++) {
+        len = sprintf(names + i * 16, "dir/sprite%u", i);
+        entry[i].hash = sg_hash64(names + i * 16, len, 0);
+        entry[i].name = i * 16;
+        entry[i].namelen = (uint16_t) len;
+        entry[i].xform = (uint16_t) (rand_next() % 8);
+        entry[i].sprite.w = (short) (rand_next() % 33);
+        entry[i].sprite.h = (short) (rand_next() % 33);
+        entry[i].sprite.x = (short) (rand_next() % (WIDTH - 32));
+        entry[i].sprite.y = (short) (rand_next() % (HEIGHT - 32));
+        entry[i].sprite.cx = (short) (rand_next() % 33);
+        entry[i].sprite.cy = (short) (rand_next() % 33);
+    }
+    /* Leave unused space in the name table, which is allowed.  */
+    namesize = (NSPRITE - 1) * 16 + 15;
+    buf = make_sheet(entry, NSPRITE, namesize, &length);
+    test_lookup(entry, buf, length);
+
+    bad = malloc(length);
+    if (!bad) {
+        fputs("error: out of memory\n", stderr);
+        return 1;
+    }
+    test_invalid("no data", buf, 0);
+    test_invalid("truncated header", buf, sizeof(h) - 1);
+    test_invalid("truncated pixels", buf, length - 1);
+
+    memcpy(bad, buf, length);
+    bad[0] ^= 1;
+    test_invalid("bad magic", bad, length);
+
+    memcpy(bad, buf, length);
+    memcpy(&h, bad, sizeof(h));
+    h.version++;
+    memcpy(bad, &h, sizeof(h));
+    test_invalid("bad version", bad, length);
+
+    off = sizeof(h);
+    memcpy(copy, buf + off, sizeof(copy));
+
+    memcpy(bad, buf, length);
+    copy[3].sprite.x = WIDTH - copy[3].sprite.w + 1;
+    memcpy(bad + off, copy, sizeof(copy));
+    test_invalid("sprite outside sheet", bad, length);
+
+    memcpy(copy, buf + off, sizeof(copy));
+    copy[5].namelen = (uint16_t) (namesize - copy[5].name + 1);
+    memcpy(bad + off, copy, sizeof(copy));
+    test_invalid("name outside name table", bad, length);
+
+    memcpy(copy, buf + off, sizeof(copy));
+    copy[7].xform = 8;
+    memcpy(bad + off, copy, sizeof(copy));
+    test_invalid("bad transform", bad, length);
+
+    memcpy(copy, buf + off, sizeof(copy));
+    copy[9].hash ^= 1;
+    memcpy(bad + off, copy, sizeof(copy));
+    test_invalid("wrong hash", bad, length);
+
+    memcpy(copy, buf + off, sizeof(copy));
+    copy[10] = copy[11];
+    memcpy(bad + off, copy, sizeof(copy));
+    test_invalid("duplicate sprite", bad, length);
+
+    memcpy(copy, buf + off, sizeof(copy));
+    copy[12] = copy[13];
+    memcpy(&copy[13], buf + off + sizeof(*copy) * 12, sizeof(*copy));
+    memcpy(bad + off, copy, sizeof(copy));
+    test_invalid("unsorted sprites", bad, length);
+
+    remove(filepath);
+    rmdir(tmpdir);
+    free(bad);
+    free(buf);
+    free(path.path);
+    if (failed)
+        return 1;
+    fputs("ok\n", stderr);
+    return 0;
+}
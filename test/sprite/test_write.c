@@ -48,6 +48,67 @@ assert_equal(short (*const x)[4], short (*const y)[4])
     }
 }
 
+#define NSPRITE 37
+
+static unsigned rand_state = 1618033988;
+
+static unsigned
+rand_next(void)
+{
+    rand_state = rand_state * 1664525u + 1013904223u;
+    return rand_state >> 8;
+}
+
+/* Check sprite arrays against the sprites written individually.  */
+static void
+test_array(void)
+{
+    static short vert1[NSPRITE][NVERTEX][4], vert2[NSPRITE][NVERTEX][4];
+    struct sg_sprite sp[NSPRITE];
+    short pos[NSPRITE][2];
+    unsigned char xform[NSPRITE];
+    int i, n;
+
+    for (i = 0; i < NSPRITE; i++) {
+        sp[i].x = (short) (rand_next() % 2048 - 512);
+        sp[i].y = (short) (rand_next() % 2048 - 512);
+        sp[i].w = (short) (rand_next() % 256);
+        sp[i].h = (short) (rand_next() % 256);
+        sp[i].cx = (short) (rand_next() % 512 - 128);
+        sp[i].cy = (short) (rand_next() % 512 - 128);
+        pos[i][0] = (short) (rand_next() % 4096 - 1024);
+        pos[i][1] = (short) (rand_next() % 4096 - 1024);
+        xform[i] = (unsigned char) (i & 7);
+    }
+
+    /* Without and with transformations.  */
+    for (n = 0; n < 2; n++) {
+        memset(vert2, 0, sizeof(vert2));
+        sg_sprite_writearray2(vert2[0][0], sp, pos[0], n ? xform : NULL,
+                              NSPRITE);
+        for (i = 0; i < NSPRITE; i++) {
+            sg_sprite_write2(vert1[i], sizeof(*vert1[i]), sp[i],
+                             pos[i][0], pos[i][1],
+                             n ? (sg_sprite_xform_t) xform[i] : SG_X_NORMAL);
+            assert_equal(vert1[i], vert2[i]);
+        }
+
+        memset(vert2, 0, sizeof(vert2));
+        sg_sprite_writearray4(vert2[0][0], sp, pos[0], n ? xform : NULL,
+                              NSPRITE);
+        for (i = 0; i < NSPRITE; i++) {
+            sg_sprite_write4(vert1[i], sizeof(*vert1[i]), sp[i],
+                             pos[i][0], pos[i][1],
+                             n ? (sg_sprite_xform_t) xform[i] : SG_X_NORMAL);
+            if (memcmp(vert1[i], (short *) vert2 + i * 16,
+                       sizeof(short) * 16)) {
+                fputs("FAIL\n", stderr);
+                exit(1);
+            }
+        }
+    }
+}
+
 int
 main(int argc, char **argv)
 {
@@ -59,9 +120,11 @@ main(int argc, char **argv)
         { 1, 0 },
         { 1, 1 }
     };
-    short vert1[NVERTEX][4], vert2[NVERTEX][4];
+    short vert1[NVERTEX][4], vert2[NVERTEX][4], vert4[4][4];
+    unsigned short index[6 * 2];
+    struct sg_sprite_instance inst;
     struct sg_sprite sp;
-    int x, y, xfi, i;
+    int x, y, xfi, i, c, vx, vy;
     sg_sprite_xform_t xform;
 
     (void) argc;
@@ -93,8 +156,36 @@ main(int argc, char **argv)
         }
         sg_sprite_write2(vert2, sizeof(*vert2), sp, x, y, xform);
         assert_equal(vert1, vert2);
+
+        /* Indexed quads, using the indexes for the second quad.  */
+        sg_sprite_write4(vert4, sizeof(*vert4), sp, x, y, xform);
+        sg_quad_writeindex(index, 2);
+        for (i = 0; i < NVERTEX; i++)
+            memcpy(vert2[i], vert4[index[6 + i] - 4], sizeof(*vert2));
+        assert_equal(vert1, vert2);
+
+        /* Instanced quads, expanded as a vertex shader would.  */
+        sg_sprite_writeinstance(&inst, sp, x, y, xform);
+        for (i = 0; i < NVERTEX; i++) {
+            c = index[i];
+            vert2[i][0] = (c & 1) * inst.w;
+            vert2[i][1] = (c >> 1) * inst.h;
+        }
+        vert_xform(vert2, (sg_sprite_xform_t) inst.xform, 0, 0);
+        for (i = 0; i < NVERTEX; i++) {
+            c = index[i];
+            vx = vert2[i][0] + inst.vx;
+            vy = vert2[i][1] + inst.vy;
+            vert2[i][0] = vx;
+            vert2[i][1] = vy;
+            vert2[i][2] = inst.tx + (c & 1) * inst.w;
+            vert2[i][3] = inst.ty + (c >> 1) * inst.h;
+        }
+        assert_equal(vert1, vert2);
     }
 
+    test_array();
+
     fputs("ok\n", stderr);
     return 0;
 }
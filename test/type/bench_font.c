@@ -0,0 +1,106 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Benchmark for building a complete font atlas.  Renders every glyph
+   in Roboto at several sizes, and the shared distance field atlas,
+   with different numbers of threads, and reports the best time of
+   several runs.  Build with optimization,
+   e.g. "make CFLAGS=-O2".  */
+#define _POSIX_C_SOURCE 200112L
+#include "sg/error.h"
+#include "sg/thread.h"
+#include "sg/type.h"
+#include "src/type/private.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char FONT_PATH[] = "font/Roboto-Regular";
+
+static const float SIZES[] = { 12.0f, 24.0f, 48.0f, 96.0f };
+
+#define NRUN 5
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Render a font, or the distance field atlas if size is zero.  */
+static double
+bench(struct sg_typeface *tp, float size, int nthread)
+{
+    struct sg_font *fp;
+    struct sg_error *err = NULL;
+    double t, best = 0.0;
+    int i;
+
+    for (i = 0; i < NRUN; i++) {
+        t = get_time();
+        fp = size > 0.0f ? sg_font_new(tp, size, &err) :
+            sg_font_newsdf(tp, 16.0f, &err);
+        if (!fp)
+            die_error("sg_font_new", err);
+        if (sg_font_renderall(fp, nthread, &err))
+            die_error("sg_font_renderall", err);
+        t = get_time() - t;
+        sg_font_decref(fp);
+        if (!i || t < best)
+            best = t;
+    }
+    return best;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct sg_typeface *tp;
+    struct sg_error *err = NULL;
+    int maxthread, nthread;
+    unsigned i;
+    double t, t1;
+
+    maxthread = sg_thread_cpucount();
+    if (argc >= 2)
+        maxthread = (int) strtol(argv[1], NULL, 0);
+    if (argc > 2 || maxthread < 1) {
+        fputs("Usage: bench_font [MAXTHREADS]\n", stderr);
+        return 1;
+    }
+
+    test_paths(NULL);
+
+    tp = sg_typeface_file(FONT_PATH, strlen(FONT_PATH), &err);
+    if (!tp)
+        die_error("sg_typeface_file", err);
+
+    for (i = 0; i <= sizeof(SIZES) / sizeof(*SIZES); i++) {
+        t1 = 0.0;
+        for (nthread = 1; ; nthread *= 2) {
+            if (nthread > maxthread)
+                nthread = maxthread;
+            if (i < sizeof(SIZES) / sizeof(*SIZES)) {
+                t = bench(tp, SIZES[i], nthread);
+                printf("size %5.1f", SIZES[i]);
+            } else {
+                t = bench(tp, 0.0f, nthread);
+                printf("sdf       ");
+            }
+            if (nthread == 1)
+                t1 = t;
+            printf("  threads %3d  %8.2f ms  speedup %5.2f\n",
+                   nthread, t * 1e3, t1 / t);
+            fflush(stdout);
+            if (nthread >= maxthread)
+                break;
+        }
+    }
+
+    sg_typeface_decref(tp);
+    return 0;
+}
@@ -0,0 +1,123 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Benchmark for the font cache.  For Roboto at several sizes,
+   compares the time to create a font and render every glyph against
+   the time to load the same font from the cache.  The cache is
+   written to the given directory, which is used as the user path.
+   Build with optimization, e.g. "make CFLAGS=-O2".  */
+#define _POSIX_C_SOURCE 200112L
+#include "sg/error.h"
+#include "sg/file.h"
+#include "sg/type.h"
+#include "src/core/file_impl.h"
+#include "src/core/private.h"
+#include "src/type/private.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char FONT_PATH[] = "font/Roboto-Regular";
+
+static const float SIZES[] = { 12.0f, 24.0f, 48.0f, 96.0f };
+
+#define NRUN 5
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Create a font and render all of its glyphs, and return the time.
+   If 'glyph' is not NULL, the glyph table is copied to it.  */
+static double
+build(struct sg_typeface *tp, float size, struct sg_font_glyph *glyph,
+      int *glyphcount)
+{
+    struct sg_font *fp;
+    struct sg_error *err = NULL;
+    double t;
+    int i;
+
+    t = get_time();
+    fp = sg_font_new(tp, size, &err);
+    if (!fp)
+        die_error("sg_font_new", err);
+    if (sg_font_renderall(fp, 0, &err))
+        die_error("sg_font_renderall", err);
+    t = get_time() - t;
+    for (i = 0; i < fp->glyphcount; i++)
+        if (!(fp->glyph[i].flags & SG_FONT_GLYPH_LOADED))
+            die("glyph not loaded");
+    if (glyph)
+        memcpy(glyph, fp->glyph, sizeof(*glyph) * fp->glyphcount);
+    *glyphcount = fp->glyphcount;
+    sg_font_decref(fp);
+    return t;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct sg_typeface *tp;
+    struct sg_error *err = NULL;
+    struct sg_font_glyph *g1, *g2;
+    unsigned i;
+    int j, n;
+    double t, tbuild, tload;
+
+    if (argc != 2) {
+        fputs("Usage: bench_fontcache DIR\n", stderr);
+        return 1;
+    }
+    test_paths(argv[1]);
+    sg_filesave_init();
+
+    tp = sg_typeface_file(FONT_PATH, strlen(FONT_PATH), &err);
+    if (!tp)
+        die_error("sg_typeface_file", err);
+    g1 = malloc(sizeof(*g1) * tp->face->num_glyphs);
+    g2 = malloc(sizeof(*g2) * tp->face->num_glyphs);
+    if (!g1 || !g2)
+        die("out of memory");
+
+    for (i = 0; i < sizeof(SIZES) / sizeof(*SIZES); i++) {
+        /* Without the cache.  */
+        test_fontcache(0);
+        tbuild = 0.0;
+        for (j = 0; j < NRUN; j++) {
+            t = build(tp, SIZES[i], g1, &n);
+            if (!j || t < tbuild)
+                tbuild = t;
+        }
+
+        /* Write the cache, then load from it.  */
+        test_fontcache(1);
+        build(tp, SIZES[i], NULL, &n);
+        sg_file_savewait();
+        tload = 0.0;
+        for (j = 0; j < NRUN; j++) {
+            t = build(tp, SIZES[i], g2, &n);
+            if (!j || t < tload)
+                tload = t;
+        }
+        if (memcmp(g1, g2, sizeof(*g1) * n))
+            die("cached font differs");
+
+        printf("size %5.1f  render %8.3f ms  cached %8.3f ms  "
+               "saved %8.3f ms\n",
+               SIZES[i], tbuild * 1e3, tload * 1e3,
+               (tbuild - tload) * 1e3);
+        fflush(stdout);
+    }
+
+    sg_typeface_decref(tp);
+    free(g1);
+    free(g2);
+    return 0;
+}
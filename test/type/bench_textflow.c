@@ -0,0 +1,196 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Benchmark for adding text to a text flow.  Measures the throughput
+   of sg_textflow_addtext() in MB of UTF-8 text per second, for
+   English, Latin-1, Cyrillic, and mixed text, with all glyphs already
+   rendered.  For comparison, also measures a simple loop which
+   decodes one byte at a time and calls FT_Get_Char_Index() for each
+   character.  Build with optimization, e.g. "make CFLAGS=-O2".  */
+#define _POSIX_C_SOURCE 200112L
+#include "sg/error.h"
+#include "sg/type.h"
+#include "src/type/private.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char FONT_PATH[] = "font/Roboto-Regular";
+
+#define TEXT_SIZE (1024 * 1024)
+#define NRUN 5
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned rand_state = 1618033988;
+
+static unsigned
+rand_next(void)
+{
+    rand_state = rand_state * 1664525u + 1013904223u;
+    return rand_state >> 8;
+}
+
+static size_t
+encode(char *p, unsigned c)
+{
+    if (c < 0x80) {
+        p[0] = (char) c;
+        return 1;
+    } else if (c < 0x800) {
+        p[0] = (char) (0xc0 | (c >> 6));
+        p[1] = (char) (0x80 | (c & 0x3f));
+        return 2;
+    } else {
+        p[0] = (char) (0xe0 | (c >> 12));
+        p[1] = (char) (0x80 | ((c >> 6) & 0x3f));
+        p[2] = (char) (0x80 | (c & 0x3f));
+        return 3;
+    }
+}
+
+/* Make text with words of random characters from the given set.  */
+static size_t
+make_text(char *buf, size_t size, const unsigned *chars, unsigned nchars)
+{
+    size_t len = 0;
+    unsigned i, n;
+    while (len + 64 < size) {
+        n = 2 + rand_next() % 8;
+        for (i = 0; i < n; i++)
+            len += encode(buf + len, chars[rand_next() % nchars]);
+        buf[len++] = ' ';
+    }
+    return len;
+}
+
+/* The old implementation, for comparison.  */
+static unsigned
+baseline(FT_Face face, const char *text, size_t length, unsigned short *out)
+{
+    const unsigned char *ptr = (const unsigned char *) text,
+        *end = ptr + length;
+    unsigned c, n = 0;
+    while (ptr < end) {
+        c = *ptr;
+        if (c < 0x80) {
+            ptr += 1;
+        } else if ((c & 0xe0) == 0xc0) {
+            if (end - ptr < 2)
+                break;
+            c = ((c & 0x1f) << 6) | (ptr[1] & 0x3f);
+            ptr += 2;
+        } else if ((c & 0xf0) == 0xe0) {
+            if (end - ptr < 3)
+                break;
+            c = ((c & 0x0f) << 12) | ((ptr[1] & 0x3f) << 6) |
+                (ptr[2] & 0x3f);
+            ptr += 3;
+        } else {
+            break;
+        }
+        out[n++] = (unsigned short) FT_Get_Char_Index(face, c);
+    }
+    return n;
+}
+
+static void
+bench(const char *name, struct sg_font *fp, const char *text, size_t len)
+{
+    struct sg_error *err = NULL;
+    struct sg_textflow *flow;
+    unsigned short *out;
+    double t, best = 0.0, bbest = 0.0;
+    int i;
+
+    out = malloc(sizeof(*out) * len);
+    if (!out)
+        die_error("malloc", NULL);
+    for (i = 0; i < NRUN; i++) {
+        t = get_time();
+        flow = sg_textflow_new(&err);
+        if (!flow)
+            die_error("sg_textflow_new", err);
+        sg_textflow_setfont(flow, fp);
+        sg_textflow_addtext(flow, text, len);
+        if (flow->err)
+            die_error("sg_textflow_addtext", flow->err);
+        sg_textflow_free(flow);
+        t = get_time() - t;
+        if (!i || t < best)
+            best = t;
+
+        t = get_time();
+        baseline(fp->typeface->face, text, len, out);
+        t = get_time() - t;
+        if (!i || t < bbest)
+            bbest = t;
+    }
+    printf("%-8s  addtext %8.1f MB/s  baseline %8.1f MB/s\n",
+           name, len / best * 1e-6, len / bbest * 1e-6);
+    free(out);
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned english[96], latin1[96 + 96], cyrillic[96], mixed[96 * 3];
+    struct sg_typeface *tp;
+    struct sg_font *fp;
+    struct sg_error *err = NULL;
+    char *text;
+    size_t len;
+    unsigned i;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: bench_textflow\n", stderr);
+        return 1;
+    }
+
+    test_paths(NULL);
+    tp = sg_typeface_file(FONT_PATH, strlen(FONT_PATH), &err);
+    if (!tp)
+        die_error("sg_typeface_file", err);
+    fp = sg_font_new(tp, 16.0f, &err);
+    if (!fp)
+        die_error("sg_font_new", err);
+    if (sg_font_renderall(fp, 0, &err))
+        die_error("sg_font_renderall", err);
+
+    for (i = 0; i < 96; i++) {
+        english[i] = i < 52 ? (i < 26 ? 'a' + i : 'A' + i - 26) :
+            'a' + i % 26;
+        latin1[i] = english[i];
+        latin1[96 + i] = 0xa0 + i % 0x60;
+        cyrillic[i] = 0x410 + i % 0x40;
+        mixed[i] = english[i];
+        mixed[96 + i] = cyrillic[i];
+        mixed[192 + i] = 0x2000 + i % 0x70;
+    }
+
+    text = malloc(TEXT_SIZE);
+    if (!text)
+        die_error("malloc", NULL);
+    len = make_text(text, TEXT_SIZE, english, 96);
+    bench("english", fp, text, len);
+    len = make_text(text, TEXT_SIZE, latin1, 192);
+    bench("latin1", fp, text, len);
+    len = make_text(text, TEXT_SIZE, cyrillic, 96);
+    bench("cyrillic", fp, text, len);
+    len = make_text(text, TEXT_SIZE, mixed, 288);
+    bench("mixed", fp, text, len);
+    free(text);
+
+    sg_font_decref(fp);
+    sg_typeface_decref(tp);
+    return 0;
+}
@@ -0,0 +1,200 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Benchmark for relayout after each keystroke.  A character is
+   appended to a document of 1k, 10k, or 100k glyphs, and the document
+   is laid out again with sg_textlayout_create(), with
+   sg_textlayout_update(), and with sg_textcache_get() when the text
+   has not changed.  Times are in microseconds per keystroke.  Also
+   measures creating a layout of the 100k glyph document in each
+   vertex format.  Build with optimization, e.g. "make CFLAGS=-O2".  */
+#define _POSIX_C_SOURCE 200112L
+#include "sg/error.h"
+#include "sg/type.h"
+#include "src/type/private.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char FONT_PATH[] = "font/Roboto-Regular";
+
+#define NKEY 100
+#define NRUN 5
+#define WIDTH 800
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned rand_state = 1618033988;
+
+static unsigned
+rand_next(void)
+{
+    rand_state = rand_state * 1664525u + 1013904223u;
+    return rand_state >> 8;
+}
+
+static struct sg_textflow *
+make_flow(struct sg_font *fp, const char *text, size_t len,
+          enum sg_textformat format)
+{
+    struct sg_error *err = NULL;
+    struct sg_textflow *flow;
+    flow = sg_textflow_new(&err);
+    if (!flow)
+        die_error("sg_textflow_new", err);
+    sg_textflow_setfont(flow, fp);
+    sg_textflow_setwidth(flow, (float) WIDTH);
+    sg_textflow_setformat(flow, format);
+    sg_textflow_addtext(flow, text, len);
+    if (flow->err)
+        die_error("sg_textflow_addtext", flow->err);
+    return flow;
+}
+
+/* Type NKEY characters at the end of the text.  Returns the time in
+   microseconds per keystroke.  */
+static double
+type_text(int mode, struct sg_font *fp, const char *text, size_t len)
+{
+    static const char KEYS[] = "abcdefghijklmnopqrstuvwxyz ";
+    struct sg_error *err = NULL;
+    struct sg_textflow *flow;
+    struct sg_textlayout layout;
+    struct sg_textcache *cache = NULL;
+    double t, best = 0.0;
+    int i, j;
+
+    for (i = 0; i < NRUN; i++) {
+        flow = make_flow(fp, text, len, SG_TEXTFORMAT_TRIANGLES);
+        if (mode == 2) {
+            cache = sg_textcache_new(4, &err);
+            if (!cache)
+                die_error("sg_textcache_new", err);
+            if (!sg_textcache_get(cache, flow, &err))
+                die_error("sg_textcache_get", err);
+        } else if (sg_textlayout_create(&layout, flow, &err)) {
+            die_error("sg_textlayout_create", err);
+        }
+        t = get_time();
+        for (j = 0; j < NKEY; j++) {
+            switch (mode) {
+            case 0:
+                sg_textflow_addtext(flow, &KEYS[rand_next() % 27], 1);
+                sg_textlayout_destroy(&layout);
+                if (sg_textlayout_create(&layout, flow, &err))
+                    die_error("sg_textlayout_create", err);
+                break;
+            case 1:
+                sg_textflow_addtext(flow, &KEYS[rand_next() % 27], 1);
+                if (sg_textlayout_update(&layout, flow, &err))
+                    die_error("sg_textlayout_update", err);
+                break;
+            default:
+                if (!sg_textcache_get(cache, flow, &err))
+                    die_error("sg_textcache_get", err);
+                break;
+            }
+        }
+        t = get_time() - t;
+        if (!i || t < best)
+            best = t;
+        if (mode == 2)
+            sg_textcache_free(cache);
+        else
+            sg_textlayout_destroy(&layout);
+        sg_textflow_free(flow);
+    }
+    return best * 1e6 / NKEY;
+}
+
+/* Create a layout in the given format.  */
+static void
+bench_format(const char *name, enum sg_textformat format,
+             struct sg_font *fp, const char *text, size_t len)
+{
+    struct sg_error *err = NULL;
+    struct sg_textflow *flow;
+    struct sg_textlayout layout;
+    double t, best = 0.0;
+    size_t size;
+    int i;
+
+    flow = make_flow(fp, text, len, format);
+    for (i = 0; i < NRUN; i++) {
+        t = get_time();
+        if (sg_textlayout_create(&layout, flow, &err))
+            die_error("sg_textlayout_create", err);
+        t = get_time() - t;
+        if (!i || t < best)
+            best = t;
+        size = layout.format == SG_TEXTFORMAT_INSTANCES ?
+            sizeof(*layout.quad) * layout.quadcount :
+            sizeof(*layout.vert) * layout.vertcount;
+        sg_textlayout_destroy(&layout);
+    }
+    printf("%-9s  create %7.1f us  %6.1f Mglyph/s  %2d bytes/glyph\n",
+           name, best * 1e6, flow->drawcount / best * 1e-6,
+           (int) (size / flow->drawcount));
+    sg_textflow_free(flow);
+}
+
+int
+main(int argc, char **argv)
+{
+    static const int SIZES[] = { 1000, 10000, 100000 };
+    struct sg_typeface *tp;
+    struct sg_font *fp;
+    struct sg_error *err = NULL;
+    char *text;
+    size_t len;
+    unsigned i, j, n;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: bench_textlayout\n", stderr);
+        return 1;
+    }
+
+    test_paths(NULL);
+    tp = sg_typeface_file(FONT_PATH, strlen(FONT_PATH), &err);
+    if (!tp)
+        die_error("sg_typeface_file", err);
+    fp = sg_font_new(tp, 16.0f, &err);
+    if (!fp)
+        die_error("sg_font_new", err);
+    if (sg_font_renderall(fp, 0, &err))
+        die_error("sg_font_renderall", err);
+
+    text = malloc(SIZES[2]);
+    if (!text)
+        die_error("malloc", NULL);
+    for (i = 0; i < sizeof(SIZES) / sizeof(*SIZES); i++) {
+        len = 0;
+        while (len < (size_t) SIZES[i]) {
+            n = 2 + rand_next() % 8;
+            for (j = 0; j < n && len < (size_t) SIZES[i] - 1; j++)
+                text[len++] = (char) ('a' + rand_next() % 26);
+            text[len++] = ' ';
+        }
+        printf("%6d glyphs  create %9.1f us  update %7.1f us  "
+               "cache hit %7.1f us\n", SIZES[i],
+               type_text(0, fp, text, len), type_text(1, fp, text, len),
+               type_text(2, fp, text, len));
+    }
+    bench_format("triangles", SG_TEXTFORMAT_TRIANGLES, fp, text, len);
+    bench_format("quads", SG_TEXTFORMAT_QUADS, fp, text, len);
+    bench_format("instances", SG_TEXTFORMAT_INSTANCES, fp, text, len);
+    free(text);
+
+    sg_font_decref(fp);
+    sg_typeface_decref(tp);
+    return 0;
+}
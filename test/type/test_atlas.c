@@ -0,0 +1,315 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Test for the glyph atlas.  Glyphs are rendered lazily into the
+   atlas, without OpenGL, and the atlas contents are compared against
+   glyphs rendered directly by FreeType.  Rendering all glyphs in
+   parallel must give the same atlas as rendering them one at a time.
+   If a directory is given, the atlas pages are written to it as PGM
+   files.  */
+#include "sg/error.h"
+#include "sg/type.h"
+#include "src/type/private.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char FONT_PATH[] = "font/Roboto-Regular";
+
+static const char TEXT[] =
+    "The quick brown fox jumps over the lazy dog.  "
+    "\xc3\x86sir \xc3\xbe\xc3\xa6r \xe2\x80\x94 \xe2\x82\xac" "5";
+
+static int failed;
+
+static void
+fail(const char *what, struct sg_font *fp, unsigned index)
+{
+    fprintf(stderr, "fail: %s (size %d, glyph %u)\n",
+            what, fp->size >> 6, index);
+    failed = 1;
+}
+
+/* Check that a loaded glyph matches FreeType's rendering.  */
+static void
+check_glyph(struct sg_font *fp, unsigned index)
+{
+    struct sg_font_glyph *g = &fp->glyph[index];
+    struct sg_glyphpage *page;
+    struct sg_typeface *tp = fp->typeface;
+    FT_GlyphSlot slot;
+    const unsigned char *ip, *ap;
+    int y, rb;
+
+    if ((g->flags & SG_FONT_GLYPH_LOADED) == 0) {
+        fail("glyph not loaded", fp, index);
+        return;
+    }
+    if (FT_Set_Char_Size(tp->face, 0, fp->size, 72, 72) ||
+        FT_Load_Glyph(tp->face, index, FT_LOAD_TARGET_NORMAL) ||
+        FT_Render_Glyph(tp->face->glyph, FT_RENDER_MODE_NORMAL))
+        die("could not render glyph");
+    tp->cursize = 0;
+    slot = tp->face->glyph;
+    if (g->advance != slot->advance.x >> 6)
+        fail("advance", fp, index);
+    if (slot->bitmap.width == 0 || slot->bitmap.rows == 0) {
+        if (g->w != 0 || g->h != 0)
+            fail("empty glyph has size", fp, index);
+        return;
+    }
+    if (g->w != (int) slot->bitmap.width ||
+        g->h != (int) slot->bitmap.rows ||
+        g->bx != slot->bitmap_left || g->by != slot->bitmap_top) {
+        fail("metrics", fp, index);
+        return;
+    }
+    if (g->page >= fp->atlas.pagecount) {
+        fail("page", fp, index);
+        return;
+    }
+    page = &fp->atlas.page[g->page];
+    if (g->x < 0 || g->y < 0 ||
+        g->x + g->w > page->pixbuf.width ||
+        g->y + g->h > page->pixbuf.height) {
+        fail("bounds", fp, index);
+        return;
+    }
+    rb = page->pixbuf.rowbytes;
+    ap = (const unsigned char *) page->pixbuf.data + g->y * rb + g->x;
+    ip = slot->bitmap.buffer;
+    for (y = 0; y < g->h; y++) {
+        if (memcmp(ap + y * rb, ip + y * slot->bitmap.pitch, g->w)) {
+            fail("bitmap", fp, index);
+            return;
+        }
+    }
+}
+
+/* Check that no two glyphs in the atlas overlap.  */
+static void
+check_overlap(struct sg_font *fp)
+{
+    struct sg_font_glyph *a, *b;
+    int i, j, n = fp->glyphcount;
+
+    for (i = 0; i < n; i++) {
+        a = &fp->glyph[i];
+        if (!(a->flags & SG_FONT_GLYPH_LOADED) || !a->w)
+            continue;
+        for (j = i + 1; j < n; j++) {
+            b = &fp->glyph[j];
+            if (!(b->flags & SG_FONT_GLYPH_LOADED) || !b->w ||
+                a->page != b->page)
+                continue;
+            if (a->x < b->x + b->w && b->x < a->x + a->w &&
+                a->y < b->y + b->h && b->y < a->y + a->h)
+                fail("overlap", fp, i);
+        }
+    }
+}
+
+static int
+count_loaded(struct sg_font *fp)
+{
+    int i, n = 0;
+    for (i = 0; i < fp->glyphcount; i++)
+        n += (fp->glyph[i].flags & SG_FONT_GLYPH_LOADED) != 0;
+    return n;
+}
+
+static void
+write_pages(const char *dir, struct sg_font *fp)
+{
+    struct sg_glyphpage *page;
+    char path[1024];
+    FILE *file;
+    unsigned i;
+    int y;
+
+    for (i = 0; i < fp->atlas.pagecount; i++) {
+        page = &fp->atlas.page[i];
+        snprintf(path, sizeof(path), "%s/atlas_%d_%u.pgm",
+                 dir, fp->size >> 6, i);
+        file = fopen(path, "wb");
+        if (!file)
+            die("could not write page");
+        fprintf(file, "P5 %d %d 255\n",
+                page->pixbuf.width, page->pixbuf.height);
+        for (y = 0; y < page->pixbuf.height; y++)
+            fwrite((const char *) page->pixbuf.data +
+                   y * page->pixbuf.rowbytes,
+                   1, page->pixbuf.width, file);
+        fclose(file);
+    }
+}
+
+/* Add text to a flow, and check that exactly the glyphs in the text
+   were rendered.  */
+static void
+test_lazy(struct sg_font *fp)
+{
+    struct sg_textflow *flow;
+    struct sg_textlayout layout;
+    struct sg_error *err = NULL;
+    unsigned i, pagecount, total;
+    int loaded;
+
+    if (fp->atlas.pagecount || count_loaded(fp))
+        fail("glyphs rendered before use", fp, 0);
+
+    flow = sg_textflow_new(&err);
+    if (!flow)
+        die_error("sg_textflow_new", err);
+    sg_textflow_setfont(flow, fp);
+    sg_textflow_addtext(flow, TEXT, strlen(TEXT));
+    if (sg_textlayout_create(&layout, flow, &err))
+        die_error("sg_textlayout_create", err);
+    for (i = 0; i < flow->glyphcount; i++)
+        check_glyph(fp, flow->glyph[i].index);
+    loaded = count_loaded(fp);
+    if (loaded > (int) flow->glyphcount)
+        fail("too many glyphs rendered", fp, 0);
+    if (!fp->atlas.pagecount ||
+        fp->atlas.page[0].dirty.y0 >= fp->atlas.page[0].dirty.y1)
+        fail("atlas not dirty", fp, 0);
+
+    total = 0;
+    for (i = 0; i < (unsigned) layout.batchcount; i++) {
+        if (layout.batch[i].font != fp ||
+            (unsigned) layout.batch[i].page >= fp->atlas.pagecount ||
+            layout.batch[i].offset != (int) total)
+            fail("batch", fp, i);
+        total += layout.batch[i].count;
+    }
+    if (total != flow->drawcount * 6 || (int) total != layout.vertcount)
+        fail("vertex count", fp, 0);
+    sg_textlayout_destroy(&layout);
+
+    /* Adding the same text again renders nothing new.  */
+    sg_glyphatlas_clean(&fp->atlas);
+    pagecount = fp->atlas.pagecount;
+    sg_textflow_addtext(flow, TEXT, strlen(TEXT));
+    if (count_loaded(fp) != loaded || fp->atlas.pagecount != pagecount)
+        fail("glyphs rendered twice", fp, 0);
+    for (i = 0; i < fp->atlas.pagecount; i++)
+        if (fp->atlas.page[i].dirty.y0 < fp->atlas.page[i].dirty.y1)
+            fail("atlas dirty after adding loaded glyphs", fp, 0);
+    sg_textflow_free(flow);
+}
+
+/* Render every glyph in the font.  */
+static void
+test_all(struct sg_font *fp)
+{
+    struct sg_error *err = NULL;
+    int i;
+
+    for (i = 0; i < fp->glyphcount; i++)
+        if (!sg_font_getglyph(fp, i, &err))
+            die_error("sg_font_getglyph", err);
+    for (i = 0; i < fp->glyphcount; i++)
+        check_glyph(fp, i);
+    check_overlap(fp);
+    printf("size %3d: %d glyphs, %u pages of %dx%d\n",
+           fp->size >> 6, fp->glyphcount, fp->atlas.pagecount,
+           fp->atlas.pagesize, fp->atlas.pagesize);
+}
+
+/* Render all glyphs in parallel, and check that the result is the
+   same as rendering them one at a time.  The fonts must be derived
+   from different typefaces, or they would be the same font.  */
+static void
+test_parallel(struct sg_font *serial, struct sg_font *fp, int nthread)
+{
+    struct sg_error *err = NULL;
+    struct sg_glyphpage *a, *b;
+    unsigned i;
+    int y;
+
+    /* Load some glyphs lazily first, like the serial font.  */
+    test_lazy(fp);
+    if (sg_font_renderall(fp, nthread, &err))
+        die_error("sg_font_renderall", err);
+    if (memcmp(fp->glyph, serial->glyph,
+               sizeof(*fp->glyph) * fp->glyphcount))
+        fail("parallel glyph table differs", fp, 0);
+    if (fp->atlas.pagecount != serial->atlas.pagecount) {
+        fail("parallel page count differs", fp, 0);
+        return;
+    }
+    for (i = 0; i < fp->atlas.pagecount; i++) {
+        a = &serial->atlas.page[i];
+        b = &fp->atlas.page[i];
+        for (y = 0; y < a->pixbuf.height; y++) {
+            if (memcmp((const char *) a->pixbuf.data + y * a->pixbuf.rowbytes,
+                       (const char *) b->pixbuf.data + y * b->pixbuf.rowbytes,
+                       a->pixbuf.width)) {
+                fail("parallel bitmap differs", fp, i);
+                break;
+            }
+        }
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    static const float SIZES[] = { 12.0f, 24.0f, 72.0f };
+    struct sg_typeface *tp, *tp2;
+    struct sg_font *fp[3], *fp2;
+    struct sg_error *err = NULL;
+    unsigned i;
+
+    if (argc > 2) {
+        fputs("Usage: test_atlas [OUTDIR]\n", stderr);
+        return 1;
+    }
+
+    test_paths(NULL);
+
+    tp = sg_typeface_file(FONT_PATH, strlen(FONT_PATH), &err);
+    if (!tp)
+        die_error("sg_typeface_file", err);
+    for (i = 0; i < 3; i++) {
+        fp[i] = sg_font_new(tp, SIZES[i], &err);
+        if (!fp[i])
+            die_error("sg_font_new", err);
+    }
+    /* Alternate between fonts, which share a FreeType face.  */
+    for (i = 0; i < 3; i++)
+        test_lazy(fp[i]);
+    for (i = 0; i < 3; i++)
+        check_glyph(fp[i], FT_Get_Char_Index(tp->face, 'g'));
+    for (i = 0; i < 3; i++)
+        test_all(fp[i]);
+    if (fp[1]->atlas.pagecount < 2)
+        fail("expected multiple pages", fp[1], 0);
+
+    tp2 = sg_typeface_file(FONT_PATH, strlen(FONT_PATH), &err);
+    if (!tp2)
+        die_error("sg_typeface_file", err);
+    for (i = 0; i < 3; i++) {
+        fp2 = sg_font_new(tp2, SIZES[i], &err);
+        if (!fp2)
+            die_error("sg_font_new", err);
+        test_parallel(fp[i], fp2, (int) i * 3 + 2);
+        sg_font_decref(fp2);
+    }
+    sg_typeface_decref(tp2);
+
+    if (argc >= 2)
+        for (i = 0; i < 3; i++)
+            write_pages(argv[1], fp[i]);
+    for (i = 0; i < 3; i++)
+        sg_font_decref(fp[i]);
+    sg_typeface_decref(tp);
+
+    if (failed) {
+        fputs("test failed\n", stderr);
+        return 1;
+    }
+    fputs("test passed\n", stderr);
+    return 0;
+}
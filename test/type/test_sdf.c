@@ -0,0 +1,369 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Test for signed distance field fonts.  The distance field for a
+   disc is compared against the exact distance, and glyphs drawn from
+   the shared distance field atlas at several sizes are compared
+   against FreeType's rendering at the same size.  The glyphs are
+   drawn the way a shader would draw them, by sampling the atlas with
+   bilinear filtering and converting the distance to coverage.
+   Rendering the atlas in parallel must give the same result as
+   rendering it on one thread.  */
+#include "sg/error.h"
+#include "sg/type.h"
+#include "src/type/private.h"
+#include "testutil.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char FONT_PATH[] = "font/Roboto-Regular";
+
+static const char TEXT[] =
+    "The quick brown fox jumps over the lazy dog.  "
+    "0123456789 @&%$ \xc3\x86\xc3\xbe\xc3\xa6";
+
+static int failed;
+
+static void
+fail(const char *what, int size, unsigned index)
+{
+    fprintf(stderr, "fail: %s (size %d, glyph %u)\n", what, size, index);
+    failed = 1;
+}
+
+/* Generate the distance field for a disc, and check each value
+   against the exact distance to the circle.  */
+static void
+test_disc(int scale)
+{
+    const int size = 24, range = 4;
+    const double radius = 7.3, cx = 11.6, cy = 12.2;
+    struct sg_sdfbuf buf = { NULL, 0 };
+    unsigned char *src, out[24 * 24];
+    int hs = size * scale, x, y;
+    double dx, dy, d, v, err, maxerr = 0.0;
+
+    src = malloc(hs * hs);
+    if (!src)
+        die("out of memory");
+    for (y = 0; y < hs; y++) {
+        for (x = 0; x < hs; x++) {
+            dx = (x + 0.5) / scale - cx;
+            dy = (y + 0.5) / scale - cy;
+            src[y * hs + x] = dx * dx + dy * dy < radius * radius ? 255 : 0;
+        }
+    }
+    if (sg_sdf_generate(&buf, out, size, size, size,
+                        src, hs, hs, hs, 0, 0, scale, range))
+        die("out of memory");
+    for (y = 0; y < size; y++) {
+        for (x = 0; x < size; x++) {
+            dx = x + 0.5 - cx;
+            dy = y + 0.5 - cy;
+            d = sqrt(dx * dx + dy * dy) - radius;
+            v = 127.5 - d * 127.5 / range;
+            if (v < 0.0)
+                v = 0.0;
+            else if (v > 255.0)
+                v = 255.0;
+            err = fabs(v - out[y * size + x]) * range / 127.5;
+            if (err > maxerr)
+                maxerr = err;
+        }
+    }
+    /* The error is in output pixels, and comes from the resolution of
+       the source bitmap.  */
+    if (maxerr > 1.0 / scale + 0.05) {
+        fprintf(stderr, "disc scale %d: max error %.3f px\n", scale, maxerr);
+        fail("disc distance", 0, 0);
+    }
+    sg_sdfbuf_destroy(&buf);
+    free(src);
+}
+
+/* Sample a glyph's distance field with bilinear filtering at a point
+   in the atlas, in texels.  */
+static double
+sample(struct sg_font *base, struct sg_font_glyph *bg, double u, double v)
+{
+    const struct sg_pixbuf *pb = &base->atlas.page[bg->page].pixbuf;
+    const unsigned char *p = pb->data;
+    int x0, y0, x, y, i, j;
+    double fx, fy, w, sum = 0.0;
+
+    u -= 0.5;
+    v -= 0.5;
+    x0 = (int) floor(u);
+    y0 = (int) floor(v);
+    fx = u - x0;
+    fy = v - y0;
+    for (j = 0; j < 2; j++) {
+        for (i = 0; i < 2; i++) {
+            x = x0 + i;
+            y = y0 + j;
+            /* Clamp to the glyph's rectangle in the atlas.  */
+            if (x < bg->x) x = bg->x;
+            if (x > bg->x + bg->w - 1) x = bg->x + bg->w - 1;
+            if (y < bg->y) y = bg->y;
+            if (y > bg->y + bg->h - 1) y = bg->y + bg->h - 1;
+            w = (i ? fx : 1.0 - fx) * (j ? fy : 1.0 - fy);
+            sum += w * p[y * pb->rowbytes + x];
+        }
+    }
+    return sum;
+}
+
+/* Draw a glyph from the distance field and compare it with FreeType's
+   unhinted rendering at the same size.  The glyph is antialiased by
+   converting the distance at each pixel center to coverage, with a
+   ramp one pixel wide.  Adds the total of the minimum and maximum
+   coverage of the two renderings at each pixel to 'cmin' and
+   'cmax'.  */
+static void
+compare_glyph(struct sg_font *fp, unsigned index, double *cmin, double *cmax)
+{
+    struct sg_typeface *tp = fp->typeface;
+    struct sg_error *err = NULL;
+    struct sg_font_glyph *g, *bg;
+    FT_GlyphSlot slot;
+    FT_Face face = tp->face;
+    int x, y, x0, x1, y0, y1, sx, sy, size = fp->size >> 6;
+    double u, v, a, b, d, range = sg_font_getsdfrange(fp);
+
+    g = sg_font_getglyph(fp, index, &err);
+    if (!g)
+        die_error("sg_font_getglyph", err);
+    bg = &fp->base->glyph[index];
+    if (FT_Set_Char_Size(face, 0, fp->size, 72, 72) ||
+        FT_Load_Glyph(face, index, FT_LOAD_NO_HINTING) ||
+        FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL))
+        die("could not render glyph");
+    tp->cursize = 0;
+    slot = face->glyph;
+    if (g->advance != (slot->advance.x + 32) >> 6 &&
+        g->advance != slot->advance.x >> 6)
+        fail("advance", size, index);
+    if (!slot->bitmap.width || !slot->bitmap.rows || !g->w)
+        return;
+
+    /* Compare over the union of both rectangles, in pixels relative
+       to the pen, with y pointing down.  */
+    x0 = g->bx < slot->bitmap_left ? g->bx : slot->bitmap_left;
+    y0 = -g->by < -slot->bitmap_top ? -g->by : -slot->bitmap_top;
+    x1 = slot->bitmap_left + (int) slot->bitmap.width;
+    if (g->bx + g->w > x1)
+        x1 = g->bx + g->w;
+    y1 = -slot->bitmap_top + (int) slot->bitmap.rows;
+    if (-g->by + g->h > y1)
+        y1 = -g->by + g->h;
+    for (y = y0; y < y1; y++) {
+        for (x = x0; x < x1; x++) {
+            sx = x - slot->bitmap_left;
+            sy = y + slot->bitmap_top;
+            a = 0.0;
+            if (sx >= 0 && sx < (int) slot->bitmap.width &&
+                sy >= 0 && sy < (int) slot->bitmap.rows)
+                a = slot->bitmap.buffer[sy * slot->bitmap.pitch + sx] *
+                    (1.0 / 255.0);
+            b = 0.0;
+            if (x >= g->bx && x < g->bx + g->w &&
+                y >= -g->by && y < -g->by + g->h) {
+                u = g->x + (x + 0.5 - g->bx) * g->tw / g->w;
+                v = g->y + (y + 0.5 + g->by) * g->th / g->h;
+                d = (127.5 - sample(fp->base, bg, u, v)) * range / 127.5;
+                b = 0.5 - d;
+                if (b < 0.0)
+                    b = 0.0;
+                else if (b > 1.0)
+                    b = 1.0;
+            }
+            *cmin += a < b ? a : b;
+            *cmax += a > b ? a : b;
+        }
+    }
+}
+
+/* Draw the glyphs in the test text at the given size, and check that
+   the coverage matches FreeType's rendering.  The score is the ratio
+   of the minimum and maximum coverage, which is like the intersection
+   over union for antialiased shapes.  */
+static void
+test_size(struct sg_typeface *tp, float size)
+{
+    struct sg_error *err = NULL;
+    struct sg_font *fp;
+    const unsigned char *p = (const unsigned char *) TEXT;
+    unsigned c, index;
+    double gmin, gmax, tmin = 0.0, tmax = 0.0, score, worst = 1.0;
+
+    fp = sg_font_newsdf(tp, size, &err);
+    if (!fp)
+        die_error("sg_font_newsdf", err);
+    if (!fp->base || fp->base->atlas.pagecount > 1)
+        fail("shared atlas", (int) size, 0);
+    if (fabs(sg_font_getsdfrange(fp) -
+             SG_SDF_SPREAD * size / SG_SDF_SIZE) > 1e-3)
+        fail("range", (int) size, 0);
+    while (*p) {
+        c = *p++;
+        if (c >= 0x80)
+            c = ((c & 0x1f) << 6) | (*p++ & 0x3f);
+        if (c == ' ')
+            continue;
+        index = FT_Get_Char_Index(tp->face, c);
+        gmin = gmax = 0.0;
+        compare_glyph(fp, index, &gmin, &gmax);
+        tmin += gmin;
+        tmax += gmax;
+        if (gmax > 0.0 && gmin / gmax < worst)
+            worst = gmin / gmax;
+    }
+    score = tmin / tmax;
+    printf("size %5.1f: score %.4f, worst glyph %.4f\n", size, score, worst);
+    /* Small glyphs have few pixels, so a small error in position is a
+       larger fraction of each glyph.  */
+    if (score < (size < 16.0f ? 0.8 : 0.9) ||
+        worst < (size < 16.0f ? 0.7 : 0.8))
+        fail("shape differs", (int) size, 0);
+    sg_font_decref(fp);
+}
+
+/* Fonts at different sizes share the base font and its atlas, and
+   layouts use the base font's texture coordinates.  */
+static void
+test_layout(struct sg_typeface *tp)
+{
+    struct sg_error *err = NULL;
+    struct sg_font *a, *b;
+    struct sg_textflow *flow;
+    struct sg_textlayout layout;
+    struct sg_textvert *v;
+    struct sg_font_glyph *bg;
+    unsigned index;
+
+    a = sg_font_newsdf(tp, 20.0f, &err);
+    if (!a)
+        die_error("sg_font_newsdf", err);
+    b = sg_font_newsdf(tp, 80.0f, &err);
+    if (!b)
+        die_error("sg_font_newsdf", err);
+    if (a->base != b->base)
+        fail("base font not shared", 0, 0);
+
+    flow = sg_textflow_new(&err);
+    if (!flow)
+        die_error("sg_textflow_new", err);
+    sg_textflow_setfont(flow, b);
+    sg_textflow_addtext(flow, "W", 1);
+    if (sg_textlayout_create(&layout, flow, &err))
+        die_error("sg_textlayout_create", err);
+    index = FT_Get_Char_Index(tp->face, 'W');
+    bg = &b->base->glyph[index];
+    v = layout.vert;
+    if (layout.vertcount != 6 || layout.batchcount != 1 ||
+        layout.batch[0].font != b)
+        fail("layout", 80, index);
+    else if (v[0].tx != b->glyph[index].x ||
+             v[1].tx - v[0].tx != b->glyph[index].tw ||
+             v[0].ty - v[2].ty != b->glyph[index].th ||
+             v[0].tx < bg->x || v[1].tx > bg->x + bg->w ||
+             v[1].vx - v[0].vx != b->glyph[index].w ||
+             v[2].vy - v[0].vy != b->glyph[index].h)
+        fail("layout coordinates", 80, index);
+    sg_textlayout_destroy(&layout);
+    sg_textflow_free(flow);
+
+    /* The base font does not go away while a scaled font uses it.  */
+    sg_font_decref(b);
+    if (a->base->refcount < 1 || !a->base->glyph[index].flags)
+        fail("base font freed", 20, index);
+    sg_font_decref(a);
+}
+
+/* Render the whole distance field atlas serially and in parallel.
+   The fonts must be from different typefaces, or they would share
+   the same atlas.  */
+static void
+test_parallel(struct sg_typeface *tp, struct sg_typeface *tp2)
+{
+    struct sg_error *err = NULL;
+    struct sg_font *a, *b;
+    struct sg_glyphatlas *aa, *ba;
+    unsigned i;
+    int y, rb;
+
+    a = sg_font_newsdf(tp, 16.0f, &err);
+    if (!a)
+        die_error("sg_font_newsdf", err);
+    b = sg_font_newsdf(tp2, 16.0f, &err);
+    if (!b)
+        die_error("sg_font_newsdf", err);
+    if (sg_font_renderall(a, 1, &err) || sg_font_renderall(b, 3, &err))
+        die_error("sg_font_renderall", err);
+    if (memcmp(a->glyph, b->glyph, sizeof(*a->glyph) * a->glyphcount) ||
+        memcmp(a->base->glyph, b->base->glyph,
+               sizeof(*a->glyph) * a->glyphcount))
+        fail("parallel glyph table differs", 16, 0);
+    aa = &a->base->atlas;
+    ba = &b->base->atlas;
+    if (aa->pagecount != ba->pagecount) {
+        fail("parallel page count differs", 16, 0);
+    } else {
+        for (i = 0; i < aa->pagecount; i++) {
+            rb = aa->page[i].pixbuf.rowbytes;
+            for (y = 0; y < aa->pagesize; y++) {
+                if (memcmp((char *) aa->page[i].pixbuf.data + y * rb,
+                           (char *) ba->page[i].pixbuf.data + y * rb,
+                           aa->pagesize)) {
+                    fail("parallel bitmap differs", 16, i);
+                    break;
+                }
+            }
+        }
+    }
+    sg_font_decref(a);
+    sg_font_decref(b);
+}
+
+int
+main(int argc, char **argv)
+{
+    static const float SIZES[] = { 12.0f, 24.0f, 32.0f, 47.5f, 96.0f };
+    struct sg_typeface *tp, *tp2;
+    struct sg_error *err = NULL;
+    unsigned i;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: test_sdf\n", stderr);
+        return 1;
+    }
+
+    for (i = 1; i <= 4; i++)
+        test_disc((int) i);
+
+    test_paths(NULL);
+
+    tp = sg_typeface_file(FONT_PATH, strlen(FONT_PATH), &err);
+    if (!tp)
+        die_error("sg_typeface_file", err);
+    for (i = 0; i < sizeof(SIZES) / sizeof(*SIZES); i++)
+        test_size(tp, SIZES[i]);
+    test_layout(tp);
+
+    tp2 = sg_typeface_file(FONT_PATH, strlen(FONT_PATH), &err);
+    if (!tp2)
+        die_error("sg_typeface_file", err);
+    test_parallel(tp, tp2);
+    sg_typeface_decref(tp2);
+    sg_typeface_decref(tp);
+
+    if (failed) {
+        fputs("test failed\n", stderr);
+        return 1;
+    }
+    fputs("test passed\n", stderr);
+    return 0;
+}
@@ -0,0 +1,302 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Test for UTF-8 decoding and character lookup in text flows.  The
+   decoder is compared against a table-driven reference decoder on
+   every character, on malformed sequences, and on random bytes.  Text
+   flows must get the same glyphs as FreeType's character map.  */
+#include "sg/error.h"
+#include "sg/type.h"
+#include "src/type/private.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char FONT_PATH[] = "font/Roboto-Regular";
+
+static int failed;
+
+static unsigned rand_state = 1618033988;
+
+static unsigned
+rand_next(void)
+{
+    rand_state = rand_state * 1664525u + 1013904223u;
+    return rand_state >> 8;
+}
+
+/* Well-formed UTF-8 byte sequences, from table 3-7 of the Unicode
+   standard.  */
+struct utf8_range {
+    int len;
+    unsigned char lo[4], hi[4];
+};
+
+static const struct utf8_range UTF8_RANGES[] = {
+    { 1, { 0x00 }, { 0x7f } },
+    { 2, { 0xc2, 0x80 }, { 0xdf, 0xbf } },
+    { 3, { 0xe0, 0xa0, 0x80 }, { 0xe0, 0xbf, 0xbf } },
+    { 3, { 0xe1, 0x80, 0x80 }, { 0xec, 0xbf, 0xbf } },
+    { 3, { 0xed, 0x80, 0x80 }, { 0xed, 0x9f, 0xbf } },
+    { 3, { 0xee, 0x80, 0x80 }, { 0xef, 0xbf, 0xbf } },
+    { 4, { 0xf0, 0x90, 0x80, 0x80 }, { 0xf0, 0xbf, 0xbf, 0xbf } },
+    { 4, { 0xf1, 0x80, 0x80, 0x80 }, { 0xf3, 0xbf, 0xbf, 0xbf } },
+    { 4, { 0xf4, 0x80, 0x80, 0x80 }, { 0xf4, 0x8f, 0xbf, 0xbf } }
+};
+
+/* Reference decoder.  Invalid sequences are replaced with U+FFFD,
+   consuming the maximal subpart of the sequence.  */
+static size_t
+ref_decode(unsigned *out, const unsigned char *p, size_t len)
+{
+    const struct utf8_range *r;
+    size_t pos = 0, n = 0;
+    unsigned i, j, best, c;
+
+    while (pos < len) {
+        best = 0;
+        c = 0;
+        for (i = 0; i < sizeof(UTF8_RANGES) / sizeof(*UTF8_RANGES); i++) {
+            r = &UTF8_RANGES[i];
+            for (j = 0; j < (unsigned) r->len && pos + j < len; j++)
+                if (p[pos + j] < r->lo[j] || p[pos + j] > r->hi[j])
+                    break;
+            if (j > best)
+                best = j;
+            if (j == (unsigned) r->len) {
+                c = r->len == 1 ? p[pos] : p[pos] & (0x7f >> r->len);
+                for (j = 1; j < (unsigned) r->len; j++)
+                    c = (c << 6) | (p[pos + j] & 0x3f);
+                break;
+            }
+        }
+        if (i == sizeof(UTF8_RANGES) / sizeof(*UTF8_RANGES)) {
+            c = 0xfffd;
+            if (!best)
+                best = 1;
+        }
+        out[n++] = c;
+        pos += best;
+    }
+    return n;
+}
+
+/* Decode with the given chunk size, and compare with the reference
+   decoder.  */
+static void
+check_decode(const char *what, const unsigned char *p, size_t len,
+             size_t chunk)
+{
+    unsigned *expect, *out;
+    const unsigned char *ptr = p, *end = p + len;
+    size_t n, nexpect, i;
+
+    expect = malloc(sizeof(*expect) * (len + 1));
+    out = malloc(sizeof(*out) * (len + 1));
+    if (!expect || !out)
+        abort();
+    nexpect = ref_decode(expect, p, len);
+    n = 0;
+    while (ptr < end) {
+        i = sg_utf8_decode(out + n, chunk, &ptr, end);
+        if (i == 0 || i > chunk) {
+            fprintf(stderr, "fail: %s: bad count\n", what);
+            failed = 1;
+            goto done;
+        }
+        n += i;
+    }
+    if (n != nexpect) {
+        fprintf(stderr, "fail: %s: decoded %zu characters, expected %zu\n",
+                what, n, nexpect);
+        failed = 1;
+        goto done;
+    }
+    for (i = 0; i < n; i++) {
+        if (out[i] != expect[i]) {
+            fprintf(stderr, "fail: %s: character %zu is U+%04X, "
+                    "expected U+%04X\n", what, i, out[i], expect[i]);
+            failed = 1;
+            break;
+        }
+    }
+done:
+    free(expect);
+    free(out);
+}
+
+static size_t
+encode(unsigned char *p, unsigned c)
+{
+    if (c < 0x80) {
+        p[0] = c;
+        return 1;
+    } else if (c < 0x800) {
+        p[0] = 0xc0 | (c >> 6);
+        p[1] = 0x80 | (c & 0x3f);
+        return 2;
+    } else if (c < 0x10000) {
+        p[0] = 0xe0 | (c >> 12);
+        p[1] = 0x80 | ((c >> 6) & 0x3f);
+        p[2] = 0x80 | (c & 0x3f);
+        return 3;
+    } else {
+        p[0] = 0xf0 | (c >> 18);
+        p[1] = 0x80 | ((c >> 12) & 0x3f);
+        p[2] = 0x80 | ((c >> 6) & 0x3f);
+        p[3] = 0x80 | (c & 0x3f);
+        return 4;
+    }
+}
+
+static void
+test_decode(void)
+{
+    static const char *const MALFORMED[] = {
+        "\xc0\x80", "\xc1\xbf", "\xe0\x80\x80", "\xe0\x9f\xbf",
+        "\xed\xa0\x80", "\xed\xbf\xbf", "\xf0\x80\x80\x80",
+        "\xf0\x8f\xbf\xbf", "\xf4\x90\x80\x80", "\xf5\x80\x80\x80",
+        "\xff", "\x80", "\xbf\x80", "\xe2\x82", "\xf0\x9f\x98",
+        "\xe2\x82" "a", "\xf0\x9f" "ab", "a\xc3", "\xc3\xc3\xa9"
+    };
+    unsigned char *buf;
+    size_t len, i, j, n;
+    unsigned c;
+    char name[64];
+
+    /* Every character, in a long run so the fast path sees non-ASCII
+       characters at every offset.  */
+    buf = malloc(4 * 0x110000);
+    if (!buf)
+        abort();
+    len = 0;
+    for (c = 0; c < 0x110000; c++) {
+        if (c >= 0xd800 && c < 0xe000)
+            continue;
+        len += encode(buf + len, c);
+    }
+    check_decode("all characters", buf, len, 4096);
+
+    for (i = 0; i < sizeof(MALFORMED) / sizeof(*MALFORMED); i++) {
+        snprintf(name, sizeof(name), "malformed %zu", i);
+        check_decode(name, (const unsigned char *) MALFORMED[i],
+                     strlen(MALFORMED[i]), 16);
+        /* Embedded in ASCII, to test the fast path.  */
+        memset(buf, 'x', 40);
+        n = strlen(MALFORMED[i]);
+        memcpy(buf + 17, MALFORMED[i], n);
+        check_decode(name, buf, 40, 64);
+    }
+
+    /* Mostly ASCII, with some non-ASCII bytes, and chunk sizes which
+       split the text at different places.  */
+    for (i = 0; i < 200; i++) {
+        len = rand_next() % 300;
+        for (j = 0; j < len; j++) {
+            c = rand_next();
+            buf[j] = (c & 0xf00) ? (c & 0x7f) : (c & 0xff);
+        }
+        snprintf(name, sizeof(name), "random %zu", i);
+        check_decode(name, buf, len, 1 + i % 40);
+    }
+
+    /* Random valid text from several scripts.  */
+    for (i = 0; i < 100; i++) {
+        len = 0;
+        for (j = 0; j < 200; j++) {
+            switch (rand_next() % 4) {
+            case 0: c = 0x20 + rand_next() % 0x5f; break;
+            case 1: c = 0xa0 + rand_next() % 0x60; break;
+            case 2: c = 0x400 + rand_next() % 0x100; break;
+            default: c = 0x4e00 + rand_next() % 0x5000; break;
+            }
+            len += encode(buf + len, c);
+        }
+        snprintf(name, sizeof(name), "text %zu", i);
+        check_decode(name, buf, len, 17 + i);
+    }
+    free(buf);
+}
+
+/* Glyphs in a text flow must match FreeType's character map.  */
+static void
+test_flow(struct sg_font *fp)
+{
+    static const unsigned CHARS[] = {
+        'A', 'z', ' ', 0xe9, 0xff, 0x100, 0x3a9, 0x416, 0x2014, 0x20ac,
+        0x4e2d, 0x1f600, 0xfffd
+    };
+    struct sg_error *err = NULL;
+    struct sg_textflow *flow;
+    unsigned char buf[4 * 3000];
+    unsigned chars[3000], expect;
+    size_t len = 0, split = 0, i, n = 0;
+
+    for (i = 0; i < 3000; i++) {
+        chars[n] = CHARS[rand_next() % (sizeof(CHARS) / sizeof(*CHARS))];
+        len += encode(buf + len, chars[n]);
+        n++;
+        if (n == 5)
+            split = len;
+    }
+    flow = sg_textflow_new(&err);
+    if (!flow)
+        die_error("sg_textflow_new", err);
+    sg_textflow_setfont(flow, fp);
+    /* Add the text in two parts, to test reserving space.  */
+    sg_textflow_addtext(flow, (const char *) buf, split);
+    sg_textflow_addtext(flow, (const char *) buf + split, len - split);
+    if (flow->err)
+        die_error("sg_textflow_addtext", flow->err);
+    if (flow->glyphcount != n || flow->glyphalloc < n) {
+        fputs("fail: glyph count\n", stderr);
+        failed = 1;
+    } else {
+        for (i = 0; i < n; i++) {
+            expect = FT_Get_Char_Index(fp->typeface->face, chars[i]);
+            if (flow->glyph[i].index != expect ||
+                (flow->glyph[i].flags & SG_TEXTFLOW_SPACE) !=
+                (chars[i] == ' ' ? SG_TEXTFLOW_SPACE : 0u)) {
+                fprintf(stderr, "fail: glyph for U+%04X\n", chars[i]);
+                failed = 1;
+                break;
+            }
+        }
+    }
+    sg_textflow_free(flow);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct sg_typeface *tp;
+    struct sg_font *fp;
+    struct sg_error *err = NULL;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: test_textflow\n", stderr);
+        return 1;
+    }
+
+    test_decode();
+
+    test_paths(NULL);
+    tp = sg_typeface_file(FONT_PATH, strlen(FONT_PATH), &err);
+    if (!tp)
+        die_error("sg_typeface_file", err);
+    fp = sg_font_new(tp, 16.0f, &err);
+    if (!fp)
+        die_error("sg_font_new", err);
+    test_flow(fp);
+    sg_font_decref(fp);
+    sg_typeface_decref(tp);
+
+    if (failed) {
+        fputs("test failed\n", stderr);
+        return 1;
+    }
+    fputs("test passed\n", stderr);
+    return 0;
+}
@@ -0,0 +1,425 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Test for updating text layouts and for the text layout cache.  A
+   layout which is updated after the text changes must be identical to
+   a layout created from the new text.  */
+#include "sg/error.h"
+#include "sg/sprite.h"
+#include "sg/type.h"
+#include "src/type/private.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char FONT_PATH[] = "font/Roboto-Regular";
+
+static int failed;
+
+static unsigned rand_state = 1618033988;
+
+static unsigned
+rand_next(void)
+{
+    rand_state = rand_state * 1664525u + 1013904223u;
+    return rand_state >> 8;
+}
+
+#define MAX_TEXT 4096
+
+/* Text with font changes.  Each character of 'font' selects the font
+   for the same character of 'text'.  */
+struct text {
+    char text[MAX_TEXT];
+    char font[MAX_TEXT];
+    int len;
+    int width;
+    enum sg_textformat format;
+};
+
+static struct sg_font *fonts[2];
+
+static struct sg_textflow *
+make_flow(const struct text *t)
+{
+    struct sg_error *err = NULL;
+    struct sg_textflow *flow;
+    int i, j;
+
+    flow = sg_textflow_new(&err);
+    if (!flow)
+        die_error("sg_textflow_new", err);
+    sg_textflow_setfont(flow, fonts[0]);
+    sg_textflow_setwidth(flow, (float) t->width);
+    sg_textflow_setformat(flow, t->format);
+    for (i = 0; i < t->len; i = j) {
+        for (j = i + 1; j < t->len && t->font[j] == t->font[i]; j++) { }
+        sg_textflow_setfont(flow, fonts[(int) t->font[i]]);
+        sg_textflow_addtext(flow, t->text + i, j - i);
+    }
+    return flow;
+}
+
+static void
+random_text(struct text *t, int len)
+{
+    int i, n, font = 0;
+    t->len = 0;
+    while (t->len < len) {
+        n = 1 + rand_next() % 10;
+        if (rand_next() % 16 == 0)
+            font ^= 1;
+        for (i = 0; i < n && t->len < len; i++) {
+            t->font[t->len] = (char) font;
+            t->text[t->len++] = (char) ('a' + rand_next() % 26);
+        }
+        if (t->len < len) {
+            t->font[t->len] = (char) font;
+            t->text[t->len++] = rand_next() % 8 ? ' ' : '.';
+        }
+    }
+}
+
+static int
+same_layout(const struct sg_textlayout *a, const struct sg_textlayout *b)
+{
+    int i;
+    if (memcmp(&a->metrics, &b->metrics, sizeof(a->metrics)) ||
+        a->format != b->format ||
+        a->vertcount != b->vertcount ||
+        a->quadcount != b->quadcount ||
+        a->batchcount != b->batchcount ||
+        (a->vertcount &&
+         memcmp(a->vert, b->vert, sizeof(*a->vert) * a->vertcount)) ||
+        (a->quadcount &&
+         memcmp(a->quad, b->quad, sizeof(*a->quad) * a->quadcount)))
+        return 0;
+    for (i = 0; i < a->batchcount; i++)
+        if (a->batch[i].font != b->batch[i].font ||
+            a->batch[i].page != b->batch[i].page ||
+            a->batch[i].offset != b->batch[i].offset ||
+            a->batch[i].count != b->batch[i].count)
+            return 0;
+    return 1;
+}
+
+/* Check that a layout has every glyph exactly once, in batches which
+   cover the vertex array.  */
+static void
+check_batches(const char *what, const struct sg_textlayout *layout,
+              const struct sg_textflow *flow)
+{
+    static const int NELEM[3] = { 6, 4, 1 };
+    int i, pos = 0, nelem = NELEM[layout->format], count;
+    count = layout->format == SG_TEXTFORMAT_INSTANCES ?
+        layout->quadcount : layout->vertcount;
+    if (count != (int) flow->drawcount * nelem) {
+        fprintf(stderr, "fail: %s: vertex count\n", what);
+        failed = 1;
+        return;
+    }
+    for (i = 0; i < layout->batchcount; i++) {
+        if (layout->batch[i].offset != pos || layout->batch[i].count <= 0 ||
+            layout->batch[i].count % nelem != 0 ||
+            (i > 0 && layout->batch[i].font == layout->batch[i-1].font &&
+             layout->batch[i].page == layout->batch[i-1].page)) {
+            fprintf(stderr, "fail: %s: batch %d\n", what, i);
+            failed = 1;
+            return;
+        }
+        pos += layout->batch[i].count;
+    }
+    if (pos != count) {
+        fprintf(stderr, "fail: %s: batches\n", what);
+        failed = 1;
+    }
+}
+
+/* Update the layout to the given text, and compare it with a new
+   layout.  */
+static void
+check_update(const char *what, struct sg_textlayout *layout,
+             const struct text *t)
+{
+    struct sg_error *err = NULL;
+    struct sg_textflow *flow;
+    struct sg_textlayout expect;
+
+    flow = make_flow(t);
+    if (sg_textlayout_update(layout, flow, &err))
+        die_error("sg_textlayout_update", err);
+    if (sg_textlayout_create(&expect, flow, &err))
+        die_error("sg_textlayout_create", err);
+    check_batches(what, &expect, flow);
+    if (!same_layout(layout, &expect)) {
+        fprintf(stderr, "fail: %s: layouts differ (len %d, width %d)\n",
+                what, t->len, t->width);
+        failed = 1;
+    }
+    sg_textlayout_destroy(&expect);
+    sg_textflow_free(flow);
+}
+
+static void
+test_update(void)
+{
+    static const int WIDTHS[] = { 0, 40, 150, 400 };
+    struct sg_error *err = NULL;
+    struct sg_textflow *flow;
+    struct sg_textlayout layout;
+    struct text t;
+    int i, j, k, pos;
+
+    for (i = 0; i < 40; i++) {
+        t.width = WIDTHS[i % 4];
+        t.format = (enum sg_textformat) (i % 3);
+        random_text(&t, 1 + rand_next() % 2000);
+        flow = make_flow(&t);
+        if (sg_textlayout_create(&layout, flow, &err))
+            die_error("sg_textlayout_create", err);
+        sg_textflow_free(flow);
+
+        for (j = 0; j < 50; j++) {
+            switch (rand_next() % 6) {
+            case 0:
+            case 1:
+                /* Type a few characters.  */
+                for (k = rand_next() % 4; k >= 0 && t.len < MAX_TEXT; k--) {
+                    t.font[t.len] = t.len ? t.font[t.len - 1] : 0;
+                    t.text[t.len++] = rand_next() % 5 ? 'x' : ' ';
+                }
+                check_update("append", &layout, &t);
+                break;
+            case 2:
+                /* Delete characters from the end.  */
+                t.len -= rand_next() % 8;
+                if (t.len < 0)
+                    t.len = 0;
+                check_update("delete", &layout, &t);
+                break;
+            case 3:
+                /* Change a character.  */
+                if (t.len) {
+                    pos = rand_next() % t.len;
+                    t.text[pos] = t.text[pos] == ' ' ? 'w' : ' ';
+                }
+                check_update("change", &layout, &t);
+                break;
+            case 4:
+                /* Change the font at the end.  */
+                if (t.len) {
+                    pos = t.len - 1 - rand_next() % 8;
+                    for (pos = pos < 0 ? 0 : pos; pos < t.len; pos++)
+                        t.font[pos] ^= 1;
+                }
+                check_update("font", &layout, &t);
+                break;
+            default:
+                /* Change the width or format.  */
+                if (rand_next() % 2)
+                    t.width = WIDTHS[rand_next() % 4];
+                else
+                    t.format = (enum sg_textformat) (rand_next() % 3);
+                check_update("width", &layout, &t);
+                break;
+            }
+        }
+        sg_textlayout_destroy(&layout);
+    }
+}
+
+/* Layouts in the quad and instance formats must draw the same
+   triangles as the default format.  */
+static void
+test_formats(void)
+{
+    static unsigned short index[6 * SG_QUAD_MAXCOUNT];
+    struct sg_error *err = NULL;
+    struct sg_textflow *flow;
+    struct sg_textlayout layout[3];
+    struct sg_textvert *v, *expect;
+    const struct sg_textquad *q;
+    const struct sg_textbatch *b, *b0;
+    struct text t;
+    int i, j, k, n, c;
+
+    sg_quad_writeindex(index, SG_QUAD_MAXCOUNT);
+    t.width = 300;
+    random_text(&t, 3000);
+    for (i = 0; i < 3; i++) {
+        t.format = (enum sg_textformat) i;
+        flow = make_flow(&t);
+        if (sg_textlayout_create(&layout[i], flow, &err))
+            die_error("sg_textlayout_create", err);
+        check_batches("format", &layout[i], flow);
+        sg_textflow_free(flow);
+    }
+
+    v = malloc(sizeof(*v) * layout[0].vertcount);
+    if (!v)
+        abort();
+    for (i = 1; i < 3; i++) {
+        if (layout[i].batchcount != layout[0].batchcount) {
+            fprintf(stderr, "fail: format %d: batch count\n", i);
+            failed = 1;
+            continue;
+        }
+        for (j = 0; j < layout[0].batchcount; j++) {
+            b0 = &layout[0].batch[j];
+            b = &layout[i].batch[j];
+            n = b0->count / 6;
+            expect = layout[0].vert + b0->offset;
+            if (b->font != b0->font || b->page != b0->page ||
+                b->count != n * (i == 1 ? 4 : 1)) {
+                fprintf(stderr, "fail: format %d: batch %d\n", i, j);
+                failed = 1;
+                break;
+            }
+            /* Expand the quads to triangles.  */
+            for (k = 0; k < n * 6; k++) {
+                if (i == 1) {
+                    v[k] = layout[i].vert[
+                        b->offset + (k / 6 / SG_QUAD_MAXCOUNT) *
+                        4 * SG_QUAD_MAXCOUNT +
+                        index[k % (6 * SG_QUAD_MAXCOUNT)]];
+                } else {
+                    q = &layout[i].quad[b->offset + k / 6];
+                    c = (0x312210 >> ((k % 6) * 4)) & 3;
+                    v[k].vx = q->vx + (c & 1) * q->vw;
+                    v[k].vy = q->vy + (c >> 1) * q->vh;
+                    v[k].tx = q->tx + (c & 1) * q->tw;
+                    v[k].ty = q->ty + (c >> 1) * q->th;
+                }
+            }
+            if (memcmp(v, expect, sizeof(*v) * n * 6)) {
+                fprintf(stderr, "fail: format %d: batch %d differs\n", i, j);
+                failed = 1;
+                break;
+            }
+        }
+    }
+    free(v);
+    for (i = 0; i < 3; i++)
+        sg_textlayout_destroy(&layout[i]);
+}
+
+static void
+test_cache(void)
+{
+    struct sg_error *err = NULL;
+    struct sg_textcache *cache;
+    struct sg_textflow *flow[3], *copy;
+    const struct sg_textlayout *layout[3], *p;
+    struct sg_textlayout expect;
+    struct text t[3];
+    int i;
+
+    cache = sg_textcache_new(2, &err);
+    if (!cache)
+        die_error("sg_textcache_new", err);
+    for (i = 0; i < 3; i++) {
+        t[i].width = 200;
+        t[i].format = SG_TEXTFORMAT_TRIANGLES;
+        random_text(&t[i], 300);
+        flow[i] = make_flow(&t[i]);
+    }
+
+    /* The same text, in a different flow, gives the same layout.  */
+    layout[0] = sg_textcache_get(cache, flow[0], &err);
+    if (!layout[0])
+        die_error("sg_textcache_get", err);
+    copy = make_flow(&t[0]);
+    p = sg_textcache_get(cache, copy, &err);
+    sg_textflow_free(copy);
+    if (p != layout[0]) {
+        fputs("fail: cache miss for same text\n", stderr);
+        failed = 1;
+    }
+
+    /* A different width is a different layout.  */
+    t[1] = t[0];
+    t[1].width = 100;
+    sg_textflow_free(flow[1]);
+    flow[1] = make_flow(&t[1]);
+    layout[1] = sg_textcache_get(cache, flow[1], &err);
+    if (!layout[1])
+        die_error("sg_textcache_get", err);
+    if (layout[1] == layout[0]) {
+        fputs("fail: cache hit for different width\n", stderr);
+        failed = 1;
+    }
+
+    /* Use the first layout, so the second one is replaced.  */
+    if (sg_textcache_get(cache, flow[0], &err) != layout[0]) {
+        fputs("fail: cache miss\n", stderr);
+        failed = 1;
+    }
+    layout[2] = sg_textcache_get(cache, flow[2], &err);
+    if (!layout[2])
+        die_error("sg_textcache_get", err);
+    if (layout[2] != layout[1]) {
+        fputs("fail: least recently used layout not replaced\n", stderr);
+        failed = 1;
+    }
+    if (sg_textcache_get(cache, flow[0], &err) != layout[0]) {
+        fputs("fail: cache miss after replacement\n", stderr);
+        failed = 1;
+    }
+
+    for (i = 0; i < 3; i++) {
+        p = sg_textcache_get(cache, flow[i], &err);
+        if (!p)
+            die_error("sg_textcache_get", err);
+        if (sg_textlayout_create(&expect, flow[i], &err))
+            die_error("sg_textlayout_create", err);
+        if (!same_layout(p, &expect)) {
+            fprintf(stderr, "fail: cached layout %d differs\n", i);
+            failed = 1;
+        }
+        sg_textlayout_destroy(&expect);
+    }
+
+    for (i = 0; i < 3; i++)
+        sg_textflow_free(flow[i]);
+    sg_textcache_free(cache);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct sg_typeface *tp;
+    struct sg_error *err = NULL;
+
+    (void) argv;
+    if (argc > 1) {
+        fputs("Usage: test_textlayout\n", stderr);
+        return 1;
+    }
+
+    test_paths(NULL);
+    tp = sg_typeface_file(FONT_PATH, strlen(FONT_PATH), &err);
+    if (!tp)
+        die_error("sg_typeface_file", err);
+    fonts[0] = sg_font_new(tp, 16.0f, &err);
+    if (!fonts[0])
+        die_error("sg_font_new", err);
+    fonts[1] = sg_font_new(tp, 28.0f, &err);
+    if (!fonts[1])
+        die_error("sg_font_new", err);
+
+    test_update();
+    test_formats();
+    test_cache();
+
+    sg_font_decref(fonts[0]);
+    sg_font_decref(fonts[1]);
+    sg_typeface_decref(tp);
+
+    if (failed) {
+        fputs("test failed\n", stderr);
+        return 1;
+    }
+    fputs("test passed\n", stderr);
+    return 0;
+}
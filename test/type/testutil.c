@@ -0,0 +1,93 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+#include "sg/cvar.h"
+#include "sg/error.h"
+#include "src/core/file_impl.h"
+#include "src/type/private.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct sg_paths sg_paths;
+
+static char DATA_PATH[] = "../demo/data/";
+
+static struct sg_cvar_bool *fontcache;
+
+/* The atlas is tested without OpenGL.  */
+void
+sg_glyphatlas_deletetextures(struct sg_glyphatlas *atlas)
+{
+    (void) atlas;
+}
+
+/* Fonts are not cached, so each font is rendered, unless
+   test_fontcache enables the cache.  */
+void
+sg_cvar_defbool(const char *section, const char *name, const char *doc,
+                struct sg_cvar_bool *cvar, int value, unsigned flags)
+{
+    (void) section;
+    (void) name;
+    (void) doc;
+    (void) value;
+    (void) flags;
+    cvar->value = 0;
+    fontcache = cvar;
+}
+
+void
+test_fontcache(int enable)
+{
+    if (!fontcache)
+        die("font cache cvar not defined");
+    fontcache->value = enable;
+}
+
+void
+test_paths(const char *dir)
+{
+    static struct sg_path path[2];
+    static char buf[256];
+    unsigned n = 0, maxlen;
+    size_t len;
+
+    if (dir) {
+        len = strlen(dir);
+        if (len + 2 > sizeof(buf))
+            die("path too long");
+        memcpy(buf, dir, len);
+        if (!len || buf[len - 1] != '/')
+            buf[len++] = '/';
+        buf[len] = '\0';
+        path[n].path = buf;
+        path[n].len = len;
+        n++;
+    }
+    path[n].path = DATA_PATH;
+    path[n].len = strlen(DATA_PATH);
+    n++;
+    maxlen = (unsigned) path[0].len;
+    if (maxlen < path[n - 1].len)
+        maxlen = (unsigned) path[n - 1].len;
+    sg_paths.path = path;
+    sg_paths.pathcount = n;
+    sg_paths.maxlen = maxlen;
+}
+
+void
+die(const char *reason)
+{
+    fprintf(stderr, "error: %s\n", reason);
+    exit(1);
+}
+
+void
+die_error(const char *what, struct sg_error *err)
+{
+    fprintf(stderr, "error: %s: %s\n", what,
+            err && err->msg ? err->msg : "unknown error");
+    exit(1);
+}
@@ -0,0 +1,26 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Helpers shared by the type tests and benchmarks.  Linking with
+   testutil.o also provides sg_paths and stubs for the glyph atlas
+   textures and the font cache cvar, so fonts are tested without
+   OpenGL and are not cached.  */
+struct sg_error;
+
+/* Search for files in the demo data directory.  If dir is not NULL,
+   search it first.  */
+void
+test_paths(const char *dir);
+
+/* Enable or disable the font cache, which is disabled by default.
+   The font library must be initialized first.  */
+void
+test_fontcache(int enable);
+
+/* Print an error message and exit.  */
+void
+die(const char *reason);
+
+/* Print an error message for a failed operation and exit.  */
+void
+die_error(const char *what, struct sg_error *err);
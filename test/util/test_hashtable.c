@@ -1,7 +1,7 @@
-/* Copyright 2012 Dietrich Epp.
+/* Copyright 2012-2014 Dietrich Epp.
    This file is part of SGLib.  SGLib is licensed under the terms of the
    2-clause BSD license.  For more information, see LICENSE.txt. */
-#include <libpce/hashtable.h>
+#include "sg/hashtable.h"
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -22,14 +22,14 @@ rand_next(unsigned x)
 }
 
 static
-void check(struct pce_hashtable *d, unsigned count,
+void check(struct sg_hashtable *d, unsigned count,
            char **strings, long *values)
 {
-    unsigned i, j, dsize = 0, isize = 0;
-    struct pce_hashtable_entry *es;
+    unsigned i, dsize = 0, isize = 0;
+    struct sg_hashtable_entry *es, *ej;
     /* Check each value */
     for (i = 0; i < count; ++i) {
-        es = pce_hashtable_get(d, strings[i]);
+        es = sg_hashtable_get(d, strings[i]);
         if (values[i]) {
             dsize++;
             assert(es);
@@ -38,15 +38,14 @@ void check(struct pce_hashtable *d, unsigned count,
             assert(!es);
     }
     /* Check number of entries */
-    assert(dsize == d->size);
-    es = d->contents;
+    assert(dsize == d->map.size);
     /* Check iteration */
-    for (j = 0; j < d->capacity; ++j) {
-        if (!es[j].key)
-            continue;
+    for (es = sg_hashtable_next(d, NULL); es;
+         es = sg_hashtable_next(d, es)) {
         isize += 1;
-        for (i = j + 1; i < d->capacity; ++i) {
-            assert(es[i].key != es[j].key);
+        for (ej = sg_hashtable_next(d, es); ej;
+             ej = sg_hashtable_next(d, ej)) {
+            assert(ej->key != es->key);
         }
     }
     /* Check iteration count */
@@ -67,9 +66,9 @@ main(int argc, char **argv)
     unsigned count = 0, size = 0, l, nsize, i, x, y;
     long ov, nv, *values;
     char buf[64];
-    struct pce_hashtable dict;
+    struct sg_hashtable dict;
     unsigned gen = 1618033988;
-    struct pce_hashtable_entry *e;
+    struct sg_hashtable_entry *e;
 
     (void) argc;
     (void) argv;
@@ -96,7 +95,7 @@ main(int argc, char **argv)
     fprintf(stderr, "%i lines read, testing...\n", count);
     values = calloc(count, sizeof(*values));
     assert(values != NULL);
-    pce_hashtable_init(&dict);
+    sg_hashtable_init(&dict);
     debug("inserting...\n");
     for (i = 0; i < count * 3; ++i) {
         x = gen % 10;
@@ -108,13 +107,13 @@ main(int argc, char **argv)
             nv = (gen % 100) + 1;
             gen = rand_next(gen);
             if (x == 7) {
-                if (pce_hashtable_reserve(&dict, dict.size * 2 + 1))
-                    fail("pce_hashtable_reserve (1)");
+                if (sg_hashtable_reserve(&dict, dict.map.size * 2 + 1))
+                    fail("sg_hashtable_reserve (1)");
             }
             debug("set %u -> %li\n", y, nv);
-            e = pce_hashtable_insert(&dict, s);
+            e = sg_hashtable_insert(&dict, s);
             if (!e)
-                fail("pce_hashtable_insert");
+                fail("sg_hashtable_insert");
             if (ov)
                 assert((long) e->value == ov);
             else
@@ -123,19 +122,19 @@ main(int argc, char **argv)
         } else {
             debug("erase %u\n", y);
             nv = 0;
-            e = pce_hashtable_get(&dict, s);
+            e = sg_hashtable_get(&dict, s);
             if (!ov)
                 assert(e == NULL);
             else {
                 assert(e != NULL);
-                pce_hashtable_erase(&dict, e);
+                sg_hashtable_erase(&dict, e);
             }
         }
         values[y] = nv;
         check(&dict, count, strings, values);
     }
     debug("erasing...\n");
-    while (dict.size > 0) {
+    while (dict.map.size > 0) {
         x = gen % count;
         y = (gen / count) % 20;
         gen = rand_next(gen);
@@ -146,25 +145,25 @@ main(int argc, char **argv)
         }
         s = strings[x];
         assert(s != NULL);
-        e = pce_hashtable_get(&dict, s);
+        e = sg_hashtable_get(&dict, s);
         assert(e != NULL);
         debug("erase %u\n", x);
-        pce_hashtable_erase(&dict, e);
+        sg_hashtable_erase(&dict, e);
         values[x] = 0;
         check(&dict, count, strings, values);
         if (y == 19) {
-            debug("compact to %u\n", dict.size);
-            if (pce_hashtable_compact(&dict))
+            debug("compact to %u\n", dict.map.size);
+            if (sg_hashtable_compact(&dict))
                 fail("compact");
             check(&dict, count, strings, values);
         } else if (y == 18) {
-            debug("resize to %u\n", dict.size * 3 + 10);
-            if (pce_hashtable_reserve(&dict, dict.size * 3 + 10))
-                fail("pce_hashtable_reserve (2)");
+            debug("resize to %u\n", dict.map.size * 3 + 10);
+            if (sg_hashtable_reserve(&dict, dict.map.size * 3 + 10))
+                fail("sg_hashtable_reserve (2)");
             check(&dict, count, strings, values);
         }
     }
-    pce_hashtable_destroy(&dict, NULL);
+    sg_hashtable_destroy(&dict, NULL);
     for (i = 0; i < count; ++i)
         free(strings[i]);
     free(strings);
@@ -0,0 +1,177 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Convert a raw video file, recorded with "recording.raw" set, to the
+   raw frames the video encoder reads.  The file format is described in
+   src/record/videoraw.h.  Frames which were dropped while recording
+   are filled in by repeating the previous frame, so the video keeps
+   its timing.  */
+#define _POSIX_C_SOURCE 200809L
+#include "sg/error.h"
+#include "src/record/videoconv.h"
+#include "src/record/videoraw.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int opt_format = SG_VIDEOFMT_YUV420P;
+static int opt_info;
+static int opt_nofill;
+
+static void
+die(const char *msg)
+{
+    fprintf(stderr, "error: %s\n", msg);
+    exit(1);
+}
+
+static void
+die_error(const char *what, struct sg_error *err)
+{
+    fprintf(stderr, "error: %s: %s\n", what,
+            err && err->msg ? err->msg : "unknown error");
+    exit(1);
+}
+
+static void *
+xmalloc(size_t size)
+{
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr)
+        die("out of memory");
+    return ptr;
+}
+
+static void
+usage(void)
+{
+    fputs(
+        "Usage: rawvideo [OPTION]... INPUT [OUTPUT]\n"
+        "Convert a raw video file to input for the video encoder.\n"
+        "\n"
+        "  -f FORMAT   pixel format: rgb0, yuv420p, or nv12\n"
+        "              (default yuv420p)\n"
+        "  -i          print information about the file and exit\n"
+        "  -n          do not repeat frames to fill in dropped frames\n"
+        "\n"
+        "Frames are written to OUTPUT, or to standard output.  The\n"
+        "encoder's input options are printed to standard error, e.g.\n"
+        "\n"
+        "  rawvideo in.sgraw | ffmpeg -f rawvideo -pix_fmt yuv420p \\\n"
+        "      -r 30 -s 1280x720 -i - -codec:v libx264 out.mp4\n",
+        stderr);
+    exit(1);
+}
+
+static void
+put_frame(FILE *fp, const void *data, size_t size)
+{
+    if (fwrite(data, 1, size, fp) != size)
+        die("could not write output");
+}
+
+int
+main(int argc, char **argv)
+{
+    struct sg_error *err = NULL;
+    struct sg_videoraw raw;
+    const char *input, *output;
+    unsigned char *frame, *out;
+    size_t outsize;
+    unsigned timestamp, next, nfill, nframe;
+    int opt, r, havelast;
+    FILE *fp;
+
+    while ((opt = getopt(argc, argv, "f:in")) != -1) {
+        switch (opt) {
+        case 'f':
+            opt_format = sg_videofmt_find(optarg);
+            if (opt_format < 0)
+                usage();
+            break;
+        case 'i':
+            opt_info = 1;
+            break;
+        case 'n':
+            opt_nofill = 1;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (argc - optind < 1 || argc - optind > 2)
+        usage();
+    input = argv[optind];
+    output = argc - optind > 1 ? argv[optind + 1] : NULL;
+
+    if (sg_videoraw_open(&raw, input, &err))
+        die_error(input, err);
+    if (opt_info) {
+        printf("size: %dx%d\n"
+               "format: %s\n"
+               "rate: %d\n",
+               raw.width, raw.height, SG_VIDEOFMT_NAME[raw.format],
+               raw.rate);
+        if (raw.indexpos)
+            printf("frames: %u\n", raw.nframe);
+        else
+            puts("frames: unknown, file was not closed");
+        sg_videoraw_close(&raw);
+        return 0;
+    }
+    if (raw.format != opt_format && raw.format != SG_VIDEOFMT_RGB0)
+        die("cannot convert between these formats");
+
+    if (output) {
+        fp = fopen(output, "wb");
+        if (!fp)
+            die("could not open output");
+    } else {
+        fp = stdout;
+    }
+    frame = xmalloc(raw.framesize);
+    outsize = sg_videofmt_framesize(
+        (sg_videofmt_t) opt_format, raw.width, raw.height);
+    out = xmalloc(outsize);
+    fprintf(stderr, "-f rawvideo -pix_fmt %s -r %d -s %dx%d\n",
+            SG_VIDEOFMT_NAME[opt_format], raw.rate, raw.width, raw.height);
+
+    havelast = 0;
+    next = 0;
+    nfill = 0;
+    nframe = 0;
+    for (;;) {
+        r = sg_videoraw_read(&raw, frame, &timestamp, &err);
+        if (r < 0)
+            die_error(input, err);
+        if (r == 0)
+            break;
+        /* The previous frame is still in the output buffer.  */
+        if (havelast && !opt_nofill) {
+            for (; next < timestamp; next++) {
+                put_frame(fp, out, outsize);
+                nfill++;
+            }
+        }
+        if (raw.format == opt_format)
+            memcpy(out, frame, outsize);
+        else
+            sg_videoconv(out, frame, (sg_videofmt_t) opt_format,
+                         raw.width, raw.height, 0, raw.height);
+        put_frame(fp, out, outsize);
+        havelast = 1;
+        next = timestamp + 1;
+        nframe++;
+    }
+    if (raw.indexpos && nframe != raw.nframe)
+        die("frame count does not match index");
+    if (fflush(fp) || (output && fclose(fp)))
+        die("could not write output");
+    fprintf(stderr, "%u frames, %u repeated\n", nframe, nfill);
+
+    free(out);
+    free(frame);
+    sg_videoraw_close(&raw);
+    return 0;
+}
@@ -0,0 +1,472 @@
+/* Copyright 2014 Dietrich Epp.
+   This file is part of SGLib.  SGLib is licensed under the terms of the
+   2-clause BSD license.  For more information, see LICENSE.txt. */
+/* Build a sprite sheet from a directory of images.  Each PNG or JPEG
+   image in the directory, recursively, becomes a sprite named after
+   its path without extension.  The images are packed with sg_pack2()
+   into a single premultiplied RGBA sheet, which is written with the
+   sprite table in the format described in src/core/sprite_impl.h.
+   Load the result with sg_spritesheet_file().  */
+#define _POSIX_C_SOURCE 200809L
+#include "sg/error.h"
+#include "sg/hash.h"
+#include "sg/pack.h"
+#include "sg/pixbuf.h"
+#include "sg/sprite.h"
+#include "sg/version.h"
+#include "src/core/file_impl.h"
+#include "src/core/sprite_impl.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct sg_paths sg_paths;
+
+struct image {
+    /* Sprite name, NUL-terminated.  */
+    char *name;
+    size_t namelen;
+    /* Premultiplied pixels, with the top row first.  */
+    struct sg_pixbuf pbuf;
+    /* Transformation from the stored sprite to the image.  */
+    sg_sprite_xform_t xform;
+    struct sg_spritesheet_entry entry;
+};
+
+/* Library versions are not logged.  */
+void
+sg_version_lib(const char *libname,
+               const char *compileversion, const char *runversion)
+{
+    (void) libname;
+    (void) compileversion;
+    (void) runversion;
+}
+
+static struct image *images;
+static unsigned imagecount, imagealloc;
+
+/* Options.  */
+static enum sg_pack_method opt_method = SG_PACK_MAXRECTS_BOTTOMLEFT;
+static unsigned opt_flags;
+static int opt_rotate;
+static int opt_center;
+static int opt_padding = 1;
+static int opt_maxsize = 4096;
+static int opt_verbose;
+
+static void
+die(const char *msg)
+{
+    fprintf(stderr, "error: %s\n", msg);
+    exit(1);
+}
+
+static void
+die_error(const char *what, struct sg_error *err)
+{
+    fprintf(stderr, "error: %s: %s\n", what,
+            err && err->msg ? err->msg : "unknown error");
+    exit(1);
+}
+
+static void *
+xmalloc(size_t size)
+{
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr)
+        die("out of memory");
+    return ptr;
+}
+
+static void
+usage(void)
+{
+    fputs(
+        "Usage: spritesheet [OPTION]... DIR OUTPUT\n"
+        "Pack the images in DIR into a sprite sheet.\n"
+        "\n"
+        "  -2          use power of two dimensions\n"
+        "  -c          put the sprite origins at the center\n"
+        "  -m METHOD   packing method: skyline, minwaste, maxrects,\n"
+        "              shortside, or area (default maxrects)\n"
+        "  -p PIXELS   padding between sprites (default 1)\n"
+        "  -r          rotate sprites which are taller than they are wide\n"
+        "  -s PIXELS   maximum sheet width and height (default 4096)\n"
+        "  -v          print the sheet size and occupancy\n"
+        "\n"
+        "Sprites are named by their path relative to DIR, without\n"
+        "extension.  The sheet is loaded with sg_spritesheet_file().\n",
+        stderr);
+    exit(1);
+}
+
+static int
+has_suffix(const char *name, size_t len, const char *suffix)
+{
+    size_t slen = strlen(suffix);
+    return len > slen && !strcmp(name + len - slen, suffix);
+}
+
+/* Add all images in a directory, recursively.  The path is relative
+   to the input directory, and is either empty or ends with '/'.  */
+static void
+scan_dir(const char *root, const char *path)
+{
+    struct dirent *ent;
+    struct stat st;
+    DIR *dir;
+    char *full, *rel;
+    size_t rootlen = strlen(root), pathlen = strlen(path), len;
+
+    full = xmalloc(rootlen + pathlen + 1);
+    memcpy(full, root, rootlen);
+    memcpy(full + rootlen, path, pathlen + 1);
+    dir = opendir(full);
+    if (!dir) {
+        fprintf(stderr, "error: could not open directory: %s\n", full);
+        exit(1);
+    }
+    free(full);
+
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.')
+            continue;
+        len = strlen(ent->d_name);
+        rel = xmalloc(pathlen + len + 2);
+        memcpy(rel, path, pathlen);
+        memcpy(rel + pathlen, ent->d_name, len + 1);
+        full = xmalloc(rootlen + pathlen + len + 1);
+        memcpy(full, root, rootlen);
+        memcpy(full + rootlen, rel, pathlen + len + 1);
+        if (stat(full, &st)) {
+            fprintf(stderr, "error: could not stat file: %s\n", full);
+            exit(1);
+        }
+        free(full);
+        if (S_ISDIR(st.st_mode)) {
+            rel[pathlen + len] = '/';
+            rel[pathlen + len + 1] = '\0';
+            scan_dir(root, rel);
+            free(rel);
+            continue;
+        }
+        if (!has_suffix(ent->d_name, len, ".png") &&
+            !has_suffix(ent->d_name, len, ".jpg")) {
+            free(rel);
+            continue;
+        }
+        if (imagecount >= imagealloc) {
+            imagealloc = imagealloc ? imagealloc * 2 : 64;
+            images = realloc(images, sizeof(*images) * imagealloc);
+            if (!images)
+                die("out of memory");
+        }
+        rel[pathlen + len - 4] = '\0';
+        memset(&images[imagecount], 0, sizeof(*images));
+        images[imagecount].name = rel;
+        images[imagecount].namelen = pathlen + len - 4;
+        imagecount++;
+    }
+    closedir(dir);
+}
+
+static int
+image_compare_name(const void *xp, const void *yp)
+{
+    const struct image *x = xp, *y = yp;
+    return strcmp(x->name, y->name);
+}
+
+/* Load an image as premultiplied RGBA.  */
+static void
+load_image(struct image *im)
+{
+    struct sg_error *err = NULL;
+    struct sg_image *img;
+    unsigned char *p;
+    int x, y;
+
+    img = sg_image_file(im->name, im->namelen, &err);
+    if (!img)
+        die_error(im->name, err);
+    if (img->width > 0x7fff - opt_padding ||
+        img->height > 0x7fff - opt_padding) {
+        fprintf(stderr, "error: image too large: %s\n", im->name);
+        exit(1);
+    }
+    if (sg_pixbuf_calloc(&im->pbuf, SG_RGBA, img->width, img->height,
+                         &err))
+        die_error(im->name, err);
+    if (img->draw(img, &im->pbuf, 0, 0, &err))
+        die_error(im->name, err);
+    if (!(img->flags & SG_IMAGE_ALPHA)) {
+        for (y = 0; y < im->pbuf.height; y++) {
+            p = (unsigned char *) im->pbuf.data + im->pbuf.rowbytes * y;
+            for (x = 0; x < im->pbuf.width; x++)
+                p[x*4+3] = 255;
+        }
+    }
+    img->free(img);
+}
+
+/* Copy an image to its location in the sheet.  The sheet's rows are
+   stored from bottom to top, the image's from top to bottom.  */
+static void
+copy_image(unsigned char *sheet, int sheetwidth, const struct image *im)
+{
+    const unsigned char *src = im->pbuf.data;
+    unsigned char *dest;
+    int w = im->pbuf.width, h = im->pbuf.height, a, b;
+    int rb = im->pbuf.rowbytes;
+    int x = im->entry.sprite.x, y = im->entry.sprite.y;
+
+    if (im->xform == SG_X_NORMAL) {
+        for (b = 0; b < h; b++)
+            memcpy(sheet + ((size_t) (y + b) * sheetwidth + x) * 4,
+                   src + (size_t) (h - 1 - b) * rb, w * 4);
+        return;
+    }
+
+    /* The stored sprite is the image rotated 90 degrees clockwise, so
+       stored pixel (a, b) is image pixel (w - 1 - b, a), where the
+       image's Y axis points up.  */
+    for (b = 0; b < w; b++) {
+        dest = sheet + ((size_t) (y + b) * sheetwidth + x) * 4;
+        for (a = 0; a < h; a++)
+            memcpy(dest + a * 4,
+                   src + (size_t) (h - 1 - a) * rb + (w - 1 - b) * 4, 4);
+    }
+}
+
+static int
+entry_compare(const void *xp, const void *yp)
+{
+    const struct image *x = xp, *y = yp;
+    if (x->entry.hash != y->entry.hash)
+        return x->entry.hash < y->entry.hash ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+static void
+write_sheet(const char *path, int width, int height)
+{
+    struct sg_spritesheet_header h;
+    struct sg_spritesheet_entry *entry;
+    unsigned char *pixels;
+    char *names;
+    size_t namesize, pixoff, pixsize, pos;
+    unsigned i;
+    FILE *fp;
+
+    namesize = 0;
+    for (i = 0; i < imagecount; i++)
+        namesize += images[i].namelen;
+    if (namesize > SG_SPRITESHEET_MAXSIZE)
+        die("names too long");
+    pixoff = sg_spritesheet_pixeloffset(imagecount, (uint32_t) namesize);
+    pixsize = (size_t) width * height * 4;
+    if (pixoff + pixsize > SG_SPRITESHEET_MAXSIZE)
+        die("sprite sheet too large");
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SG_SPRITESHEET_MAGIC, sizeof(h.magic));
+    h.version = SG_SPRITESHEET_VERSION;
+    h.spritecount = imagecount;
+    h.namesize = (uint32_t) namesize;
+    h.width = (uint16_t) width;
+    h.height = (uint16_t) height;
+
+    entry = xmalloc(sizeof(*entry) * imagecount);
+    names = xmalloc(namesize);
+    pos = 0;
+    for (i = 0; i < imagecount; i++) {
+        entry[i] = images[i].entry;
+        entry[i].name = (uint32_t) pos;
+        memcpy(names + pos, images[i].name, images[i].namelen);
+        pos += images[i].namelen;
+    }
+
+    pixels = calloc(1, pixsize);
+    if (!pixels)
+        die("out of memory");
+    for (i = 0; i < imagecount; i++)
+        copy_image(pixels, width, &images[i]);
+
+    fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "error: could not open output: %s\n", path);
+        exit(1);
+    }
+    fwrite(&h, sizeof(h), 1, fp);
+    fwrite(entry, sizeof(*entry), imagecount, fp);
+    fwrite(names, 1, namesize, fp);
+    for (pos = sizeof(h) + sizeof(*entry) * imagecount + namesize;
+         pos < pixoff; pos++)
+        putc(0, fp);
+    fwrite(pixels, 1, pixsize, fp);
+    if (ferror(fp) | fclose(fp)) {
+        fprintf(stderr, "error: could not write output: %s\n", path);
+        exit(1);
+    }
+    free(entry);
+    free(names);
+    free(pixels);
+}
+
+int
+main(int argc, char **argv)
+{
+    static const char *const METHOD[] = {
+        "skyline", "minwaste", "maxrects", "shortside", "area"
+    };
+    struct sg_error *err = NULL;
+    struct sg_path root;
+    struct sg_pack_rect *rect;
+    struct sg_pack_size size, maxsize;
+    struct sg_sprite *sp;
+    struct image *im;
+    const char *indir, *output;
+    char *rootpath;
+    size_t len;
+    unsigned i;
+    unsigned long area;
+    int opt, r, w, h;
+
+    while ((opt = getopt(argc, argv, "2cm:p:rs:v")) != -1) {
+        switch (opt) {
+        case '2':
+            opt_flags |= SG_PACK_POW2;
+            break;
+        case 'c':
+            opt_center = 1;
+            break;
+        case 'm':
+            for (i = 0; i < sizeof(METHOD) / sizeof(*METHOD); i++) {
+                if (!strcmp(optarg, METHOD[i]))
+                    break;
+            }
+            if (i == sizeof(METHOD) / sizeof(*METHOD))
+                usage();
+            opt_method = (enum sg_pack_method) i;
+            break;
+        case 'p':
+            opt_padding = atoi(optarg);
+            if (opt_padding < 0 || opt_padding > 64)
+                usage();
+            break;
+        case 'r':
+            opt_rotate = 1;
+            break;
+        case 's':
+            opt_maxsize = atoi(optarg);
+            if (opt_maxsize < 1 || opt_maxsize > 0x7fff)
+                usage();
+            break;
+        case 'v':
+            opt_verbose = 1;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (argc - optind != 2)
+        usage();
+    indir = argv[optind];
+    output = argv[optind + 1];
+
+    len = strlen(indir);
+    rootpath = xmalloc(len + 2);
+    memcpy(rootpath, indir, len);
+    if (!len || rootpath[len - 1] != '/')
+        rootpath[len++] = '/';
+    rootpath[len] = '\0';
+    root.path = rootpath;
+    root.len = len;
+    sg_paths.path = &root;
+    sg_paths.pathcount = 1;
+    sg_paths.maxlen = (unsigned) len;
+
+    scan_dir(rootpath, "");
+    if (!imagecount)
+        die("no images found");
+    qsort(images, imagecount, sizeof(*images), image_compare_name);
+    for (i = 1; i < imagecount; i++) {
+        if (!strcmp(images[i-1].name, images[i].name)) {
+            fprintf(stderr, "error: duplicate sprite name: %s\n",
+                    images[i].name);
+            return 1;
+        }
+    }
+
+    rect = xmalloc(sizeof(*rect) * imagecount);
+    area = 0;
+    for (i = 0; i < imagecount; i++) {
+        im = &images[i];
+        load_image(im);
+        w = im->pbuf.width;
+        h = im->pbuf.height;
+        im->xform = SG_X_NORMAL;
+        if (opt_rotate && h > w) {
+            im->xform = SG_X_ROTATE_90;
+            w = im->pbuf.height;
+            h = im->pbuf.width;
+        }
+        rect[i].w = (unsigned short) (w + opt_padding);
+        rect[i].h = (unsigned short) (h + opt_padding);
+        area += (unsigned long) w * h;
+    }
+
+    maxsize.width = (unsigned short) opt_maxsize;
+    maxsize.height = (unsigned short) opt_maxsize;
+    r = sg_pack2(rect, imagecount, &size, &maxsize, opt_method, opt_flags,
+                 &err);
+    if (r < 0)
+        die_error("sg_pack2", err);
+    if (r == 0)
+        die("sprites do not fit in the maximum sheet size");
+
+    for (i = 0; i < imagecount; i++) {
+        im = &images[i];
+        w = im->pbuf.width;
+        h = im->pbuf.height;
+        im->entry.hash = sg_hash64(im->name, im->namelen, 0);
+        im->entry.namelen = (uint16_t) im->namelen;
+        im->entry.xform = (uint16_t) im->xform;
+        sp = &im->entry.sprite;
+        sp->x = (short) rect[i].x;
+        sp->y = (short) rect[i].y;
+        if (im->xform == SG_X_NORMAL) {
+            sp->w = (short) w;
+            sp->h = (short) h;
+            sp->cx = (short) (opt_center ? w / 2 : 0);
+            sp->cy = (short) (opt_center ? h / 2 : 0);
+        } else {
+            /* Stored rotated clockwise, so the origin (cx, cy) in the
+               image is at (cy, w - cx) in the stored sprite.  */
+            sp->w = (short) h;
+            sp->h = (short) w;
+            sp->cx = (short) (opt_center ? h / 2 : 0);
+            sp->cy = (short) (opt_center ? w - w / 2 : w);
+        }
+    }
+    free(rect);
+
+    qsort(images, imagecount, sizeof(*images), entry_compare);
+    write_sheet(output, size.width, size.height);
+    if (opt_verbose)
+        printf("%u sprites, %dx%d, %.1f%% occupancy\n", imagecount,
+               size.width, size.height,
+               100.0 * area / ((double) size.width * size.height));
+
+    for (i = 0; i < imagecount; i++) {
+        free(images[i].name);
+        free(images[i].pbuf.data);
+    }
+    free(images);
+    free(rootpath);
+    return 0;
+}